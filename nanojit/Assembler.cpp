@@ -158,6 +158,9 @@ typedef void* (*decode_instructions_ftype) (void* start, void* end,
         , _patches(alloc)
         , _labels(alloc)
         , _noise(NULL)
+        , _callSites(NULL)
+        , _sharedPools(false)
+        , _slotStores(false)
     #if NJ_USES_IMMD_POOL
         , _immDPool(alloc)
     #endif
@@ -269,12 +272,14 @@ typedef void* (*decode_instructions_ftype) (void* start, void* end,
         _branchStateMap.clear();
         _patches.clear();
         _labels.clear();
+        if (!_sharedPools) {
     #if NJ_USES_IMMD_POOL
-        _immDPool.clear();
+            _immDPool.clear();
     #endif
     #if NJ_USES_IMMF4_POOL
-        _immF4Pool.clear();
+            _immF4Pool.clear();
     #endif
+        }
     }
 
     void Assembler::codeAlloc(NIns *&start, NIns *&end, NIns *&eip
@@ -1062,7 +1067,7 @@ typedef void* (*decode_instructions_ftype) (void* start, void* end,
         // The LIR passes through these filters as listed in this
         // function, viz, top to bottom.
 
-        // set up backwards pipeline: assembler <- StackFilter <- LirReader
+        // set up backwards pipeline: assembler <- SlotStoreFilter <- StackFilter <- LirReader
         LirFilter* lir = new (alloc) LirReader(frag->lastIns);
 
 #ifdef DEBUG
@@ -1084,6 +1089,12 @@ typedef void* (*decode_instructions_ftype) (void* start, void* end,
             lir = stackfilter;
         }
 
+        // SLOTSTOREFILTER
+        if (_slotStores) {
+            SlotStoreFilter* slotfilter = new (alloc) SlotStoreFilter(lir, alloc, frag->lastIns);
+            lir = slotfilter;
+        }
+
         verbose_only( if (_logc->lcbits & LC_AfterSF) {
         pp_after_sf = new (alloc) ReverseLister(lir, alloc, frag->lirbuf->printer, _logc,
                                                 "After StackFilter");
@@ -1996,6 +2007,8 @@ typedef void* (*decode_instructions_ftype) (void* start, void* end,
                 case LIR_rshui:
                 CASE86(LIR_divi:)
                 CASE86(LIR_divq:)
+                CASE86(LIR_mulhuq:)
+                CASE86(LIR_mulhq:)
                     countlir_alu();
                     ins->oprnd1()->setResultLive();
                     ins->oprnd2()->setResultLive();
@@ -2289,6 +2302,48 @@ typedef void* (*decode_instructions_ftype) (void* start, void* end,
                     break;
                 }
 
+                #if NJ_CRC32C_SUPPORTED
+                case LIR_crc32ci:
+                CASE64(LIR_crc32cq:)
+                    countlir_alu();
+                    ins->oprnd1()->setResultLive();
+                    ins->oprnd2()->setResultLive();
+                    if (ins->isExtant()) {
+                        asm_arith(ins);
+                    }
+                    break;
+                #endif
+
+                #if NJ_MINMAX_SUPPORTED
+                case LIR_mind:
+                case LIR_maxd:
+                case LIR_minf:
+                case LIR_maxf:
+                    countlir_fpu();
+                    ins->oprnd1()->setResultLive();
+                    ins->oprnd2()->setResultLive();
+                    if (ins->isExtant()) {
+                        asm_fop(ins);
+                    }
+                    break;
+                #endif
+
+                #if NJ_BLOCKMEM_SUPPORTED
+                case LIR_copyb:
+                case LIR_fillb:
+                case LIR_cmpb:
+                case LIR_findb:
+                case LIR_findanyb:
+                    countlir_st();
+                    ins->oprnd1()->setResultLive();
+                    ins->oprnd2()->setResultLive();
+                    ins->oprnd3()->setResultLive();
+                    if (ins->isV() || ins->isExtant()) {
+                        asm_blockmem(ins);
+                    }
+                    break;
+                #endif
+
                 case LIR_j:
                     asm_jmp(ins, pending_lives);
                     break;
@@ -2452,8 +2507,22 @@ typedef void* (*decode_instructions_ftype) (void* start, void* end,
                     break;
 
 #ifdef NANOJIT_64BIT
+                case LIR_mulxovq:
+                    verbose_only( _thisfrag->nStaticExits++; )
+                    countlir_xcc();
+                    countlir_alu();
+                    ins->oprnd1()->setResultLive();
+                    ins->oprnd2()->setResultLive();
+                    if (ins->isExtant()) {
+                        NIns* exit = asm_exit(ins); // does intersectRegisterState()
+                        asm_branch_ov(op, exit);
+                        asm_qbinop(ins);
+                    }
+                    break;
+
                 case LIR_addjovq:
                 case LIR_subjovq:
+                case LIR_muljovq:
                     countlir_jcc();
                     countlir_alu();
                     ins->oprnd1()->setResultLive();
@@ -163,6 +163,14 @@ namespace nanojit
 
     typedef SeqBuilder<NIns*> NInsList;
     typedef HashMap<NIns*, LIns*> NInsMap;
+
+    // A direct call emitted while call sites are being recorded, see
+    // Assembler::setCallSites().
+    struct CallSite {
+        const CallInfo* call;
+        NIns* at;               // the first byte of the call sequence
+    };
+    typedef SeqBuilder<CallSite> CallSites;
 #if NJ_USES_IMMD_POOL
     typedef HashMap<uint64_t, uint64_t*> ImmDPoolMap;
 #endif
@@ -312,6 +320,19 @@ namespace nanojit
 
             void        setNoiseGenerator(Noise* noise)  { _noise = noise; } // used for attack mitigation; setting to 0 disables all mitigations
 
+            // Keep the constant pools from one compile() to the next, so
+            // that a group of fragments compiled together shares them.
+            void        setSharedConstantPools(bool share) { _sharedPools = share; }
+
+            // Record every direct call emitted in 'sites' (NULL stops
+            // recording), in a form that the backend's patchCall() can
+            // retarget once the callee is known.
+            void        setCallSites(CallSites* sites) { _callSites = sites; }
+
+            // Run SlotStoreFilter in compile(), removing dead stores to
+            // LIR_allocp slots.
+            void        setRemoveDeadSlotStores(bool remove) { _slotStores = remove; }
+
             void        releaseRegisters();
             void        patch(GuardRecord *lr);
             void        patch(SideExit *exit);
@@ -406,6 +427,9 @@ namespace nanojit
             NInsMap             _patches;
             LabelStateMap       _labels;
             Noise*              _noise;             // object to generate random noise used when hardening enabled.
+            CallSites*          _callSites;         // see setCallSites()
+            bool                _sharedPools;       // see setSharedConstantPools()
+            bool                _slotStores;        // see setRemoveDeadSlotStores()
         #if NJ_USES_IMMD_POOL
             ImmDPoolMap         _immDPool;
         #endif
@@ -551,6 +575,9 @@ namespace nanojit
 
             void        asm_nongp_copy(Register r, Register s);
             void        asm_call(LIns*);
+#if NJ_BLOCKMEM_SUPPORTED
+            void        asm_blockmem(LIns* ins);
+#endif
             Register    asm_binop_rhs_reg(LIns* ins);
             Branches    asm_branch(bool branchOnFalse, LIns* cond, NIns* targ);
             NIns*       asm_branch_ov(LOpcode op, NIns* targ);
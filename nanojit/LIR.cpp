@@ -5,6 +5,7 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "nanojit.h"
+#include "../vprof/vprof.h"
 
 namespace nanojit
 {
@@ -170,6 +171,7 @@ namespace nanojit
         case LIR_muljovi:
         CASE64(LIR_addjovq:)
         CASE64(LIR_subjovq:)
+        CASE64(LIR_muljovq:)
             target = ins->getTarget();
             addEdge(ins, target);
             _vertices.put(target, true);
@@ -597,6 +599,67 @@ namespace nanojit
         }
     }
 
+#if !NJ_BLOCKMEM_SUPPORTED
+    // Without back-end support the block memory operations are calls to the
+    // C library.
+    static const CallInfo memcpy_ci =
+        { (intptr_t)&::memcpy, CallInfo::typeSig3(ARGTYPE_V, ARGTYPE_P, ARGTYPE_P, ARGTYPE_P),
+          ABI_CDECL, /*isPure*/0, ACCSET_STORE_ANY verbose_only(, "memcpy") };
+    static const CallInfo memset_ci =
+        { (intptr_t)&::memset, CallInfo::typeSig3(ARGTYPE_V, ARGTYPE_P, ARGTYPE_I, ARGTYPE_P),
+          ABI_CDECL, /*isPure*/0, ACCSET_STORE_ANY verbose_only(, "memset") };
+    static const CallInfo memcmp_ci =
+        { (intptr_t)&::memcmp, CallInfo::typeSig3(ARGTYPE_I, ARGTYPE_P, ARGTYPE_P, ARGTYPE_P),
+          ABI_CDECL, /*isPure*/0, ACCSET_NONE verbose_only(, "memcmp") };
+
+    static uintptr_t findByte(const uint8_t* a, int32_t byte, uintptr_t len)
+    {
+        const void* p = ::memchr(a, uint8_t(byte), len);
+        return p ? uintptr_t((const uint8_t*)p - a) : len;
+    }
+
+    static uintptr_t findAnyByte(const uint8_t* a, int32_t bytes, uintptr_t len)
+    {
+        for (uintptr_t i = 0; i < len; i++) {
+            uint32_t x = a[i];
+            if (x == (uint32_t(bytes) & 0xff) || x == ((uint32_t(bytes) >> 8) & 0xff) ||
+                x == ((uint32_t(bytes) >> 16) & 0xff) || x == uint32_t(bytes) >> 24)
+            {
+                return i;
+            }
+        }
+        return len;
+    }
+
+    static const CallInfo findByte_ci =
+        { (intptr_t)&findByte, CallInfo::typeSig3(ARGTYPE_P, ARGTYPE_P, ARGTYPE_I, ARGTYPE_P),
+          ABI_CDECL, /*isPure*/0, ACCSET_NONE verbose_only(, "findByte") };
+    static const CallInfo findAnyByte_ci =
+        { (intptr_t)&findAnyByte, CallInfo::typeSig3(ARGTYPE_P, ARGTYPE_P, ARGTYPE_I, ARGTYPE_P),
+          ABI_CDECL, /*isPure*/0, ACCSET_NONE verbose_only(, "findAnyByte") };
+#endif
+
+    LIns* LirBufWriter::insMem(LOpcode op, LIns* a, LIns* b, LIns* len, AccSet accSet)
+    {
+#if NJ_BLOCKMEM_SUPPORTED
+        LInsMem* insMem = (LInsMem*)_buf->makeRoom(sizeof(LInsMem));
+        LIns*    ins    = insMem->getLIns();
+        ins->initLInsMem(op, a, b, len, accSet);
+        return ins;
+#else
+        (void)accSet;
+        LIns* args[3] = { len, b, a };      // in reverse order
+        switch (op) {
+        case LIR_copyb: return insCall(&memcpy_ci, args);
+        case LIR_fillb: return insCall(&memset_ci, args);
+        case LIR_cmpb:  return insCall(&memcmp_ci, args);
+        case LIR_findb: return insCall(&findByte_ci, args);
+        case LIR_findanyb: return insCall(&findAnyByte_ci, args);
+        default:        NanoAssert(0); return NULL;
+        }
+#endif
+    }
+
     LIns* LirBufWriter::ins0(LOpcode op)
     {
         LInsOp0* insOp0 = (LInsOp0*)_buf->makeRoom(sizeof(LInsOp0));
@@ -613,8 +676,41 @@ namespace nanojit
         return ins;
     }
 
+#if !NJ_CRC32C_SUPPORTED
+    // Without back-end support LIR_crc32ci and LIR_crc32cq are calls.
+    static const CallInfo crc32c32_ci =
+        { (intptr_t)&crc32c32, CallInfo::typeSig2(ARGTYPE_UI, ARGTYPE_UI, ARGTYPE_UI),
+          ABI_CDECL, /*isPure*/1, ACCSET_NONE verbose_only(, "crc32c32") };
+#ifdef NANOJIT_64BIT
+    static const CallInfo crc32c64_ci =
+        { (intptr_t)&crc32c64, CallInfo::typeSig2(ARGTYPE_UI, ARGTYPE_UI, ARGTYPE_Q),
+          ABI_CDECL, /*isPure*/1, ACCSET_NONE verbose_only(, "crc32c64") };
+#endif
+#endif
+
     LIns* LirBufWriter::ins2(LOpcode op, LIns* o1, LIns* o2)
     {
+#if !NJ_CRC32C_SUPPORTED
+        if (op == LIR_crc32ci) {
+            LIns* args[2] = { o2, o1 };     // in reverse order
+            return insCall(&crc32c32_ci, args);
+        }
+#ifdef NANOJIT_64BIT
+        if (op == LIR_crc32cq) {
+            LIns* args[2] = { o2, o1 };
+            return insCall(&crc32c64_ci, args);
+        }
+#endif
+#endif
+#if !NJ_MINMAX_SUPPORTED
+        switch (op) {
+        case LIR_mind: return ins3(LIR_cmovd, ins2(LIR_ltd, o1, o2), o1, o2);
+        case LIR_maxd: return ins3(LIR_cmovd, ins2(LIR_gtd, o1, o2), o1, o2);
+        case LIR_minf: return ins3(LIR_cmovf, ins2(LIR_ltf, o1, o2), o1, o2);
+        case LIR_maxf: return ins3(LIR_cmovf, ins2(LIR_gtf, o1, o2), o1, o2);
+        default:       break;
+        }
+#endif
         LInsOp2* insOp2 = (LInsOp2*)_buf->makeRoom(sizeof(LInsOp2));
         LIns*    ins    = insOp2->getLIns();
         ins->initLInsOp2(op, o1, o2);
@@ -849,6 +945,33 @@ namespace nanojit
         }
     }
 
+    // Software CRC32C, four bits at a time.  'n' is the number of bytes of
+    // 'v' to take, least significant first.
+    static uint32_t crc32cBytes(uint32_t crc, uint64_t v, int n)
+    {
+        static const uint32_t table[16] = {
+            0x00000000, 0x105ec76f, 0x20bd8ede, 0x30e349b1,
+            0x417b1dbc, 0x5125dad3, 0x61c69362, 0x7198540d,
+            0x82f63b78, 0x92a8fc17, 0xa24bb5a6, 0xb21572c9,
+            0xc38d26c4, 0xd3d3e1ab, 0xe330a81a, 0xf36e6f75
+        };
+        for (int i = 0; i < 2*n; i++) {
+            crc = (crc >> 4) ^ table[(crc ^ uint32_t(v)) & 0xf];
+            v >>= 4;
+        }
+        return crc;
+    }
+
+    uint32_t crc32c32(uint32_t crc, uint32_t v)
+    {
+        return crc32cBytes(crc, v, 4);
+    }
+
+    uint32_t crc32c64(uint32_t crc, uint64_t v)
+    {
+        return crc32cBytes(crc, v, 8);
+    }
+
     
     // This is never called, but that's ok because it contains only static
     // assertions.
@@ -864,6 +987,7 @@ namespace nanojit
         NanoStaticAssert(sizeof(LInsOp3)  == 4*sizeof(void*));
         NanoStaticAssert(sizeof(LInsLd)   == 3*sizeof(void*));
         NanoStaticAssert(sizeof(LInsSt)   == 4*sizeof(void*));
+        NanoStaticAssert(sizeof(LInsMem)  == 5*sizeof(void*));
         NanoStaticAssert(sizeof(LInsSk)   == 2*sizeof(void*));
         NanoStaticAssert(sizeof(LInsC)    == 3*sizeof(void*));
         NanoStaticAssert(sizeof(LInsP)    == 2*sizeof(void*));
@@ -877,20 +1001,28 @@ namespace nanojit
     #endif
         NanoStaticAssert(sizeof(LInsJtbl) == 4*sizeof(void*));
 
-        // oprnd_1 must be in the same position in LIns{Op1,Op2,Op3,Ld,St,Jtbl}
+        // oprnd_1 must be in the same position in LIns{Op1,Op2,Op3,Ld,St,Mem,Jtbl}
         // because oprnd1() is used for all of them.
         #define OP1OFFSET (offsetof(LInsOp1,  ins) - offsetof(LInsOp1,  oprnd_1))
         NanoStaticAssert( OP1OFFSET == (offsetof(LInsOp2,  ins) - offsetof(LInsOp2,  oprnd_1)) );
         NanoStaticAssert( OP1OFFSET == (offsetof(LInsOp3,  ins) - offsetof(LInsOp3,  oprnd_1)) );
         NanoStaticAssert( OP1OFFSET == (offsetof(LInsLd,   ins) - offsetof(LInsLd,   oprnd_1)) );
         NanoStaticAssert( OP1OFFSET == (offsetof(LInsSt,   ins) - offsetof(LInsSt,   oprnd_1)) );
+        NanoStaticAssert( OP1OFFSET == (offsetof(LInsMem,  ins) - offsetof(LInsMem,  oprnd_1)) );
         NanoStaticAssert( OP1OFFSET == (offsetof(LInsJtbl, ins) - offsetof(LInsJtbl, oprnd_1)) );
 
-        // oprnd_2 must be in the same position in LIns{Op2,Op3,St}
+        // oprnd_2 must be in the same position in LIns{Op2,Op3,St,Mem}
         // because oprnd2() is used for all of them.
         #define OP2OFFSET (offsetof(LInsOp2, ins) - offsetof(LInsOp2, oprnd_2))
         NanoStaticAssert( OP2OFFSET == (offsetof(LInsOp3, ins) - offsetof(LInsOp3, oprnd_2)) );
         NanoStaticAssert( OP2OFFSET == (offsetof(LInsSt,  ins) - offsetof(LInsSt,  oprnd_2)) );
+        NanoStaticAssert( OP2OFFSET == (offsetof(LInsMem, ins) - offsetof(LInsMem, oprnd_2)) );
+
+        // oprnd_3 must be in the same position in LIns{Op3,Op4,Mem}
+        // because oprnd3() is used for all of them.
+        #define OP3OFFSET (offsetof(LInsOp3, ins) - offsetof(LInsOp3, oprnd_3))
+        NanoStaticAssert( OP3OFFSET == (offsetof(LInsOp4, ins) - offsetof(LInsOp4, oprnd_3)) );
+        NanoStaticAssert( OP3OFFSET == (offsetof(LInsMem, ins) - offsetof(LInsMem, oprnd_3)) );
         NanoStaticAssert(LIR_eqf==LIR_eqd+6);
         NanoStaticAssert(LIR_ltf==LIR_ltd+6);
         NanoStaticAssert(LIR_gtf==LIR_gtd+6);
@@ -1061,6 +1193,31 @@ namespace nanojit
         return u.d;
     }
 
+#ifdef NANOJIT_X64
+    // The high 64 bits of the unsigned 128-bit product of 'a' and 'b'.
+    static uint64_t mulhu64(uint64_t a, uint64_t b)
+    {
+        uint64_t a0 = uint32_t(a), a1 = a >> 32;
+        uint64_t b0 = uint32_t(b), b1 = b >> 32;
+        uint64_t p00 = a0 * b0;
+        uint64_t p01 = a0 * b1;
+        uint64_t p10 = a1 * b0;
+        uint64_t p11 = a1 * b1;
+        uint64_t mid = (p00 >> 32) + uint32_t(p01) + uint32_t(p10);
+        return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+    }
+
+    // The signed high half differs from the unsigned one by the other
+    // operand for each negative operand (two's complement, modulo 2^64).
+    static int64_t mulh64(int64_t a, int64_t b)
+    {
+        uint64_t hi = mulhu64(uint64_t(a), uint64_t(b));
+        if (a < 0) hi -= uint64_t(b);
+        if (b < 0) hi -= uint64_t(a);
+        return int64_t(hi);
+    }
+#endif
+
     LIns* ExprFilter::ins2(LOpcode v, LIns* oprnd1, LIns* oprnd2)
     {
         NanoAssert(oprnd1 && oprnd2);
@@ -1141,6 +1298,8 @@ namespace nanojit
             case LIR_andi:  return insImmI(c1 & c2, tainted);
             case LIR_xori:  return insImmI(c1 ^ c2, tainted);
 
+            case LIR_crc32ci: return insImmI(int32_t(crc32c32(uint32_t(c1), uint32_t(c2))), tainted);
+
             case LIR_addi:  d = double(c1) + double(c2);    goto fold;
             case LIR_subi:  d = double(c1) - double(c2);    goto fold;
             case LIR_muli:  d = double(c1) * double(c2);    goto fold;
@@ -1191,6 +1350,8 @@ namespace nanojit
             case LIR_xorq:  return insImmQ(c1 ^ c2, tainted);
 #if defined NANOJIT_X64
             case LIR_mulq:  return insImmQ(c1 * c2, tainted);
+            case LIR_mulhuq: return insImmQ(int64_t(mulhu64(uint64_t(c1), uint64_t(c2))), tainted);
+            case LIR_mulhq: return insImmQ(mulh64(c1, c2), tainted);
 #endif
             // Nb: LIR_rshq, LIR_lshq and LIR_rshuq aren't here because their
             // RHS is an int.  They are below.
@@ -1255,6 +1416,19 @@ namespace nanojit
             case LIR_rshq:  return insImmQ(c1 >> (c2 & 0x3f), tainted);
             case LIR_rshuq: return insImmQ(uint64_t(c1) >> (c2 & 0x3f), tainted);
 
+            default:        break;
+            }
+
+        } else if (oprnd1->isImmI() && oprnd2->isImmQ()) {
+            // The first operand is an int immediate, the second is a quad
+            // immediate.
+            int32_t c1 = oprnd1->immI();
+            int64_t c2 = oprnd2->immQ();
+            bool tainted = (oprnd1->isTainted() | oprnd2->isTainted());
+
+            switch (v) {
+            case LIR_crc32cq: return insImmI(int32_t(crc32c64(uint32_t(c1), uint64_t(c2))), tainted);
+
             default:        break;
             }
 #endif  // NANOJIT_64BIT
@@ -1275,6 +1449,8 @@ namespace nanojit
             case LIR_subd:  return insImmD(c1 - c2, tainted);
             case LIR_muld:  return insImmD(c1 * c2, tainted);
             case LIR_divd:  return insImmD(c1 / c2, tainted);
+            case LIR_mind:  return insImmD(c1 < c2 ? c1 : c2, tainted);
+            case LIR_maxd:  return insImmD(c1 > c2 ? c1 : c2, tainted);
 
             default:        break;
             }
@@ -1295,6 +1471,8 @@ namespace nanojit
                 case LIR_subf:  return insImmF(c1 - c2, tainted);
                 case LIR_mulf:  return insImmF(c1 * c2, tainted);
                 case LIR_divf:  return insImmF(c1 / c2, tainted);
+                case LIR_minf:  return insImmF(c1 < c2 ? c1 : c2, tainted);
+                case LIR_maxf:  return insImmF(c1 > c2 ? c1 : c2, tainted);
                     
                 default:        break;
             }
@@ -1334,6 +1512,8 @@ namespace nanojit
             case LIR_muli:
             case LIR_muld:
             CASE86(LIR_mulq:)
+            CASE86(LIR_mulhuq:)
+            CASE86(LIR_mulhq:)
             case LIR_mulf:
             case LIR_mulf4:
             case LIR_andi:
@@ -1471,6 +1651,8 @@ namespace nanojit
 
                 case LIR_andq:
                 CASE86(LIR_mulq:)
+                CASE86(LIR_mulhuq:)
+                CASE86(LIR_mulhq:)
                     return oprnd2;
 
                 case LIR_ltuq: // unsigned < 0 -> always false
@@ -1504,9 +1686,29 @@ namespace nanojit
 #ifdef NANOJIT_X64
                 else if (v == LIR_mulq) {
                     return oprnd1;          // x * 1 = x
+                } else if (v == LIR_mulhuq) {
+                    return insImmQ(0, oprnd2->isTainted());   // x * 1 has no high half
+                } else if (v == LIR_mulhq) {
+                    return out->ins2(LIR_rshq, oprnd1, insImmI(63));  // sign of x
                 }
 #endif
             }
+#ifdef NANOJIT_X64
+            if (v == LIR_mulhuq && c > 1 && (c & (c - 1)) == 0) {
+                // The high half of x * 2^k is x >>> (64 - k).
+                int k = 0;
+                while ((int64_t(1) << k) != c)
+                    k++;
+                return out->ins2(LIR_rshuq, oprnd1, insImmI(64 - k));
+            }
+            if (v == LIR_mulhq && c > 1 && (c & (c - 1)) == 0) {
+                // Likewise, but the product is signed and 2^k is positive.
+                int k = 0;
+                while ((int64_t(1) << k) != c)
+                    k++;
+                return out->ins2(LIR_rshq, oprnd1, insImmI(64 - k));
+            }
+#endif
 #endif  // NANOJIT_64BIT
         }
 
@@ -1548,6 +1750,26 @@ namespace nanojit
             // (x == y) ? x : y  =>  y
             return oprnd3;
         }
+        if ((v == LIR_cmovd && (oprnd1->isop(LIR_ltd) || oprnd1->isop(LIR_gtd))) ||
+            (v == LIR_cmovf && (oprnd1->isop(LIR_ltf) || oprnd1->isop(LIR_gtf)))) {
+            // Only the strict compares match min/max exactly:  for NaNs and
+            // for -0 vs. +0 they, like minsd/maxsd, pick the second operand.
+            bool lt = oprnd1->isop(LIR_ltd) || oprnd1->isop(LIR_ltf);
+            LOpcode minop = v == LIR_cmovd ? LIR_mind : LIR_minf;
+            LOpcode maxop = v == LIR_cmovd ? LIR_maxd : LIR_maxf;
+            LIns* a = oprnd1->oprnd1();
+            LIns* b = oprnd1->oprnd2();
+            if (oprnd2 == a && oprnd3 == b) {
+                // (a < b) ? a : b  =>  min(a, b)
+                // (a > b) ? a : b  =>  max(a, b)
+                return out->ins2(lt ? minop : maxop, a, b);
+            }
+            if (oprnd2 == b && oprnd3 == a) {
+                // (a < b) ? b : a  =>  max(b, a)
+                // (a > b) ? b : a  =>  min(b, a)
+                return out->ins2(lt ? maxop : minop, b, a);
+            }
+        }
 
         return out->ins3(v, oprnd1, oprnd2, oprnd3);
     }
@@ -1661,6 +1883,68 @@ namespace nanojit
             }
         }
 
+#ifdef NANOJIT_64BIT
+        if (oprnd1->isImmQ() && oprnd2->isImmQ()) {
+            int64_t c1 = oprnd1->immQ();
+            int64_t c2 = oprnd2->immQ();
+            static const int64_t MIN_INT64 = int64_t(0x8000000000000000LL);
+
+            // Wrap-around arithmetic is done unsigned to avoid undefined
+            // behaviour;  the sign tests then detect signed overflow.
+            uint64_t r = 0;
+            bool ov = false;
+            switch (op) {
+            case LIR_addjovq:
+                r = uint64_t(c1) + uint64_t(c2);
+                ov = int64_t((uint64_t(c1) ^ r) & (uint64_t(c2) ^ r)) < 0;
+                break;
+            case LIR_subjovq:
+                r = uint64_t(c1) - uint64_t(c2);
+                ov = int64_t((uint64_t(c1) ^ uint64_t(c2)) & (uint64_t(c1) ^ r)) < 0;
+                break;
+            case LIR_muljovq:
+            case LIR_mulxovq:
+                r = uint64_t(c1) * uint64_t(c2);
+                ov = (c1 == -1 && c2 == MIN_INT64) || (c2 == -1 && c1 == MIN_INT64) ||
+                     (c1 != 0 && int64_t(r) / c1 != c2);
+                break;
+            default:
+                NanoAssert(0);
+                break;
+            }
+            if (!ov)
+                return insImmQ(int64_t(r), (oprnd1->isTainted() | oprnd2->isTainted()));
+
+        } else if (oprnd1->isImmQ() && !oprnd2->isImmQ()) {
+            if (op == LIR_addjovq || op == LIR_muljovq || op == LIR_mulxovq) {
+                // swap operands, moving immediate to RHS
+                LIns* t = oprnd2;
+                oprnd2 = oprnd1;
+                oprnd1 = t;
+                *opnd1 = oprnd1;
+                *opnd2 = oprnd2;
+            }
+        }
+
+        if (oprnd2->isImmQ()) {
+            int64_t c = oprnd2->immQ();
+            if (c == 0) {
+                switch (op) {
+                case LIR_addjovq:
+                case LIR_subjovq:
+                    return oprnd1;
+                case LIR_muljovq:
+                case LIR_mulxovq:
+                    return oprnd2;
+                default:
+                    ;
+                }
+            } else if (c == 1 && (op == LIR_muljovq || op == LIR_mulxovq)) {
+                return oprnd1;
+            }
+        }
+#endif
+
         return NULL;
     }
 
@@ -1769,121 +2053,1325 @@ namespace nanojit
             } else if (iftrue->isD() && iffalse->isD()) {
                 op = LIR_cmovd;
             } else {
-                NanoAssert(0);  // type error
+                NanoAssert(0);  // type error
+            }
+            return ins3(op, cond, iftrue, iffalse);
+        }
+
+        LIns* ncond = ins1(LIR_negi, cond); // cond ? -1 : 0
+        return ins2(LIR_ori,
+                    ins2(LIR_andi, iftrue, ncond),
+                    ins2(LIR_andi, iffalse, ins1(LIR_noti, ncond)));
+    }
+
+    LIns* LirBufWriter::insCall(const CallInfo *ci, LIns* args[])
+    {
+        LOpcode op = getCallOpcode(ci);
+#if NJ_SOFTFLOAT_SUPPORTED
+        // SoftFloat: convert LIR_calld to LIR_calli.
+        if (_config.soft_float && op == LIR_calld)
+            op = LIR_calli;
+#endif
+
+        int32_t argc = ci->count_args();
+        NanoAssert(argc <= (int)MAXARGS);
+
+#ifdef NANOJIT_WIN_CFG
+		if (ci->isIndirect())
+		{
+			// Insert call to Control Flow Guard check function.  Argument is address of indirect call.
+			NanoAssert(argc > 0);
+			LIns** args2 = (LIns**)_buf->_allocator.alloc(sizeof(LIns*));
+			args2[0] = args[argc - 1]; // last arg is function address
+			LInsC* insC = (LInsC*)_buf->makeRoom(sizeof(LInsC));
+			LIns*  ins = insC->getLIns();
+			ins->initLInsC(LIR_callv, args2, &ci_cfg_check);
+		}
+#endif
+
+        // Allocate space for and copy the arguments.  We use the same
+        // allocator as the normal LIR buffers so it has the same lifetime.
+        // Nb: this must be kept in sync with arg().
+        LIns** args2 = (LIns**)_buf->_allocator.alloc(argc * sizeof(LIns*));
+        memcpy(args2, args, argc * sizeof(LIns*));
+
+        // Allocate and write the call instruction.
+        LInsC* insC = (LInsC*)_buf->makeRoom(sizeof(LInsC));
+        LIns*  ins  = insC->getLIns();
+        ins->initLInsC(op, args2, ci);
+        NanoAssert(!ins->isInReg());
+        return ins;
+    }
+
+    using namespace avmplus;
+
+    StackFilter::StackFilter(LirFilter *in, Allocator& alloc, LIns* sp)
+        : LirFilter(in), sp(sp), stk(alloc), top(0)
+    {}
+
+    // If we see a sequence like this:
+    //
+    //   sti sp[0]
+    //   ...
+    //   sti sp[0]
+    //
+    // where '...' contains no guards, we can remove the first store.  Also,
+    // because stack entries are eight bytes each (we check this), if we have
+    // this:
+    //
+    //   stfi sp[0]
+    //   ...
+    //   sti sp[0]
+    //
+    // we can again remove the first store -- even though the second store
+    // doesn't clobber the high four bytes -- because we know the entire value
+    // stored by the first store is dead.
+    //
+    LIns* StackFilter::read()
+    {
+        for (;;) {
+            LIns* ins = in->read();
+
+            if (ins->isStore()) {
+                LIns* base = ins->oprnd2();
+                if (base == sp) {
+                    // 'disp' must be eight-aligned because each stack entry is 8 bytes.
+                    NanoAssert((ins->disp() & 0x7) == 0);
+
+                    int d = ins->disp() >> 3;
+                    if (d >= top) {
+                        continue;
+                    } else {
+                        d = top - d;
+                        if (stk.get(d)) {
+                            continue;
+                        } else {
+                            stk.set(d);
+                        }
+                    }
+                }
+            }
+            /*
+             * NB: If there is a backward branch other than the loop-restart branch, this is
+             * going to be wrong. Unfortunately there doesn't seem to be an easy way to detect
+             * such branches. Just do not create any.
+             *
+             * The isLive() call is valid because liveness will have been
+             * computed by Assembler::gen() for every instruction following
+             * this guard.
+             */
+            else if (ins->isGuard() && ins->isLive()) {
+                stk.reset();
+                top = getTop(ins);
+                top >>= 3;
+            }
+
+            return ins;
+        }
+    }
+
+    static int32_t storeSize(LOpcode op)
+    {
+        switch (op) {
+        case LIR_sti2c:     return 1;
+        case LIR_sti2s:     return 2;
+        case LIR_sti:
+        case LIR_std2f:
+        case LIR_stf:       return 4;
+        CASE64(LIR_stq:)
+        case LIR_std:       return 8;
+        case LIR_stf4:      return 16;
+        default:            NanoAssert(0); return 0;
+        }
+    }
+
+    static int32_t loadSize(LOpcode op)
+    {
+        switch (op) {
+        case LIR_ldc2i:
+        case LIR_lduc2ui:   return 1;
+        case LIR_lds2i:
+        case LIR_ldus2ui:   return 2;
+        case LIR_ldi:
+        case LIR_ldf2d:
+        case LIR_ldf:       return 4;
+        CASE64(LIR_ldq:)
+        case LIR_ldd:       return 8;
+        case LIR_ldf4:      return 16;
+        default:            NanoAssert(0); return 0;
+        }
+    }
+
+    // The load that reads back exactly what 'op' stored, if there is one.
+    static LOpcode loadForStore(LOpcode op)
+    {
+        switch (op) {
+        case LIR_sti:       return LIR_ldi;
+        CASE64(LIR_stq:     return LIR_ldq;)
+        case LIR_std:       return LIR_ldd;
+        case LIR_stf:       return LIR_ldf;
+        case LIR_stf4:      return LIR_ldf4;
+        default:            return LIR_skip;
+        }
+    }
+
+    void SlotFilter::forget(AccSet accSet)
+    {
+        int n = 0;
+        for (int i = 0; i < nknown; i++) {
+            if (!(known[i].accSet & accSet))
+                known[n++] = known[i];
+        }
+        nknown = n;
+    }
+
+    void SlotFilter::forget(LIns* slot, int32_t disp, int32_t size)
+    {
+        int n = 0;
+        for (int i = 0; i < nknown; i++) {
+            const Known& k = known[i];
+            if (k.slot != slot || k.disp + k.size <= disp || disp + size <= k.disp)
+                known[n++] = k;
+        }
+        nknown = n;
+    }
+
+    LIns* SlotFilter::ins0(LOpcode op)
+    {
+        // A label may be reached from elsewhere;  the other operand-less
+        // instructions (pushstate, restorepc, ...) are treated the same.
+        if (op != LIR_start)
+            nknown = 0;
+        return out->ins0(op);
+    }
+
+    LIns* SlotFilter::insLoad(LOpcode op, LIns* base, int32_t disp, AccSet accSet, LoadQual loadQual)
+    {
+        if (base->isop(LIR_allocp) && loadQual == LOAD_NORMAL) {
+            for (int i = 0; i < nknown; i++) {
+                const Known& k = known[i];
+                if (k.slot == base && k.disp == disp && k.load == op)
+                    return k.value;
+            }
+        }
+        return out->insLoad(op, base, disp, accSet, loadQual);
+    }
+
+    LIns* SlotFilter::insStore(LOpcode op, LIns* value, LIns* base, int32_t disp, AccSet accSet)
+    {
+        if (base->isop(LIR_allocp)) {
+            int32_t size = storeSize(op);
+            forget(base, disp, size);
+            LOpcode load = loadForStore(op);
+            if (load != LIR_skip) {
+                if (nknown == MaxKnown) {
+                    // Drop the oldest.
+                    for (int i = 1; i < nknown; i++)
+                        known[i-1] = known[i];
+                    nknown--;
+                }
+                Known& k = known[nknown++];
+                k.slot = base;
+                k.disp = disp;
+                k.size = size;
+                k.load = load;
+                k.value = value;
+                k.accSet = accSet;
+            }
+        } else {
+            forget(accSet);
+        }
+        return out->insStore(op, value, base, disp, accSet);
+    }
+
+    LIns* SlotFilter::insMem(LOpcode op, LIns* a, LIns* b, LIns* len, AccSet accSet)
+    {
+        if (!isBlockReadOpcode(op)) {
+            forget(accSet);
+            if (a->isop(LIR_allocp))
+                forget(a, 0, a->size());
+        }
+        return out->insMem(op, a, b, len, accSet);
+    }
+
+    LIns* SlotFilter::insCall(const CallInfo* ci, LIns* args[])
+    {
+        if (!ci->_isPure)
+            forget(ci->_storeAccSet);
+        return out->insCall(ci, args);
+    }
+
+    LIns* SlotFilter::insSafe(LOpcode op, void* payload)
+    {
+        nknown = 0;
+        return out->insSafe(op, payload);
+    }
+
+    SlotStoreFilter::SlotStoreFilter(LirFilter* in, Allocator& alloc, LIns* lastIns)
+        : LirFilter(in), slots(alloc), ncovered(0)
+    {
+        // Find the slots first, then what uses them; reading backwards we
+        // see the uses of a slot before the slot itself.
+        LirReader slotReader(lastIns);
+        for (LIns* ins = slotReader.read(); !ins->isop(LIR_start); ins = slotReader.read()) {
+            if (ins->isop(LIR_allocp)) {
+                Slot* s = new (alloc) Slot;
+                s->size = ins->size();
+                s->escaped = false;
+                s->loaded = false;
+                slots.put(ins, s);
+            }
+        }
+
+        LirReader useReader(lastIns);
+        for (LIns* ins = useReader.read(); !ins->isop(LIR_start); ins = useReader.read()) {
+            LIns* opnds[4];
+            int nopnds = 0;
+            if (ins->isLoad()) {
+                if (Slot* s = slots.get(ins->oprnd1())) {
+                    if (slotFor(ins->oprnd1(), ins->disp(), loadSize(ins->opcode())))
+                        s->loaded = true;
+                    else
+                        s->escaped = true;
+                }
+                continue;
+            }
+            if (ins->isStore()) {
+                if (Slot* s = slots.get(ins->oprnd2())) {
+                    if (!slotFor(ins->oprnd2(), ins->disp(), storeSize(ins->opcode())))
+                        s->escaped = true;
+                }
+                opnds[nopnds++] = ins->oprnd1();
+            } else if (isLiveOpcode(ins->opcode())) {
+                // Keeps the slot allocated, but doesn't read it.
+            } else if (ins->isCall()) {
+                for (uint32_t i = 0; i < ins->argc(); i++) {
+                    if (Slot* s = slots.get(ins->arg(i)))
+                        s->escaped = true;
+                }
+            } else if (ins->isLInsOp1() || ins->isLInsOp1b() || ins->isLInsJtbl()) {
+                opnds[nopnds++] = ins->oprnd1();
+            } else if (ins->isLInsOp2()) {
+                // For guards and branches the second operand is a record or
+                // a label, neither of which can be a slot.
+                opnds[nopnds++] = ins->oprnd1();
+                opnds[nopnds++] = ins->oprnd2();
+            } else if (ins->isLInsOp3() || ins->isLInsOp4() || ins->isLInsMem()) {
+                opnds[nopnds++] = ins->oprnd1();
+                opnds[nopnds++] = ins->oprnd2();
+                opnds[nopnds++] = ins->oprnd3();
+                if (ins->isLInsOp4())
+                    opnds[nopnds++] = ins->oprnd4();
+            }
+            for (int i = 0; i < nopnds; i++) {
+                if (Slot* s = slots.get(opnds[i]))
+                    s->escaped = true;
+            }
+        }
+    }
+
+    // The slot accessed by a load or store of 'size' bytes at 'base[disp]',
+    // or NULL if 'base' isn't a slot or the access isn't within it.
+    SlotStoreFilter::Slot* SlotStoreFilter::slotFor(LIns* base, int32_t disp, int32_t size)
+    {
+        Slot* s = slots.get(base);
+        return (s && disp >= 0 && disp + size <= s->size) ? s : NULL;
+    }
+
+    void SlotStoreFilter::uncover(LIns* slot, int32_t lo, int32_t hi)
+    {
+        int n = 0;
+        for (int i = 0; i < ncovered; i++) {
+            const Covered& c = covered[i];
+            if (c.slot != slot || c.hi <= lo || hi <= c.lo)
+                covered[n++] = c;
+        }
+        ncovered = n;
+    }
+
+    LIns* SlotStoreFilter::read()
+    {
+        for (;;) {
+            LIns* ins = in->read();
+
+            if (ins->isStore()) {
+                LIns* base = ins->oprnd2();
+                int32_t lo = ins->disp();
+                int32_t hi = lo + storeSize(ins->opcode());
+                Slot* s = slotFor(base, lo, hi - lo);
+                if (s && !s->escaped) {
+                    if (!s->loaded)
+                        continue;
+                    bool dead = false;
+                    for (int i = 0; i < ncovered && !dead; i++) {
+                        const Covered& c = covered[i];
+                        dead = c.slot == base && c.lo <= lo && hi <= c.hi;
+                    }
+                    if (dead)
+                        continue;
+                    if (ncovered < MaxCovered) {
+                        Covered& c = covered[ncovered++];
+                        c.slot = base;
+                        c.lo = lo;
+                        c.hi = hi;
+                    }
+                }
+            } else if (ins->isLoad()) {
+                int32_t lo = ins->disp();
+                uncover(ins->oprnd1(), lo, lo + loadSize(ins->opcode()));
+            } else if (ins->isBranch() || ins->isGuard() || ins->isRet() ||
+                       ins->isop(LIR_restorepc)) {
+                // The code this may go to could load anything.
+                ncovered = 0;
+            }
+            return ins;
+        }
+    }
+
+    // The LIR_live opcode for a value of the type 'ins' produces.
+    static LOpcode liveOpcodeFor(LIns* ins)
+    {
+        switch (ins->retType()) {
+        case LTy_I:     return LIR_livei;
+#ifdef NANOJIT_64BIT
+        case LTy_Q:     return LIR_liveq;
+#endif
+        case LTy_D:     return LIR_lived;
+        case LTy_F:     return LIR_livef;
+        case LTy_F4:    return LIR_livef4;
+        default:        NanoAssert(0); return LIR_skip;
+        }
+    }
+
+    // The float4 opcode that does to each lane what 'op' does to a float,
+    // or LIR_skip if there isn't one.
+    static LOpcode lanesOpcodeFor(LOpcode op)
+    {
+        switch (op) {
+        case LIR_negf:  return LIR_negf4;
+        case LIR_absf:  return LIR_absf4;
+        case LIR_sqrtf: return LIR_sqrtf4;
+        case LIR_addf:  return LIR_addf4;
+        case LIR_subf:  return LIR_subf4;
+        case LIR_mulf:  return LIR_mulf4;
+        case LIR_divf:  return LIR_divf4;
+        case LIR_minf:  return LIR_minf4;
+        case LIR_maxf:  return LIR_maxf4;
+        default:        return LIR_skip;
+        }
+    }
+
+    LoopFilter::LoopFilter(LirWriter* out, Allocator& alloc, bool vectorizes,
+                           uint32_t unrollFactor, bool hoistsChecks)
+        : LirWriter(out), alloc(alloc), vectorizes(vectorizes), unrollFactor(unrollFactor),
+          hoistsChecks(hoistsChecks), events(NULL), nevents(0), maxevents(0), defs(alloc, 1024), head(0), kinds(NULL), bases(NULL), copies(NULL),
+          splats(NULL), lives(alloc)
+    {}
+
+    LoopFilter::Event& LoopFilter::add(EventKind kind, LOpcode op)
+    {
+        if (nevents == maxevents) {
+            // The old array is left to the allocator.
+            maxevents = maxevents ? 2 * maxevents : 256;
+            Event* grown = new (alloc) Event[maxevents];
+            for (uint32_t i = 0; i < nevents; i++)
+                grown[i] = events[i];
+            events = grown;
+        }
+        Event& e = events[nevents++];
+        VMPI_memset(&e, 0, sizeof(Event));
+        e.kind = kind;
+        e.op = op;
+        return e;
+    }
+
+    LIns* LoopFilter::record(LIns* ins)
+    {
+        events[nevents - 1].result = ins;
+        if (ins && !ins->isImmAny() && !defs.containsKey(ins))
+            defs.put(ins, nevents - 1);
+        return ins;
+    }
+
+    LIns* LoopFilter::ins0(LOpcode op)
+    {
+        add(EvOther, op);
+        return record(out->ins0(op));
+    }
+
+    LIns* LoopFilter::ins1(LOpcode op, LIns* a)
+    {
+        Event& e = add(EvOp, op);
+        e.nopnds = 1;
+        e.opnds[0] = a;
+        return record(out->ins1(op, a));
+    }
+
+    LIns* LoopFilter::ins2(LOpcode op, LIns* a, LIns* b)
+    {
+        Event& e = add(EvOp, op);
+        e.nopnds = 2;
+        e.opnds[0] = a;
+        e.opnds[1] = b;
+        return record(out->ins2(op, a, b));
+    }
+
+    LIns* LoopFilter::ins3(LOpcode op, LIns* a, LIns* b, LIns* c)
+    {
+        Event& e = add(EvOp, op);
+        e.nopnds = 3;
+        e.opnds[0] = a;
+        e.opnds[1] = b;
+        e.opnds[2] = c;
+        return record(out->ins3(op, a, b, c));
+    }
+
+    LIns* LoopFilter::ins4(LOpcode op, LIns* a, LIns* b, LIns* c, LIns* d)
+    {
+        Event& e = add(EvOp, op);
+        e.nopnds = 4;
+        e.opnds[0] = a;
+        e.opnds[1] = b;
+        e.opnds[2] = c;
+        e.opnds[3] = d;
+        return record(out->ins4(op, a, b, c, d));
+    }
+
+    LIns* LoopFilter::insSwz(LIns* a, uint8_t mask)
+    {
+        Event& e = add(EvOp, LIR_swzf4);
+        e.nopnds = 1;
+        e.opnds[0] = a;
+        e.mask = mask;
+        return record(out->insSwz(a, mask));
+    }
+
+    LIns* LoopFilter::insGuard(LOpcode op, LIns* cond, GuardRecord* gr)
+    {
+        Event& e = add(EvOther, op);
+        if (cond) {
+            e.nopnds = 1;
+            e.opnds[0] = cond;
+        }
+        return record(out->insGuard(op, cond, gr));
+    }
+
+    LIns* LoopFilter::insGuardXov(LOpcode op, LIns* a, LIns* b, GuardRecord* gr)
+    {
+        Event& e = add(EvOther, op);
+        e.nopnds = 2;
+        e.opnds[0] = a;
+        e.opnds[1] = b;
+        return record(out->insGuardXov(op, a, b, gr));
+    }
+
+    LIns* LoopFilter::insBranch(LOpcode op, LIns* cond, LIns* to)
+    {
+        // A jump back to a label closes a loop.
+        LIns* ins = NULL;
+        if (op == LIR_j && to && defs.containsKey(to)) {
+            head = defs.get(to);
+            if (events[head].op == LIR_label) {
+                if (vectorizes)
+                    ins = vectorize(to);
+                if (!ins && (unrollFactor > 1 || hoistsChecks))
+                    ins = unroll(to, unrollFactor > 1 ? unrollFactor : 1);
+            }
+        }
+        Event& e = add(EvBranch, op);
+        if (cond) {
+            e.nopnds = 1;
+            e.opnds[0] = cond;
+        }
+        return record(ins ? ins : out->insBranch(op, cond, to));
+    }
+
+    LIns* LoopFilter::insBranchJov(LOpcode op, LIns* a, LIns* b, LIns* to)
+    {
+        Event& e = add(EvBranch, op);
+        e.nopnds = 2;
+        e.opnds[0] = a;
+        e.opnds[1] = b;
+        return record(out->insBranchJov(op, a, b, to));
+    }
+
+    LIns* LoopFilter::insParam(int32_t arg, int32_t kind)
+    {
+        add(EvOther, LIR_paramp);
+        return record(out->insParam(arg, kind));
+    }
+
+    LIns* LoopFilter::insSafe(LOpcode op, void* payload)
+    {
+        add(EvOther, op);
+        return record(out->insSafe(op, payload));
+    }
+
+    LIns* LoopFilter::insLoad(LOpcode op, LIns* base, int32_t disp, AccSet accSet, LoadQual loadQual)
+    {
+        Event& e = add(EvLoad, op);
+        e.nopnds = 1;
+        e.opnds[0] = base;
+        e.disp = disp;
+        e.accSet = accSet;
+        e.loadQual = loadQual;
+        return record(out->insLoad(op, base, disp, accSet, loadQual));
+    }
+
+    LIns* LoopFilter::insStore(LOpcode op, LIns* value, LIns* base, int32_t disp, AccSet accSet)
+    {
+        Event& e = add(EvStore, op);
+        e.nopnds = 2;
+        e.opnds[0] = value;
+        e.opnds[1] = base;
+        e.disp = disp;
+        e.accSet = accSet;
+        return record(out->insStore(op, value, base, disp, accSet));
+    }
+
+    LIns* LoopFilter::insMem(LOpcode op, LIns* a, LIns* b, LIns* len, AccSet accSet)
+    {
+        Event& e = add(EvOther, op);
+        e.nopnds = 3;
+        e.opnds[0] = a;
+        e.opnds[1] = b;
+        e.opnds[2] = len;
+        e.accSet = accSet;
+        return record(out->insMem(op, a, b, len, accSet));
+    }
+
+    LIns* LoopFilter::insCall(const CallInfo* ci, LIns* args[])
+    {
+        Event& e = add(EvCall, getCallOpcode(ci));
+        e.ci = ci;
+        e.nopnds = ci->count_args();
+        e.args = new (alloc) LIns*[e.nopnds ? e.nopnds : 1];
+        for (int i = 0; i < e.nopnds; i++)
+            e.args[i] = args[i];
+        return record(out->insCall(ci, args));
+    }
+
+    LIns* LoopFilter::insAlloc(int32_t size)
+    {
+        add(EvOther, LIR_allocp);
+        return record(out->insAlloc(size));
+    }
+
+    LIns* LoopFilter::insJtbl(LIns* index, uint32_t size)
+    {
+        Event& e = add(EvOther, LIR_jtbl);
+        e.nopnds = 1;
+        e.opnds[0] = index;
+        return record(out->insJtbl(index, size));
+    }
+
+    bool LoopFilter::inBody(LIns* ins)
+    {
+        return defs.containsKey(ins) && defs.get(ins) > head;
+    }
+
+    LoopFilter::Kind LoopFilter::kindOf(LIns* ins)
+    {
+        return inBody(ins) ? kinds[defs.get(ins) - head - 1] : KSkip;
+    }
+
+    bool LoopFilter::isInvariant(LIns* ins)
+    {
+        return !inBody(ins) || kindOf(ins) == KInv;
+    }
+
+    // Whether 'ins' can be an operand of a float4 operation:  either it has
+    // a value for each lane, or it is a float that is the same for all.
+    bool LoopFilter::isLanes(LIns* ins)
+    {
+        return kindOf(ins) == KLanes || (isInvariant(ins) && ins->isF());
+    }
+
+    // Finds the counted loop, if there is one, that the events after 'head'
+    // make up.
+    bool LoopFilter::findCounted(Counted& c)
+    {
+        // The test must be the first branch, ahead of any label, so that it
+        // runs on every iteration.  Its target is the exit, which is not
+        // there yet.
+        uint32_t i = head + 1;
+        while (i < nevents && events[i].kind != EvBranch) {
+            if (events[i].op == LIR_label)
+                return false;
+            i++;
+        }
+        if (i == nevents)
+            return false;
+        LIns* br = events[i].result;
+        if (!br || !(br->isop(LIR_jt) || br->isop(LIR_jf)) || br->getTarget())
+            return false;
+        c.test = i;
+
+        // It must exit when 'a >= n' (or 'n <= a'), and otherwise stay.
+        LIns* cond = br->oprnd1();
+        bool swapped, exitIfTrue;
+        switch (cond->opcode()) {
+        case LIR_gei:   CASE64(LIR_geq:)
+        case LIR_geui:  CASE64(LIR_geuq:)
+            swapped = false, exitIfTrue = true;
+            break;
+        case LIR_lei:   CASE64(LIR_leq:)
+        case LIR_leui:  CASE64(LIR_leuq:)
+            swapped = true, exitIfTrue = true;
+            break;
+        case LIR_lti:   CASE64(LIR_ltq:)
+        case LIR_ltui:  CASE64(LIR_ltuq:)
+            swapped = false, exitIfTrue = false;
+            break;
+        case LIR_gti:   CASE64(LIR_gtq:)
+        case LIR_gtui:  CASE64(LIR_gtuq:)
+            swapped = true, exitIfTrue = false;
+            break;
+        default:
+            return false;
+        }
+        LIns* a = swapped ? cond->oprnd2() : cond->oprnd1();
+        LIns* n = swapped ? cond->oprnd1() : cond->oprnd2();
+        if (exitIfTrue != br->isop(LIR_jt))
+            return false;
+        LOpcode op = cond->opcode();
+        c.isUnsigned = op == LIR_ltui || op == LIR_gtui || op == LIR_leui || op == LIR_geui;
+#ifdef NANOJIT_64BIT
+        c.isUnsigned = c.isUnsigned ||
+                       op == LIR_ltuq || op == LIR_gtuq || op == LIR_leuq || op == LIR_geuq;
+#endif
+
+        // 'a' is the index, loaded from a slot;  'n' doesn't change.
+        bool isIndexLoad = a->isop(LIR_ldi);
+#ifdef NANOJIT_64BIT
+        isIndexLoad = isIndexLoad || a->isop(LIR_ldq);
+#endif
+        if (!isIndexLoad || !inBody(a) || !a->oprnd1()->isop(LIR_allocp) ||
+            a->loadQual() != LOAD_NORMAL || inBody(n))
+        {
+            return false;
+        }
+        c.slot = a->oprnd1();
+        c.disp = a->disp();
+        c.load = a->opcode();
+        c.accSet = a->accSet();
+        c.cond = cond;
+        c.limit = n;
+
+        // The index is stored once, after the last label, so that it is
+        // stored on every iteration.
+        int32_t size = loadSize(c.load);
+        uint32_t lastLabel = head;
+        c.store = 0;
+        for (uint32_t j = head + 1; j < nevents; j++) {
+            const Event& e = events[j];
+            if (e.op == LIR_label && e.kind == EvOther)
+                lastLabel = j;
+            if (e.kind == EvStore && e.opnds[1] == c.slot &&
+                e.disp < c.disp + size && c.disp < e.disp + storeSize(e.op))
+            {
+                if (c.store || e.disp != c.disp || loadForStore(e.op) != c.load)
+                    return false;
+                c.store = j;
+            }
+        }
+        if (!c.store || c.store < c.test || c.store < lastLabel)
+            return false;
+
+        // What it stores is the index plus one.
+        LIns* inc = events[c.store].opnds[0];
+        LIns* x = inc->oprnd1();
+        LIns* one = inc->oprnd2();
+        if (x->isImmAny()) {
+            x = inc->oprnd2();
+            one = inc->oprnd1();
+        }
+        bool isInc = inc->isop(LIR_addi) && one->isImmI(1);
+#ifdef NANOJIT_64BIT
+        isInc = isInc || (inc->isop(LIR_addq) && one->isImmQ() && one->immQ() == 1);
+#endif
+        if (!isInc || !inBody(x) || !x->isop(c.load) || x->oprnd1() != c.slot ||
+            x->disp() != c.disp || defs.get(x) > c.store)
+        {
+            return false;
+        }
+
+        // Nothing else may see the slot's address, so nothing else can
+        // change it.
+        for (uint32_t j = 0; j < nevents; j++) {
+            const Event& e = events[j];
+            LIns** opnds = e.kind == EvCall ? e.args : (LIns**)e.opnds;
+            int nopnds = e.kind == EvLoad ? 0 : e.kind == EvStore ? 1 : e.nopnds;
+            if (e.kind == EvOp && isLiveOpcode(e.op))
+                nopnds = 0;
+            for (int k = 0; k < nopnds; k++) {
+                if (opnds[k] == c.slot)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether 'ins' is the index of the counted loop 'c', as loaded in the
+    // body before it is incremented.
+    bool LoopFilter::isIndex(const Counted& c, LIns* ins)
+    {
+        return ins->isop(c.load) && inBody(ins) && ins->oprnd1() == c.slot &&
+               ins->disp() == c.disp && ins->loadQual() == LOAD_NORMAL &&
+               defs.get(ins) < c.store;
+    }
+
+    // Whether event 'i' of the body of the counted loop 'c' is a check that
+    // unroll() can make once, ahead of the loop, and if so what it is.
+    bool LoopFilter::isCheck(const Counted& c, uint32_t i, Check& chk)
+    {
+        const Event& e = events[i];
+        bool isGuard = e.kind == EvOther && (e.op == LIR_xt || e.op == LIR_xf);
+        bool isBranch = e.kind == EvBranch && (e.op == LIR_jt || e.op == LIR_jf) &&
+                        e.result && !e.result->getTarget() && i != c.test;
+        if (!hoistsChecks || !(isGuard || isBranch) || e.nopnds != 1)
+            return false;
+        LIns* cond = e.opnds[0];
+        chk.cond = cond;
+        chk.exitIfTrue = e.op == LIR_xt || e.op == LIR_jt;
+        chk.len = NULL;
+        chk.widen = LIR_skip;
+        if (!inBody(cond))
+            return true;
+        if (!isCmpOpcode(cond->opcode()))
+            return false;
+        if (!inBody(cond->oprnd1()) && !inBody(cond->oprnd2()))
+            return true;
+
+        // The index is in bounds if 'x <u len' (or 'len >u x');  the check
+        // leaves the loop if it isn't.
+        bool swapped, inIfTrue;
+        switch (cond->opcode()) {
+        case LIR_ltui:  CASE64(LIR_ltuq:)
+            swapped = false, inIfTrue = true;
+            break;
+        case LIR_geui:  CASE64(LIR_geuq:)
+            swapped = false, inIfTrue = false;
+            break;
+        case LIR_gtui:  CASE64(LIR_gtuq:)
+            swapped = true, inIfTrue = true;
+            break;
+        case LIR_leui:  CASE64(LIR_leuq:)
+            swapped = true, inIfTrue = false;
+            break;
+        default:
+            return false;
+        }
+        if (inIfTrue == chk.exitIfTrue)
+            return false;
+        LIns* x = swapped ? cond->oprnd2() : cond->oprnd1();
+        chk.len = swapped ? cond->oprnd1() : cond->oprnd2();
+        if (inBody(chk.len))
+            return false;
+#ifdef NANOJIT_64BIT
+        if (x->isop(LIR_i2q) || x->isop(LIR_ui2uq)) {
+            chk.widen = x->opcode();
+            x = x->oprnd1();
+        }
+#endif
+        return isIndex(c, x);
+    }
+
+    // Makes 'checks' once, going back to the loop at 'label' if any would
+    // fail.  Every iteration's index is in bounds if the limit is no more
+    // than the length, as the index only goes up to it, and if the index
+    // isn't negative now when that would make it out of bounds:  when it
+    // counts up as a signed value, or is sign-extended.
+    void LoopFilter::insChecks(const Counted& c, LIns* label, const Check* checks, int nchecks)
+    {
+        LIns* made[MaxChecks];
+        bool madeExitIfTrue[MaxChecks];
+        int nmade = 0;
+        bool madeSign = false;
+        LOpcode ltOp = LIR_lti;
+#ifdef NANOJIT_64BIT
+        if (c.load == LIR_ldq)
+            ltOp = LIR_ltq;
+#endif
+        for (int k = 0; k < nchecks; k++) {
+            const Check& chk = checks[k];
+            LIns* cond;
+            bool exitIfTrue = chk.exitIfTrue;
+            if (!chk.len) {
+                cond = !inBody(chk.cond)
+                     ? use(chk.cond)
+                     : out->ins2(chk.cond->opcode(), use(chk.cond->oprnd1()),
+                                 use(chk.cond->oprnd2()));
+            } else {
+                LIns* n = use(c.limit);
+                bool isSigned = !c.isUnsigned || chk.widen == LIR_i2q;
+                if (isSigned && !madeSign) {
+                    LIns* i1 = out->insLoad(c.load, use(c.slot), c.disp, c.accSet, LOAD_NORMAL);
+                    out->insBranch(LIR_jt, out->ins2(ltOp, i1, insIndexPlus(c, NULL, 0)), label);
+                    // An unsigned index below the limit is then not negative
+                    // either if the limit isn't.
+                    if (c.isUnsigned)
+                        out->insBranch(LIR_jt, out->ins2(ltOp, n, insIndexPlus(c, NULL, 0)), label);
+                    madeSign = true;
+                }
+                LOpcode leuOp = LIR_leui;
+#ifdef NANOJIT_64BIT
+                if (chk.widen != LIR_skip) {
+                    n = out->ins1(chk.widen, n);
+                    leuOp = LIR_leuq;
+                } else if (c.load == LIR_ldq) {
+                    leuOp = LIR_leuq;
+                }
+#endif
+                cond = out->ins2(leuOp, n, use(chk.len));
+                exitIfTrue = false;
             }
-            return ins3(op, cond, iftrue, iffalse);
+            bool isMade = false;
+            for (int j = 0; j < nmade; j++)
+                isMade = isMade || (made[j] == cond && madeExitIfTrue[j] == exitIfTrue);
+            if (isMade)
+                continue;
+            made[nmade] = cond;
+            madeExitIfTrue[nmade++] = exitIfTrue;
+            out->insBranch(exitIfTrue ? LIR_jt : LIR_jf, cond, label);
         }
-
-        LIns* ncond = ins1(LIR_negi, cond); // cond ? -1 : 0
-        return ins2(LIR_ori,
-                    ins2(LIR_andi, iftrue, ncond),
-                    ins2(LIR_andi, iffalse, ins1(LIR_noti, ncond)));
     }
 
-    LIns* LirBufWriter::insCall(const CallInfo *ci, LIns* args[])
+    // The copy, in the new loop, of an instruction of the loop body or of
+    // something from before the loop;  the latter must be kept alive.
+    LIns* LoopFilter::use(LIns* ins)
     {
-        LOpcode op = getCallOpcode(ci);
-#if NJ_SOFTFLOAT_SUPPORTED
-        // SoftFloat: convert LIR_calld to LIR_calli.
-        if (_config.soft_float && op == LIR_calld)
-            op = LIR_calli;
-#endif
+        if (copies->containsKey(ins))
+            return copies->get(ins);
+        if (!ins->isImmAny()) {
+            Seq<LIns*>* p = lives.get();
+            while (p && p->head != ins)
+                p = p->tail;
+            if (!p)
+                lives.add(ins);
+        }
+        return ins;
+    }
 
-        int32_t argc = ci->count_args();
-        NanoAssert(argc <= (int)MAXARGS);
+    // Like use(), but for a float4 operand:  an invariant float is copied
+    // to all four lanes.
+    LIns* LoopFilter::useLanes(LIns* ins)
+    {
+        if (kindOf(ins) == KLanes)
+            return copies->get(ins);
+        if (ins->isImmF()) {
+            float f = ins->immF();
+            float4_t f4 = { f, f, f, f };
+            return out->insImmF4(f4);
+        }
+        if (splats->containsKey(ins))
+            return use(splats->get(ins));
+        return out->ins1(LIR_f2f4, use(ins));
+    }
 
-#ifdef NANOJIT_WIN_CFG
-		if (ci->isIndirect())
-		{
-			// Insert call to Control Flow Guard check function.  Argument is address of indirect call.
-			NanoAssert(argc > 0);
-			LIns** args2 = (LIns**)_buf->_allocator.alloc(sizeof(LIns*));
-			args2[0] = args[argc - 1]; // last arg is function address
-			LInsC* insC = (LInsC*)_buf->makeRoom(sizeof(LInsC));
-			LIns*  ins = insC->getLIns();
-			ins->initLInsC(LIR_callv, args2, &ci_cfg_check);
-		}
+    // Starts a loop that does 'count' iterations of the counted loop 'c' at
+    // a time, and goes back to the loop at 'label' unless there are at
+    // least that many left.  Returns the new loop's label, and the index
+    // in 'i0'.
+    LIns* LoopFilter::insLoopHead(const Counted& c, LIns* label, int32_t count, LIns*& i0)
+    {
+        LOpcode geOp = c.isUnsigned ? LIR_geui : LIR_gei;
+        LOpcode subOp = LIR_subi;
+        LOpcode ltuOp = LIR_ltui;
+#ifdef NANOJIT_64BIT
+        if (c.load == LIR_ldq) {
+            geOp = c.isUnsigned ? LIR_geuq : LIR_geq;
+            subOp = LIR_subq;
+            ltuOp = LIR_ltuq;
+        }
 #endif
+        LIns* loop = out->ins0(LIR_label);
+        i0 = out->insLoad(c.load, use(c.slot), c.disp, c.accSet, LOAD_NORMAL);
+        LIns* n = use(c.limit);
+        out->insBranch(LIR_jt, out->ins2(geOp, i0, n), label);
+        if (count > 1) {
+            out->insBranch(LIR_jt, out->ins2(ltuOp, out->ins2(subOp, n, i0),
+                                             insIndexPlus(c, NULL, count)), label);
+        }
+        return loop;
+    }
 
-        // Allocate space for and copy the arguments.  We use the same
-        // allocator as the normal LIR buffers so it has the same lifetime.
-        // Nb: this must be kept in sync with arg().
-        LIns** args2 = (LIns**)_buf->_allocator.alloc(argc * sizeof(LIns*));
-        memcpy(args2, args, argc * sizeof(LIns*));
-
-        // Allocate and write the call instruction.
-        LInsC* insC = (LInsC*)_buf->makeRoom(sizeof(LInsC));
-        LIns*  ins  = insC->getLIns();
-        ins->initLInsC(op, args2, ci);
-        NanoAssert(!ins->isInReg());
-        return ins;
+    // 'i0 + k', or just 'k' if 'i0' is NULL, as the index's type.
+    LIns* LoopFilter::insIndexPlus(const Counted& c, LIns* i0, int32_t k)
+    {
+        if (i0 && k == 0)
+            return i0;
+#ifdef NANOJIT_64BIT
+        if (c.load == LIR_ldq) {
+            LIns* imm = out->insImmQ(k);
+            return i0 ? out->ins2(LIR_addq, i0, imm) : imm;
+        }
+#endif
+        LIns* imm = out->insImmI(k);
+        return i0 ? out->ins2(LIR_addi, i0, imm) : imm;
+    }
+
+    // If 'addr' is 'base + (i << shift)', for the index 'i' of the loop
+    // being unrolled and a base from before it, returns 'shift', and
+    // otherwise -1.  Within an unrolled iteration 'i + k' doesn't
+    // overflow, so 'addr' is then the first copy's plus 'k << shift'.
+    int LoopFilter::indexShift(const Counted& c, LIns* addr)
+    {
+        if (!addr->isop(LIR_addp) || !inBody(addr))
+            return -1;
+        LIns* offset = addr->oprnd2();
+        if (inBody(addr->oprnd1())) {
+            if (inBody(offset))
+                return -1;
+            offset = addr->oprnd1();
+        } else if (!inBody(offset)) {
+            return -1;
+        }
+        int shift = 0;
+        if (offset->isop(LIR_lshp) && offset->oprnd2()->isImmI()) {
+            shift = offset->oprnd2()->immI();
+            offset = offset->oprnd1();
+            if (shift < 0 || shift > 4)
+                return -1;
+        }
+#ifdef NANOJIT_64BIT
+        // The index is widened the way it is compared.
+        if (offset->isop(c.isUnsigned ? LIR_ui2uq : LIR_i2q))
+            offset = offset->oprnd1();
+        else if (c.load != LIR_ldq)
+            return -1;
+#endif
+        return offset->isop(c.load) && inBody(offset) && offset->oprnd1() == c.slot &&
+               offset->disp() == c.disp ? shift : -1;
+    }
+
+    // Closes the loop started by insLoopHead().  What it uses from outside
+    // is kept alive across it;  the lives must follow the jump, as the
+    // assembler works backwards.
+    LIns* LoopFilter::insLoopEnd(LIns* loop)
+    {
+        LIns* jmp = out->insBranch(LIR_j, NULL, loop);
+        for (Seq<LIns*>* p = lives.get(); p; p = p->tail)
+            out->ins1(liveOpcodeFor(p->head), p->head);
+        return jmp;
+    }
+
+    // Writes the instruction 'e' records again, with its operands' copies.
+    LIns* LoopFilter::insCopy(const Event& e)
+    {
+        LIns* a[MAXARGS] = {};
+        LIns** opnds = e.kind == EvCall ? e.args : (LIns**)e.opnds;
+        for (int j = 0; j < e.nopnds; j++)
+            a[j] = use(opnds[j]);
+        switch (e.kind) {
+        case EvLoad:
+            return out->insLoad(e.op, a[0], e.disp, e.accSet, e.loadQual);
+        case EvStore:
+            return out->insStore(e.op, a[0], a[1], e.disp, e.accSet);
+        case EvCall:
+            return out->insCall(e.ci, a);
+        default:
+            NanoAssert(e.kind == EvOp);
+            switch (e.nopnds) {
+            case 1:
+                return e.op == LIR_swzf4 ? out->insSwz(a[0], e.mask) : out->ins1(e.op, a[0]);
+            case 2:     return out->ins2(e.op, a[0], a[1]);
+            case 3:     return out->ins3(e.op, a[0], a[1], a[2]);
+            default:    return out->ins4(e.op, a[0], a[1], a[2], a[3]);
+            }
+        }
     }
 
-    using namespace avmplus;
+    LIns* LoopFilter::vectorize(LIns* label)
+    {
+        Counted c;
+        if (!findCounted(c))
+            return NULL;
+
+        // Work out what each instruction of the body becomes.  Only
+        // instructions that compute the index, the addresses of the array
+        // elements it selects, values that don't change, and float
+        // arithmetic on the elements are allowed.
+        uint32_t nbody = nevents - head - 1;
+        kinds = new (alloc) Kind[nbody];
+        bases = new (alloc) LIns*[nbody];
+        Access accesses[MaxAccesses];
+        int naccesses = 0;
+        for (uint32_t i = head + 1; i < nevents; i++) {
+            const Event& e = events[i];
+            Kind& kind = kinds[i - head - 1];
+            LIns* r = e.result;
+            kind = KSkip;
+            if (e.kind == EvBranch) {
+                if (i != c.test)
+                    return NULL;
+                continue;
+            }
+            if (e.kind == EvStore) {
+                if (i == c.store)
+                    continue;
+                if (e.op != LIR_stf || kindOf(e.opnds[1]) != KAddr || !isLanes(e.opnds[0]) ||
+                    naccesses == MaxAccesses)
+                {
+                    return NULL;
+                }
+                Access& acc = accesses[naccesses++];
+                acc.base = bases[defs.get(e.opnds[1]) - head - 1];
+                acc.disp = e.disp;
+                acc.isStore = true;
+                continue;
+            }
+            // An instruction produced earlier, or from before the loop, is
+            // left as it is.
+            if (!r || !inBody(r) || defs.get(r) != i)
+                continue;
+            if (e.kind == EvLoad) {
+                if (e.opnds[0] == c.slot) {
+                    if (e.op != c.load || e.disp != c.disp || e.loadQual != LOAD_NORMAL ||
+                        i > c.store)
+                    {
+                        return NULL;
+                    }
+                    kind = KIndex;
+                } else if (e.op == LIR_ldf && kindOf(e.opnds[0]) == KAddr &&
+                           naccesses < MaxAccesses)
+                {
+                    Access& acc = accesses[naccesses++];
+                    acc.base = bases[defs.get(e.opnds[0]) - head - 1];
+                    acc.disp = e.disp;
+                    acc.isStore = false;
+                    kind = KLanes;
+                } else {
+                    return NULL;
+                }
+                continue;
+            }
+            if (e.kind != EvOp)
+                return NULL;
 
-    StackFilter::StackFilter(LirFilter *in, Allocator& alloc, LIns* sp)
-        : LirFilter(in), sp(sp), stk(alloc), top(0)
-    {}
+            bool invariant = true;
+            for (int j = 0; j < e.nopnds; j++)
+                invariant = invariant && isInvariant(e.opnds[j]);
+            Kind k0 = kindOf(e.opnds[0]);
+            Kind k1 = e.nopnds > 1 ? kindOf(e.opnds[1]) : KSkip;
+            if (invariant) {
+                if (!isCseOpcode(e.op))
+                    return NULL;
+                kind = KInv;
+            } else if (r == c.cond) {
+                kind = KTest;
+            } else if (r == events[c.store].opnds[0]) {
+                kind = KInc;
+#ifdef NANOJIT_64BIT
+            } else if ((e.op == LIR_i2q || e.op == LIR_ui2uq) && k0 == KIndex) {
+                kind = KWide;
+#endif
+            } else if (e.op == LIR_lshp && e.opnds[1]->isImmI(2) &&
+                       (k0 == KWide || (k0 == KIndex && c.load == LIR_ldp)))
+            {
+                kind = KOffset;
+            } else if (e.op == LIR_addp && k0 == KOffset && isInvariant(e.opnds[1])) {
+                kind = KAddr;
+                bases[i - head - 1] = e.opnds[1];
+            } else if (e.op == LIR_addp && k1 == KOffset && isInvariant(e.opnds[0])) {
+                kind = KAddr;
+                bases[i - head - 1] = e.opnds[0];
+            } else if (lanesOpcodeFor(e.op) != LIR_skip && isLanes(e.opnds[0]) &&
+                       (e.nopnds == 1 || isLanes(e.opnds[1])))
+            {
+                kind = KLanes;
+            } else {
+                return NULL;
+            }
+        }
 
-    // If we see a sequence like this:
-    //
-    //   sti sp[0]
-    //   ...
-    //   sti sp[0]
-    //
-    // where '...' contains no guards, we can remove the first store.  Also,
-    // because stack entries are eight bytes each (we check this), if we have
-    // this:
-    //
-    //   stfi sp[0]
-    //   ...
-    //   sti sp[0]
-    //
-    // we can again remove the first store -- even though the second store
-    // doesn't clobber the high four bytes -- because we know the entire value
-    // stored by the first store is dead.
-    //
-    LIns* StackFilter::read()
-    {
-        for (;;) {
-            LIns* ins = in->read();
+        // Each iteration must only access its own element of an array, and
+        // the arrays stored to must not overlap others.  That is checked at
+        // run time for arrays with different bases.
+        for (int i = 0; i < naccesses; i++) {
+            for (int j = i + 1; j < naccesses; j++) {
+                const Access& a = accesses[i];
+                const Access& b = accesses[j];
+                if ((a.isStore || b.isStore) && a.base == b.base && a.disp != b.disp)
+                    return NULL;
+            }
+        }
 
-            if (ins->isStore()) {
-                LIns* base = ins->oprnd2();
-                if (base == sp) {
-                    // 'disp' must be eight-aligned because each stack entry is 8 bytes.
-                    NanoAssert((ins->disp() & 0x7) == 0);
+        HashMap<LIns*, LIns*> copyMap(alloc);
+        HashMap<LIns*, LIns*> splatMap(alloc);
+        copies = &copyMap;
+        splats = &splatMap;
+        lives.clear();
+
+        // Four iterations' elements of two arrays overlap if their starts
+        // are less than 'span' bytes apart.  If they do, the original loop
+        // does all the iterations.
+        const int32_t span = Lanes * sizeof(float);
+        for (int i = 0; i < naccesses; i++) {
+            for (int j = i + 1; j < naccesses; j++) {
+                const Access& a = accesses[i];
+                const Access& b = accesses[j];
+                if (!(a.isStore || b.isStore) || a.base == b.base)
+                    continue;
+                LIns* d = out->ins2(LIR_subp, a.base, b.base);
+                LIns* t = out->ins2(LIR_addp, d, out->insImmWord(a.disp - b.disp + span - 1));
+                LIns* overlap = out->ins2(LIR_andi,
+                    out->ins2(LIR_ltup, t, out->insImmWord(2 * span - 1)),
+                    out->insEqI_0(out->ins2(LIR_eqp, t, out->insImmWord(span - 1))));
+                out->insBranch(LIR_jf, out->insEqI_0(overlap), label);
+            }
+        }
 
-                    int d = ins->disp() >> 3;
-                    if (d >= top) {
-                        continue;
-                    } else {
-                        d = top - d;
-                        if (stk.get(d)) {
-                            continue;
-                        } else {
-                            stk.set(d);
-                        }
-                    }
+        // Floats from before the loop are copied to all lanes before it.
+        for (uint32_t i = head + 1; i < nevents; i++) {
+            const Event& e = events[i];
+            if (kinds[i - head - 1] != KLanes && !(e.kind == EvStore && i != c.store))
+                continue;
+            for (int j = 0; j < e.nopnds; j++) {
+                LIns* ins = e.opnds[j];
+                if (ins->isF() && !inBody(ins) && !ins->isImmF() && !splatMap.containsKey(ins))
+                    splatMap.put(ins, out->ins1(LIR_f2f4, ins));
+            }
+        }
+
+        // The new loop:  it goes back to the original one unless there are
+        // at least four iterations left.
+        LIns* i0;
+        LIns* loop = insLoopHead(c, label, Lanes, i0);
+        for (uint32_t i = head + 1; i < nevents; i++) {
+            const Event& e = events[i];
+            Kind kind = kinds[i - head - 1];
+            if (e.kind == EvStore) {
+                if (i == c.store) {
+                    out->insStore(e.op, insIndexPlus(c, i0, Lanes), use(c.slot), c.disp,
+                                  e.accSet);
+                } else {
+                    out->insStore(LIR_stf4, useLanes(e.opnds[0]), use(e.opnds[1]), e.disp,
+                                  e.accSet);
                 }
+                continue;
             }
-            /*
-             * NB: If there is a backward branch other than the loop-restart branch, this is
-             * going to be wrong. Unfortunately there doesn't seem to be an easy way to detect
-             * such branches. Just do not create any.
-             *
-             * The isLive() call is valid because liveness will have been
-             * computed by Assembler::gen() for every instruction following
-             * this guard.
-             */
-            else if (ins->isGuard() && ins->isLive()) {
-                stk.reset();
-                top = getTop(ins);
-                top >>= 3;
+            LIns* ins = NULL;
+            switch (kind) {
+            case KIndex:
+                ins = i0;
+                break;
+            case KLanes:
+                if (e.kind == EvLoad) {
+                    ins = out->insLoad(LIR_ldf4, use(e.opnds[0]), e.disp, e.accSet, e.loadQual);
+                } else if (e.nopnds == 1) {
+                    ins = out->ins1(lanesOpcodeFor(e.op), useLanes(e.opnds[0]));
+                } else {
+                    ins = out->ins2(lanesOpcodeFor(e.op), useLanes(e.opnds[0]),
+                                    useLanes(e.opnds[1]));
+                }
+                break;
+            case KWide:
+            case KOffset:
+            case KAddr:
+            case KInv:
+                ins = insCopy(e);
+                break;
+            default:
+                // The test and the increment are replaced by the new loop's.
+                break;
             }
+            if (ins)
+                copyMap.put(e.result, ins);
+        }
 
-            return ins;
+        LIns* jmp = insLoopEnd(loop);
+        copies = splats = NULL;
+        return jmp;
+    }
+
+    LIns* LoopFilter::unroll(LIns* label, uint32_t factor)
+    {
+        Counted c;
+        if (!findCounted(c))
+            return NULL;
+
+        // The body must not branch, other than to exit or in checks that
+        // can be made ahead of it, and must be small enough to copy.
+        uint32_t nbody = nevents - head - 1;
+        if (nbody * factor > MaxUnrolled)
+            return NULL;
+        Check checks[MaxChecks];
+        int nchecks = 0;
+        for (uint32_t i = head + 1; i < nevents; i++) {
+            const Event& e = events[i];
+            Check chk;
+            if (isCheck(c, i, chk)) {
+                if (nchecks == MaxChecks)
+                    return NULL;
+                checks[nchecks++] = chk;
+                continue;
+            }
+            if (e.kind == EvBranch && i != c.test)
+                return NULL;
+            if (e.kind == EvOther || (e.kind == EvOp && (isRetOpcode(e.op) || isLiveOpcode(e.op))))
+                return NULL;
+            if (e.kind == EvLoad && e.opnds[0] == c.slot &&
+                (e.op != c.load || e.disp != c.disp || e.loadQual != LOAD_NORMAL || i > c.store))
+            {
+                return NULL;
+            }
+        }
+        if (factor == 1 && nchecks == 0)
+            return NULL;
+
+        HashMap<LIns*, LIns*> copyMap(alloc);
+        HashMap<LIns*, LIns*> firstMap(alloc);     // the first copy's element addresses
+        copies = &copyMap;
+        lives.clear();
+        insChecks(c, label, checks, nchecks);
+
+        // The new loop:  each copy of the body sees the index plus the
+        // copy's number in place of the index, and accesses array elements
+        // at the first copy's addresses, further on.  The test and the
+        // increment are the new loop's.
+        LIns* i0;
+        LIns* loop = insLoopHead(c, label, factor, i0);
+        for (uint32_t k = 0; k < factor; k++) {
+            LIns* index = insIndexPlus(c, i0, k);
+            for (uint32_t i = head + 1; i < nevents; i++) {
+                const Event& e = events[i];
+                Check chk;
+                if (i == c.test || i == c.store || isCheck(c, i, chk))
+                    continue;
+                if (e.kind == EvLoad && e.opnds[0] == c.slot) {
+                    copyMap.put(e.result, index);
+                    continue;
+                }
+                // An instruction produced earlier, or from before the loop,
+                // is left as it is.
+                if (e.kind != EvStore && (!inBody(e.result) || defs.get(e.result) != i))
+                    continue;
+                LIns* ins;
+                LIns* addr = e.kind == EvLoad ? e.opnds[0] : e.kind == EvStore ? e.opnds[1] : NULL;
+                int shift = addr && k > 0 && firstMap.containsKey(addr) ? indexShift(c, addr) : -1;
+                if (shift >= 0 && e.kind == EvLoad) {
+                    ins = out->insLoad(e.op, firstMap.get(addr), e.disp + (int32_t(k) << shift),
+                                       e.accSet, e.loadQual);
+                } else if (shift >= 0) {
+                    ins = out->insStore(e.op, use(e.opnds[0]), firstMap.get(addr),
+                                        e.disp + (int32_t(k) << shift), e.accSet);
+                } else {
+                    ins = insCopy(e);
+                }
+                if (k == 0 && e.result && indexShift(c, e.result) >= 0)
+                    firstMap.put(e.result, ins);
+                if (e.result)
+                    copyMap.put(e.result, ins);
+            }
         }
+        const Event& store = events[c.store];
+        out->insStore(store.op, insIndexPlus(c, i0, factor), use(c.slot), c.disp,
+                      store.accSet);
+
+        LIns* jmp = insLoopEnd(loop);
+        copies = NULL;
+        return jmp;
     }
 
 #ifdef NJ_VERBOSE
@@ -2133,10 +3621,14 @@ namespace nanojit
                 case LIR_subd:
                 case LIR_muld:
                 case LIR_divd:
+                case LIR_mind:
+                case LIR_maxd:
                 case LIR_addf:
                 case LIR_subf:
                 case LIR_mulf:
                 case LIR_divf:
+                case LIR_minf:
+                case LIR_maxf:
                 case LIR_addf4:
                 case LIR_subf4:
                 case LIR_mulf4:
@@ -2155,9 +3647,15 @@ namespace nanojit
                 CASE64(LIR_addq:)
                 CASE64(LIR_subq:)
                 CASE86(LIR_mulq:)
+                CASE86(LIR_mulhuq:)
+                CASE86(LIR_mulhq:)
                 CASE64(LIR_addjovq:)
                 CASE64(LIR_subjovq:)
+                CASE64(LIR_muljovq:)
+                CASE64(LIR_mulxovq:)
                 CASE86(LIR_divq:)
+                case LIR_crc32ci:
+                CASE64(LIR_crc32cq:)
                 case LIR_andi:
                 case LIR_ori:
                 case LIR_xori:
@@ -2176,6 +3674,11 @@ namespace nanojit
                 case LIR_cmovd:
                 case LIR_cmovf:
                 case LIR_cmovf4:
+                case LIR_copyb:
+                case LIR_fillb:
+                case LIR_cmpb:
+                case LIR_findb:
+                case LIR_findanyb:
                     live.add(ins->oprnd1(), 0);
                     live.add(ins->oprnd2(), 0);
                     live.add(ins->oprnd3(), 0);
@@ -2627,6 +4130,7 @@ namespace nanojit
             case LIR_addxovi:
             case LIR_subxovi:
             case LIR_mulxovi:
+            CASE64(LIR_mulxovq:)
                 formatGuardXov(buf, i);
                 break;
 
@@ -2635,6 +4139,7 @@ namespace nanojit
             case LIR_muljovi:
             CASE64(LIR_addjovq:)
             CASE64(LIR_subjovq:)
+            CASE64(LIR_muljovq:)
                 VMPI_snprintf(s, n, "%s = %s %s, %s ; ovf -> %s", formatRef(&b1, i), lirNames[op],
                     formatRef(&b2, i->oprnd1()),
                     formatRef(&b3, i->oprnd2()),
@@ -2644,15 +4149,21 @@ namespace nanojit
             case LIR_addi:       CASE64(LIR_addq:)
             case LIR_subi:       CASE64(LIR_subq:)
             case LIR_muli:       CASE86(LIR_mulq:)
+            CASE86(LIR_mulhuq:)  CASE86(LIR_mulhq:)
             CASE86(LIR_divi:)    CASE86(LIR_divq:)
+            case LIR_crc32ci:    CASE64(LIR_crc32cq:)
             case LIR_addd:
             case LIR_subd:
             case LIR_muld:
             case LIR_divd:
+            case LIR_mind:
+            case LIR_maxd:
             case LIR_addf:
             case LIR_subf:
             case LIR_mulf:
             case LIR_divf:
+            case LIR_minf:
+            case LIR_maxf:
             case LIR_addf4:
             case LIR_subf4:
             case LIR_mulf4:
@@ -2759,6 +4270,25 @@ namespace nanojit
                     formatRef(&b3, i->oprnd1()));
                 break;
 
+            case LIR_copyb:
+            case LIR_fillb:
+                VMPI_snprintf(s, n, "%s%s %s, %s, %s", lirNames[op],
+                    formatAccSet(&b1, i->accSet()),
+                    formatRef(&b2, i->oprnd1()),
+                    formatRef(&b3, i->oprnd2()),
+                    formatRef(&b4, i->oprnd3()));
+                break;
+
+            case LIR_cmpb:
+            case LIR_findb:
+            case LIR_findanyb:
+                VMPI_snprintf(s, n, "%s = %s%s %s, %s, %s", formatRef(&b1, i), lirNames[op],
+                    formatAccSet(&b2, i->accSet()),
+                    formatRef(&b3, i->oprnd1()),
+                    formatRef(&b4, i->oprnd2()),
+                    formatRef(&b5, i->oprnd3()));
+                break;
+
             case LIR_comment:
                 VMPI_snprintf(s, n, "------------------------------ # %s", (char*)i->oprnd1());
                 break;
@@ -3628,6 +5158,15 @@ namespace nanojit
         return ins;
     }
 
+    LIns* CseFilter::insMem(LOpcode op, LIns* a, LIns* b, LIns* len, AccSet accSet)
+    {
+        // None of these is CSE'd;  some only read.  LirBufWriter may turn
+        // them into calls, so the result isn't checked.
+        if (!isBlockReadOpcode(op))
+            storesSinceLastLoad |= accSet;
+        return out->insMem(op, a, b, len, accSet);
+    }
+
     LIns* CseFilter::insGuard(LOpcode op, LIns* c, GuardRecord *gr)
     {
         // LIR_xt and LIR_xf guards are CSEable.  Note that we compare the
@@ -3877,6 +5416,10 @@ namespace nanojit
         case LIR_lshi:
         CASE86(LIR_divi:)
         CASE86(LIR_divq:)
+        CASE86(LIR_mulhuq:)
+        CASE86(LIR_mulhq:)
+        case LIR_crc32ci:
+        CASE64(LIR_crc32cq:)
         case LIR_calli:
         case LIR_reti:
         CASE64(LIR_q2i:)
@@ -4075,6 +5618,113 @@ namespace nanojit
     }
 #endif // NJ_SOFTFLOAT_SUPPORTED
 
+#ifdef NANOJIT_64BIT
+    ProfileWriter::ProfileWriter(LirWriter* out, Allocator& alloc, const char* name, AccSet accSet)
+        : LirWriter(out), alloc(alloc), accSet(accSet), nbins(0), bounds(NULL), nprobes(0)
+    {
+        char* copy = (char*) malloc(VMPI_strlen(name) + 1);
+        VMPI_strcpy(copy, name);
+        this->name = copy;
+        VMPI_memset(probed, 0, sizeof(probed));
+    }
+
+    void ProfileWriter::addProbe(LOpcode op)
+    {
+        NanoAssert(op < LIR_sentinel);
+        probed[op] = true;
+    }
+
+    void ProfileWriter::setHistogram(int nbins, const int64_t* lb)
+    {
+        NanoAssert(nbins >= 0);
+        this->nbins = nbins;
+        bounds = new (alloc) int64_t[nbins ? nbins : 1];
+        for (int b = 0; b < nbins; b++)
+            bounds[b] = lb[b];
+    }
+
+    LIns* ProfileWriter::probe(LIns* ins)
+    {
+        if (!probed[ins->opcode()] || !(ins->isI() || ins->isQ()))
+            return ins;
+
+        // Create the entry now, so that its address can be baked into the
+        // code.  Sequence numbers keep entries from different probes apart.
+        void* id = NULL;
+        if (nbins > 0)
+            initHistProfileBounds(&id, (char*)name, nprobes, nbins, bounds);
+        else
+            initValueProfile(&id, (char*)name, nprobes, NULL);
+        nprobes++;
+
+        entry_t e = (entry_t) id;
+        if (e->count == 0) {
+            // profileValue() special-cases the first sample;  the probe
+            // instead starts min and max off at the extremes.
+            e->min = int64_t(uint64_t(-1) >> 1);
+            e->max = ~e->min;
+        }
+
+        LIns* v = ins->isI() ? out->ins1(LIR_i2q, ins) : ins;
+        LIns* base = out->insImmP(e);
+
+        out->insStore(LIR_stq, v, base, offsetof(entry, value), accSet);
+
+        LIns* count = out->insLoad(LIR_ldq, base, offsetof(entry, count), accSet, LOAD_NORMAL);
+        out->insStore(LIR_stq, out->ins2(LIR_addq, count, out->insImmQ(1)),
+                      base, offsetof(entry, count), accSet);
+
+        LIns* sum = out->insLoad(LIR_ldq, base, offsetof(entry, sum), accSet, LOAD_NORMAL);
+        out->insStore(LIR_stq, out->ins2(LIR_addq, sum, v), base, offsetof(entry, sum), accSet);
+
+        LIns* min = out->insLoad(LIR_ldq, base, offsetof(entry, min), accSet, LOAD_NORMAL);
+        out->insStore(LIR_stq, out->ins3(LIR_cmovq, out->ins2(LIR_ltq, v, min), v, min),
+                      base, offsetof(entry, min), accSet);
+
+        LIns* max = out->insLoad(LIR_ldq, base, offsetof(entry, max), accSet, LOAD_NORMAL);
+        out->insStore(LIR_stq, out->ins3(LIR_cmovq, out->ins2(LIR_gtq, v, max), v, max),
+                      base, offsetof(entry, max), accSet);
+
+        if (nbins > 0) {
+            // The bucket index is the number of lower bounds that are <= v,
+            // which matches histValue() as long as the bounds are sorted.
+            LIns* idx = out->insImmI(0);
+            for (int b = 0; b < nbins; b++)
+                idx = out->ins2(LIR_addi, idx, out->ins2(LIR_geq, v, out->insImmQ(bounds[b])));
+            LIns* addr = out->ins2(LIR_addq, out->insImmP(e->h->count),
+                                   out->ins2(LIR_lshq, out->ins1(LIR_ui2uq, idx), out->insImmI(3)));
+            LIns* bucket = out->insLoad(LIR_ldq, addr, 0, accSet, LOAD_NORMAL);
+            out->insStore(LIR_stq, out->ins2(LIR_addq, bucket, out->insImmQ(1)), addr, 0, accSet);
+        }
+        return ins;
+    }
+
+    LIns* ProfileWriter::ins1(LOpcode v, LIns* a)
+    {
+        return probe(out->ins1(v, a));
+    }
+
+    LIns* ProfileWriter::ins2(LOpcode v, LIns* a, LIns* b)
+    {
+        return probe(out->ins2(v, a, b));
+    }
+
+    LIns* ProfileWriter::ins3(LOpcode v, LIns* a, LIns* b, LIns* c)
+    {
+        return probe(out->ins3(v, a, b, c));
+    }
+
+    LIns* ProfileWriter::insLoad(LOpcode op, LIns* base, int32_t d, AccSet accSet, LoadQual loadQual)
+    {
+        return probe(out->insLoad(op, base, d, accSet, loadQual));
+    }
+
+    LIns* ProfileWriter::insCall(const CallInfo *ci, LIns* args[])
+    {
+        return probe(out->insCall(ci, args));
+    }
+#endif // NANOJIT_64BIT
+
 
     #endif /* FEATURE_NANOJIT */
 
@@ -4311,6 +5961,37 @@ namespace nanojit
         return out->insStore(op, value, base, d, accSet);
     }
 
+    LIns* ValidateWriter::insMem(LOpcode op, LIns* a, LIns* b, LIns* len, AccSet accSet)
+    {
+        // The AccSet covers both blocks, so it may hold more than one region
+        // and isn't given to checkAccSet().
+        if (accSet == ACCSET_NONE)
+            errorAccSet(lirNames[op], accSet, "it should not be ACCSET_NONE");
+
+        int nArgs = 3;
+        LTy formals[3] = { LTy_P, LTy_P, LTy_P };
+        LIns* args[3] = { a, b, len };
+
+        switch (op) {
+        case LIR_copyb:
+        case LIR_cmpb:
+            break;
+
+        case LIR_fillb:
+        case LIR_findb:
+        case LIR_findanyb:
+            formals[1] = LTy_I;
+            break;
+
+        default:
+            NanoAssert(0);
+        }
+
+        typeCheckArgs(op, nArgs, formals, args);
+
+        return out->insMem(op, a, b, len, accSet);
+    }
+
     LIns* ValidateWriter::ins0(LOpcode op)
     {
         switch (op) {
@@ -4473,6 +6154,7 @@ namespace nanojit
         case LIR_gtui:
         case LIR_leui:
         case LIR_geui:
+        case LIR_crc32ci:
             formals[0] = LTy_I;
             formals[1] = LTy_I;
             break;
@@ -4500,6 +6182,8 @@ namespace nanojit
         case LIR_leuq:
         case LIR_geuq:
         CASE86(LIR_mulq:)
+        CASE86(LIR_mulhuq:)
+        CASE86(LIR_mulhq:)
         CASE86(LIR_divq:)
             formals[0] = LTy_Q;
             formals[1] = LTy_Q;
@@ -4511,12 +6195,19 @@ namespace nanojit
             formals[0] = LTy_Q;
             formals[1] = LTy_I;
             break;
+
+        case LIR_crc32cq:
+            formals[0] = LTy_I;
+            formals[1] = LTy_Q;
+            break;
 #endif
 
         case LIR_addd:
         case LIR_subd:
         case LIR_muld:
         case LIR_divd:
+        case LIR_mind:
+        case LIR_maxd:
         case LIR_eqd:
         case LIR_gtd:
         case LIR_ltd:
@@ -4530,6 +6221,8 @@ namespace nanojit
         case LIR_subf:
         case LIR_mulf:
         case LIR_divf:
+        case LIR_minf:
+        case LIR_maxf:
         case LIR_eqf:
         case LIR_gtf:
         case LIR_ltf:
@@ -4774,6 +6467,13 @@ namespace nanojit
         case LIR_mulxovi:
             break;
 
+#ifdef NANOJIT_64BIT
+        case LIR_mulxovq:
+            formals[0] = LTy_Q;
+            formals[1] = LTy_Q;
+            break;
+#endif
+
         default:
             NanoAssert(0);
         }
@@ -4838,6 +6538,7 @@ namespace nanojit
 #ifdef NANOJIT_64BIT
         case LIR_addjovq:
         case LIR_subjovq:
+        case LIR_muljovq:
             formals[0] = LTy_Q;
             formals[1] = LTy_Q;
             break;
@@ -4891,6 +6592,7 @@ namespace nanojit
         case LIR_muljovi:
         CASE64(LIR_addjovq:)
         CASE64(LIR_subjovq:)
+        CASE64(LIR_muljovq:)
             NanoAssert(ins->getTarget() && ins->oprnd3()->isop(LIR_label));
             break;
 
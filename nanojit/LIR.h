@@ -466,6 +466,10 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
                isCmpF4Opcode(op)||
                isCmpDOpcode(op);
     }
+    // The block memory operations that only read.
+    inline bool isBlockReadOpcode(LOpcode op) {
+        return op == LIR_cmpb || op == LIR_findb || op == LIR_findanyb;
+    }
 
     inline LOpcode getCmpFOpcode(LOpcode op){
         NanoAssert(isCmpDOpcode(op));
@@ -514,6 +518,10 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
     LOpcode cmpOpcodeD2I(LOpcode op);
     LOpcode cmpOpcodeD2UI(LOpcode op);
 
+    // Software versions of LIR_crc32ci and LIR_crc32cq.
+    uint32_t crc32c32(uint32_t crc, uint32_t v);
+    uint32_t crc32c64(uint32_t crc, uint64_t v);
+
     // Array holding the 'repKind' field from LIRopcode.tbl.
     extern const uint8_t repKinds[];
 
@@ -618,6 +626,7 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
         LRK_Op4,
         LRK_Ld,
         LRK_St,
+        LRK_Mem,
         LRK_Sk,
         LRK_C,
         LRK_P,
@@ -637,6 +646,7 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
     class LInsOp4;
     class LInsLd;
     class LInsSt;
+    class LInsMem;
     class LInsSk;
     class LInsC;
     class LInsP;
@@ -714,6 +724,7 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
         inline LInsOp4*  toLInsOp4()  const;
         inline LInsLd*   toLInsLd()   const;
         inline LInsSt*   toLInsSt()   const;
+        inline LInsMem*  toLInsMem()  const;
         inline LInsSk*   toLInsSk()   const;
         inline LInsC*    toLInsC()    const;
         inline LInsP*    toLInsP()    const;
@@ -735,6 +746,7 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
         inline void initLInsOp4(LOpcode opcode, LIns* oprnd1, LIns* oprnd2, LIns* oprnd3, LIns* oprnd4);
         inline void initLInsLd(LOpcode opcode, LIns* val, int32_t d, AccSet accSet, LoadQual loadQual);
         inline void initLInsSt(LOpcode opcode, LIns* val, LIns* base, int32_t d, AccSet accSet);
+        inline void initLInsMem(LOpcode opcode, LIns* a, LIns* b, LIns* len, AccSet accSet);
         inline void initLInsSk(LIns* prevLIns);
         // Nb: args[] must be allocated and initialised before being passed in;
         // initLInsC() just copies the pointer into the LInsC.
@@ -976,6 +988,10 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
             NanoAssert(LRK_None != repKinds[opcode()]);
             return LRK_St == repKinds[opcode()];
         }
+        bool isLInsMem() const {
+            NanoAssert(LRK_None != repKinds[opcode()]);
+            return LRK_Mem == repKinds[opcode()];
+        }
         bool isLInsSk() const {
             NanoAssert(LRK_None != repKinds[opcode()]);
             return LRK_Sk == repKinds[opcode()];
@@ -1040,12 +1056,15 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
         }
         bool isGuard() const {
             return isop(LIR_x) || isop(LIR_xf) || isop(LIR_xt) || isop(LIR_xbarrier) ||
+#ifdef NANOJIT_64BIT
+                   isop(LIR_mulxovq) ||
+#endif
                    isop(LIR_addxovi) || isop(LIR_subxovi) || isop(LIR_mulxovi);
         }
         bool isJov() const {
             return
 #ifdef NANOJIT_64BIT
-                isop(LIR_addjovq) || isop(LIR_subjovq) ||
+                isop(LIR_addjovq) || isop(LIR_subjovq) || isop(LIR_muljovq) ||
 #endif
                 isop(LIR_addjovi) || isop(LIR_subjovi) || isop(LIR_muljovi);
         }
@@ -1325,6 +1344,27 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
         LIns* getLIns() { return &ins; };
     };
 
+    // Used for the block memory operations LIR_copyb, LIR_fillb, LIR_cmpb,
+    // LIR_findb and LIR_findanyb.
+    class LInsMem
+    {
+    private:
+        friend class LIns;
+
+        MiniAccSetVal miniAccSetVal;
+
+        LIns*       oprnd_3;
+
+        LIns*       oprnd_2;
+
+        LIns*       oprnd_1;
+
+        LIns        ins;
+
+    public:
+        LIns* getLIns() { return &ins; };
+    };
+
     // Used for LIR_skip.
     class LInsSk
     {
@@ -1463,6 +1503,7 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
     LInsOp4*  LIns::toLInsOp4()  const { return (LInsOp4* )(uintptr_t(this+1) - sizeof(LInsOp4 )); }
     LInsLd*   LIns::toLInsLd()   const { return (LInsLd*  )(uintptr_t(this+1) - sizeof(LInsLd  )); }
     LInsSt*   LIns::toLInsSt()   const { return (LInsSt*  )(uintptr_t(this+1) - sizeof(LInsSt  )); }
+    LInsMem*  LIns::toLInsMem()  const { return (LInsMem* )(uintptr_t(this+1) - sizeof(LInsMem )); }
     LInsSk*   LIns::toLInsSk()   const { return (LInsSk*  )(uintptr_t(this+1) - sizeof(LInsSk  )); }
     LInsC*    LIns::toLInsC()    const { return (LInsC*   )(uintptr_t(this+1) - sizeof(LInsC   )); }
     LInsP*    LIns::toLInsP()    const { return (LInsP*   )(uintptr_t(this+1) - sizeof(LInsP   )); }
@@ -1527,6 +1568,14 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
         toLInsSt()->miniAccSetVal = compressAccSet(accSet).val;
         NanoAssert(isLInsSt());
     }
+    void LIns::initLInsMem(LOpcode opcode, LIns* a, LIns* b, LIns* len, AccSet accSet) {
+        initSharedFields(opcode);
+        toLInsMem()->oprnd_1 = a;
+        toLInsMem()->oprnd_2 = b;
+        toLInsMem()->oprnd_3 = len;
+        toLInsMem()->miniAccSetVal = compressAccSet(accSet).val;
+        NanoAssert(isLInsMem());
+    }
     void LIns::initLInsSk(LIns* prevLIns) {
         initSharedFields(LIR_skip);
         toLInsSk()->prevLIns = prevLIns;
@@ -1579,15 +1628,15 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
     }
     LIns* LIns::oprnd1() const {
         NanoAssert(isLInsOp1() || isLInsOp1b() || isLInsOp2() || isLInsOp3() ||
-                   isLInsOp4() || isLInsLd() || isLInsSt() || isLInsJtbl());
+                   isLInsOp4() || isLInsLd() || isLInsSt() || isLInsMem() || isLInsJtbl());
         return toLInsOp2()->oprnd_1;
     }
     LIns* LIns::oprnd2() const {
-        NanoAssert(isLInsOp2() || isLInsOp3() || isLInsOp4() || isLInsSt());
+        NanoAssert(isLInsOp2() || isLInsOp3() || isLInsOp4() || isLInsSt() || isLInsMem());
         return toLInsOp2()->oprnd_2;
     }
     LIns* LIns::oprnd3() const {
-        NanoAssert(isLInsOp3() || isLInsOp4());
+        NanoAssert(isLInsOp3() || isLInsOp4() || isLInsMem());
         return toLInsOp3()->oprnd_3;
     }
     LIns* LIns::oprnd4() const {
@@ -1637,6 +1686,7 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
         case LIR_addxovi:
         case LIR_subxovi:
         case LIR_mulxovi:
+        CASE64(LIR_mulxovq:)
             return (GuardRecord*)oprnd3();
 
         default:
@@ -1663,6 +1713,8 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
         MiniAccSet miniAccSet;
         if (isLInsSt()) {
             miniAccSet.val = toLInsSt()->miniAccSetVal;
+        } else if (isLInsMem()) {
+            miniAccSet.val = toLInsMem()->miniAccSetVal;
         } else {
             NanoAssert(isLInsLd());
             miniAccSet.val = toLInsLd()->miniAccSetVal;
@@ -1842,6 +1894,11 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
         virtual LIns* insStore(LOpcode op, LIns* value, LIns* base, int32_t d, AccSet accSet) {
             return out->insStore(op, value, base, d, accSet);
         }
+        // For LIR_copyb, LIR_fillb, LIR_cmpb, LIR_findb and LIR_findanyb;
+        // 'len' is pointer-sized.
+        virtual LIns* insMem(LOpcode op, LIns* a, LIns* b, LIns* len, AccSet accSet) {
+            return out->insMem(op, a, b, len, accSet);
+        }
         // args[] is in reverse order, ie. args[0] holds the rightmost arg.
         virtual LIns* insCall(const CallInfo *call, LIns* args[]) {
             return out->insCall(call, args);
@@ -2204,6 +2261,9 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
         LIns* insStore(LOpcode op, LIns* v, LIns* b, int32_t d, AccSet accSet) {
             return add_flush(out->insStore(op, v, b, d, accSet));
         }
+        LIns* insMem(LOpcode op, LIns* a, LIns* b, LIns* len, AccSet accSet) {
+            return add_flush(out->insMem(op, a, b, len, accSet));
+        }
         LIns* insAlloc(int32_t size) {
             return add(out->insAlloc(size));
         }
@@ -2427,6 +2487,7 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
         LIns* ins4(LOpcode v, LIns*, LIns*, LIns*, LIns*);
         LIns* insLoad(LOpcode op, LIns* base, int32_t d, AccSet accSet, LoadQual loadQual);
         LIns* insStore(LOpcode op, LIns* value, LIns* base, int32_t d, AccSet accSet);
+        LIns* insMem(LOpcode op, LIns* a, LIns* b, LIns* len, AccSet accSet);
         LIns* insCall(const CallInfo *call, LIns* args[]);
         LIns* insGuard(LOpcode op, LIns* cond, GuardRecord *gr);
         LIns* insGuardXov(LOpcode op, LIns* a, LIns* b, GuardRecord *gr);
@@ -2493,6 +2554,7 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
             // LirWriter interface
             LIns*   insLoad(LOpcode op, LIns* base, int32_t disp, AccSet accSet, LoadQual loadQual);
             LIns*   insStore(LOpcode op, LIns* o1, LIns* o2, int32_t disp, AccSet accSet);
+            LIns*   insMem(LOpcode op, LIns* a, LIns* b, LIns* len, AccSet accSet);
             LIns*   ins0(LOpcode op);
             LIns*   ins1(LOpcode op, LIns* o1);
             LIns*   ins2(LOpcode op, LIns* o1, LIns* o2);
@@ -2621,6 +2683,216 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
         LIns* read();
     };
 
+    // Forwards the value stored to a LIR_allocp slot to later loads of the
+    // same bytes in the same block, so that a local kept in a slot is only
+    // loaded where control may have come from elsewhere.  A label forgets
+    // every slot;  a store through any other base, or an impure call,
+    // forgets the slots whose stores it may alias, going by access sets.
+    class SlotFilter: public LirWriter
+    {
+        struct Known {
+            LIns* slot;
+            int32_t disp;
+            int32_t size;
+            LOpcode load;       // the load that reads back 'value'
+            LIns* value;
+            AccSet accSet;
+        };
+        static const int MaxKnown = 16;
+        Known known[MaxKnown];
+        int nknown;
+
+        void forget(AccSet accSet);
+        void forget(LIns* slot, int32_t disp, int32_t size);
+
+    public:
+        SlotFilter(LirWriter* out) : LirWriter(out), nknown(0) {}
+        LIns* ins0(LOpcode op);
+        LIns* insLoad(LOpcode op, LIns* base, int32_t disp, AccSet accSet, LoadQual loadQual);
+        LIns* insStore(LOpcode op, LIns* value, LIns* base, int32_t disp, AccSet accSet);
+        LIns* insMem(LOpcode op, LIns* a, LIns* b, LIns* len, AccSet accSet);
+        LIns* insCall(const CallInfo* call, LIns* args[]);
+        LIns* insSafe(LOpcode op, void* payload);
+    };
+
+    // Removes stores to LIR_allocp slots that are never read.  A slot
+    // qualifies if its address is only ever the base of loads and stores
+    // within it, so that nothing else can read it.  Its stores are then
+    // dead if it is never loaded, or if the same bytes are stored again
+    // before any load or branch.  The constructor scans the whole fragment
+    // to find such slots.
+    class SlotStoreFilter: public LirFilter
+    {
+        struct Slot {
+            int32_t size;
+            bool escaped;
+            bool loaded;
+        };
+        struct Covered {
+            LIns* slot;
+            int32_t lo, hi;     // bytes [lo, hi) are stored before any load
+        };
+        static const int MaxCovered = 16;
+        HashMap<LIns*, Slot*> slots;
+        Covered covered[MaxCovered];
+        int ncovered;
+
+        Slot* slotFor(LIns* base, int32_t disp, int32_t size);
+        void uncover(LIns* slot, int32_t lo, int32_t hi);
+
+    public:
+        SlotStoreFilter(LirFilter* in, Allocator& alloc, LIns* lastIns);
+        LIns* read();
+    };
+
+    // Vectorizes counted loops over float arrays.  It records everything
+    // written through it, and at the back edge of an innermost loop of the
+    // form
+    //
+    //   L:  i = ldi slot[d]           ; or ldq;  'slot' is a LIR_allocp
+    //       jt gei(i, n) exit         ; or jf lti(i, n), or unsigned
+    //       ...                       ; ldf/stf at base + (i << 2), and
+    //       ...                       ;   float arithmetic on what they load
+    //       sti slot[d] = addi(i, 1)
+    //       j L
+    //
+    // it adds a second loop that does four iterations at once, with ldf4,
+    // addf4, stf4 and so on, and jumps back to L for the iterations that
+    // are left.  So the original loop runs the first iteration and the
+    // last few, and all of them if an array it stores to overlaps another
+    // one it accesses, which is checked once on the way in.  Loops that
+    // carry a value from one iteration to the next, such as reductions, or
+    // that branch or call are left alone.
+    //
+    // It can also unroll such loops, whatever their body computes as long
+    // as it doesn't branch:  the second loop is then 'unrollFactor' copies
+    // of the body, each using the index plus its number, with one test and
+    // one increment for all of them.  The filters after this one fold the
+    // copies together.  A loop is vectorized if it can be, and otherwise
+    // unrolled.
+    //
+    // The unrolled loop can also leave out the body's bounds checks, given
+    // 'hoistsChecks', which then unrolls loops that have any even if
+    // 'unrollFactor' is 1.  A check is an xt/xf guard, or a forward jt/jf,
+    // that leaves the loop unless the index, maybe widened, is below a
+    // length that doesn't change (ltui(i, len) and the like), or whose
+    // condition doesn't change.  Each one is made once, ahead of the new
+    // loop, which goes back to L if any would fail;  for the index, that
+    // the limit is no more than the length, and, if it is signed, that the
+    // index isn't negative.  So identical checks become one as well.
+    class LoopFilter: public LirWriter
+    {
+        enum EventKind { EvOp, EvLoad, EvStore, EvCall, EvBranch, EvOther };
+        struct Event {
+            EventKind kind;
+            LOpcode op;
+            int nopnds;
+            LIns* opnds[4];     // for stores: value, base
+            int32_t disp;
+            AccSet accSet;
+            LoadQual loadQual;
+            uint8_t mask;       // LIR_swzf4
+            const CallInfo* ci;
+            LIns** args;        // nopnds of them
+            LIns* result;
+        };
+        // A counted loop:  'slot[disp]' holds the index, which counts up to
+        // 'limit'.  'test' and 'store' are the events that compare and
+        // increment it.
+        struct Counted {
+            LIns* slot;
+            int32_t disp;
+            LOpcode load;
+            AccSet accSet;
+            LIns* cond;
+            LIns* limit;
+            bool isUnsigned;
+            uint32_t test;
+            uint32_t store;
+        };
+        // What vectorize() makes of each instruction of a loop body.
+        enum Kind { KSkip, KIndex, KWide, KOffset, KAddr, KInc, KTest, KInv, KLanes };
+        struct Access {
+            LIns* base;
+            int32_t disp;
+            bool isStore;
+        };
+        // A bounds check that unroll() makes ahead of the loop:  if 'len'
+        // is set, 'cond' is true or false, per 'exitIfTrue', unless the
+        // index (widened by 'widen', unless that is LIR_skip) is below it.
+        // Otherwise it is a 'cond' whose operands don't change.
+        struct Check {
+            LIns* cond;
+            bool exitIfTrue;
+            LIns* len;
+            LOpcode widen;
+        };
+        static const int Lanes = 4;
+        static const int MaxAccesses = 8;
+        static const int MaxChecks = 8;
+        static const uint32_t MaxUnrolled = 256;    // events, over all the copies
+
+        Allocator& alloc;
+        bool vectorizes;
+        uint32_t unrollFactor;
+        bool hoistsChecks;
+        Event* events;
+        uint32_t nevents;
+        uint32_t maxevents;
+        HashMap<LIns*, uint32_t> defs;      // the first event to produce each instruction
+
+        // The loop being vectorized.
+        uint32_t head;
+        Kind* kinds;
+        LIns** bases;                       // of the KAddr instructions
+        HashMap<LIns*, LIns*>* copies;
+        HashMap<LIns*, LIns*>* splats;
+        SeqBuilder<LIns*> lives;
+
+        Event& add(EventKind kind, LOpcode op);
+        LIns* record(LIns* ins);
+        bool inBody(LIns* ins);
+        Kind kindOf(LIns* ins);
+        bool isInvariant(LIns* ins);
+        bool isLanes(LIns* ins);
+        bool findCounted(Counted& c);
+        bool isIndex(const Counted& c, LIns* ins);
+        bool isCheck(const Counted& c, uint32_t i, Check& chk);
+        void insChecks(const Counted& c, LIns* label, const Check* checks, int nchecks);
+        LIns* insLoopHead(const Counted& c, LIns* label, int32_t count, LIns*& i0);
+        LIns* insIndexPlus(const Counted& c, LIns* i0, int32_t k);
+        int indexShift(const Counted& c, LIns* addr);
+        LIns* insLoopEnd(LIns* loop);
+        LIns* insCopy(const Event& e);
+        LIns* vectorize(LIns* label);
+        LIns* unroll(LIns* label, uint32_t factor);
+        LIns* use(LIns* ins);
+        LIns* useLanes(LIns* ins);
+
+    public:
+        // 'unrollFactor' is 0 or 1 to not unroll.
+        LoopFilter(LirWriter* out, Allocator& alloc, bool vectorizes, uint32_t unrollFactor,
+                   bool hoistsChecks = false);
+        LIns* ins0(LOpcode op);
+        LIns* ins1(LOpcode op, LIns* a);
+        LIns* ins2(LOpcode op, LIns* a, LIns* b);
+        LIns* ins3(LOpcode op, LIns* a, LIns* b, LIns* c);
+        LIns* ins4(LOpcode op, LIns* a, LIns* b, LIns* c, LIns* d);
+        LIns* insGuard(LOpcode op, LIns* cond, GuardRecord* gr);
+        LIns* insGuardXov(LOpcode op, LIns* a, LIns* b, GuardRecord* gr);
+        LIns* insBranch(LOpcode op, LIns* cond, LIns* to);
+        LIns* insBranchJov(LOpcode op, LIns* a, LIns* b, LIns* to);
+        LIns* insParam(int32_t arg, int32_t kind);
+        LIns* insSafe(LOpcode op, void* payload);
+        LIns* insLoad(LOpcode op, LIns* base, int32_t disp, AccSet accSet, LoadQual loadQual);
+        LIns* insStore(LOpcode op, LIns* value, LIns* base, int32_t disp, AccSet accSet);
+        LIns* insMem(LOpcode op, LIns* a, LIns* b, LIns* len, AccSet accSet);
+        LIns* insCall(const CallInfo* call, LIns* args[]);
+        LIns* insAlloc(int32_t size);
+        LIns* insJtbl(LIns* index, uint32_t size);
+        LIns* insSwz(LIns* a, uint8_t mask);
+    };
+
     // This type is used to perform a simple interval analysis of 32-bit
     // add/sub/mul.  It lets us avoid overflow checks in some cases.
     struct Interval
@@ -2721,6 +2993,51 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
     };
 #endif
 
+#ifdef NANOJIT_64BIT
+    // Inserts an inline value-profiling probe after every instruction whose
+    // opcode has been selected with addProbe().  Each probe updates a vprof
+    // entry (last value, count, sum, min, max and optionally histogram
+    // buckets) with plain loads and stores, so the generated code does not
+    // make a call or spill registers.  Entries are named 'name:N', where N
+    // is the probe's sequence number, and are reported by vprof's usual
+    // dump at exit.
+    //
+    // Probes are emitted directly to 'out', so this filter should sit below
+    // any CseFilter in the pipeline.  'accSet' is the region used for the
+    // probe loads and stores;  it must not alias anything the fragment
+    // itself loads from.  Only int and quad values are profiled.
+    class ProfileWriter : public LirWriter
+    {
+        Allocator&  alloc;
+        const char* name;       // malloc'd, since vprof keeps it until exit
+        AccSet      accSet;
+        bool        probed[LIR_sentinel];
+        int         nbins;
+        int64_t*    bounds;
+        int         nprobes;
+
+        LIns* probe(LIns* ins);
+
+    public:
+        ProfileWriter(LirWriter* out, Allocator& alloc, const char* name, AccSet accSet);
+
+        // Profile every value produced by 'op'.
+        void addProbe(LOpcode op);
+
+        // Also bucket the values into a histogram whose 'nbins' lower bounds
+        // are 'lb[0..nbins-1]', as with initHistProfile().
+        void setHistogram(int nbins, const int64_t* lb);
+
+        int numProbes() const { return nprobes; }
+
+        LIns* ins1(LOpcode v, LIns* a);
+        LIns* ins2(LOpcode v, LIns* a, LIns* b);
+        LIns* ins3(LOpcode v, LIns* a, LIns* b, LIns* c);
+        LIns* insLoad(LOpcode op, LIns* base, int32_t d, AccSet accSet, LoadQual loadQual);
+        LIns* insCall(const CallInfo *ci, LIns* args[]);
+    };
+#endif
+
 #ifdef DEBUG
     // This class does thorough checking of LIR.  It checks *implicit* LIR
     // instructions, ie. LIR instructions specified via arguments -- to
@@ -2760,6 +3077,7 @@ NanoStaticAssert(LIR_start == 0 && LIR_sentinel <= 256); // It's ok if LIR_senti
 
         LIns* insLoad(LOpcode op, LIns* base, int32_t d, AccSet accSet, LoadQual loadQual);
         LIns* insStore(LOpcode op, LIns* value, LIns* base, int32_t d, AccSet accSet);
+        LIns* insMem(LOpcode op, LIns* a, LIns* b, LIns* len, AccSet accSet);
         LIns* ins0(LOpcode v);
         LIns* ins1(LOpcode v, LIns* a);
         LIns* ins2(LOpcode v, LIns* a, LIns* b);
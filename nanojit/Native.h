@@ -69,6 +69,18 @@
 #  define NJ_DIVI_SUPPORTED 0
 #endif
 
+#ifndef NJ_BLOCKMEM_SUPPORTED
+#  define NJ_BLOCKMEM_SUPPORTED 0
+#endif
+
+#ifndef NJ_CRC32C_SUPPORTED
+#  define NJ_CRC32C_SUPPORTED 0
+#endif
+
+#ifndef NJ_MINMAX_SUPPORTED
+#  define NJ_MINMAX_SUPPORTED 0
+#endif
+
 #if NJ_SOFTFLOAT_SUPPORTED
     #define CASESF(x)   case x
 #else
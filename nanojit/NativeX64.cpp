@@ -411,6 +411,8 @@ namespace nanojit
     void Assembler::NEGQ(R r)   { emitr(X64_negq, r); asm_output("negq %s", RQ(r)); }
     void Assembler::IDIV( R r)  { emitr(X64_idiv, r); asm_output("idivl edx:eax, %s",RL(r)); }
     void Assembler::IDIVQ(R r)  { emitr(X64_idivq, r); asm_output("idivq rdx:rax, %s", RQ(r)); }
+    void Assembler::MULQ( R r)  { emitr(X64_mulq,  r); asm_output("mulq rdx:rax, %s", RQ(r)); }
+    void Assembler::IMULQ1(R r) { emitr(X64_imulq1, r); asm_output("imulq rdx:rax, %s", RQ(r)); }
 
 
     void Assembler::SHR( R r)   { emitr(X64_shr,  r); asm_output("shrl %s, ecx", RL(r)); }
@@ -438,8 +440,18 @@ namespace nanojit
     void Assembler::SETAE(R r)  { emitr8(X64_setae,r); asm_output("setae %s",RB(r)); }
     void Assembler::SETO( R r)  { emitr8(X64_seto, r); asm_output("seto %s", RB(r)); }
 
+    void Assembler::BSWAP( R r) { emitr(X64_bswap,  r); asm_output("bswapl %s", RL(r)); }
+    void Assembler::BSWAPQ(R r) { emitr(X64_bswapq, r); asm_output("bswapq %s", RQ(r)); }
+    void Assembler::REP_MOVSB() { emit(X64_repmovsb); asm_output("rep movsb"); }
+    void Assembler::REP_STOSB() { emit(X64_repstosb); asm_output("rep stosb"); }
+
     void Assembler::ADDRR(R l, R r)     { emitrr(X64_addrr,l,r); asm_output("addl %s, %s", RL(l),RL(r)); }
     void Assembler::SUBRR(R l, R r)     { emitrr(X64_subrr,l,r); asm_output("subl %s, %s", RL(l),RL(r)); }
+    void Assembler::SBBRR(R l, R r)     { emitrr(X64_sbbrr,l,r); asm_output("sbbl %s, %s", RL(l),RL(r)); }
+    void Assembler::CRC32(R l, R r)     { emitprr(X64_crc32, l,r); asm_output("crc32l %s, %s", RL(l),RL(r)); }
+    void Assembler::CRC32Q(R l, R r)    { emitprr(X64_crc32q,l,r); asm_output("crc32q %s, %s", RQ(l),RQ(r)); }
+    void Assembler::BSFQ(R l, R r)      { emitrr(X64_bsfq,l,r);    asm_output("bsfq %s, %s", RQ(l),RQ(r)); }
+    void Assembler::TZCNTQ(R l, R r)    { emitprr(X64_tzcntq,l,r); asm_output("tzcntq %s, %s", RQ(l),RQ(r)); }
     void Assembler::ANDRR(R l, R r)     { emitrr(X64_andrr,l,r); asm_output("andl %s, %s", RL(l),RL(r)); }
     void Assembler::ORLRR(R l, R r)     { emitrr(X64_orlrr,l,r); asm_output("orl %s, %s",  RL(l),RL(r)); }
     void Assembler::XORRR(R l, R r)     { emitrr(X64_xorrr,l,r); asm_output("xorl %s, %s", RL(l),RL(r)); }
@@ -460,6 +472,7 @@ namespace nanojit
     void Assembler::UNPCKLPS(R l, R r)  { emitrr(X64_unpcklps,l,r);asm_output("unpcklps %s, %s",RQ(l),RQ(r));}
 
     void Assembler::CMOVNO( R l, R r)   { emitrr(X64_cmovno, l,r); asm_output("cmovlno %s, %s",  RL(l),RL(r)); }
+    void Assembler::CMOVE(  R l, R r)   { emitrr(X64_cmove,  l,r); asm_output("cmovle %s, %s",   RL(l),RL(r)); }
     void Assembler::CMOVNE( R l, R r)   { emitrr(X64_cmovne, l,r); asm_output("cmovlne %s, %s",  RL(l),RL(r)); }
     void Assembler::CMOVNL( R l, R r)   { emitrr(X64_cmovnl, l,r); asm_output("cmovlnl %s, %s",  RL(l),RL(r)); }
     void Assembler::CMOVNLE(R l, R r)   { emitrr(X64_cmovnle,l,r); asm_output("cmovlnle %s, %s", RL(l),RL(r)); }
@@ -471,6 +484,7 @@ namespace nanojit
     void Assembler::CMOVNAE(R l, R r)   { emitrr(X64_cmovnae,l,r); asm_output("cmovlnae %s, %s", RL(l),RL(r)); }
 
     void Assembler::CMOVQNO( R l, R r)  { emitrr(X64_cmovqno, l,r); asm_output("cmovqno %s, %s",  RQ(l),RQ(r)); }
+    void Assembler::CMOVQE(  R l, R r)  { emitrr(X64_cmovqe,  l,r); asm_output("cmovqe %s, %s",   RQ(l),RQ(r)); }
     void Assembler::CMOVQNE( R l, R r)  { emitrr(X64_cmovqne, l,r); asm_output("cmovqne %s, %s",  RQ(l),RQ(r)); }
     void Assembler::CMOVQNL( R l, R r)  { emitrr(X64_cmovqnl, l,r); asm_output("cmovqnl %s, %s",  RQ(l),RQ(r)); }
     void Assembler::CMOVQNLE(R l, R r)  { emitrr(X64_cmovqnle,l,r); asm_output("cmovqnle %s, %s", RQ(l),RQ(r)); }
@@ -503,6 +517,22 @@ namespace nanojit
     void Assembler::MULPS(   R l, R r)  { emitrr(X64_mulps,   l,r); asm_output("mulps %s, %s",   RQ(l),RQ(r)); }
     void Assembler::ADDPS(   R l, R r)  { emitrr(X64_addps,   l,r); asm_output("addps %s, %s",   RQ(l),RQ(r)); }
     void Assembler::SUBPS(   R l, R r)  { emitrr(X64_subps,   l,r); asm_output("subps %s, %s",   RQ(l),RQ(r)); }
+    void Assembler::MINPS(   R l, R r)  { emitrr(X64_minps,   l,r); asm_output("minps %s, %s",   RQ(l),RQ(r)); }
+    void Assembler::MAXPS(   R l, R r)  { emitrr(X64_maxps,   l,r); asm_output("maxps %s, %s",   RQ(l),RQ(r)); }
+    void Assembler::MINSD(   R l, R r)  { emitprr(X64_minsd,  l,r); asm_output("minsd %s, %s",   RQ(l),RQ(r)); }
+    void Assembler::MAXSD(   R l, R r)  { emitprr(X64_maxsd,  l,r); asm_output("maxsd %s, %s",   RQ(l),RQ(r)); }
+    void Assembler::MINSS(   R l, R r)  { emitprr(X64_minss,  l,r); asm_output("minss %s, %s",   RQ(l),RQ(r)); }
+    void Assembler::MAXSS(   R l, R r)  { emitprr(X64_maxss,  l,r); asm_output("maxss %s, %s",   RQ(l),RQ(r)); }
+    void Assembler::SQRTPS(  R l, R r)  { emitrr(X64_sqrtps,  l,r); asm_output("sqrtps %s, %s",  RQ(l),RQ(r)); }
+    void Assembler::SQRTSS(  R l, R r)  { emitprr(X64_sqrtss, l,r); asm_output("sqrtss %s, %s",  RQ(l),RQ(r)); }
+    void Assembler::RCPPS(   R l, R r)  { emitrr(X64_rcpps,   l,r); asm_output("rcpps %s, %s",   RQ(l),RQ(r)); }
+    void Assembler::RCPSS(   R l, R r)  { emitprr(X64_rcpss,  l,r); asm_output("rcpss %s, %s",   RQ(l),RQ(r)); }
+    void Assembler::RSQRTPS( R l, R r)  { emitrr(X64_rsqrtps, l,r); asm_output("rsqrtps %s, %s", RQ(l),RQ(r)); }
+    void Assembler::RSQRTSS( R l, R r)  { emitprr(X64_rsqrtss,l,r); asm_output("rsqrtss %s, %s", RQ(l),RQ(r)); }
+    void Assembler::ANDPS(   R l, R r)  { emitrr(X64_andps,   l,r); asm_output("andps %s, %s",   RQ(l),RQ(r)); }
+    void Assembler::ANDNPS(  R l, R r)  { emitrr(X64_andnps,  l,r); asm_output("andnps %s, %s",  RQ(l),RQ(r)); }
+    void Assembler::ORPS(    R l, R r)  { emitrr(X64_orps,    l,r); asm_output("orps %s, %s",    RQ(l),RQ(r)); }
+    void Assembler::BLENDVPS(R l, R r)  { emitprr(X64_blendvps,l,r); asm_output("blendvps %s, %s, xmm0", RQ(l),RQ(r)); }
     void Assembler::CVTSQ2SD(R l, R r)  { emitprr(X64_cvtsq2sd,l,r); asm_output("cvtsq2sd %s, %s",RQ(l),RQ(r)); }
     void Assembler::CVTSQ2SS(R l, R r)  { emitprr(X64_cvtsq2ss,l,r); asm_output("cvtsq2ss %s, %s",RQ(l),RQ(r)); }
     void Assembler::CVTSI2SD(R l, R r)  { emitprr(X64_cvtsi2sd,l,r); asm_output("cvtsi2sd %s, %s",RQ(l),RL(r)); }
@@ -520,7 +550,13 @@ namespace nanojit
     void Assembler::MOVDXR(  R l, R r)  { emitprr(X64_movdxr,  l,r); asm_output("movd %s, %s",    RQ(l),RQ(r)); }
     void Assembler::MOVLHPS( R l, R r)  { emitrr(X64_movlhps, l,r);  asm_output("movlhps %s, %s", RQ(l),RQ(r)); }
     void Assembler::PMOVMSKB(R l, R r)  { emitprr(X64_pmovmskb,l,r); asm_output("pmovmskb %s, %s",RQ(l),RQ(r)); }
+    void Assembler::PCMPEQB( R l, R r)  { emitprr(X64_pcmpeqb, l,r); asm_output("pcmpeqb %s, %s", RQ(l),RQ(r)); }
+    void Assembler::POR(     R l, R r)  { emitprr(X64_por,     l,r); asm_output("por %s, %s",     RQ(l),RQ(r)); }
     void Assembler::CMPNEQPS(R l, R r)  { emitrr_imm8(X64_cmppsr,l,r,4); asm_output("cmpneqps %s, %s", RL(l),RL(r)); }
+    void Assembler::CMPPS(R l, R r, I p){ emitrr_imm8(X64_cmppsr,l,r,uint8_t(p)); asm_output("cmpps %s, %s, %d", RQ(l),RQ(r),p); }
+    void Assembler::CMPSD(R l, R r, I p){ emitprr_imm8(X64_cmpsd,l,r,uint8_t(p)); asm_output("cmpsd %s, %s, %d", RQ(l),RQ(r),p); }
+    void Assembler::CMPSS(R l, R r, I p){ emitprr_imm8(X64_cmpss,l,r,uint8_t(p)); asm_output("cmpss %s, %s, %d", RQ(l),RQ(r),p); }
+    void Assembler::DPPS(R l, R r, I m) { emitprr_imm8(X64_dpps,l,r,uint8_t(m)); asm_output("dpps %s, %s, %x", RQ(l),RQ(r),m); }
 
     inline uint8_t PSHUFD_MASK(int x, int y, int z, int w) { 
         NanoAssert(x>=0 && x<=3);
@@ -565,6 +601,8 @@ namespace nanojit
     void Assembler::ANDLR8(R r, I32 i8)     { emitr_imm8(X64_andlr8,r,i8); asm_output("andl %s, %d", RL(r),i8); }
     void Assembler::ORLR8( R r, I32 i8)     { emitr_imm8(X64_orlr8, r,i8); asm_output("orl %s, %d",  RL(r),i8); }
     void Assembler::XORLR8(R r, I32 i8)     { emitr_imm8(X64_xorlr8,r,i8); asm_output("xorl %s, %d", RL(r),i8); }
+    void Assembler::ADCLR8(R r, I32 i8)     { emitr_imm8(X64_adclr8,r,i8); asm_output("adcl %s, %d", RL(r),i8); }
+    void Assembler::SBBLR8(R r, I32 i8)     { emitr_imm8(X64_sbblr8,r,i8); asm_output("sbbl %s, %d", RL(r),i8); }
     void Assembler::CMPLR8(R r, I32 i8)     { emitr_imm8(X64_cmplr8,r,i8); asm_output("cmpl %s, %d", RL(r),i8); }
 
     void Assembler::ADDQR8(R r, I32 i8)     { emitr_imm8(X64_addqr8,r,i8); asm_output("addq %s, %d",RQ(r),i8); }
@@ -572,6 +610,8 @@ namespace nanojit
     void Assembler::ANDQR8(R r, I32 i8)     { emitr_imm8(X64_andqr8,r,i8); asm_output("andq %s, %d",RQ(r),i8); }
     void Assembler::ORQR8( R r, I32 i8)     { emitr_imm8(X64_orqr8, r,i8); asm_output("orq %s, %d", RQ(r),i8); }
     void Assembler::XORQR8(R r, I32 i8)     { emitr_imm8(X64_xorqr8,r,i8); asm_output("xorq %s, %d",RQ(r),i8); }
+    void Assembler::ADCQR8(R r, I32 i8)     { emitr_imm8(X64_adcqr8,r,i8); asm_output("adcq %s, %d",RQ(r),i8); }
+    void Assembler::SBBQR8(R r, I32 i8)     { emitr_imm8(X64_sbbqr8,r,i8); asm_output("sbbq %s, %d",RQ(r),i8); }
     void Assembler::CMPQR8(R r, I32 i8)     { emitr_imm8(X64_cmpqr8,r,i8); asm_output("cmpq %s, %d",RQ(r),i8); }
 
     void Assembler::IMULI(R l, R r, I32 i32)    { emitrr_imm(X64_imuli,l,r,i32); asm_output("imuli %s, %s, %d",RL(l),RL(r),i32); }
@@ -698,6 +738,8 @@ namespace nanojit
 
     void Assembler::XORPSA(R r, I32 i32)    { emitxm_abs(X64_xorpsa, r, i32); asm_output("xorps %s, (0x%x)",RQ(r), i32); }
     void Assembler::XORPSM(R r, NIns* a64)  { emitxm_rel(X64_xorpsm, r, a64); asm_output("xorps %s, (%p)",  RQ(r), a64); }
+    void Assembler::ANDPSA(R r, I32 i32)    { emitxm_abs(X64_andpsa, r, i32); asm_output("andps %s, (0x%x)",RQ(r), i32); }
+    void Assembler::ANDPSM(R r, NIns* a64)  { emitxm_rel(X64_andpsm, r, a64); asm_output("andps %s, (%p)",  RQ(r), a64); }
 
     void Assembler::X86_AND8R(R r)  { emit(X86_and8r | U64(REGNUM(r)<<3|(REGNUM(r)|4))<<56); asm_output("andb %s, %s", RB(r), RBhi(r)); }
     void Assembler::X86_SETNP(R r)  { emit(X86_setnp | U64(REGNUM(r)|4)<<56); asm_output("setnp %s", RBhi(r)); }
@@ -830,7 +872,7 @@ namespace nanojit
         }
 
         // Quad multiply with where RHS is 32bit integer
-        if (op == LIR_mulq) {
+        if (op == LIR_mulq || op == LIR_muljovq || op == LIR_mulxovq) {
             // Special case: imulq-by-imm has true 3-addr form.  So we don't
             // need the MR(rr, ra) after the IMULQI.
             beginOp1Regs(ins, GpRegs, rr, ra);
@@ -1061,6 +1103,214 @@ namespace nanojit
         }
     }
 
+    // Generates code for LIR_mulhuq and LIR_mulhq.  The one-operand forms of
+    // 'mul' and 'imul' take one operand in RAX and leave the high half of the
+    // product in RDX.
+    void Assembler::asm_mulh(LIns *ins) {
+        NanoAssert(ins->isop(LIR_mulhuq) || ins->isop(LIR_mulhq));
+        LIns *a = ins->oprnd1();
+        LIns *b = ins->oprnd2();
+
+        evictIfActive(RAX);
+        prepareResultReg(ins, rmask(RDX));
+
+        Register rb = findRegFor(b, GpRegs & ~(rmask(RAX) | rmask(RDX)));
+        Register ra = a->isInReg() ? a->getReg() : RAX;
+
+        if (ins->isop(LIR_mulhq))
+            IMULQ1(rb);
+        else
+            MULQ(rb);
+        if (RAX != ra)
+            MR(RAX, ra);
+
+        freeResourcesOf(ins);
+        if (!a->isInReg()) {
+            NanoAssert(ra == RAX);
+            findSpecificRegForUnallocated(a, RAX);
+        }
+    }
+
+    // Generates code for LIR_crc32ci and LIR_crc32cq, with the SSE4.2
+    // 'crc32' instruction if there is one.
+    void Assembler::asm_crc32c(LIns *ins) {
+        bool isQ = ins->isop(LIR_crc32cq);
+        if (!_config.i386_sse42) {
+            static const ArgType argTypesI[] = { ARGTYPE_UI, ARGTYPE_UI };
+            static const ArgType argTypesQ[] = { ARGTYPE_UI, ARGTYPE_Q };
+            NIns *target = (NIns*)(isQ ? (intptr_t)&crc32c64 : (intptr_t)&crc32c32);
+            asm_helper_call(ins, target, 2, isQ ? argTypesQ : argTypesI);
+            return;
+        }
+
+        Register rr, ra, rb;
+        beginOp2Regs(ins, GpRegs, rr, ra, rb);
+        if (isQ)
+            CRC32Q(rr, rb);
+        else
+            CRC32(rr, rb);
+        if (rr != ra)
+            MR(rr, ra);
+        endOpRegs(ins, rr, ra);
+    }
+
+    // Returns the integer condition that 'v' is, or widens to a quad if
+    // 'isQ', if nothing else needs it in a register.
+    static LIns* arithCond(LIns* v, bool isQ) {
+        if (isQ) {
+            if (!(v->isop(LIR_ui2uq) || v->isop(LIR_i2q)) || v->isExtant())
+                return NULL;
+            v = v->oprnd1();
+        }
+        LOpcode op = v->opcode();
+        return (isCmpIOpcode(op) || isCmpQOpcode(op)) && !v->isExtant() ? v : NULL;
+    }
+
+    // Adds a condition to, or subtracts it from, an integer without
+    // materializing it, as in addi(x, eqi(a, b)).  An unsigned compare
+    // leaves its result in the carry flag, as does comparing 'a' with 1 for
+    // a == 0, and adc/sbb fold that in directly:
+    //
+    //      cmp a, b            cmp a, b            (or another compare)
+    //      mov rr, x           mov rr, x
+    //      adc rr, 0           lea rt, 1(rr)
+    //                          cmovcc rr, rt
+    //
+    // Other conditions select x +/- 1 with cmov.  Returns false, having
+    // generated nothing, if 'ins' isn't of this form.
+    bool Assembler::asm_arith_cond(LIns *ins) {
+        LOpcode op = ins->opcode();
+        bool isQ = op == LIR_addq || op == LIR_subq;
+        bool isSub = op == LIR_subi || op == LIR_subq;
+        LIns* x = ins->oprnd1();
+        LIns* cond = arithCond(ins->oprnd2(), isQ);
+        if (!cond && !isSub && (cond = arithCond(x, isQ)) != NULL)
+            x = ins->oprnd2();
+        if (!cond)
+            return false;
+
+        LOpcode condop = cond->opcode();
+        LIns* a = cond->oprnd1();
+        LIns* b = cond->oprnd2();
+        bool condQ = isCmpQOpcode(condop);
+        bool imm = isImm32(b) && !(b->isTainted() && shouldBlind(getImm32(b)));
+        int32_t k = imm ? getImm32(b) : 0;
+        // an immediate that can be bumped by one without leaving its range
+        bool bumpable = imm && k != -1 && k != 0x7fffffff;
+
+        // 'useCarry' is set if the compare below leaves the condition, or
+        // its inverse if '!carryIsCond', in the carry flag.
+        bool useCarry = true, carryIsCond = true, swap = false;
+        switch (condop) {
+        case LIR_ltui: case LIR_ltuq:
+            break;
+        case LIR_geui: case LIR_geuq:
+            carryIsCond = false;
+            break;
+        case LIR_gtui: case LIR_gtuq:
+            // a > b  iff  b < a  iff  !(a < b+1)
+            if (imm)
+                { useCarry = bumpable; carryIsCond = false; k++; }
+            else
+                swap = true;
+            break;
+        case LIR_leui: case LIR_leuq:
+            // a <= b  iff  !(b < a)  iff  a < b+1
+            if (imm)
+                { useCarry = bumpable; k++; }
+            else
+                { swap = true; carryIsCond = false; }
+            break;
+        case LIR_eqi: case LIR_eqq:
+            // a == 0  iff  a < 1
+            useCarry = imm && k == 0;
+            k = 1;
+            break;
+        default:
+            useCarry = false;
+            break;
+        }
+        if (!useCarry)
+            k = imm ? getImm32(b) : 0;
+
+        Register ra, rb = UnspecifiedReg;
+        if (imm) {
+            ra = findRegFor(a, GpRegs);
+        } else if (a != b) {
+            findRegFor2(GpRegs, a, ra, GpRegs, b, rb);
+        } else {
+            ra = rb = findRegFor(a, GpRegs);
+        }
+        RegisterMask notCmp = ~rmask(ra) & (imm ? ~0 : ~rmask(rb));
+        Register rr = prepareResultReg(ins, BaseRegs & notCmp);
+
+        // If 'x' isn't in a register, it can be clobbered by 'ins'.
+        Register rx = x->isInReg() ? x->getReg() : rr;
+
+        // WARNING: nothing between here and the compare may affect the
+        // condition codes.
+        if (useCarry) {
+            int32_t c = carryIsCond ? 0 : -1;
+            if (isSub == carryIsCond) {
+                if (isQ) SBBQR8(rr, c); else SBBLR8(rr, c);
+            } else {
+                if (isQ) ADCQR8(rr, c); else ADCLR8(rr, c);
+            }
+        } else {
+            Register rt = _allocator.allocTempReg(GpRegs & notCmp & ~rmask(rr) & ~rmask(rx));
+            if (isQ) {
+                switch (condop) {
+                case LIR_eqi:  case LIR_eqq:    CMOVQE(  rr, rt); break;
+                case LIR_lti:  case LIR_ltq:    CMOVQNGE(rr, rt); break;
+                case LIR_gti:  case LIR_gtq:    CMOVQNLE(rr, rt); break;
+                case LIR_lei:  case LIR_leq:    CMOVQNG( rr, rt); break;
+                case LIR_gei:  case LIR_geq:    CMOVQNL( rr, rt); break;
+                case LIR_ltui: case LIR_ltuq:   CMOVQNAE(rr, rt); break;
+                case LIR_gtui: case LIR_gtuq:   CMOVQNBE(rr, rt); break;
+                case LIR_leui: case LIR_leuq:   CMOVQNA( rr, rt); break;
+                case LIR_geui: case LIR_geuq:   CMOVQNB( rr, rt); break;
+                default:                        NanoAssert(0);    break;
+                }
+                LEAQRM(rt, isSub ? -1 : 1, rr);
+            } else {
+                switch (condop) {
+                case LIR_eqi:  case LIR_eqq:    CMOVE(  rr, rt);  break;
+                case LIR_lti:  case LIR_ltq:    CMOVNGE(rr, rt);  break;
+                case LIR_gti:  case LIR_gtq:    CMOVNLE(rr, rt);  break;
+                case LIR_lei:  case LIR_leq:    CMOVNG( rr, rt);  break;
+                case LIR_gei:  case LIR_geq:    CMOVNL( rr, rt);  break;
+                case LIR_ltui: case LIR_ltuq:   CMOVNAE(rr, rt);  break;
+                case LIR_gtui: case LIR_gtuq:   CMOVNBE(rr, rt);  break;
+                case LIR_leui: case LIR_leuq:   CMOVNA( rr, rt);  break;
+                case LIR_geui: case LIR_geuq:   CMOVNB( rr, rt);  break;
+                default:                        NanoAssert(0);    break;
+                }
+                LEALRM(rt, isSub ? -1 : 1, rr);
+            }
+        }
+        if (rr != rx)
+            MR(rr, rx);
+
+        freeResourcesOf(ins);
+        if (!x->isInReg()) {
+            NanoAssert(rx == rr);
+            findSpecificRegForUnallocated(x, rr);
+        }
+
+        if (imm) {
+            if (condQ) {
+                if (isS8(k)) CMPQR8(ra, k); else CMPQRI(ra, k);
+            } else {
+                if (isS8(k)) CMPLR8(ra, k); else CMPLRI(ra, k);
+            }
+        } else {
+            Register l = swap ? rb : ra;
+            Register r = swap ? ra : rb;
+            if (condQ) CMPQR(l, r); else CMPLR(l, r);
+        }
+        return true;
+    }
+
     // binary op with integer registers
     void Assembler::asm_arith(LIns *ins) {
         Register rr, ra, rb = UnspecifiedReg;   // init to shut GCC up
@@ -1087,6 +1337,21 @@ namespace nanojit
             // asm_divq_modq() rather than here.
             asm_divq(ins);
             return;
+        case LIR_mulhuq:
+        case LIR_mulhq:
+            asm_mulh(ins);
+            return;
+        case LIR_crc32ci:
+        case LIR_crc32cq:
+            asm_crc32c(ins);
+            return;
+        case LIR_addi:
+        case LIR_subi:
+        case LIR_addq:
+        case LIR_subq:
+            if (asm_arith_cond(ins))
+                return;
+            break;
         default:
             break;
         }
@@ -1122,7 +1387,9 @@ namespace nanojit
         case LIR_muli:
         case LIR_muljovi:
         case LIR_mulxovi:  IMUL(rr, rb);   break;
-        case LIR_mulq:     IMULQ(rr, rb);  break;
+        case LIR_mulq:
+        case LIR_muljovq:
+        case LIR_mulxovq:  IMULQ(rr, rb);  break;
         case LIR_xorq:     XORQRR(rr, rb); break;
         case LIR_orq:      ORQRR(rr, rb);  break;
         case LIR_andq:     ANDQRR(rr, rb); break;
@@ -1139,6 +1406,24 @@ namespace nanojit
 
     // Binary op with fp registers.
     void Assembler::asm_fop(LIns *ins) {
+        switch (ins->opcode()) {
+        case LIR_cmpgtf4:
+        case LIR_cmpgef4:
+        case LIR_cmpltf4:
+        case LIR_cmplef4:
+        case LIR_cmpeqf4:
+        case LIR_cmpnef4:
+            asm_cmpf4_lanes(ins);
+            return;
+        case LIR_dotf4:
+        case LIR_dotf3:
+        case LIR_dotf2:
+            asm_dotf4(ins);
+            return;
+        default:
+            break;
+        }
+
         Register rr, ra, rb = UnspecifiedReg;   // init to shut GCC up
         beginOp2Regs(ins, FpRegs, rr, ra, rb);
         switch (ins->opcode()) {
@@ -1155,6 +1440,12 @@ namespace nanojit
         case LIR_mulf4: MULPS(rr, rb); break;
         case LIR_addf4: ADDPS(rr, rb); break;
         case LIR_subf4: SUBPS(rr, rb); break;
+        case LIR_minf4: MINPS(rr, rb); break;
+        case LIR_maxf4: MAXPS(rr, rb); break;
+        case LIR_mind:  MINSD(rr, rb); break;
+        case LIR_maxd:  MAXSD(rr, rb); break;
+        case LIR_minf:  MINSS(rr, rb); break;
+        case LIR_maxf:  MAXSS(rr, rb); break;
         }
         if (rr != ra) {
             asm_nongp_copy(rr, ra);
@@ -1163,6 +1454,88 @@ namespace nanojit
         endOpRegs(ins, rr, ra);
     }
 
+    // Lane-wise float4 compares.  Each lane of the result is 1.0f where the
+    // comparison holds and 0.0f where it doesn't, as on i386.
+    void Assembler::asm_cmpf4_lanes(LIns *ins) {
+        LOpcode op = ins->opcode();
+        LIns *a = ins->oprnd1();
+        LIns *b = ins->oprnd2();
+
+        // SSE has no greater-than predicates, so a > b is computed as b < a.
+        if (op == LIR_cmpgtf4 || op == LIR_cmpgef4) {
+            LIns *t = a;
+            a = b;
+            b = t;
+        }
+
+        RegisterMask allow = FpRegs;
+        Register rb = UnspecifiedReg;
+        if (a != b) {
+            rb = findRegFor(b, allow);
+            allow &= ~rmask(rb);
+        }
+        Register rr = prepareResultReg(ins, allow);
+
+        // If 'a' isn't in a register, it can be clobbered by 'ins'.
+        Register ra = a->isInReg() ? a->getReg() : rr;
+        if (a == b)
+            rb = ra;
+
+        int pred;
+        switch (op) {
+        default:          NanoAssert(!"bad opcode for asm_cmpf4_lanes"); pred = 0; break;
+        case LIR_cmpeqf4: pred = 0; break;
+        case LIR_cmpgtf4:
+        case LIR_cmpltf4: pred = 1; break;
+        case LIR_cmpgef4:
+        case LIR_cmplef4: pred = 2; break;
+        case LIR_cmpnef4: pred = 4; break;
+        }
+
+        // CMPPS leaves an all-ones or all-zeroes mask in each lane;  and it
+        // with 1.0f to get the result.
+        float4_t ones = { 1.0f, 1.0f, 1.0f, 1.0f };
+        Register rt = _allocator.allocTempReg(FpRegs & ~(rmask(rr)|rmask(ra)|rmask(rb)));
+        ANDPS(rr, rt);
+        asm_immf4(rt, ones, /*canClobberCCs*/true, /*blind*/false);
+        CMPPS(rr, rb, pred);
+        if (rr != ra)
+            asm_nongp_copy(rr, ra);
+
+        freeResourcesOf(ins);
+        if (!a->isInReg()) {
+            NanoAssert(ra == rr);
+            findSpecificRegForUnallocated(a, ra);
+        }
+    }
+
+    // dotf4/dotf3/dotf2.  DPPS does it in one instruction with SSE4.1;
+    // otherwise multiply lane-wise and add the products into the low lane.
+    void Assembler::asm_dotf4(LIns *ins) {
+        LOpcode op = ins->opcode();
+        int lanes = op == LIR_dotf4 ? 4 : op == LIR_dotf3 ? 3 : 2;
+        Register rr, ra, rb = UnspecifiedReg;   // init to shut GCC up
+        beginOp2Regs(ins, FpRegs, rr, ra, rb);
+
+        if (_config.i386_sse41) {
+            // High nibble selects the lanes to multiply, low nibble the
+            // lane that receives the sum.
+            static const uint8_t masks[] = { /*dot4*/0xF1, /*dot3*/0x71, /*dot2*/0x31 };
+            DPPS(rr, rb, masks[4 - lanes]);
+        } else {
+            Register rt = _allocator.allocTempReg(FpRegs & ~(rmask(rr)|rmask(ra)|rmask(rb)));
+            for (int i = lanes - 1; i > 0; i--) {
+                ADDSS(rr, rt);
+                PSHUFD(rt, rr, PSHUFD_MASK(i, i, i, i));
+            }
+            MULPS(rr, rb);
+        }
+        if (rr != ra)
+            asm_nongp_copy(rr, ra);
+
+        endOpRegs(ins, rr, ra);
+    }
+
     void Assembler::asm_neg_not(LIns *ins) {
         Register rr, ra;
         beginOp1Regs(ins, GpRegs, rr, ra);
@@ -1203,11 +1576,20 @@ namespace nanojit
             NIns *target = (NIns*)call->_address;
             if (isTargetWithinS32(target)) {
                 CALL(8, target);
+            } else if (_callSites) {
+                // A fixed sequence that patchCall() can retarget.
+                underrunProtect(2+16);  // call rax, movq rax, imm64
+                CALLRAX();
+                MOVQI(RAX, (uint64_t)target);
             } else {
                 // can't reach target from here, load imm64 and do an indirect jump
                 CALLRAX();
                 asm_immq(RAX, (uint64_t)target, /*canClobberCCs*/true, /*blind*/false);
             }
+            if (_callSites) {
+                CallSite site = { call, _nIns };
+                _callSites->add(site);
+            }
             // Call this now so that the arg setup can involve 'rr'.
             freeResourcesOf(ins);
         } else {
@@ -1355,6 +1737,446 @@ namespace nanojit
         }
     }
 
+    // Blocks of up to this many bytes with a constant length are copied,
+    // filled or compared inline.
+    static const int32_t MaxInlineBlock = 64;
+
+    // Splits a block of 'n' bytes into chunks of at most 'widest' bytes.  All
+    // chunks have the same size;  if that doesn't divide 'n' the last chunk
+    // overlaps the one before it.  Returns the number of chunks.
+    static int blockChunks(int32_t n, int32_t widest, int32_t offs[], int32_t sizes[])
+    {
+        NanoAssert(n >= 0 && n <= MaxInlineBlock);
+        if (n == 0)
+            return 0;
+        int32_t size = widest;
+        while (size > n)
+            size >>= 1;
+        int k = 0;
+        for (int32_t off = 0; off + size <= n; off += size) {
+            offs[k] = off;
+            sizes[k++] = size;
+        }
+        if (n % size != 0) {
+            offs[k] = n - size;
+            sizes[k++] = size;
+        }
+        return k;
+    }
+
+    void Assembler::asm_blockmem(LIns *ins) {
+        static const ArgType argTypes[] = { ARGTYPE_Q, ARGTYPE_Q, ARGTYPE_Q };
+        static const ArgType fillArgTypes[] = { ARGTYPE_Q, ARGTYPE_I, ARGTYPE_Q };
+
+        LOpcode op = ins->opcode();
+        LIns* len = ins->oprnd3();
+        if (op == LIR_findb || op == LIR_findanyb) {
+            asm_findb(ins);
+        } else if (len->isImmQ() && uint64_t(len->immQ()) <= uint64_t(MaxInlineBlock)) {
+            asm_blockmem_inline(ins, int32_t(len->immQ()));
+        } else if (len->isImmQ() && _config.i386_erms && op != LIR_cmpb) {
+            asm_blockmem_rep(ins, len->immQ());
+        } else {
+            NIns *target = (NIns*)(op == LIR_copyb ? (intptr_t)&::memcpy :
+                                   op == LIR_fillb ? (intptr_t)&::memset :
+                                                     (intptr_t)&::memcmp);
+            asm_helper_call(ins, target, 3, op == LIR_fillb ? fillArgTypes : argTypes);
+        }
+    }
+
+    void Assembler::asm_blockmem_inline(LIns *ins, int32_t n) {
+        LIns* a = ins->oprnd1();
+        LIns* b = ins->oprnd2();
+        int32_t offs[MaxInlineBlock / 8];
+        int32_t sizes[MaxInlineBlock / 8];
+
+        switch (ins->opcode()) {
+        case LIR_copyb: {
+            int count = blockChunks(n, 16, offs, sizes);
+            if (count == 0)
+                break;
+            Register rd, rs;
+            findRegFor2(BaseRegs, a, rd, BaseRegs, b, rs);
+            Register gt = _allocator.allocTempReg(SingleByteStoreRegs & ~rmask(rd) & ~rmask(rs));
+            Register xt = n >= 16 ? _allocator.allocTempReg(FpRegs) : UnspecifiedReg;
+            // Each chunk is loaded from the source and stored to the
+            // destination;  we emit backwards, so the store comes first.
+            for (int i = count; i-- > 0; ) {
+                int32_t d = offs[i];
+                switch (sizes[i]) {
+                case 16: MOVUPSMR(xt, d, rd); MOVUPSRM(xt, d, rs); break;
+                case 8:  MOVQMR(gt, d, rd);   MOVQRM(gt, d, rs);   break;
+                case 4:  MOVLMR(gt, d, rd);   MOVLRM(gt, d, rs);   break;
+                case 2:  MOVSMR(gt, d, rd);   MOVZX16M(gt, d, rs); break;
+                default: MOVBMR(gt, d, rd);   MOVZX8M(gt, d, rs);  break;
+                }
+            }
+            break;
+        }
+        case LIR_fillb: {
+            int count = blockChunks(n, 16, offs, sizes);
+            if (count == 0)
+                break;
+            Register rd, rb = UnspecifiedReg;
+            if (b->isImmI())
+                rd = findRegFor(a, BaseRegs);
+            else
+                findRegFor2(BaseRegs, a, rd, GpRegs, b, rb);
+            RegisterMask notOps = ~rmask(rd) & (b->isImmI() ? ~0 : ~rmask(rb));
+            Register gt = _allocator.allocTempReg(SingleByteStoreRegs & notOps);
+            Register xt = n >= 16 ? _allocator.allocTempReg(FpRegs) : UnspecifiedReg;
+            for (int i = count; i-- > 0; ) {
+                int32_t d = offs[i];
+                switch (sizes[i]) {
+                case 16: MOVUPSMR(xt, d, rd); break;
+                case 8:  MOVQMR(gt, d, rd);   break;
+                case 4:  MOVLMR(gt, d, rd);   break;
+                case 2:  MOVSMR(gt, d, rd);   break;
+                default: MOVBMR(gt, d, rd);   break;
+                }
+            }
+            // Replicate the byte into every byte of 'gt', and from there into
+            // every byte of 'xt' if there are 16-byte chunks.
+            const uint64_t ones = 0x0101010101010101ULL;
+            if (b->isImmI()) {
+                uint64_t pattern = uint64_t(uint8_t(b->immI())) * ones;
+                if (n >= 16 && pattern == 0) {
+                    XORPS(xt);
+                } else {
+                    if (n >= 16) {
+                        PSHUFD(xt, xt, PSHUFD_MASK(0, 1, 0, 1));
+                        MOVQXR(xt, gt);
+                    }
+                    asm_immq(gt, pattern, /*canClobberCCs*/true, b->isTainted());
+                }
+            } else {
+                if (n >= 16) {
+                    PSHUFD(xt, xt, PSHUFD_MASK(0, 1, 0, 1));
+                    MOVQXR(xt, gt);
+                }
+                Register kt = _allocator.allocTempReg(GpRegs & notOps & ~rmask(gt));
+                IMULQ(gt, kt);
+                asm_immq(kt, ones, /*canClobberCCs*/true, /*blind*/false);
+                MOVZX8(gt, rb);
+            }
+            break;
+        }
+        case LIR_cmpb: {
+            // Each chunk is loaded big-endian so that an unsigned compare
+            // orders it the way memcmp() would.  The first chunk that differs
+            // decides the result:  -1 if the borrow is set, otherwise 1.
+            //
+            //      xor rr, rr                  (only when n == 0)
+            //      <chunk>: load, bswap, cmp, jne diff
+            //      ...
+            //      xor rr, rr
+            //      jmp done
+            // diff:
+            //      sbb rr, rr
+            //      or rr, 1
+            // done:
+            Register rr = prepareResultReg(ins, GpRegs);
+            int count = blockChunks(n, 8, offs, sizes);
+            if (count == 0) {
+                XORRR(rr, rr);
+                freeResourcesOf(ins);
+                break;
+            }
+            Register ra, rb;
+            findRegFor2(BaseRegs & ~rmask(rr), a, ra, BaseRegs & ~rmask(rr), b, rb);
+            RegisterMask notOps = ~rmask(rr) & ~rmask(ra) & ~rmask(rb);
+            Register ta = _allocator.allocTempReg(GpRegs & notOps);
+            Register tb = _allocator.allocTempReg(GpRegs & notOps & ~rmask(ta));
+
+            // Keep the tail on one page so its short jump reaches.
+            underrunProtect(24);
+            NIns* done = _nIns;
+            ORLR8(rr, 1);
+            SBBRR(rr, rr);
+            NIns* diff = _nIns;
+            JMP8(8, done);
+            XORRR(rr, rr);
+            for (int i = count; i-- > 0; ) {
+                int32_t d = offs[i];
+                JNE(8, diff);
+                switch (sizes[i]) {
+                case 8:
+                    CMPQR(ta, tb);
+                    BSWAPQ(tb);
+                    BSWAPQ(ta);
+                    MOVQRM(tb, d, rb);
+                    MOVQRM(ta, d, ra);
+                    break;
+                case 4:
+                    CMPLR(ta, tb);
+                    BSWAP(tb);
+                    BSWAP(ta);
+                    MOVLRM(tb, d, rb);
+                    MOVLRM(ta, d, ra);
+                    break;
+                case 2:
+                    CMPLR(ta, tb);
+                    BSWAP(tb);
+                    BSWAP(ta);
+                    MOVZX16M(tb, d, rb);
+                    MOVZX16M(ta, d, ra);
+                    break;
+                default:
+                    CMPLR(ta, tb);
+                    MOVZX8M(tb, d, rb);
+                    MOVZX8M(ta, d, ra);
+                    break;
+                }
+            }
+            freeResourcesOf(ins);
+            break;
+        }
+        default:
+            NanoAssert(0);
+            break;
+        }
+    }
+
+    void Assembler::asm_blockmem_rep(LIns *ins, int64_t n) {
+        // 'rep movsb' copies RCX bytes from [RSI] to [RDI];  'rep stosb'
+        // stores AL into RCX bytes at [RDI].  All three are clobbered.
+        bool copy = ins->isop(LIR_copyb);
+        LIns* a = ins->oprnd1();
+        LIns* b = ins->oprnd2();
+        Register rsrc = copy ? RSI : RAX;
+        evictIfActive(RDI);
+        evictIfActive(rsrc);
+        evictIfActive(RCX);
+        RegisterMask allow = GpRegs & ~(rmask(RDI) | rmask(rsrc) | rmask(RCX));
+
+        Register rd, rb = UnspecifiedReg;
+        bool immByte = !copy && b->isImmI();
+        if (immByte)
+            rd = findRegFor(a, allow);
+        else
+            findRegFor2(allow, a, rd, allow, b, rb);
+
+        if (copy)
+            REP_MOVSB();
+        else
+            REP_STOSB();
+        asm_immq(RCX, uint64_t(n), /*canClobberCCs*/true, ins->oprnd3()->isTainted());
+        if (immByte)
+            asm_immi(RAX, b->immI(), /*canClobberCCs*/true, b->isTainted());
+        else
+            MR(rsrc, rb);
+        MR(RDI, rd);
+    }
+
+    // Scans [a, a+len) for the first byte in the needle set.  Whole 16-byte
+    // chunks are compared against every needle with pcmpeqb and the match
+    // bits collected with pmovmskb;  a last partial chunk is handled by
+    // rescanning the final 16 bytes, which is harmless because the bytes it
+    // repeats are already known not to match.  Ranges shorter than 16 bytes
+    // are scanned a byte at a time, so nothing outside the range is read.
+    //
+    //      mov rr, ra
+    //      mov re, ra
+    //      add re, rl
+    //      <rset = needle set>         (findb only)
+    //      cmpq rl, 16
+    //      jb small
+    //      <broadcast needles>
+    // loop:
+    //      <chunk at rr>
+    //      and rm, rm
+    //      jne found
+    //      addq rr, 16
+    //      leaq rm, 16(rr)
+    //      cmpq rm, re
+    //      jbe loop
+    //      cmpq rr, re
+    //      je done
+    //      leaq rr, -16(re)
+    //      <chunk at rr>
+    //      and rm, rm
+    //      jne found
+    //      mov rr, re
+    //      jmp done
+    // small:
+    //      cmpq rr, re
+    //      jae done
+    //      <rm = nonzero iff the byte at rr is in rset>
+    //      jne done
+    //      addq rr, 1
+    //      jmp small
+    // found:
+    //      bsfq rm, rm                 (tzcntq if BMI1 is available)
+    //      addq rr, rm
+    // done:
+    //      subq rr, ra
+    //
+    // The two backward branches are emitted with a zero offset and patched
+    // once the loop heads have been generated.
+    void Assembler::asm_findb(LIns *ins) {
+        bool any = ins->isop(LIR_findanyb);
+        Register rr = prepareResultReg(ins, BaseRegs);
+        Register ra, rl;
+        findRegFor2(GpRegs & ~rmask(rr), ins->oprnd1(), ra, GpRegs & ~rmask(rr), ins->oprnd3(), rl);
+        Register rb = findRegFor(ins->oprnd2(), GpRegs & ~rmask(rr) & ~rmask(ra) & ~rmask(rl));
+
+        RegisterMask notOps = ~rmask(rr) & ~rmask(ra) & ~rmask(rl) & ~rmask(rb);
+        Register re = _allocator.allocTempReg(BaseRegs & notOps);
+        Register rm = _allocator.allocTempReg(BaseRegs & notOps & ~rmask(re));
+        Register rt = _allocator.allocTempReg(GpRegs & notOps & ~rmask(re) & ~rmask(rm));
+        Register rset = any ? rb : _allocator.allocTempReg(GpRegs & notOps & ~rmask(re) & ~rmask(rm) & ~rmask(rt));
+
+        int nneedles = any ? 4 : 1;
+        Register xn[4];
+        RegisterMask xfree = FpRegs;
+        for (int i = 0; i < nneedles; i++) {
+            xn[i] = _allocator.allocTempReg(xfree);
+            xfree &= ~rmask(xn[i]);
+        }
+        Register xc = _allocator.allocTempReg(xfree);
+        xfree &= ~rmask(xc);
+        Register xd = UnspecifiedReg, xt = UnspecifiedReg;
+        if (any) {
+            xd = _allocator.allocTempReg(xfree);
+            xt = _allocator.allocTempReg(xfree & ~rmask(xd));
+        }
+
+        const int32_t ones = 0x01010101;
+
+        SUBQRR(rr, ra);
+        NIns* done = _nIns;
+        ADDQRR(rr, rm);
+        if (_config.i386_bmi1)
+            TZCNTQ(rm, rm);
+        else
+            BSFQ(rm, rm);
+        NIns* found = _nIns;
+
+        // The byte loop.  Replicating the byte and xor'ing it with the set
+        // leaves a zero byte exactly where the set holds that byte, and
+        // (x - 0x01010101) & ~x & 0x80808080 is nonzero iff x has one.
+        JMP32(8, 0);
+        NIns* smallBack = _nIns;
+        ADDQR8(rr, 1);
+        JNE(8, done);
+        ANDLRI(rm, int32_t(0x80808080));
+        ANDRR(rm, rt);
+        NOT(rm);
+        LEALRM(rt, -ones, rm);
+        XORRR(rm, rset);
+        IMULI(rm, rm, ones);
+        MOVZX8M(rm, 0, rr);
+        JAE(8, done);
+        CMPQR(rr, re);
+        NIns* small = _nIns;
+        nPatchBranch(smallBack, small);
+
+        // The final, possibly overlapping, chunk.
+        JMP32(8, done);
+        MR(rr, re);
+        JNE(8, found);
+        ANDRR(rm, rm);
+        asm_findb_chunk(any, rm, rr, xc, xd, xt, xn);
+        LEAQRM(rr, -16, re);
+        JE(8, done);
+        CMPQR(rr, re);
+
+        // The chunk loop.
+        JBE(8, 0);
+        NIns* loopBack = _nIns;
+        CMPQR(rm, re);
+        LEAQRM(rm, 16, rr);
+        ADDQR8(rr, 16);
+        JNE(8, found);
+        ANDRR(rm, rm);
+        asm_findb_chunk(any, rm, rr, xc, xd, xt, xn);
+        NIns* loop = _nIns;
+        nPatchBranch(loopBack, loop);
+
+        // Broadcast each needle byte into every lane of its register.
+        for (int i = nneedles; i-- > 0; ) {
+            PSHUFD(xn[i], xn[i], PSHUFD_MASK(0, 0, 0, 0));
+            if (!any) {
+                MOVDXR(xn[i], rset);
+            } else {
+                MOVDXR(xn[i], rt);
+                IMULI(rt, rt, ones);
+                if (i == 0) {
+                    MOVZX8(rt, rb);
+                } else {
+                    MOVZX8(rt, rt);
+                    SHRI(rt, 8 * i);
+                    MR(rt, rb);
+                }
+            }
+        }
+        JB(8, small);
+        CMPQR8(rl, 16);
+        if (!any) {
+            IMULI(rset, rset, ones);
+            MOVZX8(rset, rb);
+        }
+        ADDQRR(re, rl);
+        MR(re, ra);
+        MR(rr, ra);
+        freeResourcesOf(ins);
+    }
+
+    // Leaves in 'rm' a mask of the bytes of the 16-byte chunk at 'rp' that
+    // match any of the broadcast needles in 'xn'.
+    void Assembler::asm_findb_chunk(bool any, Register rm, Register rp, Register xc,
+                                    Register xd, Register xt, const Register xn[]) {
+        PMOVMSKB(rm, xc);
+        if (!any) {
+            PCMPEQB(xc, xn[0]);
+            MOVUPSRM(xc, 0, rp);
+            return;
+        }
+        for (int i = 3; i > 0; i--) {
+            POR(xc, xd);
+            PCMPEQB(xd, xt);
+            MOVAPSR(xd, xn[i]);
+        }
+        PCMPEQB(xc, xt);
+        MOVAPSR(xc, xn[0]);
+        MOVUPSRM(xt, 0, rp);
+    }
+
+    // Calls 'target' with the operands of 'ins' as its arguments, which
+    // must all go in GPRs.  Used for operations that have no inline
+    // expansion on this CPU.
+    void Assembler::asm_helper_call(LIns *ins, NIns *target, int argc, const ArgType argTypes[]) {
+        NanoAssert(argc <= 3);
+        if (!ins->isV()) {
+            prepareResultReg(ins, rmask(RAX));
+            evictScratchRegsExcept(rmask(RAX));
+        } else {
+            evictScratchRegsExcept(0);
+        }
+
+        if (isTargetWithinS32(target)) {
+            CALL(8, target);
+        } else {
+            CALLRAX();
+            asm_immq(RAX, (uint64_t)target, /*canClobberCCs*/true, /*blind*/false);
+        }
+        // Call this now so that the arg setup can involve 'rr'.
+        if (!ins->isV())
+            freeResourcesOf(ins);
+
+    #ifdef _WIN64
+        if (max_stk_used < 32)
+            max_stk_used = 32;  // always reserve 32byte shadow area
+    #endif
+        LIns* args[3] = { ins->oprnd1(), NULL, NULL };
+        if (argc > 1)
+            args[1] = ins->oprnd2();
+        if (argc > 2)
+            args[2] = ins->oprnd3();
+        for (int i = argc; i-- > 0; )
+            asm_regarg(argTypes[i], args[i], RegAlloc::argRegs[i]);
+    }
+
     void Assembler::asm_q2i(LIns *ins) {
         Register rr, ra;
         beginOp1Regs(ins, GpRegs, rr, ra);
@@ -1568,6 +2390,70 @@ namespace nanojit
         freeResourcesOf(ins);
     }
 
+    // Branchless select for cmovd/cmovf/cmovf4 whose condition is a double or
+    // float compare.  CMPSD/CMPSS turn the condition into an all-ones or
+    // all-zeroes mask, broadcast to the width of the result if need be, which
+    // then picks 'iftrue' or 'iffalse':  with BLENDVPS if the mask can go in
+    // XMM0, otherwise with ANDPS/ANDNPS/ORPS.  Like the compares, the mask is
+    // false for unordered operands.
+    void Assembler::asm_cmov_mask(LIns *ins) {
+        LIns* cond    = ins->oprnd1();
+        LIns* iftrue  = ins->oprnd2();
+        LIns* iffalse = ins->oprnd3();
+        LOpcode condop = cond->opcode();
+        bool singleCond = isCmpFOpcode(condop);
+        if (singleCond)
+            condop = getCmpDOpcode(condop);
+        LIns* a = cond->oprnd1();
+        LIns* b = cond->oprnd2();
+
+        // There are no greater-than predicates, so a > b is computed as b < a.
+        if (condop == LIR_gtd || condop == LIR_ged) {
+            LIns* t = a;
+            a = b;
+            b = t;
+        }
+        int pred = condop == LIR_eqd ? 0 : (condop == LIR_ltd || condop == LIR_gtd) ? 1 : 2;
+
+        // Every register but the result is read after the mask is written,
+        // so the mask gets a register of its own;  BLENDVPS wants it in XMM0.
+        bool blend = _config.i386_sse41;
+        RegisterMask allow = blend ? FpRegs & ~rmask(XMM0) : FpRegs;
+        Register rr = prepareResultReg(ins, allow);
+        RegisterMask used = rmask(rr);
+        Register rt = findRegFor(iftrue, allow & ~used);
+        used |= rmask(rt);
+        Register rf = iffalse == iftrue ? rt : findRegFor(iffalse, allow & ~used);
+        used |= rmask(rf);
+        Register ra = a == iftrue ? rt : a == iffalse ? rf : findRegFor(a, allow & ~used);
+        used |= rmask(ra);
+        Register rb = b == a ? ra : b == iftrue ? rt : b == iffalse ? rf : findRegFor(b, allow & ~used);
+        used |= rmask(rb);
+        Register rm = _allocator.allocTempReg(blend ? rmask(XMM0) : allow & ~used);
+
+        if (blend) {
+            BLENDVPS(rr, rt);
+            asm_nongp_copy(rr, rf);
+        } else {
+            ORPS(rr, rm);
+            ANDNPS(rm, rf);
+            ANDPS(rr, rm);
+            asm_nongp_copy(rr, rt);
+        }
+        // A float mask covers the low 32 bits only, a double one the low 64.
+        if (singleCond && !ins->isop(LIR_cmovf))
+            PSHUFD(rm, rm, PSHUFD_MASK(0, 0, 0, 0));
+        else if (!singleCond && ins->isop(LIR_cmovf4))
+            PSHUFD(rm, rm, PSHUFD_MASK(0, 1, 0, 1));
+        if (singleCond)
+            CMPSS(rm, rb, pred);
+        else
+            CMPSD(rm, rb, pred);
+        asm_nongp_copy(rm, ra);
+
+        freeResourcesOf(ins);
+    }
+
     void Assembler::asm_cmov(LIns *ins) {
         LIns* cond    = ins->oprnd1();
         LIns* iftrue  = ins->oprnd2();
@@ -1580,6 +2466,10 @@ namespace nanojit
                    (ins->isop(LIR_cmovd) && iftrue->isD() && iffalse->isD())  );
 
         bool isFloatOp = ins->isD() || ins->isF() || ins->isF4();
+        if (isFloatOp && (isCmpDOpcode(cond->opcode()) || isCmpFOpcode(cond->opcode()))) {
+            asm_cmov_mask(ins);
+            return;
+        }
         RegisterMask allow = isFloatOp ? FpRegs : GpRegs;
 
         Register rr = prepareResultReg(ins, allow);
@@ -2200,11 +3090,27 @@ namespace nanojit
     void Assembler::asm_cond(LIns *ins) {
         LOpcode op = ins->opcode();
 
+        // Find the compare's operands first, so that the result register
+        // can be one they aren't in.  It's then cleared ahead of the
+        // compare, which is cheaper than extending the SETcc result.
+        LIns *a = ins->oprnd1();
+        LIns *b = ins->oprnd2();
+        Register ra, rb;
+        RegisterMask allow = GpRegs;
+        if (isImm32(b) && !(b->isTainted() && shouldBlind(getImm32(b)))) {
+            ra = findRegFor(a, GpRegs);
+            allow &= ~rmask(ra);
+        } else if (a != b) {
+            findRegFor2(GpRegs, a, ra, GpRegs, b, rb);
+            allow &= ~rmask(ra) & ~rmask(rb);
+        } else {
+            ra = findRegFor(a, GpRegs);
+            allow &= ~rmask(ra);
+        }
+
         // unlike x86-32, with a rex prefix we can use any GP register as an 8bit target
-        Register r = prepareResultReg(ins, GpRegs);
+        Register r = prepareResultReg(ins, allow);
 
-        // SETcc only sets low 8 bits, so extend
-        MOVZX8(r, r);
         switch (op) {
         default:
             TODO(cond);
@@ -2227,9 +3133,14 @@ namespace nanojit
         case LIR_geuq:
         case LIR_geui:   SETAE(r);   break;
         }
-        freeResourcesOf(ins);
 
+        // The operands are in registers already, so this only emits the
+        // compare.
         asm_cmpi(ins);
+
+        // SETcc only sets low 8 bits, so clear the rest beforehand
+        XORRR(r, r);
+        freeResourcesOf(ins);
     }
 
     void Assembler::asm_ret(LIns *ins) {
@@ -2395,7 +3306,8 @@ namespace nanojit
                     int32_t d = int32_t(int64_t(vaddr)-int64_t(_nIns));
                     is_aligned? MOVAPSRMRIP(r, d):MOVUPSRMRIP(r, d);
                 } else {
-                    Register gp = _allocator.allocTempReg(GpRegs);
+                    // Not R12, which as a base needs a SIB byte.
+                    Register gp = _allocator.allocTempReg(BaseRegs);
                     is_aligned? MOVAPSRM(r, 0, gp): MOVUPSRM(r,0,gp);
                     asm_immq(gp, (uint64_t) vaddr, canClobberCCs, /*blind*/false);
                 }
@@ -2680,30 +3592,43 @@ namespace nanojit
     static const AVMPLUS_ALIGN16(int64_t) negateMaskD[]  = { 0x8000000000000000LL, 0 };
     static const AVMPLUS_ALIGN16(int32_t) negateMaskF[]  = { 0x80000000, 0, 0, 0 };
     static const AVMPLUS_ALIGN16(int32_t) negateMaskF4[] = { 0x80000000, 0x80000000, 0x80000000, 0x80000000 };
+    static const AVMPLUS_ALIGN16(int64_t) absMaskD[]     = { 0x7FFFFFFFFFFFFFFFLL, 0 };
+    static const AVMPLUS_ALIGN16(int32_t) absMaskF[]     = { 0x7FFFFFFF, 0, 0, 0 };
+    static const AVMPLUS_ALIGN16(int32_t) absMaskF4[]    = { 0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF };
 
+    // Negation flips the sign bit with XORPS, absolute value clears it with ANDPS.
     void Assembler::asm_neg_abs(LIns *ins) {
         Register rr, ra;
-        NanoAssert(ins->isop(LIR_negf) || ins->isop(LIR_negf4) || ins->isop(LIR_negd));
         beginOp1Regs(ins, FpRegs, rr, ra);
         uintptr_t mask;
+        bool isAbs = false;
 
         switch (ins->opcode()) {
         default: NanoAssert(!"bad opcode for asm_neg_abs"); mask = 0; break;
         case LIR_negf:    mask = (uintptr_t) negateMaskF;  break;
         case LIR_negf4:   mask = (uintptr_t) negateMaskF4; break;
         case LIR_negd:    mask = (uintptr_t) negateMaskD;     break;
+        case LIR_absf:    mask = (uintptr_t) absMaskF;  isAbs = true; break;
+        case LIR_absf4:   mask = (uintptr_t) absMaskF4; isAbs = true; break;
+        case LIR_absd:    mask = (uintptr_t) absMaskD;  isAbs = true; break;
         }
 
         if (isS32(mask)) {
             // builtin code is in bottom or top 2GB addr space, use absolute addressing
-            XORPSA(rr, (int32_t)mask);
+            if (isAbs)
+                ANDPSA(rr, (int32_t)mask);
+            else
+                XORPSA(rr, (int32_t)mask);
         } else if (isTargetWithinS32((NIns*)mask)) {
             // jit code is within +/-2GB of builtin code, use rip-relative
-            XORPSM(rr, (NIns*)mask);
+            if (isAbs)
+                ANDPSM(rr, (NIns*)mask);
+            else
+                XORPSM(rr, (NIns*)mask);
         } else {
             // This is just hideous - can't use RIP-relative load, can't use
             // absolute-address load, and cant move imm64 const to XMM.
-            // Solution: move negateMaskD into a temp GP register, then copy to
+            // Solution: move the mask into a temp GP register, then copy to
             // a temp XMM register.
             // Nb: we don't want any F64 values to end up in a GpReg, nor any
             // I64 values to end up in an FpReg.
@@ -2719,17 +3644,20 @@ namespace nanojit
             // But this is arguably dangerous (some called function may change in the future), 
             Register rt = _allocator.allocTempReg(FpRegs & ~(rmask(ra)|rmask(rr)));
             Register gt = _allocator.allocTempReg(GpRegs);
-            XORPS(rr, rt);
+            if (isAbs)
+                ANDPS(rr, rt);
+            else
+                XORPS(rr, rt);
 
-            if (ins->isop(LIR_negf) || ins->isop(LIR_negf4)) {
-                if (ins->isop(LIR_negf4))
+            if (ins->isF() || ins->isF4()) {
+                if (ins->isF4())
                     PSHUFD(rt,rt,PSHUFD_MASK(0, 0, 0, 0));    // copy mask in all 4 components of the float4 vector 
                 MOVDXR(rt, gt);
-                asm_immi(gt, negateMaskF[0], /*canClobberCCs*/true, /*blind*/false); 
+                asm_immi(gt, ((const int32_t*)mask)[0], /*canClobberCCs*/true, /*blind*/false); 
             } else {
-                // LIR_negd
+                // LIR_negd, LIR_absd
                 MOVQXR(rt, gt);
-                asm_immq(gt, negateMaskD[0], /*canClobberCCs*/true, /*blind*/false);
+                asm_immq(gt, ((const int64_t*)mask)[0], /*canClobberCCs*/true, /*blind*/false);
             }
         }
         if (ra != rr)
@@ -2737,8 +3665,23 @@ namespace nanojit
         endOpRegs(ins, rr, ra);
     }
 
-    void Assembler::asm_recip_sqrt(LIns*) {
-        NanoAssert(!"not implemented");
+    void Assembler::asm_recip_sqrt(LIns *ins) {
+        Register rr, ra;
+        beginOp1Regs(ins, FpRegs, rr, ra);
+
+        // These are all of the form R = (op) B, so no copy of 'ra' is needed.
+        // RCP and RSQRT are the hardware approximations (12 bits), as on i386.
+        switch (ins->opcode()) {
+        default:           NanoAssert(!"bad opcode for asm_recip_sqrt"); break;
+        case LIR_recipf:   RCPSS(rr, ra);   break;
+        case LIR_recipf4:  RCPPS(rr, ra);   break;
+        case LIR_rsqrtf:   RSQRTSS(rr, ra); break;
+        case LIR_rsqrtf4:  RSQRTPS(rr, ra); break;
+        case LIR_sqrtf:    SQRTSS(rr, ra);  break;
+        case LIR_sqrtf4:   SQRTPS(rr, ra);  break;
+        }
+
+        endOpRegs(ins, rr, ra);
     }
 
     void Assembler::asm_spill(Register rr, int d, int8_t nWords) {
@@ -2872,6 +3815,29 @@ namespace nanojit
         ((int32_t*)next)[-1] = int32_t(target - next);
     }
 
+    // Retarget a call recorded by asm_call().  A "movq rax, imm64; call rax"
+    // becomes a direct call, padded with a nop, if the target is near.
+    bool Assembler::patchCall(NIns *at, NIns *target) {
+        static const uint8_t nop7[] = { 0x0F, 0x1F, 0x80, 0, 0, 0, 0 };
+        NIns *next = at + 5;
+        if (at[0] == 0xE8) {
+            if (!isS32(target - next))
+                return false;
+            ((int32_t*)next)[-1] = int32_t(target - next);
+        } else {
+            NanoAssert(at[0] == 0x48 && at[1] == 0xB8 && at[10] == 0xFF && at[11] == 0xD0);
+            if (isS32(target - next) && !_config.force_long_branch) {
+                at[0] = 0xE8;
+                ((int32_t*)next)[-1] = int32_t(target - next);
+                memcpy(next, nop7, sizeof(nop7));
+            } else {
+                *((uint64_t*)(at + 2)) = uint64_t(target);
+            }
+        }
+        CodeAlloc::flushICache(at, 12);
+        return true;
+    }
+
     void Assembler::nFragExit(LIns *guard) {
         SideExit *exit = guard->record()->exit;
         Fragment *frag = exit->target;
@@ -35,6 +35,9 @@ namespace nanojit
 #define NJ_F2I_SUPPORTED                1
 #define NJ_SOFTFLOAT_SUPPORTED          0
 #define NJ_DIVI_SUPPORTED               1
+#define NJ_BLOCKMEM_SUPPORTED           1
+#define NJ_CRC32C_SUPPORTED             1
+#define NJ_MINMAX_SUPPORTED             1
 #define RA_PREFERS_LSREG                1
 #define NJ_USES_IMMF4_POOL              1   // Note: doesn't use IMMD pool!
 #define NJ_SAFEPOINT_POLLING_SUPPORTED  1
@@ -162,6 +165,8 @@ register number. The register bits are added by the code.
         X64_orqr8   = 0x00C8834800000004LL, // 64bit or  r |= int64(imm8)
         X64_xorqri  = 0xF081480000000003LL, // 64bit xor r ^= int64(immI)
         X64_xorqr8  = 0x00F0834800000004LL, // 64bit xor r ^= int64(imm8)
+        X64_adcqr8  = 0x00D0834800000004LL, // 64bit add with carry r += int64(imm8) + CF
+        X64_sbbqr8  = 0x00D8834800000004LL, // 64bit subtract with borrow r -= int64(imm8) + CF
         X64_addlri  = 0xC081400000000003LL, // 32bit add r += immI
         X64_addlr8  = 0x00C0834000000004LL, // 32bit add r += imm8
         X64_andlri  = 0xE081400000000003LL, // 32bit and r &= immI
@@ -172,14 +177,23 @@ register number. The register bits are added by the code.
         X64_sublr8  = 0x00E8834000000004LL, // 32bit sub r -= imm8
         X64_xorlri  = 0xF081400000000003LL, // 32bit xor r ^= immI
         X64_xorlr8  = 0x00F0834000000004LL, // 32bit xor r ^= imm8
+        X64_adclr8  = 0x00D0834000000004LL, // 32bit add with carry r += imm8 + CF
+        X64_sbblr8  = 0x00D8834000000004LL, // 32bit subtract with borrow r -= imm8 + CF
         X64_addrr   = 0xC003400000000003LL, // 32bit add r += b
         X64_andqrr  = 0xC023480000000003LL, // 64bit and r &= b
         X64_andrr   = 0xC023400000000003LL, // 32bit and r &= b
+        X64_bswap   = 0xC80F400000000003LL, // 32bit byte swap r
+        X64_bswapq  = 0xC80F480000000003LL, // 64bit byte swap r
         X64_call    = 0x00000000E8000005LL, // near call
+        X64_crc32   = 0xC0F1380F40F20006LL, // SSE4.2 crc32c r = crc32c(r, b), 32-bit b
+        X64_crc32q  = 0xC0F1380F48F20006LL, // SSE4.2 crc32c r = crc32c(r, b), 64-bit b
+        X64_bsfq    = 0xC0BC0F4800000004LL, // 64bit r = index of lowest set bit of b (b != 0)
+        X64_tzcntq  = 0xC0BC0F48F3000005LL, // BMI1 64bit r = count of trailing zero bits of b
         X64_callrax = 0xD0FF000000000002LL, // indirect call to addr in rax (no REX)
 		X64_cmovqno = 0xC0410F4800000004LL, // 64bit conditional mov if (no overflow) r = b
         X64_cmovqnae= 0xC0420F4800000004LL, // 64bit conditional mov if (uint <)  r = b
         X64_cmovqnb = 0xC0430F4800000004LL, // 64bit conditional mov if (uint >=) r = b
+        X64_cmovqe  = 0xC0440F4800000004LL, // 64bit conditional mov if (==)      r = b
         X64_cmovqne = 0xC0450F4800000004LL, // 64bit conditional mov if (c)       r = b
         X64_cmovqna = 0xC0460F4800000004LL, // 64bit conditional mov if (uint <=) r = b
         X64_cmovqnbe= 0xC0470F4800000004LL, // 64bit conditional mov if (uint >)  r = b
@@ -190,6 +204,7 @@ register number. The register bits are added by the code.
         X64_cmovno  = 0xC0410F4000000004LL, // 32bit conditional mov if (no overflow) r = b
         X64_cmovnae = 0xC0420F4000000004LL, // 32bit conditional mov if (uint <)  r = b
         X64_cmovnb  = 0xC0430F4000000004LL, // 32bit conditional mov if (uint >=) r = b
+        X64_cmove   = 0xC0440F4000000004LL, // 32bit conditional mov if (==)      r = b
         X64_cmovne  = 0xC0450F4000000004LL, // 32bit conditional mov if (c)       r = b
         X64_cmovna  = 0xC0460F4000000004LL, // 32bit conditional mov if (uint <=) r = b
         X64_cmovnbe = 0xC0470F4000000004LL, // 32bit conditional mov if (uint >)  r = b
@@ -200,6 +215,8 @@ register number. The register bits are added by the code.
         X64_cmplr   = 0xC03B400000000003LL, // 32bit compare r,b
         X64_cmpqr   = 0xC03B480000000003LL, // 64bit compare r,b
         X64_cmppsr  = 0xC0C20F4000000004LL, // 128bit compare r,b; requires an immediate to specify what kind of comparison
+        X64_cmpsd   = 0xC0C20F40F2000005LL, // scalar double compare r,b to an all-ones/all-zeroes mask; requires an immediate predicate
+        X64_cmpss   = 0xC0C20F40F3000005LL, // scalar single-precision compare r,b to a mask; requires an immediate predicate
         X64_cmplri  = 0xF881400000000003LL, // 32bit compare r,immI
         X64_cmpqri  = 0xF881480000000003LL, // 64bit compare r,int64(immI)
         X64_cmplr8  = 0x00F8834000000004LL, // 32bit compare r,imm8
@@ -223,12 +240,27 @@ register number. The register bits are added by the code.
         X64_divps   = 0xC05E0F4000000004LL, // divide float4 vector single-precision r[i] /= b[i]
         X64_mulps   = 0xC0590F4000000004LL, // multiply float4 vector single-precision r[i] *= b[i]
         X64_addps   = 0xC0580F4000000004LL, // add float4 vector single-precision r[i] += b[i]
+        X64_minps   = 0xC05D0F4000000004LL, // minimum float4 vector single-precision r[i] = min(r[i],b[i])
+        X64_maxps   = 0xC05F0F4000000004LL, // maximum float4 vector single-precision r[i] = max(r[i],b[i])
+        X64_minsd   = 0xC05D0F40F2000005LL, // minimum scalar double r = r < b ? r : b
+        X64_maxsd   = 0xC05F0F40F2000005LL, // maximum scalar double r = r > b ? r : b
+        X64_minss   = 0xC05D0F40F3000005LL, // minimum scalar single-precision r = r < b ? r : b
+        X64_maxss   = 0xC05F0F40F3000005LL, // maximum scalar single-precision r = r > b ? r : b
+        X64_sqrtps  = 0xC0510F4000000004LL, // square root float4 vector single-precision r[i] = sqrt(b[i])
+        X64_sqrtss  = 0xC0510F40F3000005LL, // square root scalar single-precision r = sqrt(b)
+        X64_rcpps   = 0xC0530F4000000004LL, // approximate reciprocal float4 vector r[i] = 1/b[i]
+        X64_rcpss   = 0xC0530F40F3000005LL, // approximate reciprocal scalar single-precision r = 1/b
+        X64_rsqrtps = 0xC0520F4000000004LL, // approximate reciprocal square root float4 vector r[i] = 1/sqrt(b[i])
+        X64_rsqrtss = 0xC0520F40F3000005LL, // approximate reciprocal square root scalar single-precision r = 1/sqrt(b)
+        X64_dpps    = 0xC0403A0F40660006LL, // SSE4.1 float4 dot product r = dot(r,b); requires an immediate lane mask
         X64_idiv    = 0xF8F7400000000003LL, // 32bit signed div (rax = rdx:rax/r, rdx=rdx:rax%r)
         X64_idivq   = 0xF8F7480000000003LL, // 64bit signed div (rax = rdx:rax/r, rdx=rdx:rax%r)
         X64_imul    = 0xC0AF0F4000000004LL, // 32bit signed mul r *= b
         X64_imulq   = 0xC0AF0F4800000004LL, // 64bit signed mul r *= b
         X64_imuli   = 0xC069400000000003LL, // 32bit signed mul r = b * immI
         X64_imulqi  = 0xC069480000000003LL, // 64bit signed mul r = b * immI
+        X64_mulq    = 0xE0F7480000000003LL, // 64bit unsigned mul (rdx:rax = rax * r)
+        X64_imulq1  = 0xE8F7480000000003LL, // 64bit signed mul (rdx:rax = rax * r)
         X64_imul8   = 0x00C06B4000000004LL, // 32bit signed mul r = b * imm8
         X64_jmpi    = 0x0000000025FF0006LL, // jump *0(rip)
         X64_jmp     = 0x00000000E9000005LL, // jump near rel32
@@ -289,6 +321,8 @@ register number. The register bits are added by the code.
         X64_movupsmr= 0x80110F4000000004LL, // 128bit store xmm-r -> [b+d32]
         X64_movlhps = 0xC0160F4000000004LL, // 64bit mov r[64:127] <- l[0:63] (the rest unmodified)
         X64_pmovmskb= 0xC0D70F4066000005LL, // move byte mask, r = (first bit from every byte of xmm)
+        X64_pcmpeqb = 0xC0740F4066000005LL, // 128bit r[i] = r[i] == b[i] ? 0xff : 0, per byte
+        X64_por     = 0xC0EB0F4066000005LL, // 128bit or xmm-r |= xmm-b
         X64_movsdrm = 0x80100F40F2000005LL, // 64bit load xmm-r <- [b+d32] (upper 64 cleared)
         X64_movsdmr = 0x80110F40F2000005LL, // 64bit store xmm-r -> [b+d32]
         X64_movssrm = 0x80100F40F3000005LL, // 32bit load xmm-r <- [b+d32] (upper 96 cleared)
@@ -319,7 +353,10 @@ register number. The register bits are added by the code.
         X64_pshufd  = 0xC0700F4066000005LL, // 64bit PSHUFD xmm1,xmm2,imm
         X64_shufpd  = 0xC0C60F4066000005LL, // 64bit SHUFPD xmm1,xmm2,imm
         X64_pxor    = 0xC0EF0F4066000005LL, // 128bit xor xmm-r ^= xmm-b
+        X64_repmovsb= 0xA4F3000000000002LL, // copy rcx bytes from [rsi] to [rdi]
+        X64_repstosb= 0xAAF3000000000002LL, // store al to rcx bytes at [rdi]
         X64_ret     = 0xC300000000000001LL, // near return from called procedure
+        X64_sbbrr   = 0xC01B400000000003LL, // 32bit subtract with borrow r -= b + CF
         X64_sete    = 0xC0940F4000000004LL, // set byte if equal (ZF == 1)
         X64_seto    = 0xC0900F4000000004LL, // set byte if overflow (OF == 1)
         X64_setc    = 0xC0920F4000000004LL, // set byte if carry (CF == 1)
@@ -356,8 +393,14 @@ register number. The register bits are added by the code.
         X64_xorrr   = 0xC033400000000003LL, // 32bit xor r &= b
         X64_xorpd   = 0xC0570F4066000005LL, // 128bit xor xmm (two packed doubles)
         X64_xorps   = 0xC0570F4000000004LL, // 128bit xor xmm (four packed singles), one byte shorter
+        X64_andps   = 0xC0540F4000000004LL, // 128bit and xmm (four packed singles)
+        X64_andnps  = 0xC0550F4000000004LL, // 128bit and-not xmm r = ~r & b
+        X64_orps    = 0xC0560F4000000004LL, // 128bit or xmm
+        X64_blendvps= 0xC014380F40660006LL, // SSE4.1 r = xmm0 sign bits ? b : r, per 32-bit lane
         X64_xorpsm  = 0x05570F4000000004LL, // 128bit xor xmm, [rip+disp32]
         X64_xorpsa  = 0x2504570F40000005LL, // 128bit xor xmm, [disp32]
+        X64_andpsm  = 0x05540F4000000004LL, // 128bit and xmm, [rip+disp32]
+        X64_andpsa  = 0x2504540F40000005LL, // 128bit and xmm, [disp32]
         X64_inclmRAX= 0x00FF000000000002LL, // incl (%rax)
         X64_jmpx    = 0xC524ff4000000004LL, // jmp [d32+x*8]
         X64_jmpxb   = 0xC024ff4000000004LL, // jmp [b+x*8]
@@ -430,6 +473,7 @@ register number. The register bits are added by the code.
         void MR(Register, Register);\
         void JMP(NIns*);\
         void JMPl(NIns*);\
+        bool patchCall(NIns* at, NIns* target);\
         void emit(uint64_t op);\
         void emit8(uint64_t op, int64_t val);\
         void emit_target8(size_t underrun, uint64_t op, NIns* target);\
@@ -486,6 +530,8 @@ register number. The register bits are added by the code.
         void asm_cmpi_imm(LIns*);\
         void asm_cmpd(LIns*);\
         void asm_cmpf4(LIns*);\
+        void asm_cmpf4_lanes(LIns*);\
+        void asm_dotf4(LIns*);\
         Branches asm_branch_helper(bool, LIns*, NIns*);\
         Branches asm_branchd_helper(bool, LIns*, NIns*);\
 		NIns* asm_branchi_S8(bool onFalse, LIns *cond, NIns *target);\
@@ -494,6 +540,15 @@ register number. The register bits are added by the code.
         void asm_div_mod(LIns *ins);\
         void asm_divq(LIns *ins);\
         void asm_divq_modq(LIns *ins);\
+        void asm_blockmem_inline(LIns *ins, int32_t n);\
+        void asm_blockmem_rep(LIns *ins, int64_t n);\
+        void asm_helper_call(LIns *ins, NIns *target, int argc, const ArgType argTypes[]);\
+        void asm_findb(LIns *ins);\
+        void asm_findb_chunk(bool any, Register rm, Register rp, Register xc, Register xd, Register xt, const Register xn[]);\
+        void asm_crc32c(LIns *ins);\
+        bool asm_arith_cond(LIns *ins);\
+        void asm_mulh(LIns *ins);\
+        void asm_cmov_mask(LIns *ins);\
         int max_stk_used;\
         void PUSHR(Register r);\
         void POPR(Register r);\
@@ -503,6 +558,8 @@ register number. The register bits are added by the code.
         void NEGQ(Register r);\
         void IDIV(Register r);\
         void IDIVQ(Register r);\
+        void MULQ(Register r);\
+        void IMULQ1(Register r);\
         void SHR(Register r);\
         void SAR(Register r);\
         void SHL(Register r);\
@@ -525,8 +582,17 @@ register number. The register bits are added by the code.
         void SETA(Register r);\
         void SETAE(Register r);\
         void SETO(Register r);\
+        void BSWAP(Register r);\
+        void BSWAPQ(Register r);\
+        void REP_MOVSB();\
+        void REP_STOSB();\
         void ADDRR(Register l, Register r);\
         void SUBRR(Register l, Register r);\
+        void SBBRR(Register l, Register r);\
+        void CRC32(Register l, Register r);\
+        void CRC32Q(Register l, Register r);\
+        void BSFQ(Register l, Register r);\
+        void TZCNTQ(Register l, Register r);\
         void ANDRR(Register l, Register r);\
         void ORLRR(Register l, Register r);\
         void XORRR(Register l, Register r);\
@@ -536,6 +602,8 @@ register number. The register bits are added by the code.
         void CMPNEQPS(Register l, Register r);\
         void MOVLR(Register l, Register r);\
         void PMOVMSKB(Register l, Register r);\
+        void PCMPEQB(Register l, Register r);\
+        void POR(Register l, Register r);\
         void ADDQRR(Register l, Register r);\
         void SUBQRR(Register l, Register r);\
         void ANDQRR(Register l, Register r);\
@@ -546,6 +614,7 @@ register number. The register bits are added by the code.
         void MOVAPSR(Register l, Register r);\
         void UNPCKLPS(Register l, Register r);\
         void CMOVNO(Register l, Register r);\
+        void CMOVE(Register l, Register r);\
         void CMOVNE(Register l, Register r);\
         void CMOVNL(Register l, Register r);\
         void CMOVNLE(Register l, Register r);\
@@ -556,6 +625,7 @@ register number. The register bits are added by the code.
         void CMOVNA(Register l, Register r);\
         void CMOVNAE(Register l, Register r);\
         void CMOVQNO(Register l, Register r);\
+        void CMOVQE(Register l, Register r);\
         void CMOVQNE(Register l, Register r);\
         void CMOVQNL(Register l, Register r);\
         void CMOVQNLE(Register l, Register r);\
@@ -581,6 +651,26 @@ register number. The register bits are added by the code.
         void MULPS(Register l, Register r);\
         void ADDPS(Register l, Register r);\
         void SUBPS(Register l, Register r);\
+        void MINPS(Register l, Register r);\
+        void MINSD(Register l, Register r);\
+        void MAXSD(Register l, Register r);\
+        void MINSS(Register l, Register r);\
+        void MAXSS(Register l, Register r);\
+        void MAXPS(Register l, Register r);\
+        void SQRTPS(Register l, Register r);\
+        void SQRTSS(Register l, Register r);\
+        void RCPPS(Register l, Register r);\
+        void RCPSS(Register l, Register r);\
+        void RSQRTPS(Register l, Register r);\
+        void RSQRTSS(Register l, Register r);\
+        void ANDPS(Register l, Register r);\
+        void ANDNPS(Register l, Register r);\
+        void ORPS(Register l, Register r);\
+        void BLENDVPS(Register l, Register r);\
+        void CMPPS(Register l, Register r, int pred);\
+        void CMPSD(Register l, Register r, int pred);\
+        void CMPSS(Register l, Register r, int pred);\
+        void DPPS(Register l, Register r, int mask);\
         void CVTSQ2SD(Register l, Register r);\
         void CVTSI2SD(Register l, Register r);\
         void CVTSS2SD(Register l, Register r);\
@@ -616,12 +706,16 @@ register number. The register bits are added by the code.
         void ANDLR8(Register r, int32_t i8);\
         void ORLR8(Register r, int32_t i8);\
         void XORLR8(Register r, int32_t i8);\
+        void ADCLR8(Register r, int32_t i8);\
+        void SBBLR8(Register r, int32_t i8);\
         void CMPLR8(Register r, int32_t i8);\
         void ADDQR8(Register r, int32_t i8);\
         void SUBQR8(Register r, int32_t i8);\
         void ANDQR8(Register r, int32_t i8);\
         void ORQR8(Register r, int32_t i8);\
         void XORQR8(Register r, int32_t i8);\
+        void ADCQR8(Register r, int32_t i8);\
+        void SBBQR8(Register r, int32_t i8);\
         void CMPQR8(Register r, int32_t i8);\
         void IMULI(Register l, Register r, int32_t i32);\
         void IMULQI(Register l, Register r, int32_t i32);\
@@ -706,6 +800,8 @@ register number. The register bits are added by the code.
         void MOVQSPX(int d, Register r);\
         void XORPSA(Register r, int32_t i32);\
         void XORPSM(Register r, NIns* a64);\
+        void ANDPSA(Register r, int32_t i32);\
+        void ANDPSM(Register r, NIns* a64);\
         void X86_AND8R(Register r);\
         void X86_SETNP(Register r);\
         void X86_SETE(Register r);\
@@ -0,0 +1,305 @@
+/* -*- Mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; tab-width: 4 -*- */
+/* vi: set ts=4 sw=4 expandtab: (add to ~/.vimrc: set modeline modelines=5) */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "nanojit.h"
+
+#ifdef AVMPLUS_LINUX
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+namespace nanojit
+{
+    #ifdef FEATURE_NANOJIT
+
+    // Sampling periods.  Odd values keep the samples from locking onto a
+    // loop whose trip length divides the period.
+    static const uint64_t hwPeriods[PERF_NUM_EVENTS] = { 100003, 100003, 1009, 1009 };
+    static const uint64_t softClockPeriod = 100000;     // ns, ie. 10kHz
+
+    // Number of data pages in each ring buffer;  must be a power of 2.
+    static const size_t dataPages = 64;
+
+    PerfSampler::PerfSampler(Allocator& alloc)
+        : alloc(alloc)
+        , entries(NULL), nentries(0), maxentries(0)
+        , ranges(NULL), nranges(0), maxranges(0)
+        , sorted(true)
+        , lost(0)
+        , opened(false)
+        , softClock(false)
+        , bufSize(0)
+    {
+        other.name = "[other]";
+        VMPI_memset(other.samples, 0, sizeof(other.samples));
+        for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+            fds[e] = -1;
+            bufs[e] = NULL;
+        }
+    }
+
+    PerfSampler::~PerfSampler()
+    {
+#ifdef AVMPLUS_LINUX
+        for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+            if (bufs[e])
+                munmap(bufs[e], bufSize);
+            if (fds[e] >= 0)
+                close(fds[e]);
+        }
+#endif
+    }
+
+    PerfSampler::Entry* PerfSampler::lookup(const char* name)
+    {
+        for (uint32_t i = 0; i < nentries; i++) {
+            if (VMPI_strcmp(entries[i]->name, name) == 0)
+                return entries[i];
+        }
+        if (nentries == maxentries) {
+            maxentries = maxentries ? 2 * maxentries : 16;
+            Entry** e = new (alloc) Entry*[maxentries];
+            if (nentries)
+                memcpy(e, entries, nentries * sizeof(Entry*));
+            entries = e;
+        }
+        Entry* e = new (alloc) Entry;
+        char* copy = new (alloc) char[VMPI_strlen(name) + 1];
+        VMPI_strcpy(copy, name);
+        e->name = copy;
+        VMPI_memset(e->samples, 0, sizeof(e->samples));
+        entries[nentries++] = e;
+        return e;
+    }
+
+    void PerfSampler::addRange(const char* name, const void* start, const void* end)
+    {
+        NanoAssert(uintptr_t(start) <= uintptr_t(end));
+        if (nranges == maxranges) {
+            maxranges = maxranges ? 2 * maxranges : 16;
+            Range* r = new (alloc) Range[maxranges];
+            if (nranges)
+                memcpy(r, ranges, nranges * sizeof(Range));
+            ranges = r;
+        }
+        Range& r = ranges[nranges++];
+        r.start = uintptr_t(start);
+        r.end = uintptr_t(end);
+        r.entry = lookup(name);
+        sorted = false;
+    }
+
+    void PerfSampler::addCode(const char* name, const CodeList* code)
+    {
+        for (CodeRange r(code); !r.empty(); r.popFront())
+            addRange(name, r.frontStart(), r.frontEnd());
+    }
+
+    PerfSampler::Entry* PerfSampler::find(uintptr_t ip)
+    {
+        if (!sorted) {
+            // Insertion sort;  ranges are mostly registered in address order.
+            for (uint32_t i = 1; i < nranges; i++) {
+                Range r = ranges[i];
+                uint32_t j = i;
+                for (; j > 0 && ranges[j-1].start > r.start; j--)
+                    ranges[j] = ranges[j-1];
+                ranges[j] = r;
+            }
+            sorted = true;
+        }
+        uint32_t lo = 0, hi = nranges;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (ip < ranges[mid].start)
+                hi = mid;
+            else if (ip >= ranges[mid].end)
+                lo = mid + 1;
+            else
+                return ranges[mid].entry;
+        }
+        return &other;
+    }
+
+    uint64_t PerfSampler::period(PerfEvent e) const
+    {
+        return (e == PERF_CYCLES && softClock) ? softClockPeriod : hwPeriods[e];
+    }
+
+    const char* PerfSampler::eventName(PerfEvent e, bool softClock)
+    {
+        static const char* names[PERF_NUM_EVENTS] = {
+            "cycles", "instructions", "branch-misses", "cache-misses"
+        };
+        return (e == PERF_CYCLES && softClock) ? "cpu-clock" : names[e];
+    }
+
+#ifdef AVMPLUS_LINUX
+    static int perfEventOpen(uint32_t type, uint64_t config, uint64_t period)
+    {
+        struct perf_event_attr attr;
+        VMPI_memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.sample_period = period;
+        attr.sample_type = PERF_SAMPLE_IP;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // this thread, any cpu, no group
+        return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    bool PerfSampler::open()
+    {
+        static const uint64_t hwConfigs[PERF_NUM_EVENTS] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_BRANCH_MISSES,
+            PERF_COUNT_HW_CACHE_MISSES
+        };
+
+        opened = true;
+        bufSize = (1 + dataPages) * VMPI_getVMPageSize();
+        bool any = false;
+        for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+            int fd = perfEventOpen(PERF_TYPE_HARDWARE, hwConfigs[e], hwPeriods[e]);
+            if (fd < 0 && e == PERF_CYCLES) {
+                fd = perfEventOpen(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK, softClockPeriod);
+                softClock = fd >= 0;
+            }
+            if (fd < 0)
+                continue;
+            void* buf = mmap(NULL, bufSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (buf == MAP_FAILED) {
+                close(fd);
+                if (e == PERF_CYCLES)
+                    softClock = false;
+                continue;
+            }
+            fds[e] = fd;
+            bufs[e] = buf;
+            any = true;
+        }
+        return any;
+    }
+
+    // Copy 'len' bytes at ring offset 'pos' out of a ring of 'size' bytes.
+    static void ringCopy(void* dst, const uint8_t* ring, uint64_t size, uint64_t pos, size_t len)
+    {
+        uint8_t* d = (uint8_t*) dst;
+        for (size_t i = 0; i < len; i++)
+            d[i] = ring[(pos + i) & (size - 1)];
+    }
+
+    void PerfSampler::drain(int e)
+    {
+        struct perf_event_mmap_page* meta = (struct perf_event_mmap_page*) bufs[e];
+        const uint8_t* ring = (const uint8_t*) bufs[e] + VMPI_getVMPageSize();
+        uint64_t size = bufSize - VMPI_getVMPageSize();
+
+        uint64_t head = meta->data_head;
+        __sync_synchronize();   // read the data only after data_head
+        uint64_t tail = meta->data_tail;
+        while (tail < head) {
+            struct perf_event_header hdr;
+            ringCopy(&hdr, ring, size, tail, sizeof(hdr));
+            if (hdr.size == 0)
+                break;
+            if (hdr.type == PERF_RECORD_SAMPLE) {
+                uint64_t ip;
+                ringCopy(&ip, ring, size, tail + sizeof(hdr), sizeof(ip));
+                find(uintptr_t(ip))->samples[e]++;
+            } else if (hdr.type == PERF_RECORD_LOST) {
+                uint64_t idAndLost[2];
+                ringCopy(idAndLost, ring, size, tail + sizeof(hdr), sizeof(idAndLost));
+                lost += idAndLost[1];
+            }
+            tail += hdr.size;
+        }
+        __sync_synchronize();   // finish reading before releasing the space
+        meta->data_tail = tail;
+    }
+
+    bool PerfSampler::start()
+    {
+        if (!opened && !open())
+            return false;
+        bool any = false;
+        for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+            if (fds[e] >= 0) {
+                ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+                any = true;
+            }
+        }
+        return any;
+    }
+
+    void PerfSampler::stop()
+    {
+        for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+            if (fds[e] >= 0) {
+                ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+                drain(e);
+            }
+        }
+    }
+#else
+    bool PerfSampler::open()
+    {
+        opened = true;
+        return false;
+    }
+
+    void PerfSampler::drain(int)
+    {}
+
+    bool PerfSampler::start()
+    {
+        return false;
+    }
+
+    void PerfSampler::stop()
+    {}
+#endif // AVMPLUS_LINUX
+
+    uint64_t PerfSampler::samples(const char* name, PerfEvent e)
+    {
+        if (VMPI_strcmp(name, other.name) == 0)
+            return other.samples[e];
+        for (uint32_t i = 0; i < nentries; i++) {
+            if (VMPI_strcmp(entries[i]->name, name) == 0)
+                return entries[i]->samples[e];
+        }
+        return 0;
+    }
+
+    void PerfSampler::dump(FILE* f)
+    {
+        fprintf(f, "region");
+        for (int e = 0; e < PERF_NUM_EVENTS; e++)
+            fprintf(f, " %s/%llu", eventName(PerfEvent(e), softClock),
+                    (unsigned long long) period(PerfEvent(e)));
+        fprintf(f, "\n");
+        for (uint32_t i = 0; i <= nentries; i++) {
+            Entry* entry = i < nentries ? entries[i] : &other;
+            fprintf(f, "%s", entry->name);
+            for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+                if (fds[e] >= 0)
+                    fprintf(f, " %llu", (unsigned long long) entry->samples[e]);
+                else
+                    fprintf(f, " -");
+            }
+            fprintf(f, "\n");
+        }
+        if (lost)
+            fprintf(f, "lost %llu\n", (unsigned long long) lost);
+    }
+
+    #endif // FEATURE_NANOJIT
+}
@@ -0,0 +1,104 @@
+/* -*- Mode: C++; c-basic-offset: 4; indent-tabs-mode: nil; tab-width: 4 -*- */
+/* vi: set ts=4 sw=4 expandtab: (add to ~/.vimrc: set modeline modelines=5) */
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __nanojit_PerfSampler__
+#define __nanojit_PerfSampler__
+
+namespace nanojit
+{
+    enum PerfEvent {
+        PERF_CYCLES = 0,
+        PERF_INSTRUCTIONS,
+        PERF_BRANCH_MISSES,
+        PERF_CACHE_MISSES,
+        PERF_NUM_EVENTS
+    };
+
+    /**
+     * PerfSampler samples the instruction pointer of the running thread
+     * on hardware counter overflow (Linux perf_event_open) and attributes
+     * the samples to named regions of generated code, so that the cost of
+     * each compiled fragment can be measured without running perf.
+     *
+     * Every event samples independently, once every period(e) occurrences.
+     * If the cycle counter can't be opened (e.g. in a VM or container) the
+     * software cpu-clock is sampled in its place, once per period(e)
+     * nanoseconds;  the other events are then simply unavailable.
+     * Samples that hit no registered region are counted as "[other]".
+     *
+     * Code regions are registered with addCode(), normally straight after
+     * Assembler::compile() using Assembler::codeList.  Regions registered
+     * under the same name are reported together.  On platforms other
+     * than Linux start() always fails.
+     */
+    class PerfSampler
+    {
+        struct Entry {
+            const char* name;
+            uint64_t    samples[PERF_NUM_EVENTS];
+        };
+        struct Range {
+            uintptr_t   start;
+            uintptr_t   end;
+            Entry*      entry;
+        };
+
+        Allocator&  alloc;
+        Entry**     entries;
+        uint32_t    nentries, maxentries;
+        Range*      ranges;
+        uint32_t    nranges, maxranges;
+        bool        sorted;
+        Entry       other;
+        uint64_t    lost;
+
+        bool        opened;
+        bool        softClock;
+        int         fds[PERF_NUM_EVENTS];
+        void*       bufs[PERF_NUM_EVENTS];
+        size_t      bufSize;
+
+        Entry* lookup(const char* name);
+        Entry* find(uintptr_t ip);
+        bool open();
+        void drain(int e);
+
+    public:
+        PerfSampler(Allocator& alloc);
+        ~PerfSampler();
+
+        /** attribute samples in every block of 'code' to 'name' */
+        void addCode(const char* name, const CodeList* code);
+
+        /** attribute samples in [start, end) to 'name' */
+        void addRange(const char* name, const void* start, const void* end);
+
+        /** start (or resume) sampling;  returns false if no counter could be opened */
+        bool start();
+
+        /** stop sampling and attribute all samples gathered so far */
+        void stop();
+
+        /** true if event 'e' is being sampled */
+        bool isAvailable(PerfEvent e) const { return fds[e] >= 0; }
+
+        /** true if PERF_CYCLES is really the software cpu-clock */
+        bool usesSoftwareClock() const { return softClock; }
+
+        /** number of event occurrences (or nanoseconds) per sample */
+        uint64_t period(PerfEvent e) const;
+
+        /** samples of 'e' attributed to 'name', or 0 if the name is unknown */
+        uint64_t samples(const char* name, PerfEvent e);
+
+        /** print a per-region table of samples to 'f' */
+        void dump(FILE* f);
+
+        static const char* eventName(PerfEvent e, bool softClock);
+    };
+}
+
+#endif // __nanojit_PerfSampler__
@@ -355,6 +355,7 @@ namespace nanojit {
 #include "RegAlloc.h"
 #include "Fragmento.h"
 #include "Assembler.h"
+#include "PerfSampler.h"
 
 #endif // FEATURE_NANOJIT
 #endif // __nanojit_h__
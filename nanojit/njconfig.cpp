@@ -6,6 +6,12 @@
 
 #include "nanojit.h"
 
+#if defined(NANOJIT_X64) && defined(__GNUC__)
+#include <cpuid.h>
+#elif defined(NANOJIT_X64) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #ifdef FEATURE_NANOJIT
 
 namespace nanojit
@@ -55,11 +61,59 @@ namespace nanojit
     }
 #endif
 
+#ifdef NANOJIT_X64
+    // SSE2 and cmov are part of x86-64;  everything newer is detected.
+    static void setCpuFeatures(Config* config)
+    {
+        uint32_t ecx_flags = 0, ebx7_flags = 0;
+        bool osYmm = false;
+    #if defined __GNUC__
+        uint32_t eax, ebx, ecx, edx;
+        uint32_t maxLeaf = __get_cpuid_max(0, NULL);
+        __cpuid(1, eax, ebx, ecx_flags, edx);
+        if (maxLeaf >= 7)
+            __cpuid_count(7, 0, eax, ebx7_flags, ecx, edx);
+        if (ecx_flags & (1 << 27)) {        // OSXSAVE: xgetbv is usable
+            uint32_t xcr0, xcr0hi;
+            asm("xgetbv" : "=a" (xcr0), "=d" (xcr0hi) : "c" (0));
+            osYmm = (xcr0 & 6) == 6;
+        }
+    #elif defined _MSC_VER
+        int regs[4];
+        __cpuid(regs, 0);
+        int maxLeaf = regs[0];
+        __cpuid(regs, 1);
+        ecx_flags = regs[2];
+        if (maxLeaf >= 7) {
+            __cpuidex(regs, 7, 0);
+            ebx7_flags = regs[1];
+        }
+        if (ecx_flags & (1 << 27))
+            osYmm = (_xgetbv(0) & 6) == 6;
+    #endif
+
+        config->i386_sse2 = true;
+        config->i386_use_cmov = true;
+        config->i386_sse3 = (ecx_flags & (1 << 0)) != 0;
+        config->i386_sse41 = (ecx_flags & (1 << 19)) != 0;
+        config->i386_sse42 = (ecx_flags & (1 << 20)) != 0;
+        config->i386_popcnt = (ecx_flags & (1 << 23)) != 0;
+        // The VEX-encoded extensions also need the OS to save the ymm state.
+        config->i386_avx = osYmm && (ecx_flags & (1 << 28)) != 0;
+        config->i386_fma = config->i386_avx && (ecx_flags & (1 << 12)) != 0;
+        config->i386_avx2 = config->i386_avx && (ebx7_flags & (1 << 5)) != 0;
+        config->i386_bmi1 = (ebx7_flags & (1 << 3)) != 0;
+        config->i386_bmi2 = (ebx7_flags & (1 << 8)) != 0;
+        config->i386_erms = (ebx7_flags & (1 << 9)) != 0;
+    }
+#endif
+
     Config::Config()
     {
         VMPI_memset(this, 0, sizeof(*this));
 
         cseopt = true;
+        unroll_factor = 4;
         harden_function_alignment = false;
         harden_nop_insertion = false;
         harden_blind_constants = false;
@@ -71,7 +125,7 @@ namespace nanojit
         force_long_branch = false;
 #endif
 
-#ifdef NANOJIT_IA32
+#if defined(NANOJIT_IA32) || defined(NANOJIT_X64)
         setCpuFeatures(this);
 #endif
 
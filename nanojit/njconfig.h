@@ -40,6 +40,9 @@ namespace nanojit
         // ARM architecture to assume when generate instructions for (currently, 4 <= arm_arch <= 7)
         uint8_t arm_arch;
 
+        // How many copies of a loop's body LoopFilter unrolls it to;  0 or 1 for none.
+        uint8_t unroll_factor;
+
         // If true, use CSE.
         uint32_t cseopt:1;
 
@@ -49,12 +52,34 @@ namespace nanojit
         // Can we use SSE2 instructions? (x86-only)
         uint32_t i386_sse2:1;
 
-        // Can we use SSE3 instructions? (x86-only)
+        // Can we use SSE3 instructions? (x86 and x86-64)
         uint32_t i386_sse3:1;
 
-        // Can we use SSE4.1 instructions? (x86 only)
+        // Can we use SSE4.1 instructions? (x86 and x86-64)
         uint32_t i386_sse41:1;
 
+        // Can we use SSE4.2 instructions? (x86-64; not detected on x86)
+        uint32_t i386_sse42:1;
+
+        // Can we use AVX instructions, and does the OS save the ymm registers? (x86-64; not detected on x86)
+        uint32_t i386_avx:1;
+
+        // Can we use AVX2 instructions? (x86-64; not detected on x86)
+        uint32_t i386_avx2:1;
+
+        // Can we use BMI1 and BMI2 instructions? (x86-64; not detected on x86)
+        uint32_t i386_bmi1:1;
+        uint32_t i386_bmi2:1;
+
+        // Can we use FMA3 instructions? (x86-64; not detected on x86)
+        uint32_t i386_fma:1;
+
+        // Can we use popcnt? (x86-64; not detected on x86)
+        uint32_t i386_popcnt:1;
+
+        // Are 'rep movsb' and 'rep stosb' fast (ERMS)? (x86-64; not detected on x86)
+        uint32_t i386_erms:1;
+
         // Can we use cmov instructions? (x86-only)
         uint32_t i386_use_cmov:1;
 
@@ -1,9 +1,10 @@
 #include <nanojit.h>
 #include <nanojitextra.h>
 
+#include <chrono>
 #include <iostream>
-#include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #ifndef NANOJIT_64BIT
@@ -17,20 +18,52 @@ enum ReturnType {
   RT_QUAD = 2,
   RT_DOUBLE = 4,
   RT_FLOAT = 8,
+  RT_FLOAT4 = 16,
 };
 
-// We lump everything into a single access region for lirasm.
+// Each NJX memory region is an access region;  region 0 is the default.
 static const AccSet ACCSET_OTHER = (1 << 0);
-static const uint8_t LIRASM_NUM_USED_ACCS = 1;
+static const uint8_t LIRASM_NUM_USED_ACCS = NJXMaxRegions;
 
 typedef int32_t(FASTCALL *RetInt)();
 typedef int64_t(FASTCALL *RetQuad)();
 typedef double(FASTCALL *RetDouble)();
 typedef float(FASTCALL *RetFloat)();
+typedef NJXFloat4(FASTCALL *RetFloat4)();
+
+/**
+* The source of random numbers for JIT hardening, a xorshift generator.
+*/
+class HardeningNoise : public Noise {
+  uint32_t state_;
+
+public:
+  HardeningNoise(uint32_t seed) : state_(seed ? seed : 0x9E3779B9) {}
+  uint32_t getValue32() override {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return state_;
+  }
+  int32_t getValue(int32_t maxValue) override {
+    return int32_t(getValue32() % (uint32_t(maxValue) + 1));
+  }
+};
 
 struct Function {
   std::string name;
-  struct nanojit::CallInfo callInfo;
+  /**
+  * Shared by every call, so that CseFilter can recognise calls to the
+  * same pure function.
+  */
+  struct nanojit::CallInfo *callInfo;
+};
+
+/**
+* A side exit tagged with the id given to the guard that created it
+*/
+struct NJXSideExit : public nanojit::SideExit {
+  int32_t id;
 };
 
 class LirasmFragment {
@@ -40,14 +73,17 @@ public:
     RetQuad rquad;
     RetDouble rdouble;
     RetFloat rfloat;
+    RetFloat4 rfloat4;
   };
   ReturnType mReturnType;
   Fragment *fragptr;
   uint32_t typeSig;
 };
 
-typedef std::map<std::string, LirasmFragment> Fragments;
+typedef std::unordered_map<std::string, LirasmFragment> Fragments;
 typedef std::vector<Function> Functions;
+typedef std::unordered_map<std::string, NJXFunctionHandle> FunctionIndex;
+typedef std::unordered_map<const void *, int32_t> ExitIndex;
 
 // Equivalent to Lirasm
 class NanoJitContextImpl {
@@ -114,17 +150,40 @@ public:
   Assembler asm_;
 
   /**
-  * LirBuffer object to hold LIR instructions
+  * Prints LIR for the verbose output, shared by every function's LirBuffer
   */
-  LirBuffer *lirbuf_;
+  verbose_only(LInsPrinter *printer_;)
 
   // LogControl, a class for controlling and routing debug output
   LogControl logc_;
 
+  /**
+  * Registered C functions;  the handle of external_functions_[i] is i+1.
+  * external_function_index_ maps their names to their handles.
+  */
   Functions external_functions_;
+  FunctionIndex external_function_index_;
+
+  /**
+  * The guard records of the overflow guards, by which a taken exit
+  * returns, mapped to the ids of their exits
+  */
+  ExitIndex exit_ids_;
+
+  /**
+  * Samples hardware counters on request and attributes them to the
+  * compiled functions; every function's code is registered on finalize.
+  */
+  PerfSampler perf_;
+
+  /**
+  * Noise for the hardening options, only set up if one of them is on
+  */
+  HardeningNoise noise_;
+  uint32_t hardeningSeed_;
 
 public:
-  NanoJitContextImpl(bool verbose, Config config);
+  NanoJitContextImpl(bool verbose, Config config, uint32_t hardeningSeed = 0);
   ~NanoJitContextImpl();
 
   LirasmFragment *get_fragment(const char *name);
@@ -135,12 +194,37 @@ public:
   // Returns 2 if internal
   int lookupFunction(const std::string &name, CallInfo *&ci);
 
+  // Returns the handle of an external function, 0 if not found
+  NJXFunctionHandle functionHandle(const std::string &name) const {
+    FunctionIndex::const_iterator i = external_function_index_.find(name);
+    return i == external_function_index_.end() ? 0 : i->second;
+  }
+
+  // Returns the CallInfo of an external function, nullptr if the handle
+  // is invalid
+  CallInfo *functionCallInfo(NJXFunctionHandle handle) const {
+    if (handle == 0 || handle > external_functions_.size())
+      return nullptr;
+    return external_functions_[handle - 1].callInfo;
+  }
+
+  // Returns the id of the exit whose guard record is 'rec', -1 if 'rec'
+  // isn't the guard record of an overflow guard
+  int32_t exitId(const void *rec) const {
+    ExitIndex::const_iterator i = exit_ids_.find(rec);
+    return i == exit_ids_.end() ? -1 : i->second;
+  }
+
   // Register an external function - assumed to be C calling
-  // convention
-  bool registerFunction(const std::string &name, void *fptr, ArgType retval,
-                        const ArgType *args, int argc);
+  // convention;  returns its handle or 0
+  NJXFunctionHandle registerFunction(const std::string &name, void *fptr, ArgType retval,
+                        const ArgType *args, int argc,
+                        NJXFunctionEffects effects = NJX_EFFECTS_ANY,
+                        uint32_t storeRegions = 0);
 };
 
+class ModuleImpl;
+
 /**
 * Assembles a fragment - the fragment is saved in the parent Jit object by name.
 * A fragment can be thought of as a function, at least that is how we use it
@@ -160,7 +244,10 @@ private:
   */
   Fragment *fragment_;
 
-  bool optimize_;
+  /**
+  * The optional passes to run, see NJXPass
+  */
+  uint32_t passes_;
 
   LirWriter *lir_;
 
@@ -181,6 +268,9 @@ private:
 
   LirWriter *exprFilter_;
 
+  LirWriter *slotFilter_;
+  LirWriter *loopFilter_;
+
   LirWriter *verboseWriter_;
 
   LirWriter *validateWriter1_;
@@ -197,13 +287,61 @@ private:
 
   LIns *params_[MAXARGS];
 
+  /**
+  * Access region of loads and stores, see NJX_set_region()
+  */
+  AccSet accSet_;
+
+  /**
+  * The module this function belongs to, if any, and the indexes in it of
+  * the functions of that module it calls, see ModuleImpl
+  */
+  ModuleImpl *module_;
+  std::vector<size_t> moduleCalls_;
+
+  /**
+  * A variable of the structured control flow builders, see NJX_var(). It
+  * lives in a stack slot, but 'value' holds its value within a block, so
+  * that it is loaded at most once per block and stored only at the end of
+  * a block that changed it.
+  */
+  struct Var {
+    LIns *slot;
+    LOpcode load, store, live;
+    LIns *value; // nullptr if it must be loaded
+    bool dirty;  // value is newer than the slot
+    bool read;   // value was used in the innermost loop
+    int depth;   // the loop depth at which it can be set
+  };
+  std::vector<Var> vars_;
+
+  /**
+  * An open loop or if, see NJX_loop_begin() and NJX_if()
+  */
+  struct Block {
+    bool loop;
+    bool hasElse;
+    LIns *head;                 // loop: the label branched back to
+    std::vector<LIns *> exits;  // the branches to the end, or to the else
+    std::vector<LIns *> saved;  // the values of the variables on entry
+    std::vector<LIns *> then;   // if: the values at the end of the then
+    std::vector<bool> read;     // loop: the read flags on entry
+    std::vector<int32_t> carried;
+  };
+  std::vector<Block> blocks_;
+  int loopDepth_;
+
+  void flushVars();
+  std::vector<LIns *> varValues() const;
+  void patchExits(Block &block, LIns *label);
+
 private:
   static uint32_t sProfId;
 
 public:
   FunctionBuilderImpl(NanoJitContextImpl &parent,
                       const std::string &fragmentName, ArgType rvalue,
-                      const ArgType *args, int argc, bool optimize);
+                      const ArgType *args, int argc, uint32_t passes);
   ~FunctionBuilderImpl();
 
   /**
@@ -226,6 +364,11 @@ public:
   */
   LIns *retq(LIns *result);
 
+  /**
+  * Adds a float4 return instruction.
+  */
+  LIns *retf4(LIns *result);
+
   /**
   * Add a void return - TODO check that LIR_x is the right instruction to emit
   */
@@ -250,6 +393,13 @@ public:
   * Creates a float constant
   */
   LIns *immf(float f) { return lir_->insImmF(f); }
+  LIns *immf4(float x, float y, float z, float w) {
+    // float4_t is either a struct or a vector type, four floats in both.
+    const float lanes[4] = {x, y, z, w};
+    float4_t f4;
+    memcpy(&f4, lanes, sizeof(f4));
+    return lir_->insImmF4(f4);
+  }
 
   /**
   * Adds a function parameter - the parameter size is always the
@@ -268,6 +418,21 @@ public:
   */
   LIns *addLabel() { return lir_->ins0(LIR_label); }
 
+  /**
+  * Set the access region of subsequent loads and stores
+  */
+  bool setRegion(int region) {
+    if (region < 0 || region >= NJXMaxRegions)
+      return false;
+    accSet_ = AccSet(1) << region;
+    return true;
+  }
+
+  /**
+  * Insert a register fence at current position
+  */
+  LIns *regFence() { return lir_->ins0(LIR_regfence); }
+
   /**
   * Allocate size bytes on the stack
   */
@@ -287,6 +452,33 @@ public:
   LIns *cbrFalse(LIns *cond, LIns *to) {
     return lir_->insBranch(LIR_jf, cond, to);
   }
+
+  /**
+  * Overflow-checked arithmetic that branches to 'to' on overflow
+  */
+  LIns *branchJov(LOpcode op, LIns *lhs, LIns *rhs, LIns *to) {
+    return lir_->insBranchJov(op, lhs, rhs, to);
+  }
+
+  /**
+  * Overflow-checked arithmetic that leaves the function through a side
+  * exit tagged with 'id' on overflow
+  */
+  LIns *guardXov(LOpcode op, LIns *lhs, LIns *rhs, int32_t id);
+
+  /**
+  * Structured control flow, see NJX_var(), NJX_loop_begin() and NJX_if()
+  */
+  int32_t var(LIns *initial);
+  LIns *getVar(int32_t var);
+  bool setVar(int32_t var, LIns *value);
+  bool loopBegin(const int32_t *carried, int ncarried);
+  bool breakIf(LIns *cond);
+  bool loopEnd();
+  bool ifBegin(LIns *cond);
+  bool ifElse();
+  bool ifEnd();
+
   LIns *jmpTable(LIns *index, uint32_t size) {
     return lir_->insJtbl(index, size);
   }
@@ -295,52 +487,83 @@ public:
   }
 
   LIns *loadc2i(LIns *ptr, int32_t offset) {
-    return lir_->insLoad(LIR_ldc2i, ptr, offset, ACCSET_OTHER);
+    return lir_->insLoad(LIR_ldc2i, ptr, offset, accSet_);
   }
   LIns *loaduc2ui(LIns *ptr, int32_t offset) {
-    return lir_->insLoad(LIR_lduc2ui, ptr, offset, ACCSET_OTHER);
+    return lir_->insLoad(LIR_lduc2ui, ptr, offset, accSet_);
   }
   LIns *loads2i(LIns *ptr, int32_t offset) {
-    return lir_->insLoad(LIR_lds2i, ptr, offset, ACCSET_OTHER);
+    return lir_->insLoad(LIR_lds2i, ptr, offset, accSet_);
   }
   LIns *loadus2ui(LIns *ptr, int32_t offset) {
-    return lir_->insLoad(LIR_ldus2ui, ptr, offset, ACCSET_OTHER);
+    return lir_->insLoad(LIR_ldus2ui, ptr, offset, accSet_);
   }
   LIns *loadi(LIns *ptr, int32_t offset) {
-    return lir_->insLoad(LIR_ldi, ptr, offset, ACCSET_OTHER);
+    return lir_->insLoad(LIR_ldi, ptr, offset, accSet_);
   }
   LIns *loadq(LIns *ptr, int32_t offset) {
-    return lir_->insLoad(LIR_ldq, ptr, offset, ACCSET_OTHER);
+    return lir_->insLoad(LIR_ldq, ptr, offset, accSet_);
   }
   LIns *loadf(LIns *ptr, int32_t offset) {
-    return lir_->insLoad(LIR_ldf, ptr, offset, ACCSET_OTHER);
+    return lir_->insLoad(LIR_ldf, ptr, offset, accSet_);
   }
   LIns *loadd(LIns *ptr, int32_t offset) {
-    return lir_->insLoad(LIR_ldd, ptr, offset, ACCSET_OTHER);
+    return lir_->insLoad(LIR_ldd, ptr, offset, accSet_);
   }
   LIns *loadf2d(LIns *ptr, int32_t offset) {
-    return lir_->insLoad(LIR_ldf2d, ptr, offset, ACCSET_OTHER);
+    return lir_->insLoad(LIR_ldf2d, ptr, offset, accSet_);
   }
 
   LIns *storei2c(LIns *value, LIns *ptr, int32_t offset) {
-    return lir_->insStore(LIR_sti2c, value, ptr, offset, ACCSET_OTHER);
+    return lir_->insStore(LIR_sti2c, value, ptr, offset, accSet_);
   }
   LIns *storei2s(LIns *value, LIns *ptr, int32_t offset) {
-    return lir_->insStore(LIR_sti2s, value, ptr, offset, ACCSET_OTHER);
+    return lir_->insStore(LIR_sti2s, value, ptr, offset, accSet_);
   }
   LIns *storei(LIns *value, LIns *ptr, int32_t offset) {
-    return lir_->insStore(LIR_sti, value, ptr, offset, ACCSET_OTHER);
+    return lir_->insStore(LIR_sti, value, ptr, offset, accSet_);
   }
   LIns *storeq(LIns *value, LIns *ptr, int32_t offset) {
-    return lir_->insStore(LIR_stq, value, ptr, offset, ACCSET_OTHER);
+    return lir_->insStore(LIR_stq, value, ptr, offset, accSet_);
   }
   LIns *stored(LIns *value, LIns *ptr, int32_t offset) {
-    return lir_->insStore(LIR_std, value, ptr, offset, ACCSET_OTHER);
+    return lir_->insStore(LIR_std, value, ptr, offset, accSet_);
   }
   LIns *storef(LIns *value, LIns *ptr, int32_t offset) {
-    return lir_->insStore(LIR_stf, value, ptr, offset, ACCSET_OTHER);
+    return lir_->insStore(LIR_stf, value, ptr, offset, accSet_);
+  }
+  LIns *copyb(LIns *dest, LIns *src, LIns *len) {
+    return lir_->insMem(LIR_copyb, dest, src, len, accSet_);
+  }
+  LIns *fillb(LIns *dest, LIns *byte, LIns *len) {
+    return lir_->insMem(LIR_fillb, dest, byte, len, accSet_);
+  }
+  LIns *cmpb(LIns *a, LIns *b, LIns *len) {
+    return lir_->insMem(LIR_cmpb, a, b, len, accSet_);
+  }
+  LIns *findb(LIns *a, LIns *byte, LIns *len) {
+    return lir_->insMem(LIR_findb, a, byte, len, accSet_);
+  }
+  LIns *findanyb(LIns *a, LIns *bytes, LIns *len) {
+    return lir_->insMem(LIR_findanyb, a, bytes, len, accSet_);
+  }
+  LIns *loadf4(LIns *ptr, int32_t offset) {
+    return lir_->insLoad(LIR_ldf4, ptr, offset, accSet_);
+  }
+  LIns *storef4(LIns *value, LIns *ptr, int32_t offset) {
+    return lir_->insStore(LIR_stf4, value, ptr, offset, accSet_);
   }
 
+  /**
+  * Float4 operations, see NJX_addf4() etc.
+  */
+  LIns *f4op1(LOpcode op, LIns *a) { return lir_->ins1(op, a); }
+  LIns *f4op2(LOpcode op, LIns *a, LIns *b) { return lir_->ins2(op, a, b); }
+  LIns *ffff2f4(LIns *x, LIns *y, LIns *z, LIns *w) {
+    return lir_->ins4(LIR_ffff2f4, x, y, z, w);
+  }
+  LIns *swzf4(LIns *a, uint8_t mask) { return lir_->insSwz(a, mask); }
+
   LIns *addi(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_addi, lhs, rhs); }
   LIns *addq(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_addq, lhs, rhs); }
   LIns *addd(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_addd, lhs, rhs); }
@@ -355,15 +578,27 @@ public:
   LIns *mulq(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_mulq, lhs, rhs); }
   LIns *muld(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_muld, lhs, rhs); }
   LIns *mulf(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_mulf, lhs, rhs); }
+  LIns *mulhuq(LIns *lhs, LIns *rhs) {
+    return lir_->ins2(LIR_mulhuq, lhs, rhs);
+  }
+  LIns *mulhq(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_mulhq, lhs, rhs); }
 
   LIns *divi(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_divi, lhs, rhs); }
   LIns *divq(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_divq, lhs, rhs); }
   LIns *divd(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_divd, lhs, rhs); }
   LIns *divf(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_divf, lhs, rhs); }
 
+  LIns *mind(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_mind, lhs, rhs); }
+  LIns *maxd(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_maxd, lhs, rhs); }
+  LIns *minf(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_minf, lhs, rhs); }
+  LIns *maxf(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_maxf, lhs, rhs); }
+
   LIns *modi(LIns *lhs, LIns *rhs) { return lir_->ins1(LIR_modi, lir_->ins2(LIR_divi, lhs, rhs)); }
   LIns *modq(LIns *lhs, LIns *rhs) { return lir_->ins1(LIR_modq, lir_->ins2(LIR_divq, lhs, rhs)); }
 
+  LIns *crc32ci(LIns *crc, LIns *i) { return lir_->ins2(LIR_crc32ci, crc, i); }
+  LIns *crc32cq(LIns *crc, LIns *q) { return lir_->ins2(LIR_crc32cq, crc, q); }
+
   LIns *eqi(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_eqi, lhs, rhs); }
   LIns *eqq(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_eqq, lhs, rhs); }
   LIns *eqd(LIns *lhs, LIns *rhs) { return lir_->ins2(LIR_eqd, lhs, rhs); }
@@ -440,12 +675,20 @@ public:
   LIns *liveq(LIns *q) { return lir_->ins1(LIR_liveq, q); }
   LIns *livei(LIns *q) { return lir_->ins1(LIR_livei, q); }
   LIns *livef(LIns *q) { return lir_->ins1(LIR_livef, q); }
+  LIns *livef4(LIns *q) { return lir_->ins1(LIR_livef4, q); }
   LIns *lived(LIns *q) { return lir_->ins1(LIR_lived, q); }
 
   LIns *comment(const char *s) { return lir_->insComment(s); }
 
   LIns *call(const char *funcname, LOpcode opcode, AbiKind abi, int argc,
              LIns *args[]);
+  LIns *call(NJXFunctionHandle function, LOpcode opcode, int argc,
+             LIns *args[]);
+
+private:
+  LIns *insCall(CallInfo *ci, LOpcode opcode, int argc, LIns *argsin[]);
+
+public:
 
   /**
   * Completes the fragment, adds a guard record and if all ok, assembles the
@@ -456,7 +699,15 @@ public:
   */
   void *finalize();
 
-  SideExit *createSideExit();
+  const std::string &name() const { return fragName_; }
+  uint32_t typeSig() const {
+    return CallInfo::typeSigN(rvalue_, paramCount_, args_);
+  }
+  ModuleImpl *module() const { return module_; }
+  void setModule(ModuleImpl *module) { module_ = module; }
+  const std::vector<size_t> &moduleCalls() const { return moduleCalls_; }
+
+  NJXSideExit *createSideExit(int32_t id = -1);
   GuardRecord *createGuardRecord(SideExit *exit);
 
 private:
@@ -465,20 +716,89 @@ private:
   FunctionBuilderImpl &operator=(const FunctionBuilderImpl &) = delete;
 };
 
+/**
+* A group of functions compiled together. The functions can call each other
+* in any order: each call to a function of the module is bound once all the
+* functions are compiled, callees before their callers, and so becomes a
+* direct call.
+*/
+class ModuleImpl {
+  NanoJitContextImpl &parent_;
+
+  struct Member {
+    FunctionBuilderImpl *builder;
+    /**
+    * Shared by every call to the function; its address is a placeholder
+    * until the function is compiled.
+    */
+    CallInfo *callInfo;
+  };
+  std::vector<Member> members_;
+  std::unordered_map<std::string, size_t> index_;
+  // Set by the first call of compile(), whether or not it succeeds
+  bool compiled_;
+
+  bool compileMember(size_t i, std::vector<char> &state);
+  bool fail();
+
+public:
+  ModuleImpl(NanoJitContextImpl &parent) : parent_(parent), compiled_(false) {}
+  ~ModuleImpl();
+
+  NanoJitContextImpl &context() const { return parent_; }
+
+  // Whether a function of that name can be added, i.e. the module has no
+  // such function and compile() has not been called
+  bool canAdd(const std::string &name) const {
+    return !compiled_ && !index_.count(name);
+  }
+
+  // Adds a function to the module, which takes ownership of its builder
+  void add(FunctionBuilderImpl *builder);
+
+  // Returns the CallInfo of a function of the module and sets 'index' to
+  // its index, or returns nullptr if there is no such function
+  CallInfo *lookup(const std::string &name, size_t &index) const {
+    auto i = index_.find(name);
+    if (i == index_.end())
+      return nullptr;
+    index = i->second;
+    return members_[index].callInfo;
+  }
+
+  bool compile();
+
+private:
+  // Prohibit copying.
+  ModuleImpl(const ModuleImpl &) = delete;
+  ModuleImpl &operator=(const ModuleImpl &) = delete;
+};
+
+/**
+* The address of a call to a function of a module that is not compiled yet,
+* which is never within reach of a direct call.
+*/
+static const uintptr_t UnboundCallAddress = uintptr_t(1) << 63;
+
 uint32_t FunctionBuilderImpl::sProfId = 0;
 
-NanoJitContextImpl::NanoJitContextImpl(bool verbose, Config config)
-    : verbose_(verbose), config_(config), code_alloc_(&config),
-      asm_(code_alloc_, alloc_, alloc_, &logc_, config_) {
+NanoJitContextImpl::NanoJitContextImpl(bool verbose, Config config,
+                                       uint32_t hardeningSeed)
+    : verbose_(verbose), config_(config), code_alloc_(&config_),
+      asm_(code_alloc_, alloc_, alloc_, &logc_, config_), perf_(alloc_),
+      noise_(hardeningSeed), hardeningSeed_(hardeningSeed) {
   verbose_ = verbose;
   logc_.lcbits = 0;
+  if (config_.harden_function_alignment || config_.harden_nop_insertion ||
+      config_.harden_blind_constants)
+    asm_.setNoiseGenerator(&noise_);
 
-  lirbuf_ = new (alloc_) LirBuffer(alloc_);
+  verbose_only(printer_ = nullptr;)
 #ifdef DEBUG
   if (verbose) {
     logc_.lcbits = LC_ReadLIR | LC_AfterDCE | LC_Native | LC_RegAlloc |
                    LC_Activation | LC_Bytes;
-    lirbuf_->printer = new (alloc_) LInsPrinter(alloc_, LIRASM_NUM_USED_ACCS);
+    printer_ = new (alloc_) LInsPrinter(alloc_, LIRASM_NUM_USED_ACCS);
   }
 #endif
 }
@@ -498,14 +818,13 @@ LirasmFragment *NanoJitContextImpl::get_fragment(const char *name) {
   return &result->second;
 }
 
-bool NanoJitContextImpl::registerFunction(const std::string &name, void *fptr,
-                                          ArgType retval, const ArgType *args,
-                                          int argc) {
-  for (int i = 0; i < external_functions_.size(); i++) {
-    auto &function = external_functions_[i];
-    if (function.name == name) {
-      return function.callInfo._address == (uintptr_t)fptr;
-    }
+NJXFunctionHandle NanoJitContextImpl::registerFunction(
+    const std::string &name, void *fptr, ArgType retval, const ArgType *args,
+    int argc, NJXFunctionEffects effects, uint32_t storeRegions) {
+  NJXFunctionHandle existing = functionHandle(name);
+  if (existing) {
+    return functionCallInfo(existing)->_address == (uintptr_t)fptr ? existing
+                                                                    : 0;
   }
   if (argc < 0 || argc > MAXARGS) {
     fprintf(
@@ -519,53 +838,89 @@ bool NanoJitContextImpl::registerFunction(const std::string &name, void *fptr,
     return false;
   }
   for (int i = 0; i < argc; i++) {
-    if (args[i] < ARGTYPE_I && args[i] > ARGTYPE_F) {
+    if (args[i] < ARGTYPE_I || args[i] > ARGTYPE_F4) {
       fprintf(stderr, "Error in arg[%d]: Function cannot accept this type of "
                       "argument at present\n",
               i);
       return false;
     }
   }
-  if (retval < ARGTYPE_V || retval > ARGTYPE_F) {
+  if (retval < ARGTYPE_V || retval > ARGTYPE_F4) {
     fprintf(stderr, "Error: Function must return a value\n");
     return false;
   }
+  AccSet storeAccSet;
+  switch (effects) {
+  case NJX_EFFECTS_ANY:
+    storeAccSet = ACCSET_STORE_ANY;
+    break;
+  case NJX_EFFECTS_PURE:
+    // The result of a pure void function could never be used.
+    if (retval == ARGTYPE_V) {
+      fprintf(stderr, "Error: a pure function must return a value\n");
+      return false;
+    }
+    storeAccSet = ACCSET_NONE;
+    break;
+  case NJX_EFFECTS_READONLY:
+    storeAccSet = ACCSET_NONE;
+    break;
+  case NJX_EFFECTS_STORES:
+    if (storeRegions >> NJXMaxRegions) {
+      fprintf(stderr, "Error: store regions must be below %d\n",
+              NJXMaxRegions);
+      return false;
+    }
+    storeAccSet = storeRegions;
+    break;
+  default:
+    fprintf(stderr, "Error: unknown function effects %d\n", (int)effects);
+    return false;
+  }
 
   uint32_t typeSig = CallInfo::typeSigN(retval, argc, args);
   Function function;
   function.name = name;
-  function.callInfo._address = (uintptr_t)fptr;
+  function.callInfo = new (alloc_) CallInfo;
+  function.callInfo->_address = (uintptr_t)fptr;
 #if DEBUG
-  function.callInfo._name = "";
+  function.callInfo->_name = "";
 #endif
-  function.callInfo._typesig = typeSig;
-  function.callInfo._storeAccSet = ACCSET_STORE_ANY;
-  function.callInfo._abi = nanojit::ABI_CDECL; // Assumed to be C calling
-                                               // convention, maybe this should
-                                               // be a parameter
-  function.callInfo._isPure = 0;
+  function.callInfo->_typesig = typeSig;
+  function.callInfo->_storeAccSet = storeAccSet;
+  function.callInfo->_abi = nanojit::ABI_CDECL; // Assumed to be C calling
+                                                // convention, maybe this should
+                                                // be a parameter
+  function.callInfo->_isPure = effects == NJX_EFFECTS_PURE;
   external_functions_.push_back(function);
-  return true;
+  NJXFunctionHandle handle = (NJXFunctionHandle)external_functions_.size();
+  external_function_index_[name] = handle;
+  return handle;
 }
 
 int NanoJitContextImpl::lookupFunction(const std::string &name, CallInfo *&ci) {
 
-  const size_t nfuns = external_functions_.size();
-  for (size_t i = 0; i < nfuns; i++) {
-    if (name == external_functions_[i].name) {
-      *ci = external_functions_[i].callInfo;
-      return 1;
-    }
+  NJXFunctionHandle handle = functionHandle(name);
+  if (handle) {
+    ci = functionCallInfo(handle);
+    return 1;
   }
 
+  // typeSig is set once the function is compiled.
   Fragments::const_iterator func = fragments_.find(name);
-  if (func != fragments_.end()) {
+  if (func != fragments_.end() && func->second.typeSig != 0) {
+    ci = new (alloc_) CallInfo;
     // The ABI, arg types and ret type will be overridden by the caller.
     if (func->second.mReturnType == RT_DOUBLE) {
       CallInfo target = {
           (uintptr_t)func->second.rdouble, func->second.typeSig, ABI_FASTCALL,
           /*isPure*/ 0, ACCSET_STORE_ANY verbose_only(, func->first.c_str())};
       *ci = target;
+    } else if (func->second.mReturnType == RT_FLOAT4) {
+      CallInfo target = {
+          (uintptr_t)func->second.rfloat4, func->second.typeSig, ABI_FASTCALL,
+          /*isPure*/ 0, ACCSET_STORE_ANY verbose_only(, func->first.c_str())};
+      *ci = target;
     } else if (func->second.mReturnType == RT_FLOAT) {
       CallInfo target = {
           (uintptr_t)func->second.rfloat, func->second.typeSig, ABI_FASTCALL,
@@ -591,19 +946,24 @@ int NanoJitContextImpl::lookupFunction(const std::string &name, CallInfo *&ci) {
 FunctionBuilderImpl::FunctionBuilderImpl(NanoJitContextImpl &parent,
                                          const std::string &fragmentName,
                                          ArgType rvalue, const ArgType *args,
-                                         int argc, bool optimize)
-    : parent_(parent), fragName_(fragmentName), optimize_(optimize),
+                                         int argc, uint32_t passes)
+    : parent_(parent), fragName_(fragmentName), passes_(passes),
       bufWriter_(nullptr), cseFilter_(nullptr), exprFilter_(nullptr),
-      verboseWriter_(nullptr), validateWriter1_(nullptr),
-      validateWriter2_(nullptr), paramCount_(0), rvalue_(rvalue) {
+      slotFilter_(nullptr), loopFilter_(nullptr), verboseWriter_(nullptr),
+      validateWriter1_(nullptr), validateWriter2_(nullptr), paramCount_(0),
+      rvalue_(rvalue), accSet_(ACCSET_OTHER), module_(nullptr), loopDepth_(0) {
   fragment_ = new Fragment(nullptr verbose_only(
       , (parent_.logc_.lcbits & nanojit::LC_FragProfile) ? sProfId++ : 0));
-  fragment_->lirbuf = parent_.lirbuf_;
+  // Each function has its own buffer, so that the functions of a module can
+  // be built side by side.
+  fragment_->lirbuf = new (parent_.alloc_) LirBuffer(parent_.alloc_);
+  verbose_only(fragment_->lirbuf->printer = parent_.printer_;)
   parent_.fragments_[fragName_].fragptr = fragment_;
 
-  lir_ = bufWriter_ = new LirBufWriter(parent_.lirbuf_, parent_.config_);
+  lir_ = bufWriter_ = new LirBufWriter(fragment_->lirbuf, parent_.config_);
 #ifdef DEBUG
-  if (optimize) { // don't re-validate if no optimization has taken place
+  // don't re-validate if no filter has run
+  if (passes & (NJX_PASS_EXPR | NJX_PASS_CSE)) {
     lir_ = validateWriter2_ = new ValidateWriter(
         lir_, fragment_->lirbuf->printer, "end of writer pipeline");
   }
@@ -611,16 +971,28 @@ FunctionBuilderImpl::FunctionBuilderImpl(NanoJitContextImpl &parent,
 #ifdef DEBUG
   if (parent_.verbose_) {
     lir_ = verboseWriter_ = new VerboseWriter(
-        parent_.alloc_, lir_, parent_.lirbuf_->printer, &parent_.logc_);
+        parent_.alloc_, lir_, parent_.printer_, &parent_.logc_);
   }
 #endif
-  if (optimize) {
+  if ((passes & NJX_PASS_CSE) && parent_.config_.cseopt) {
     lir_ = cseFilter_ = new CseFilter(lir_, LIRASM_NUM_USED_ACCS,
                                       parent_.alloc_, parent_.config_);
   }
-  if (optimize) {
+  if (passes & NJX_PASS_EXPR) {
     lir_ = exprFilter_ = new ExprFilter(lir_);
   }
+  // Ahead of the others, so that they see the forwarded values.
+  if (passes & NJX_PASS_SLOTS) {
+    lir_ = slotFilter_ = new SlotFilter(lir_);
+  }
+  // Ahead of those too, so that they optimize the loops it adds.
+  if (passes & (NJX_PASS_VECTORIZE | NJX_PASS_UNROLL | NJX_PASS_CHECKS)) {
+    uint32_t factor =
+        (passes & NJX_PASS_UNROLL) ? parent_.config_.unroll_factor : 0;
+    lir_ = loopFilter_ = new LoopFilter(
+        lir_, parent_.alloc_, (passes & NJX_PASS_VECTORIZE) != 0, factor,
+        (passes & NJX_PASS_CHECKS) != 0);
+  }
 #ifdef DEBUG
   lir_ = validateWriter1_ = new ValidateWriter(lir_, fragment_->lirbuf->printer,
                                                "start of writer pipeline");
@@ -646,6 +1018,8 @@ FunctionBuilderImpl::~FunctionBuilderImpl() {
   delete validateWriter1_;
   delete validateWriter2_;
   delete verboseWriter_;
+  delete slotFilter_;
+  delete loopFilter_;
   delete exprFilter_;
   delete cseFilter_;
   delete bufWriter_;
@@ -674,7 +1048,14 @@ LIns *FunctionBuilderImpl::call(const char *funcname, LOpcode opcode,
     return nullptr;
 
   std::string func(funcname);
-  CallInfo *ci = new (parent_.alloc_) CallInfo;
+  CallInfo *ci = nullptr;
+
+  // The functions of our module can be called before they are compiled.
+  size_t callee;
+  if (module_ && (ci = module_->lookup(func, callee)) != nullptr) {
+    moduleCalls_.push_back(callee);
+    return insCall(ci, opcode, argc, argsin);
+  }
 
   // We can only call functions previously defined
   // TODO is there a need to handle functions compiled by
@@ -683,7 +1064,21 @@ LIns *FunctionBuilderImpl::call(const char *funcname, LOpcode opcode,
   int known = parent_.lookupFunction(func, ci);
   if (!known)
     return nullptr;
+  return insCall(ci, opcode, argc, argsin);
+}
+
+LIns *FunctionBuilderImpl::call(NJXFunctionHandle function, LOpcode opcode,
+                                int argc, LIns *argsin[]) {
+  if (argc < 0 || argc > MAXARGS)
+    return nullptr;
+  CallInfo *ci = parent_.functionCallInfo(function);
+  if (!ci)
+    return nullptr;
+  return insCall(ci, opcode, argc, argsin);
+}
 
+LIns *FunctionBuilderImpl::insCall(CallInfo *ci, LOpcode opcode, int argc,
+                                   LIns *argsin[]) {
   ArgType argTypes[MAXARGS]; // In order
   LIns *args[MAXARGS];	// In reverse order
   memset(&args[0], 0, sizeof(args));
@@ -698,6 +1093,8 @@ LIns *FunctionBuilderImpl::call(const char *funcname, LOpcode opcode,
       argTypes[j] = ARGTYPE_D;
     else if (args[i]->isF())
       argTypes[j] = ARGTYPE_F;
+    else if (args[i]->isF4())
+      argTypes[j] = ARGTYPE_F4;
     else if (args[i]->isQ())
       argTypes[j] = ARGTYPE_Q;
     else
@@ -716,6 +1113,8 @@ LIns *FunctionBuilderImpl::call(const char *funcname, LOpcode opcode,
     retType = ARGTYPE_D;
   else if (opcode == LIR_callf)
     retType = ARGTYPE_F;
+  else if (opcode == LIR_callf4)
+    retType = ARGTYPE_F4;
   else
     return nullptr;
 
@@ -749,17 +1148,24 @@ LIns *FunctionBuilderImpl::retf(LIns *result) {
   return lir_->ins1(LIR_retf, result);
 }
 
+LIns *FunctionBuilderImpl::retf4(LIns *result) {
+  NanoAssert(rvalue_ == ARGTYPE_F4);
+  returnTypeBits_ |= ReturnType::RT_FLOAT4;
+  return lir_->ins1(LIR_retf4, result);
+}
+
 LIns *FunctionBuilderImpl::retq(LIns *result) {
   NanoAssert(rvalue_ == ARGTYPE_Q);
   returnTypeBits_ |= ReturnType::RT_QUAD;
   return lir_->ins1(LIR_retq, result);
 }
 
-SideExit *FunctionBuilderImpl::createSideExit() {
-  SideExit *exit = new (parent_.alloc_) SideExit();
-  memset(exit, 0, sizeof(SideExit));
+NJXSideExit *FunctionBuilderImpl::createSideExit(int32_t id) {
+  NJXSideExit *exit = new (parent_.alloc_) NJXSideExit();
+  memset(exit, 0, sizeof(NJXSideExit));
   exit->from = fragment_;
   exit->target = nullptr;
+  exit->id = id;
   return exit;
 }
 
@@ -771,13 +1177,219 @@ GuardRecord *FunctionBuilderImpl::createGuardRecord(SideExit *exit) {
   return rec;
 }
 
+LIns *FunctionBuilderImpl::guardXov(LOpcode op, LIns *lhs, LIns *rhs,
+                                    int32_t id) {
+  GuardRecord *rec = createGuardRecord(createSideExit(id));
+  parent_.exit_ids_[rec] = id;
+  return lir_->insGuardXov(op, lhs, rhs, rec);
+}
+
+int32_t FunctionBuilderImpl::var(LIns *initial) {
+  Var v;
+  int32_t size;
+  if (initial->isI()) {
+    v.load = LIR_ldi, v.store = LIR_sti, v.live = LIR_livei, size = 4;
+  } else if (initial->isQ()) {
+    v.load = LIR_ldq, v.store = LIR_stq, v.live = LIR_liveq, size = 8;
+  } else if (initial->isD()) {
+    v.load = LIR_ldd, v.store = LIR_std, v.live = LIR_lived, size = 8;
+  } else if (initial->isF()) {
+    v.load = LIR_ldf, v.store = LIR_stf, v.live = LIR_livef, size = 4;
+  } else if (initial->isF4()) {
+    v.load = LIR_ldf4, v.store = LIR_stf4, v.live = LIR_livef4, size = 16;
+  } else {
+    return -1;
+  }
+  v.slot = lir_->insAlloc(size);
+  v.value = initial;
+  v.dirty = true;
+  v.read = false;
+  v.depth = loopDepth_;
+  vars_.push_back(v);
+  return int32_t(vars_.size() - 1);
+}
+
+LIns *FunctionBuilderImpl::getVar(int32_t var) {
+  if (var < 0 || size_t(var) >= vars_.size())
+    return nullptr;
+  Var &v = vars_[var];
+  if (!v.value)
+    v.value = lir_->insLoad(v.load, v.slot, 0, ACCSET_OTHER);
+  v.read = true;
+  return v.value;
+}
+
+bool FunctionBuilderImpl::setVar(int32_t var, LIns *value) {
+  if (var < 0 || size_t(var) >= vars_.size())
+    return false;
+  Var &v = vars_[var];
+  // Only the variables declared as carried by the innermost loop, or
+  // declared in it, can change in it.
+  if (v.depth != loopDepth_)
+    return false;
+  v.value = value;
+  v.dirty = true;
+  return true;
+}
+
+// Stores the variables that changed in this block, before a branch or label
+void FunctionBuilderImpl::flushVars() {
+  for (Var &v : vars_) {
+    if (v.dirty) {
+      lir_->insStore(v.store, v.value, v.slot, 0, ACCSET_OTHER);
+      v.dirty = false;
+    }
+  }
+}
+
+std::vector<LIns *> FunctionBuilderImpl::varValues() const {
+  std::vector<LIns *> values;
+  for (const Var &v : vars_)
+    values.push_back(v.value);
+  return values;
+}
+
+void FunctionBuilderImpl::patchExits(Block &block, LIns *label) {
+  for (LIns *exit : block.exits)
+    exit->setTarget(label);
+  block.exits.clear();
+}
+
+bool FunctionBuilderImpl::loopBegin(const int32_t *carried, int ncarried) {
+  for (int i = 0; i < ncarried; i++) {
+    if (carried[i] < 0 || size_t(carried[i]) >= vars_.size() ||
+        vars_[carried[i]].depth != loopDepth_)
+      return false;
+  }
+  flushVars();
+  Block block;
+  block.loop = true;
+  block.hasElse = false;
+  block.head = lir_->ins0(LIR_label);
+  block.saved = varValues();
+  block.carried.assign(carried, carried + ncarried);
+  loopDepth_++;
+  for (Var &v : vars_) {
+    block.read.push_back(v.read);
+    v.read = false;
+  }
+  // The other variables keep their values, in registers, through the loop.
+  for (int32_t var : block.carried) {
+    vars_[var].value = nullptr;
+    vars_[var].depth = loopDepth_;
+  }
+  blocks_.push_back(block);
+  return true;
+}
+
+bool FunctionBuilderImpl::breakIf(LIns *cond) {
+  size_t i = blocks_.size();
+  while (i > 0 && !blocks_[i - 1].loop)
+    i--;
+  if (i == 0)
+    return false;
+  flushVars();
+  LIns *exit = lir_->insBranch(LIR_jt, cond, nullptr);
+  // ExprFilter drops a branch that is never taken.
+  if (exit)
+    blocks_[i - 1].exits.push_back(exit);
+  return true;
+}
+
+bool FunctionBuilderImpl::loopEnd() {
+  if (blocks_.empty() || !blocks_.back().loop)
+    return false;
+  Block &block = blocks_.back();
+  flushVars();
+  lir_->insBranch(LIR_j, nullptr, block.head);
+  // Keep the slots, and the values the loop uses from before it, alive
+  // across the back edge. The assembler runs bottom-up, so these must
+  // follow the jump to be seen before it.
+  for (size_t i = 0; i < vars_.size(); i++) {
+    Var &v = vars_[i];
+    lir_->ins1(LIR_livep, v.slot);
+    if (i < block.saved.size() && block.saved[i] && v.depth != loopDepth_ &&
+        v.read)
+      lir_->ins1(v.live, block.saved[i]);
+  }
+  patchExits(block, lir_->ins0(LIR_label));
+  loopDepth_--;
+  // A value the loop did not use is not kept alive across it, so it is
+  // reloaded from its slot if it is used after the loop.
+  for (size_t i = 0; i < vars_.size(); i++) {
+    Var &v = vars_[i];
+    bool before = i < block.saved.size();
+    v.value = before && v.read ? block.saved[i] : nullptr;
+    v.read = before && (v.read || block.read[i]);
+    if (!before)
+      v.depth = loopDepth_;
+  }
+  for (int32_t var : block.carried) {
+    vars_[var].value = nullptr;
+    vars_[var].depth = loopDepth_;
+  }
+  blocks_.pop_back();
+  return true;
+}
+
+bool FunctionBuilderImpl::ifBegin(LIns *cond) {
+  flushVars();
+  Block block;
+  block.loop = false;
+  block.hasElse = false;
+  block.head = nullptr;
+  block.saved = varValues();
+  LIns *skip = lir_->insBranch(LIR_jf, cond, nullptr);
+  if (skip)
+    block.exits.push_back(skip);
+  blocks_.push_back(block);
+  return true;
+}
+
+bool FunctionBuilderImpl::ifElse() {
+  if (blocks_.empty() || blocks_.back().loop || blocks_.back().hasElse)
+    return false;
+  Block &block = blocks_.back();
+  flushVars();
+  LIns *end = lir_->insBranch(LIR_j, nullptr, nullptr);
+  patchExits(block, lir_->ins0(LIR_label));
+  block.exits.push_back(end);
+  block.hasElse = true;
+  block.then = varValues();
+  for (size_t i = 0; i < vars_.size(); i++)
+    vars_[i].value = i < block.saved.size() ? block.saved[i] : nullptr;
+  return true;
+}
+
+bool FunctionBuilderImpl::ifEnd() {
+  if (blocks_.empty() || blocks_.back().loop)
+    return false;
+  Block &block = blocks_.back();
+  flushVars();
+  patchExits(block, lir_->ins0(LIR_label));
+  // A value survives the join only if it is the same on both paths.
+  const std::vector<LIns *> &other = block.hasElse ? block.then : block.saved;
+  for (size_t i = 0; i < vars_.size(); i++) {
+    if (i >= other.size() || other[i] != vars_[i].value)
+      vars_[i].value = nullptr;
+  }
+  blocks_.pop_back();
+  return true;
+}
+
 void *FunctionBuilderImpl::finalize() {
+  if (!blocks_.empty()) {
+    std::cerr << "error: unterminated loop or if in fragment '" << fragName_
+              << "'" << std::endl;
+    return nullptr;
+  }
   if (returnTypeBits_ == 0) {
     std::cerr << "warning: no return type in fragment '" << fragName_ << "'"
               << std::endl;
 
   } else if (returnTypeBits_ != RT_INT && returnTypeBits_ != RT_QUAD &&
-             returnTypeBits_ != RT_DOUBLE && returnTypeBits_ != RT_FLOAT) {
+             returnTypeBits_ != RT_DOUBLE && returnTypeBits_ != RT_FLOAT &&
+             returnTypeBits_ != RT_FLOAT4) {
     std::cerr << "warning: multiple return types in fragment '" << fragName_
               << "'" << std::endl;
     return nullptr;
@@ -796,8 +1408,10 @@ void *FunctionBuilderImpl::finalize() {
   fragment_->lastIns =
       lir_->insGuard(LIR_x, NULL, createGuardRecord(createSideExit()));
 
+  parent_.asm_.setRemoveDeadSlotStores((passes_ & NJX_PASS_SLOTS) != 0);
   parent_.asm_.compile(fragment_, parent_.alloc_,
-                       optimize_ verbose_only(, parent_.lirbuf_->printer));
+                       (passes_ & NJX_PASS_STACK) != 0
+                           verbose_only(, parent_.printer_));
 
   if (parent_.asm_.error() != nanojit::None) {
     std::cerr << "error during assembly: ";
@@ -822,6 +1436,8 @@ void *FunctionBuilderImpl::finalize() {
     std::exit(1);
   }
 
+  parent_.perf_.addCode(fragName_.c_str(), parent_.asm_.codeList);
+
   LirasmFragment *f;
   f = &parent_.fragments_[fragName_];
 
@@ -846,6 +1462,11 @@ void *FunctionBuilderImpl::finalize() {
     f->mReturnType = RT_FLOAT;
     f->typeSig = CallInfo::typeSigN(rvalue_, paramCount_, args_);
     return reinterpret_cast<void *>(f->rfloat);
+  case RT_FLOAT4:
+    f->rfloat4 = (RetFloat4)((uintptr_t)fragment_->code());
+    f->mReturnType = RT_FLOAT4;
+    f->typeSig = CallInfo::typeSigN(rvalue_, paramCount_, args_);
+    return reinterpret_cast<void *>(f->rfloat4);
   default:
     NanoAssert(0);
     std::cerr << "invalid return type\n";
@@ -853,6 +1474,85 @@ void *FunctionBuilderImpl::finalize() {
   }
   return nullptr;
 }
+
+ModuleImpl::~ModuleImpl() {
+  for (size_t i = 0; i < members_.size(); i++)
+    delete members_[i].builder;
+}
+
+void ModuleImpl::add(FunctionBuilderImpl *builder) {
+  NanoAssert(canAdd(builder->name()));
+  CallInfo *ci = new (parent_.alloc_) CallInfo;
+  CallInfo target = {
+      UnboundCallAddress, builder->typeSig(), ABI_FASTCALL, /*isPure*/ 0,
+      ACCSET_STORE_ANY verbose_only(,
+                                    parent_.fragments_.find(builder->name())
+                                        ->first.c_str())};
+  *ci = target;
+  builder->setModule(this);
+  index_[builder->name()] = members_.size();
+  members_.push_back(Member{builder, ci});
+}
+
+// Compiles member i after the members it calls; state[j] is 1 while member
+// j is being compiled and 2 once it is, so a call back to a member on the
+// way here, i.e. one in a cycle, is left to be bound by compile().
+bool ModuleImpl::compileMember(size_t i, std::vector<char> &state) {
+  if (state[i])
+    return true;
+  state[i] = 1;
+  FunctionBuilderImpl *builder = members_[i].builder;
+  for (size_t callee : builder->moduleCalls()) {
+    if (!compileMember(callee, state))
+      return false;
+  }
+  void *code = builder->finalize();
+  if (!code)
+    return false;
+  members_[i].callInfo->_address = (uintptr_t)code;
+  state[i] = 2;
+  return true;
+}
+
+// Unpublishes every member after a failed compile(): the ones that were
+// compiled may call members that were not, or through calls that were never
+// patched, so none of them can be looked up.
+bool ModuleImpl::fail() {
+  for (size_t i = 0; i < members_.size(); i++) {
+    LirasmFragment &f = parent_.fragments_[members_[i].builder->name()];
+    f.rint = nullptr;
+    f.typeSig = 0;
+    members_[i].callInfo->_address = UnboundCallAddress;
+  }
+  return false;
+}
+
+bool ModuleImpl::compile() {
+  if (compiled_)
+    return false;
+  compiled_ = true;
+  CallSites sites(parent_.alloc_);
+  std::vector<char> state(members_.size(), 0);
+  bool ok = true;
+  parent_.asm_.setCallSites(&sites);
+  parent_.asm_.setSharedConstantPools(true);
+  for (size_t i = 0; ok && i < members_.size(); i++)
+    ok = compileMember(i, state);
+  parent_.asm_.setSharedConstantPools(false);
+  parent_.asm_.setCallSites(nullptr);
+  if (!ok)
+    return fail();
+
+  // Every callee has its address now; turn the calls that were emitted
+  // before it did into direct calls.
+  for (Seq<CallSite> *p = sites.get(); p; p = p->tail) {
+    if (!parent_.asm_.patchCall(p->head.at, (NIns *)p->head.call->_address)) {
+      std::cerr << "error during assembly: BranchTooFar" << std::endl;
+      return fail();
+    }
+  }
+  return true;
+}
 }
 
 using namespace nanojit;
@@ -875,6 +1575,14 @@ unwrap_function_builder(NJXFunctionBuilderRef p) {
   return reinterpret_cast<FunctionBuilderImpl *>(p);
 }
 
+static inline NJXModuleRef wrap_module(ModuleImpl *p) {
+  return reinterpret_cast<NJXModuleRef>(p);
+}
+
+static inline ModuleImpl *unwrap_module(NJXModuleRef p) {
+  return reinterpret_cast<ModuleImpl *>(p);
+}
+
 static inline NJXLInsRef wrap_ins(LIns *p) {
   return reinterpret_cast<NJXLInsRef>(p);
 }
@@ -883,6 +1591,62 @@ static inline LIns *unwrap_ins(NJXLInsRef p) {
   return reinterpret_cast<LIns *>(p);
 }
 
+static void configToOptions(const Config &config,
+                            NJXContextOptions *options) {
+  options->cseopt = config.cseopt;
+  options->unroll_factor = config.unroll_factor;
+  options->force_long_branch = config.force_long_branch;
+  options->check_page_flags = config.check_page_flags;
+  options->harden_function_alignment = config.harden_function_alignment;
+  options->harden_nop_insertion = config.harden_nop_insertion;
+  options->harden_blind_constants = config.harden_blind_constants;
+  options->sse2 = config.i386_sse2;
+  options->sse3 = config.i386_sse3;
+  options->sse41 = config.i386_sse41;
+  options->sse42 = config.i386_sse42;
+  options->avx = config.i386_avx;
+  options->avx2 = config.i386_avx2;
+  options->bmi1 = config.i386_bmi1;
+  options->bmi2 = config.i386_bmi2;
+  options->fma = config.i386_fma;
+  options->popcnt = config.i386_popcnt;
+  options->erms = config.i386_erms;
+  options->use_cmov = config.i386_use_cmov;
+  options->fixed_esp = config.i386_fixed_esp;
+  options->arm_arch = config.arm_arch;
+  options->arm_vfp = config.arm_vfp;
+  options->arm_show_stats = config.arm_show_stats;
+  options->soft_float = config.soft_float;
+}
+
+static void optionsToConfig(const NJXContextOptions *options,
+                            Config &config) {
+  config.cseopt = options->cseopt;
+  config.unroll_factor = options->unroll_factor;
+  config.force_long_branch = options->force_long_branch;
+  config.check_page_flags = options->check_page_flags;
+  config.harden_function_alignment = options->harden_function_alignment;
+  config.harden_nop_insertion = options->harden_nop_insertion;
+  config.harden_blind_constants = options->harden_blind_constants;
+  config.i386_sse2 = options->sse2;
+  config.i386_sse3 = options->sse3;
+  config.i386_sse41 = options->sse41;
+  config.i386_sse42 = options->sse42;
+  config.i386_avx = options->avx;
+  config.i386_avx2 = options->avx2;
+  config.i386_bmi1 = options->bmi1;
+  config.i386_bmi2 = options->bmi2;
+  config.i386_fma = options->fma;
+  config.i386_popcnt = options->popcnt;
+  config.i386_erms = options->erms;
+  config.i386_use_cmov = options->use_cmov;
+  config.i386_fixed_esp = options->fixed_esp;
+  config.arm_arch = options->arm_arch;
+  config.arm_vfp = options->arm_vfp;
+  config.arm_show_stats = options->arm_show_stats;
+  config.soft_float = options->soft_float;
+}
+
 extern "C" {
 
 NJXContextRef NJX_create_context(int verbose) {
@@ -890,6 +1654,32 @@ NJXContextRef NJX_create_context(int verbose) {
   return wrap_context(ctx);
 }
 
+void NJX_init_context_options(NJXContextOptions *options) {
+  memset(options, 0, sizeof(*options));
+  configToOptions(Config(), options);
+}
+
+NJXContextRef
+NJX_create_context_with_options(const NJXContextOptions *options) {
+  Config config;
+  optionsToConfig(options, config);
+  uint32_t seed = options->hardening_seed;
+  if (seed == 0)
+    seed = (uint32_t)
+        std::chrono::steady_clock::now().time_since_epoch().count();
+  auto ctx = new NanoJitContextImpl(options->verbose, config, seed);
+  return wrap_context(ctx);
+}
+
+void NJX_get_context_options(NJXContextRef context,
+                             NJXContextOptions *options) {
+  auto ctx = unwrap_context(context);
+  memset(options, 0, sizeof(*options));
+  configToOptions(ctx->config_, options);
+  options->verbose = ctx->verbose_;
+  options->hardening_seed = ctx->hardeningSeed_;
+}
+
 void NJX_destroy_context(NJXContextRef ctx) {
   auto impl = unwrap_context(ctx);
   delete impl;
@@ -908,24 +1698,90 @@ void *NJX_get_function_by_name(NJXContextRef ctx, const char *name) {
       return reinterpret_cast<void *>(f->rdouble);
     case RT_FLOAT:
       return reinterpret_cast<void *>(f->rfloat);
+    case RT_FLOAT4:
+      return reinterpret_cast<void *>(f->rfloat4);
     }
   }
   return nullptr;
 }
 
-bool NJX_register_C_function(NJXContextRef context, const char *name,
-                             void *fptr, NJXValueKind return_type,
-                             const NJXValueKind *args, int argc) {
+bool NJX_start_sampling(NJXContextRef context) {
+  return unwrap_context(context)->perf_.start();
+}
+
+void NJX_stop_sampling(NJXContextRef context) {
+  unwrap_context(context)->perf_.stop();
+}
+
+uint64_t NJX_get_sample_period(NJXContextRef context, NJXPerfEvent event) {
+  auto ctx = unwrap_context(context);
+  if (event < NJX_PERF_CYCLES || event > NJX_PERF_CACHE_MISSES ||
+      !ctx->perf_.isAvailable((PerfEvent)event))
+    return 0;
+  return ctx->perf_.period((PerfEvent)event);
+}
+
+uint64_t NJX_get_samples(NJXContextRef context, const char *name,
+                         NJXPerfEvent event) {
+  if (event < NJX_PERF_CYCLES || event > NJX_PERF_CACHE_MISSES)
+    return 0;
+  return unwrap_context(context)->perf_.samples(name, (PerfEvent)event);
+}
+
+void NJX_dump_samples(NJXContextRef context) {
+  unwrap_context(context)->perf_.dump(stdout);
+}
+
+NJXFunctionHandle NJX_register_C_function(NJXContextRef context,
+                                          const char *name, void *fptr,
+                                          NJXValueKind return_type,
+                                          const NJXValueKind *args, int argc) {
   auto ctx = unwrap_context(context);
   return ctx->registerFunction(std::string(name), fptr, (ArgType)return_type,
                                (const ArgType *)args, argc);
 }
 
+NJXFunctionHandle
+NJX_register_C_function_ex(NJXContextRef context, const char *name, void *fptr,
+                           NJXValueKind return_type, const NJXValueKind *args,
+                           int argc, NJXFunctionEffects effects,
+                           uint32_t store_regions) {
+  auto ctx = unwrap_context(context);
+  return ctx->registerFunction(std::string(name), fptr, (ArgType)return_type,
+                               (const ArgType *)args, argc, effects,
+                               store_regions);
+}
+
+NJXFunctionHandle NJX_get_function_handle(NJXContextRef context,
+                                          const char *name) {
+  return unwrap_context(context)->functionHandle(std::string(name));
+}
+
+uint32_t NJX_passes_for_level(NJXOptLevel level) {
+  switch (level) {
+  case NJX_O0:
+    return 0;
+  case NJX_O1:
+    return NJX_PASS_EXPR | NJX_PASS_CSE | NJX_PASS_STACK;
+  default:
+    return NJX_PASS_EXPR | NJX_PASS_CSE | NJX_PASS_STACK | NJX_PASS_SLOTS |
+           NJX_PASS_VECTORIZE | NJX_PASS_UNROLL | NJX_PASS_CHECKS;
+  }
+}
+
 NJXFunctionBuilderRef NJX_create_function_builder(NJXContextRef context,
                                                   const char *name,
                                                   NJXValueKind return_type,
                                                   const NJXValueKind *args,
                                                   int argc, int optimize) {
+  NJXOptLevel level = optimize <= 0 ? NJX_O0 : optimize == 1 ? NJX_O1 : NJX_O2;
+  return NJX_create_function_builder_with_passes(
+      context, name, return_type, args, argc, NJX_passes_for_level(level));
+}
+
+NJXFunctionBuilderRef NJX_create_function_builder_with_passes(
+    NJXContextRef context, const char *name, NJXValueKind return_type,
+    const NJXValueKind *args, int argc, uint32_t passes) {
   if (argc < 0 || argc > NJXMaxArgs) {
     fprintf(stderr,
             "Error: Function cannot accept more than %d arguments at present\n",
@@ -940,18 +1796,23 @@ NJXFunctionBuilderRef NJX_create_function_builder(NJXContextRef context,
       return nullptr;
     }
   }
-  if (return_type < NJXValueKind_I || return_type > NJXValueKind_F) {
+  if (return_type < NJXValueKind_I || return_type > NJXValueKind_F4) {
     fprintf(stderr, "Error: Function must return a value\n");
     return nullptr;
   }
   auto impl = new FunctionBuilderImpl(*unwrap_context(context),
                                       std::string(name), (ArgType)return_type,
-                                      (ArgType *)args, argc, optimize != 0);
+                                      (ArgType *)args, argc, passes);
   return wrap_function_builder(impl);
 }
 
 void NJX_destroy_function_builder(NJXFunctionBuilderRef fn) {
   auto impl = unwrap_function_builder(fn);
+  if (impl->module()) {
+    fprintf(stderr, "Error: the builder of '%s' belongs to a module\n",
+            impl->name().c_str());
+    return;
+  }
   delete impl;
 }
 
@@ -1042,6 +1903,26 @@ NJXLInsRef NJX_mulq(NJXFunctionBuilderRef fn, NJXLInsRef lhs, NJXLInsRef rhs) {
   return wrap_ins(
       unwrap_function_builder(fn)->mulq(unwrap_ins(lhs), unwrap_ins((rhs))));
 }
+NJXLInsRef NJX_mulhuq(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                      NJXLInsRef rhs) {
+  return wrap_ins(
+      unwrap_function_builder(fn)->mulhuq(unwrap_ins(lhs), unwrap_ins(rhs)));
+}
+NJXLInsRef NJX_mulhq(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                     NJXLInsRef rhs) {
+  return wrap_ins(
+      unwrap_function_builder(fn)->mulhq(unwrap_ins(lhs), unwrap_ins(rhs)));
+}
+NJXLInsRef NJX_crc32ci(NJXFunctionBuilderRef fn, NJXLInsRef crc,
+                       NJXLInsRef i) {
+  return wrap_ins(
+      unwrap_function_builder(fn)->crc32ci(unwrap_ins(crc), unwrap_ins(i)));
+}
+NJXLInsRef NJX_crc32cq(NJXFunctionBuilderRef fn, NJXLInsRef crc,
+                       NJXLInsRef q) {
+  return wrap_ins(
+      unwrap_function_builder(fn)->crc32cq(unwrap_ins(crc), unwrap_ins(q)));
+}
 NJXLInsRef NJX_muld(NJXFunctionBuilderRef fn, NJXLInsRef lhs, NJXLInsRef rhs) {
   return wrap_ins(
       unwrap_function_builder(fn)->muld(unwrap_ins(lhs), unwrap_ins((rhs))));
@@ -1068,6 +1949,23 @@ NJXLInsRef NJX_divf(NJXFunctionBuilderRef fn, NJXLInsRef lhs, NJXLInsRef rhs) {
       unwrap_function_builder(fn)->divf(unwrap_ins(lhs), unwrap_ins((rhs))));
 }
 
+NJXLInsRef NJX_mind(NJXFunctionBuilderRef fn, NJXLInsRef lhs, NJXLInsRef rhs) {
+  return wrap_ins(
+      unwrap_function_builder(fn)->mind(unwrap_ins(lhs), unwrap_ins((rhs))));
+}
+NJXLInsRef NJX_maxd(NJXFunctionBuilderRef fn, NJXLInsRef lhs, NJXLInsRef rhs) {
+  return wrap_ins(
+      unwrap_function_builder(fn)->maxd(unwrap_ins(lhs), unwrap_ins((rhs))));
+}
+NJXLInsRef NJX_minf(NJXFunctionBuilderRef fn, NJXLInsRef lhs, NJXLInsRef rhs) {
+  return wrap_ins(
+      unwrap_function_builder(fn)->minf(unwrap_ins(lhs), unwrap_ins((rhs))));
+}
+NJXLInsRef NJX_maxf(NJXFunctionBuilderRef fn, NJXLInsRef lhs, NJXLInsRef rhs) {
+  return wrap_ins(
+      unwrap_function_builder(fn)->maxf(unwrap_ins(lhs), unwrap_ins((rhs))));
+}
+
 NJXLInsRef NJX_modi(NJXFunctionBuilderRef fn, NJXLInsRef lhs, NJXLInsRef rhs) {
   return wrap_ins(
       unwrap_function_builder(fn)->modi(unwrap_ins(lhs), unwrap_ins((rhs))));
@@ -1318,6 +2216,10 @@ NJXLInsRef NJX_add_label(NJXFunctionBuilderRef fn) {
   return wrap_ins(unwrap_function_builder(fn)->addLabel());
 }
 
+NJXLInsRef NJX_regfence(NJXFunctionBuilderRef fn) {
+  return wrap_ins(unwrap_function_builder(fn)->regFence());
+}
+
 NJXLInsRef NJX_alloca(NJXFunctionBuilderRef fn, int32_t size) {
   return wrap_ins(unwrap_function_builder(fn)->allocA(size));
 }
@@ -1350,6 +2252,10 @@ NJXLInsRef NJX_switch(NJXFunctionBuilderRef fn, NJXLInsRef index,
       unwrap_function_builder(fn)->jmpTable(unwrap_ins(index), size));
 }
 
+bool NJX_set_region(NJXFunctionBuilderRef fn, int region) {
+  return unwrap_function_builder(fn)->setRegion(region);
+}
+
 NJXLInsRef NJX_load_c2i(NJXFunctionBuilderRef fn, NJXLInsRef ptr,
                         int32_t offset) {
   return wrap_ins(
@@ -1423,6 +2329,32 @@ NJXLInsRef NJX_store_f(NJXFunctionBuilderRef fn, NJXLInsRef value,
                                                       unwrap_ins(ptr), offset));
 }
 
+NJXLInsRef NJX_copy_bytes(NJXFunctionBuilderRef fn, NJXLInsRef dest,
+                          NJXLInsRef src, NJXLInsRef len) {
+  return wrap_ins(unwrap_function_builder(fn)->copyb(
+      unwrap_ins(dest), unwrap_ins(src), unwrap_ins(len)));
+}
+NJXLInsRef NJX_fill_bytes(NJXFunctionBuilderRef fn, NJXLInsRef dest,
+                          NJXLInsRef byte, NJXLInsRef len) {
+  return wrap_ins(unwrap_function_builder(fn)->fillb(
+      unwrap_ins(dest), unwrap_ins(byte), unwrap_ins(len)));
+}
+NJXLInsRef NJX_compare_bytes(NJXFunctionBuilderRef fn, NJXLInsRef a,
+                             NJXLInsRef b, NJXLInsRef len) {
+  return wrap_ins(unwrap_function_builder(fn)->cmpb(
+      unwrap_ins(a), unwrap_ins(b), unwrap_ins(len)));
+}
+NJXLInsRef NJX_find_byte(NJXFunctionBuilderRef fn, NJXLInsRef a,
+                         NJXLInsRef byte, NJXLInsRef len) {
+  return wrap_ins(unwrap_function_builder(fn)->findb(
+      unwrap_ins(a), unwrap_ins(byte), unwrap_ins(len)));
+}
+NJXLInsRef NJX_find_any_byte(NJXFunctionBuilderRef fn, NJXLInsRef a,
+                             NJXLInsRef bytes, NJXLInsRef len) {
+  return wrap_ins(unwrap_function_builder(fn)->findanyb(
+      unwrap_ins(a), unwrap_ins(bytes), unwrap_ins(len)));
+}
+
 bool NJX_is_i(NJXLInsRef ins) { return unwrap_ins(ins)->isI(); }
 bool NJX_is_q(NJXLInsRef ins) { return unwrap_ins(ins)->isQ(); }
 bool NJX_is_d(NJXLInsRef ins) { return unwrap_ins(ins)->isD(); }
@@ -1434,7 +2366,110 @@ bool NJX_is_f(NJXLInsRef ins) { return unwrap_ins(ins)->isF(); }
 void NJX_set_jmp_target(NJXLInsRef jmp, NJXLInsRef target) {
   auto jmpins = unwrap_ins(jmp);
   auto targetins = unwrap_ins(target);
-  jmpins->setTarget(targetins);
+  // An overflow check that ExprFilter proved can't overflow comes back as
+  // plain arithmetic;  there is no branch left to patch.
+  if (jmpins->isBranch())
+    jmpins->setTarget(targetins);
+}
+
+int32_t NJX_var(NJXFunctionBuilderRef fn, NJXLInsRef initial) {
+  if (!initial)
+    return -1;
+  return unwrap_function_builder(fn)->var(unwrap_ins(initial));
+}
+
+NJXLInsRef NJX_get_var(NJXFunctionBuilderRef fn, int32_t var) {
+  return wrap_ins(unwrap_function_builder(fn)->getVar(var));
+}
+
+bool NJX_set_var(NJXFunctionBuilderRef fn, int32_t var, NJXLInsRef value) {
+  return value && unwrap_function_builder(fn)->setVar(var, unwrap_ins(value));
+}
+
+bool NJX_loop_begin(NJXFunctionBuilderRef fn, const int32_t *carried,
+                    int ncarried) {
+  return unwrap_function_builder(fn)->loopBegin(carried, ncarried);
+}
+
+bool NJX_break_if(NJXFunctionBuilderRef fn, NJXLInsRef cond) {
+  return cond && unwrap_function_builder(fn)->breakIf(unwrap_ins(cond));
+}
+
+bool NJX_loop_end(NJXFunctionBuilderRef fn) {
+  return unwrap_function_builder(fn)->loopEnd();
+}
+
+bool NJX_if(NJXFunctionBuilderRef fn, NJXLInsRef cond) {
+  return cond && unwrap_function_builder(fn)->ifBegin(unwrap_ins(cond));
+}
+
+bool NJX_else(NJXFunctionBuilderRef fn) {
+  return unwrap_function_builder(fn)->ifElse();
+}
+
+bool NJX_endif(NJXFunctionBuilderRef fn) {
+  return unwrap_function_builder(fn)->ifEnd();
+}
+
+static NJXLInsRef NJX_jov(NJXFunctionBuilderRef fn, LOpcode op,
+                          NJXLInsRef lhs, NJXLInsRef rhs, NJXLInsRef to) {
+  return wrap_ins(unwrap_function_builder(fn)->branchJov(
+      op, unwrap_ins(lhs), unwrap_ins(rhs), unwrap_ins(to)));
+}
+NJXLInsRef NJX_addjovi(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs, NJXLInsRef to) {
+  return NJX_jov(fn, LIR_addjovi, lhs, rhs, to);
+}
+NJXLInsRef NJX_subjovi(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs, NJXLInsRef to) {
+  return NJX_jov(fn, LIR_subjovi, lhs, rhs, to);
+}
+NJXLInsRef NJX_muljovi(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs, NJXLInsRef to) {
+  return NJX_jov(fn, LIR_muljovi, lhs, rhs, to);
+}
+#ifdef NANOJIT_64BIT
+NJXLInsRef NJX_addjovq(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs, NJXLInsRef to) {
+  return NJX_jov(fn, LIR_addjovq, lhs, rhs, to);
+}
+NJXLInsRef NJX_subjovq(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs, NJXLInsRef to) {
+  return NJX_jov(fn, LIR_subjovq, lhs, rhs, to);
+}
+NJXLInsRef NJX_muljovq(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs, NJXLInsRef to) {
+  return NJX_jov(fn, LIR_muljovq, lhs, rhs, to);
+}
+#endif
+
+static NJXLInsRef NJX_xov(NJXFunctionBuilderRef fn, LOpcode op,
+                          NJXLInsRef lhs, NJXLInsRef rhs, int32_t exit_id) {
+  return wrap_ins(unwrap_function_builder(fn)->guardXov(
+      op, unwrap_ins(lhs), unwrap_ins(rhs), exit_id));
+}
+NJXLInsRef NJX_addxovi(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs, int32_t exit_id) {
+  return NJX_xov(fn, LIR_addxovi, lhs, rhs, exit_id);
+}
+NJXLInsRef NJX_subxovi(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs, int32_t exit_id) {
+  return NJX_xov(fn, LIR_subxovi, lhs, rhs, exit_id);
+}
+NJXLInsRef NJX_mulxovi(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs, int32_t exit_id) {
+  return NJX_xov(fn, LIR_mulxovi, lhs, rhs, exit_id);
+}
+#ifdef NANOJIT_64BIT
+NJXLInsRef NJX_mulxovq(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs, int32_t exit_id) {
+  return NJX_xov(fn, LIR_mulxovq, lhs, rhs, exit_id);
+}
+#endif
+
+int32_t NJX_get_exit_id(NJXContextRef jit, int64_t result) {
+  return unwrap_context(jit)->exitId(
+      reinterpret_cast<const void *>(static_cast<intptr_t>(result)));
 }
 
 void NJX_set_switch_target(NJXLInsRef switchins, uint32_t index,
@@ -1497,10 +2532,418 @@ NJXLInsRef NJX_calld(NJXFunctionBuilderRef fn, const char *funcname,
   return NJX_call(fn, funcname, LIR_calld, abi, nargs, args);
 }
 
+static NJXLInsRef NJX_call_handle(NJXFunctionBuilderRef fn,
+                                  NJXFunctionHandle function, LOpcode opcode,
+                                  int nargs, NJXLInsRef args[]) {
+  if (nargs < 0 || nargs > MAXARGS) {
+    fprintf(stderr, "Only upto %d arguments allowed in a call\n", MAXARGS);
+    return nullptr;
+  }
+  LIns *arguments[MAXARGS];
+  for (int i = 0; i < nargs; i++) {
+    arguments[i] = unwrap_ins(args[i]);
+  }
+  return wrap_ins(
+      unwrap_function_builder(fn)->call(function, opcode, nargs, arguments));
+}
+
+NJXLInsRef NJX_callv_handle(NJXFunctionBuilderRef fn,
+                            NJXFunctionHandle function, int nargs,
+                            NJXLInsRef args[]) {
+  return NJX_call_handle(fn, function, LIR_callv, nargs, args);
+}
+NJXLInsRef NJX_calli_handle(NJXFunctionBuilderRef fn,
+                            NJXFunctionHandle function, int nargs,
+                            NJXLInsRef args[]) {
+  return NJX_call_handle(fn, function, LIR_calli, nargs, args);
+}
+NJXLInsRef NJX_callq_handle(NJXFunctionBuilderRef fn,
+                            NJXFunctionHandle function, int nargs,
+                            NJXLInsRef args[]) {
+  return NJX_call_handle(fn, function, LIR_callq, nargs, args);
+}
+NJXLInsRef NJX_callf_handle(NJXFunctionBuilderRef fn,
+                            NJXFunctionHandle function, int nargs,
+                            NJXLInsRef args[]) {
+  return NJX_call_handle(fn, function, LIR_callf, nargs, args);
+}
+NJXLInsRef NJX_calld_handle(NJXFunctionBuilderRef fn,
+                            NJXFunctionHandle function, int nargs,
+                            NJXLInsRef args[]) {
+  return NJX_call_handle(fn, function, LIR_calld, nargs, args);
+}
+
+NJXLInsRef NJX_immf4(NJXFunctionBuilderRef fn, float x, float y, float z,
+                     float w) {
+  return wrap_ins(unwrap_function_builder(fn)->immf4(x, y, z, w));
+}
+
+NJXLInsRef NJX_retf4(NJXFunctionBuilderRef fn, NJXLInsRef result) {
+  return wrap_ins(unwrap_function_builder(fn)->retf4(unwrap_ins(result)));
+}
+
+NJXLInsRef NJX_load_f4(NJXFunctionBuilderRef fn, NJXLInsRef ptr,
+                       int32_t offset) {
+  return wrap_ins(unwrap_function_builder(fn)->loadf4(unwrap_ins(ptr), offset));
+}
+
+NJXLInsRef NJX_store_f4(NJXFunctionBuilderRef fn, NJXLInsRef value,
+                        NJXLInsRef ptr, int32_t offset) {
+  return wrap_ins(unwrap_function_builder(fn)->storef4(
+      unwrap_ins(value), unwrap_ins(ptr), offset));
+}
+
+static NJXLInsRef NJX_f4op1(NJXFunctionBuilderRef fn, LOpcode op,
+                            NJXLInsRef a) {
+  return wrap_ins(unwrap_function_builder(fn)->f4op1(op, unwrap_ins(a)));
+}
+
+static NJXLInsRef NJX_f4op2(NJXFunctionBuilderRef fn, LOpcode op,
+                            NJXLInsRef lhs, NJXLInsRef rhs) {
+  return wrap_ins(unwrap_function_builder(fn)->f4op2(op, unwrap_ins(lhs),
+                                                     unwrap_ins(rhs)));
+}
+
+NJXLInsRef NJX_addf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                     NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_addf4, lhs, rhs);
+}
+NJXLInsRef NJX_subf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                     NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_subf4, lhs, rhs);
+}
+NJXLInsRef NJX_mulf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                     NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_mulf4, lhs, rhs);
+}
+NJXLInsRef NJX_divf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                     NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_divf4, lhs, rhs);
+}
+NJXLInsRef NJX_minf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                     NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_minf4, lhs, rhs);
+}
+NJXLInsRef NJX_maxf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                     NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_maxf4, lhs, rhs);
+}
+NJXLInsRef NJX_dotf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                     NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_dotf4, lhs, rhs);
+}
+NJXLInsRef NJX_dotf3(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                     NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_dotf3, lhs, rhs);
+}
+NJXLInsRef NJX_dotf2(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                     NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_dotf2, lhs, rhs);
+}
+NJXLInsRef NJX_cmpeqf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_cmpeqf4, lhs, rhs);
+}
+NJXLInsRef NJX_cmpnef4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_cmpnef4, lhs, rhs);
+}
+NJXLInsRef NJX_cmpltf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_cmpltf4, lhs, rhs);
+}
+NJXLInsRef NJX_cmplef4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_cmplef4, lhs, rhs);
+}
+NJXLInsRef NJX_cmpgtf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_cmpgtf4, lhs, rhs);
+}
+NJXLInsRef NJX_cmpgef4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                       NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_cmpgef4, lhs, rhs);
+}
+NJXLInsRef NJX_eqf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                    NJXLInsRef rhs) {
+  return NJX_f4op2(fn, LIR_eqf4, lhs, rhs);
+}
+NJXLInsRef NJX_negf4(NJXFunctionBuilderRef fn, NJXLInsRef f4) {
+  return NJX_f4op1(fn, LIR_negf4, f4);
+}
+NJXLInsRef NJX_absf4(NJXFunctionBuilderRef fn, NJXLInsRef f4) {
+  return NJX_f4op1(fn, LIR_absf4, f4);
+}
+NJXLInsRef NJX_sqrtf4(NJXFunctionBuilderRef fn, NJXLInsRef f4) {
+  return NJX_f4op1(fn, LIR_sqrtf4, f4);
+}
+NJXLInsRef NJX_recipf4(NJXFunctionBuilderRef fn, NJXLInsRef f4) {
+  return NJX_f4op1(fn, LIR_recipf4, f4);
+}
+NJXLInsRef NJX_rsqrtf4(NJXFunctionBuilderRef fn, NJXLInsRef f4) {
+  return NJX_f4op1(fn, LIR_rsqrtf4, f4);
+}
+NJXLInsRef NJX_f2f4(NJXFunctionBuilderRef fn, NJXLInsRef f) {
+  return NJX_f4op1(fn, LIR_f2f4, f);
+}
+NJXLInsRef NJX_f4x(NJXFunctionBuilderRef fn, NJXLInsRef f4) {
+  return NJX_f4op1(fn, LIR_f4x, f4);
+}
+NJXLInsRef NJX_f4y(NJXFunctionBuilderRef fn, NJXLInsRef f4) {
+  return NJX_f4op1(fn, LIR_f4y, f4);
+}
+NJXLInsRef NJX_f4z(NJXFunctionBuilderRef fn, NJXLInsRef f4) {
+  return NJX_f4op1(fn, LIR_f4z, f4);
+}
+NJXLInsRef NJX_f4w(NJXFunctionBuilderRef fn, NJXLInsRef f4) {
+  return NJX_f4op1(fn, LIR_f4w, f4);
+}
+NJXLInsRef NJX_livef4(NJXFunctionBuilderRef fn, NJXLInsRef f4) {
+  return wrap_ins(unwrap_function_builder(fn)->livef4(unwrap_ins(f4)));
+}
+
+NJXLInsRef NJX_ffff2f4(NJXFunctionBuilderRef fn, NJXLInsRef x, NJXLInsRef y,
+                       NJXLInsRef z, NJXLInsRef w) {
+  return wrap_ins(unwrap_function_builder(fn)->ffff2f4(
+      unwrap_ins(x), unwrap_ins(y), unwrap_ins(z), unwrap_ins(w)));
+}
+
+NJXLInsRef NJX_swzf4(NJXFunctionBuilderRef fn, NJXLInsRef f4, uint8_t mask) {
+  return wrap_ins(unwrap_function_builder(fn)->swzf4(unwrap_ins(f4), mask));
+}
+
+bool NJX_is_f4(NJXLInsRef ins) { return unwrap_ins(ins)->isF4(); }
+
+NJXLInsRef NJX_callf4(NJXFunctionBuilderRef fn, const char *funcname,
+                      NJXCallAbiKind abi, int nargs, NJXLInsRef args[]) {
+  return NJX_call(fn, funcname, LIR_callf4, abi, nargs, args);
+}
+
+NJXLInsRef NJX_callf4_handle(NJXFunctionBuilderRef fn,
+                             NJXFunctionHandle function, int nargs,
+                             NJXLInsRef args[]) {
+  return NJX_call_handle(fn, function, LIR_callf4, nargs, args);
+}
+
 NJXLInsRef NJX_comment(NJXFunctionBuilderRef fn, const char *s) {
   return wrap_ins(unwrap_function_builder(fn)->comment(s));
 }
 
+#define NJX_BATCH_UNARY(X)                                                    \
+  X(NEGI, negi) X(NEGQ, negq) X(NEGD, negd) X(NEGF, negf) X(NOTI, noti)       \
+  X(NOTQ, notq) X(I2Q, i2q) X(UI2UQ, ui2uq) X(Q2I, q2i) X(Q2D, q2d)           \
+  X(I2D, i2d) X(I2F, i2f) X(UI2D, ui2d) X(UI2F, ui2f) X(F2D, f2d)             \
+  X(D2F, d2f) X(D2I, d2i) X(F2I, f2i) X(D2Q, d2q)                             \
+  X(RETI, reti) X(RETQ, retq) X(RETD, retd) X(RETF, retf)
+
+#define NJX_BATCH_BINARY(X)                                                   \
+  X(ADDI, addi) X(ADDQ, addq) X(ADDD, addd) X(ADDF, addf) X(SUBI, subi)       \
+  X(SUBQ, subq) X(SUBD, subd) X(SUBF, subf) X(MULI, muli) X(MULQ, mulq)       \
+  X(MULD, muld) X(MULF, mulf) X(DIVI, divi) X(DIVQ, divq) X(DIVD, divd)       \
+  X(DIVF, divf) X(MODI, modi) X(MODQ, modq) X(ANDI, andi) X(ANDQ, andq)       \
+  X(ORI, ori) X(ORQ, orq) X(XORI, xori) X(XORQ, xorq) X(LSHI, lshi)           \
+  X(LSHQ, lshq) X(RSHI, rshi) X(RSHQ, rshq) X(RSHUI, rshui) X(RSHUQ, rshuq)   \
+  X(EQI, eqi) X(EQQ, eqq) X(EQD, eqd) X(EQF, eqf) X(LTI, lti) X(LTQ, ltq)     \
+  X(LTD, ltd) X(LTF, ltf) X(LEI, lei) X(LEQ, leq) X(LED, led) X(LEF, lef)     \
+  X(GTI, gti) X(GTQ, gtq) X(GTD, gtd) X(GTF, gtf) X(GEI, gei) X(GEQ, geq)     \
+  X(GED, ged) X(GEF, gef) X(LTUI, ltui) X(LTUQ, ltuq) X(LEUI, leui)           \
+  X(LEUQ, leuq) X(GTUI, gtui) X(GTUQ, gtuq) X(GEUI, geui) X(GEUQ, geuq)
+
+#define NJX_BATCH_LOAD(X)                                                     \
+  X(LOAD_C2I, load_c2i) X(LOAD_UC2UI, load_uc2ui) X(LOAD_S2I, load_s2i)       \
+  X(LOAD_US2UI, load_us2ui) X(LOAD_I, load_i) X(LOAD_Q, load_q)               \
+  X(LOAD_F, load_f) X(LOAD_D, load_d)
+
+#define NJX_BATCH_STORE(X)                                                    \
+  X(STORE_I2C, store_i2c) X(STORE_I2S, store_i2s) X(STORE_I, store_i)         \
+  X(STORE_Q, store_q) X(STORE_F, store_f) X(STORE_D, store_d)
+
+#define NJX_BATCH_XOV(X) X(ADDXOVI, addxovi) X(SUBXOVI, subxovi) X(MULXOVI, mulxovi)
+
+#define NJX_BATCH_CALL(X)                                                     \
+  X(CALLV, callv) X(CALLI, calli) X(CALLQ, callq) X(CALLD, calld)             \
+  X(CALLF, callf)
+
+int NJX_build(NJXFunctionBuilderRef fn, const NJXInsRecord *records,
+              int count, NJXLInsRef *values, int first) {
+  // Branches to labels later in the batch, patched once they exist
+  std::vector<std::pair<NJXLInsRef, int>> forward;
+  int k;
+  for (k = 0; k < count; k++) {
+    const NJXInsRecord &r = records[k];
+    const int here = first + k;
+    bool bad = false;
+    // A value operand must be an instruction built before this one
+    auto val = [&](int i) -> NJXLInsRef {
+      int v = r.operands[i];
+      if (v < 0 || v >= here || values[v] == nullptr) {
+        bad = true;
+        return nullptr;
+      }
+      return values[v];
+    };
+    // A branch target may be -1, an earlier label or a later label record
+    auto target = [&](int i) -> NJXLInsRef {
+      int v = r.operands[i];
+      if (v < 0)
+        return nullptr;
+      if (v >= first + count ||
+          (v < here && (values[v] == nullptr ||
+                        !unwrap_ins(values[v])->isop(LIR_label))) ||
+          (v >= here && records[v - first].opcode != NJX_OP_LABEL)) {
+        bad = true;
+        return nullptr;
+      }
+      return v < here ? values[v] : nullptr;
+    };
+    auto later = [&](int i, NJXLInsRef branch) {
+      if (branch && r.operands[i] >= here)
+        forward.push_back(std::make_pair(branch, r.operands[i]));
+    };
+
+    NJXLInsRef ins = nullptr;
+    switch (r.opcode) {
+    case NJX_OP_IMMI:
+      ins = NJX_immi(fn, int32_t(r.imm.i));
+      break;
+    case NJX_OP_IMMQ:
+      ins = NJX_immq(fn, r.imm.i);
+      break;
+    case NJX_OP_IMMD:
+      ins = NJX_immd(fn, r.imm.d);
+      break;
+    case NJX_OP_IMMF:
+      ins = NJX_immf(fn, r.imm.f);
+      break;
+    case NJX_OP_PARAM:
+      ins = NJX_get_parameter(fn, int(r.imm.i));
+      break;
+    case NJX_OP_ALLOCA:
+      ins = NJX_alloca(fn, int32_t(r.imm.i));
+      break;
+#define NJX_BATCH_CASE(OP, name)                                              \
+  case NJX_OP_##OP: {                                                         \
+    NJXLInsRef a = val(0);                                                    \
+    if (!bad)                                                                 \
+      ins = NJX_##name(fn, a);                                                \
+    break;                                                                    \
+  }
+      NJX_BATCH_UNARY(NJX_BATCH_CASE)
+#undef NJX_BATCH_CASE
+#define NJX_BATCH_CASE(OP, name)                                              \
+  case NJX_OP_##OP: {                                                         \
+    NJXLInsRef a = val(0), b = val(1);                                        \
+    if (!bad)                                                                 \
+      ins = NJX_##name(fn, a, b);                                             \
+    break;                                                                    \
+  }
+      NJX_BATCH_BINARY(NJX_BATCH_CASE)
+#undef NJX_BATCH_CASE
+#define NJX_BATCH_CASE(OP, name)                                              \
+  case NJX_OP_##OP: {                                                         \
+    NJXLInsRef a = val(0);                                                    \
+    if (!bad)                                                                 \
+      ins = NJX_##name(fn, a, int32_t(r.imm.i));                              \
+    break;                                                                    \
+  }
+      NJX_BATCH_LOAD(NJX_BATCH_CASE)
+#undef NJX_BATCH_CASE
+#define NJX_BATCH_CASE(OP, name)                                              \
+  case NJX_OP_##OP: {                                                         \
+    NJXLInsRef a = val(0), b = val(1);                                        \
+    if (!bad)                                                                 \
+      ins = NJX_##name(fn, a, b, int32_t(r.imm.i));                           \
+    break;                                                                    \
+  }
+      NJX_BATCH_STORE(NJX_BATCH_CASE)
+      NJX_BATCH_XOV(NJX_BATCH_CASE)
+#undef NJX_BATCH_CASE
+#define NJX_BATCH_CASE(OP, name)                                              \
+  case NJX_OP_##OP: {                                                         \
+    NJXLInsRef args[3];                                                       \
+    int nargs = 0;                                                            \
+    while (nargs < 3 && r.operands[nargs] >= 0) {                             \
+      args[nargs] = val(nargs);                                               \
+      nargs++;                                                                \
+    }                                                                         \
+    if (!bad)                                                                 \
+      ins = NJX_##name##_handle(fn, NJXFunctionHandle(r.imm.i), nargs, args); \
+    break;                                                                    \
+  }
+      NJX_BATCH_CALL(NJX_BATCH_CASE)
+#undef NJX_BATCH_CASE
+    case NJX_OP_LABEL:
+      ins = NJX_add_label(fn);
+      break;
+    case NJX_OP_BR: {
+      NJXLInsRef to = target(0);
+      if (!bad) {
+        ins = NJX_br(fn, to);
+        later(0, ins);
+      }
+      break;
+    }
+    case NJX_OP_CBR_TRUE:
+    case NJX_OP_CBR_FALSE: {
+      NJXLInsRef cond = val(0), to = target(1);
+      if (!bad) {
+        ins = r.opcode == NJX_OP_CBR_TRUE ? NJX_cbr_true(fn, cond, to)
+                                          : NJX_cbr_false(fn, cond, to);
+        later(1, ins);
+      }
+      break;
+    }
+    case NJX_OP_ADDJOVI:
+    case NJX_OP_SUBJOVI:
+    case NJX_OP_MULJOVI:
+#ifdef NANOJIT_64BIT
+    case NJX_OP_ADDJOVQ:
+    case NJX_OP_SUBJOVQ:
+#endif
+    {
+      NJXLInsRef a = val(0), b = val(1), to = target(2);
+      if (bad)
+        break;
+      switch (r.opcode) {
+      case NJX_OP_ADDJOVI: ins = NJX_addjovi(fn, a, b, to); break;
+      case NJX_OP_SUBJOVI: ins = NJX_subjovi(fn, a, b, to); break;
+      case NJX_OP_MULJOVI: ins = NJX_muljovi(fn, a, b, to); break;
+#ifdef NANOJIT_64BIT
+      case NJX_OP_ADDJOVQ: ins = NJX_addjovq(fn, a, b, to); break;
+      case NJX_OP_SUBJOVQ: ins = NJX_subjovq(fn, a, b, to); break;
+#endif
+      }
+      later(2, ins);
+      break;
+    }
+    case NJX_OP_CHOOSE: {
+      NJXLInsRef c = val(0), t = val(1), f = val(2);
+      if (!bad)
+        ins = NJX_choose(fn, c, t, f, r.imm.i != 0);
+      break;
+    }
+    default:
+      bad = true;
+      break;
+    }
+    if (bad) {
+      fprintf(stderr, "NJX_build: invalid record %d (opcode %u)\n", k,
+              r.opcode);
+      break;
+    }
+    values[here] = ins;
+  }
+
+  for (size_t i = 0; i < forward.size(); i++) {
+    int label = forward[i].second;
+    if (label >= first + k)
+      continue; // not built, the batch stopped at an invalid record
+    NanoAssert(unwrap_ins(values[label])->isop(LIR_label));
+    NJX_set_jmp_target(forward[i].first, values[label]);
+  }
+  return k;
+}
+
 /**
 * Completes the function, and assembles the code.
 * If assembly is successful then the generated code is saved in the parent
@@ -1512,6 +2955,42 @@ NJXLInsRef NJX_comment(NJXFunctionBuilderRef fn, const char *s) {
 * Context ends.
 */
 void *NJX_finalize(NJXFunctionBuilderRef fn) {
-  return unwrap_function_builder(fn)->finalize();
+  auto impl = unwrap_function_builder(fn);
+  if (impl->module()) {
+    fprintf(stderr, "Error: '%s' is compiled by NJX_compile_module()\n",
+            impl->name().c_str());
+    return nullptr;
+  }
+  return impl->finalize();
+}
+
+NJXModuleRef NJX_create_module(NJXContextRef context) {
+  return wrap_module(new ModuleImpl(*unwrap_context(context)));
+}
+
+NJXFunctionBuilderRef NJX_module_add_function(NJXModuleRef module,
+                                              const char *name,
+                                              NJXValueKind return_type,
+                                              const NJXValueKind *args,
+                                              int argc, int optimize) {
+  auto impl = unwrap_module(module);
+  if (!impl->canAdd(name)) {
+    fprintf(stderr, "Error: cannot add function '%s' to the module\n", name);
+    return nullptr;
+  }
+  NJXFunctionBuilderRef fn = NJX_create_function_builder(
+      wrap_context(&impl->context()), name, return_type, args, argc,
+      optimize);
+  if (fn)
+    impl->add(unwrap_function_builder(fn));
+  return fn;
+}
+
+bool NJX_compile_module(NJXModuleRef module) {
+  return unwrap_module(module)->compile();
+}
+
+void NJX_destroy_module(NJXModuleRef module) {
+  delete unwrap_module(module);
 }
 }
@@ -20,6 +20,19 @@ extern "C" {
 struct NJXLIns;
 typedef struct NJXLIns *NJXLInsRef;
 
+/**
+* The C type of a float4 (NJXValueKind_F4) value. It must be a 16-byte
+* vector type rather than a struct of four floats: compiled functions
+* pass and return float4 values in a single xmm register, whereas a
+* struct would be split across two.
+*/
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+typedef __m128 NJXFloat4;
+#else
+typedef float NJXFloat4 __attribute__((vector_size(16)));
+#endif
+
 /**
 * The Jit Context defines a container for the Jit machinery and
 * also acts as the repository of the compiled functions. The Jit
@@ -37,6 +50,12 @@ typedef struct NJXContext *NJXContextRef;
 */
 typedef struct NFXFunctionBuilder *NJXFunctionBuilderRef;
 
+/**
+* A Module is a group of functions compiled together, so that they can
+* call each other in any order, see NJX_create_module().
+*/
+typedef struct NJXModule *NJXModuleRef;
+
 /**
 * Nanojit function parameter types are is a 64-bit quantities
 * on a 64-bit machine
@@ -66,6 +85,12 @@ enum {
 #endif
 };
 
+/*
+* Number of memory regions that loads and stores can be tagged with,
+* see NJX_set_region().
+*/
+enum { NJXMaxRegions = 8 };
+
 /*
 * These types are used to define function argument
 * types. See NJX_create_function_builder() below for further
@@ -79,6 +104,7 @@ enum NJXValueKind {
 #endif
   NJXValueKind_D = 4, // double
   NJXValueKind_F = 5, // single-precision float;
+  NJXValueKind_F4 = 6, // four single-precision floats, see NJXFloat4
 #ifdef NANOJIT_64BIT
   NJXValueKind_P = NJXValueKind_Q, // pointer
 #else
@@ -93,6 +119,7 @@ enum NJXValueKind {
 * q - quad (64 bit integer)
 * f - float (32 bit)
 * d - double (64 bit)
+* f4 - float4 (4 x 32 bit floats, SIMD)
 * On 64-bit architecture pointers are synonymous with quads,
 * i.e. a pointer is just a quad integer. There is no separate
 * pointer type.
@@ -105,21 +132,183 @@ enum NJXValueKind {
 */
 extern NJXContextRef NJX_create_context(int verbose);
 
+/**
+* Options for NJX_create_context_with_options(), covering every field of
+* nanojit's Config. NJX_init_context_options() fills in the defaults,
+* including the CPU features detected on the host; callers can then
+* override any field, e.g. clear the features above a fixed baseline so
+* that the generated code doesn't depend on the machine it is built on.
+* Turning on a CPU feature the host lacks leads to illegal instructions.
+*/
+typedef struct NJXContextOptions {
+  /* verbose output during code generation (debug builds only) */
+  bool verbose;
+
+  /* Optimization */
+  bool cseopt; /* allow CSE in functions built with optimize on */
+  /* copies of a loop's body NJX_PASS_UNROLL makes, 0 or 1 for none;
+     4 by default */
+  uint8_t unroll_factor;
+
+  /* Code generation */
+  bool force_long_branch; /* x86-64: always use 32-bit branch offsets */
+  bool check_page_flags;  /* check protection of code memory */
+
+  /* Hardening; see hardening_seed */
+  bool harden_function_alignment; /* random padding between functions */
+  bool harden_nop_insertion;      /* random nops within functions */
+  bool harden_blind_constants;    /* xor-blind constants in the code */
+  /* Seeds the noise used by hardening, 0 means seed from the clock */
+  uint32_t hardening_seed;
+
+  /* x86 and x86-64 CPU features; sse42 to erms are only detected on
+     x86-64 and are always false by default on x86 */
+  bool sse2;
+  bool sse3;
+  bool sse41;
+  bool sse42;
+  bool avx;
+  bool avx2;
+  bool bmi1;
+  bool bmi2;
+  bool fma;
+  bool popcnt;
+  bool erms; /* fast 'rep movsb' and 'rep stosb' */
+  bool use_cmov;
+  bool fixed_esp; /* x86: use a fixed stack pointer */
+
+  /* ARM */
+  uint8_t arm_arch; /* 4 to 7 */
+  bool arm_vfp;
+  bool arm_show_stats;
+  bool soft_float;
+} NJXContextOptions;
+
+/**
+* Fills in the default options, detecting the host's CPU features.
+*/
+extern void NJX_init_context_options(NJXContextOptions *options);
+
+/**
+* Creates a Jit Context with the given options, see NJXContextOptions.
+*/
+extern NJXContextRef
+NJX_create_context_with_options(const NJXContextOptions *options);
+
+/**
+* Returns the options a Jit Context was created with.
+*/
+extern void NJX_get_context_options(NJXContextRef context,
+                                    NJXContextOptions *options);
+
 /**
 * Destroys the Jit Context. Note that all compiled functions
 * managed by this context will die at this point.
 */
 extern void NJX_destroy_context(NJXContextRef);
 
+/**
+* Identifies a registered C function within its context. Calls built
+* through a handle (NJX_callq_handle() etc.) skip the lookup by name.
+* 0 is never a valid handle.
+*/
+typedef uint32_t NJXFunctionHandle;
+
 /*
 * Registers an externally defined C function.
 * Note that such functions can only accept upto 8 parameters
 * and the only supported calling convention is C calling
 * convention.
+* Returns the function's handle, or 0 on failure. Registering a name
+* again returns the existing handle if fptr is the same, 0 otherwise.
+*/
+extern NJXFunctionHandle NJX_register_C_function(NJXContextRef context,
+                                                 const char *name, void *fptr,
+                                                 enum NJXValueKind return_type,
+                                                 const enum NJXValueKind *args,
+                                                 int argc);
+
+/**
+* What a registered C function may do to memory. The optimizer uses
+* this to remove repeated calls and to keep loaded values across calls:
+* - NJX_EFFECTS_ANY: may read and write any memory (the default)
+* - NJX_EFFECTS_PURE: doesn't access memory and the result depends only
+*   on the arguments, so identical calls are merged; must return a value
+* - NJX_EFFECTS_READONLY: may read memory but never writes it, so loads
+*   before the call remain valid after it
+* - NJX_EFFECTS_STORES: writes only the regions in store_regions, a bit
+*   mask of (1 << region), see NJX_set_region()
+* Calls are only merged within a block, i.e. between labels.
+*/
+enum NJXFunctionEffects {
+  NJX_EFFECTS_ANY = 0,
+  NJX_EFFECTS_PURE = 1,
+  NJX_EFFECTS_READONLY = 2,
+  NJX_EFFECTS_STORES = 3
+};
+
+/**
+* Registers an externally defined C function, like
+* NJX_register_C_function(), declaring its effects on memory.
+* store_regions is only used with NJX_EFFECTS_STORES.
+*/
+extern NJXFunctionHandle
+NJX_register_C_function_ex(NJXContextRef context, const char *name, void *fptr,
+                           enum NJXValueKind return_type,
+                           const enum NJXValueKind *args, int argc,
+                           enum NJXFunctionEffects effects,
+                           uint32_t store_regions);
+
+/**
+* Returns the handle of a registered C function, or 0 if there is none
+* by that name.
+*/
+extern NJXFunctionHandle NJX_get_function_handle(NJXContextRef context,
+                                                 const char *name);
+
+/**
+* Hardware counters that can be sampled while running compiled
+* functions. See NJX_start_sampling().
+*/
+enum NJXPerfEvent {
+  NJX_PERF_CYCLES = 0, // falls back to the cpu-clock (in ns) if unavailable
+  NJX_PERF_INSTRUCTIONS = 1,
+  NJX_PERF_BRANCH_MISSES = 2,
+  NJX_PERF_CACHE_MISSES = 3
+};
+
+/**
+* Starts (or resumes) sampling the calling thread's performance counters
+* using Linux perf_event_open. Samples that land in a function compiled
+* by this context are attributed to that function. Returns false if no
+* counter could be opened, e.g. on other platforms or when
+* /proc/sys/kernel/perf_event_paranoid forbids it.
 */
-extern bool NJX_register_C_function(NJXContextRef context, const char *name,
-                                    void *fptr, enum NJXValueKind return_type,
-                                    const enum NJXValueKind *args, int argc);
+extern bool NJX_start_sampling(NJXContextRef context);
+
+/**
+* Stops sampling and attributes the samples gathered so far.
+*/
+extern void NJX_stop_sampling(NJXContextRef context);
+
+/**
+* Returns how many events each sample represents, or 0 if the event
+* is not being sampled.
+*/
+extern uint64_t NJX_get_sample_period(NJXContextRef context,
+                                      enum NJXPerfEvent event);
+
+/**
+* Returns the number of samples of the event attributed to the named
+* function; the name "[other]" covers samples outside compiled code.
+*/
+extern uint64_t NJX_get_samples(NJXContextRef context, const char *name,
+                                enum NJXPerfEvent event);
+
+/**
+* Prints a table of samples per function to stdout.
+*/
+extern void NJX_dump_samples(NJXContextRef context);
 
 /**
 * Returns a Jit compiled function looking it up by name.
@@ -134,7 +323,9 @@ extern void *NJX_get_function_by_name(NJXContextRef, const char *name);
 * machine code is generated by calling finalize(). After the function is
 * compiled the builder object can be thrown away - the compiled function
 * will live as long as the owning Jit Context lives.
-* If optimize flag is true then NanoJit's CSE and Expr filters are enabled.
+* optimize is an optimization level, see NJXOptLevel: 0 for none, 1 (or
+* true) to enable NanoJit's CSE and Expr filters, 2 for more expensive
+* passes as well.
 * *** IMPORTANT ***
 * Note that a limitation of NanoJIT is that the function can only
 * accept integer or pointer parameters on X64 architecture. Furthermore
@@ -147,6 +338,47 @@ extern NJXFunctionBuilderRef NJX_create_function_builder(
     NJXContextRef context, const char *name, enum NJXValueKind return_type,
     const enum NJXValueKind *args, int argc, int optimize);
 
+/**
+* The optional passes of a function's LIR pipeline, combined in a bit
+* mask; see NJX_create_function_builder_with_passes().
+*/
+enum NJXPass {
+  NJX_PASS_EXPR = 1 << 0, /* ExprFilter: constant folding, simplification */
+  NJX_PASS_CSE = 1 << 1,  /* CseFilter: common subexpression elimination */
+  NJX_PASS_STACK = 1 << 2, /* StackFilter and the assembler's optimizations */
+  NJX_PASS_SLOTS = 1 << 3, /* SlotFilter and SlotStoreFilter: keep the values
+                              of NJX_alloca() slots out of memory */
+  NJX_PASS_VECTORIZE = 1 << 4, /* LoopFilter: run counted loops over float
+                                  arrays four elements at a time */
+  NJX_PASS_UNROLL = 1 << 5, /* LoopFilter: run counted loops unroll_factor
+                               iterations at a time, see NJXContextOptions */
+  NJX_PASS_CHECKS = 1 << 6  /* LoopFilter: make the bounds checks of counted
+                               loops once, ahead of the loop */
+};
+
+/**
+* Optimization levels, trading compile time for code quality:
+* - NJX_O0: no passes, the fastest compile
+* - NJX_O1: NJX_PASS_EXPR, NJX_PASS_CSE and NJX_PASS_STACK
+* - NJX_O2: O1 plus the more expensive passes: NJX_PASS_SLOTS,
+*   NJX_PASS_VECTORIZE, NJX_PASS_UNROLL and NJX_PASS_CHECKS
+*/
+enum NJXOptLevel { NJX_O0 = 0, NJX_O1 = 1, NJX_O2 = 2 };
+
+/**
+* Returns the passes run at an optimization level.
+*/
+extern uint32_t NJX_passes_for_level(enum NJXOptLevel level);
+
+/**
+* Creates a function builder like NJX_create_function_builder(), running
+* exactly the given passes, a combination of NJXPass values. CSE is left
+* out if the context was created with cseopt off.
+*/
+extern NJXFunctionBuilderRef NJX_create_function_builder_with_passes(
+    NJXContextRef context, const char *name, enum NJXValueKind return_type,
+    const enum NJXValueKind *args, int argc, uint32_t passes);
+
 /**
 * Destroys the FunctionBuilder object. Note that this will not delete the
 * compiled function created using this builder - as the compiled function lives
@@ -245,12 +477,46 @@ extern NJXLInsRef NJX_divd(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
 extern NJXLInsRef NJX_divf(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
                            NJXLInsRef rhs);
 
+/* Minimum and maximum, as minsd/maxsd: if either operand is a NaN, or both
+   are zero, the result is rhs */
+extern NJXLInsRef NJX_mind(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                           NJXLInsRef rhs);
+extern NJXLInsRef NJX_maxd(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                           NJXLInsRef rhs);
+extern NJXLInsRef NJX_minf(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                           NJXLInsRef rhs);
+extern NJXLInsRef NJX_maxf(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                           NJXLInsRef rhs);
+
 /* Modulus */
 extern NJXLInsRef NJX_modi(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
                            NJXLInsRef rhs);
 extern NJXLInsRef NJX_modq(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
                            NJXLInsRef rhs);
 
+/**
+* High 64 bits of the unsigned 128-bit product of two quads; the low
+* 64 bits are NJX_mulq()
+*/
+extern NJXLInsRef NJX_mulhuq(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                             NJXLInsRef rhs);
+
+/**
+* High 64 bits of the signed 128-bit product of two quads
+*/
+extern NJXLInsRef NJX_mulhq(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                            NJXLInsRef rhs);
+
+/**
+* CRC32C (Castagnoli) of an int or a quad, accumulated onto the int crc
+* as the SSE4.2 crc32 instruction does, without pre- or post-inversion.
+* A call on CPUs without SSE4.2.
+*/
+extern NJXLInsRef NJX_crc32ci(NJXFunctionBuilderRef fn, NJXLInsRef crc,
+                              NJXLInsRef i);
+extern NJXLInsRef NJX_crc32cq(NJXFunctionBuilderRef fn, NJXLInsRef crc,
+                              NJXLInsRef q);
+
 /* Negate */
 extern NJXLInsRef NJX_negq(NJXFunctionBuilderRef fn, NJXLInsRef q);
 extern NJXLInsRef NJX_negi(NJXFunctionBuilderRef fn, NJXLInsRef q);
@@ -370,6 +636,13 @@ extern NJXLInsRef NJX_d2q(NJXFunctionBuilderRef fn, NJXLInsRef q);
 */
 extern NJXLInsRef NJX_add_label(NJXFunctionBuilderRef fn);
 
+/**
+* Inserts a register fence: all values are spilled to the stack and
+* no registers are live across it. A fence must immediately follow
+* each label that is the target of an NJX_switch().
+*/
+extern NJXLInsRef NJX_regfence(NJXFunctionBuilderRef fn);
+
 /**
 * Allocates 'size' bytes on the stack. Load and store instructions
 * can be used to access memory allocated.
@@ -391,6 +664,51 @@ extern NJXLInsRef NJX_cbr_true(NJXFunctionBuilderRef fn, NJXLInsRef cond,
 extern NJXLInsRef NJX_cbr_false(NJXFunctionBuilderRef fn, NJXLInsRef cond,
                                 NJXLInsRef to);
 
+/**
+* Overflow-checked arithmetic that branches to 'to' on signed overflow.
+* The result is the sum, difference or product, and is also the branch:
+* 'to' can be NULL and set later using NJX_set_jmp_target(). If the
+* operands are constants that can't overflow, the result is plain
+* arithmetic and setting the target does nothing.
+*/
+extern NJXLInsRef NJX_addjovi(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs, NJXLInsRef to);
+extern NJXLInsRef NJX_subjovi(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs, NJXLInsRef to);
+extern NJXLInsRef NJX_muljovi(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs, NJXLInsRef to);
+#ifdef NANOJIT_64BIT
+extern NJXLInsRef NJX_addjovq(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs, NJXLInsRef to);
+extern NJXLInsRef NJX_subjovq(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs, NJXLInsRef to);
+extern NJXLInsRef NJX_muljovq(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs, NJXLInsRef to);
+#endif
+
+/**
+* Overflow-checked arithmetic that leaves the function on signed
+* overflow. The function then returns at once, and in a function whose
+* return kind is NJXValueKind_P the value it returns identifies the
+* exit: NJX_get_exit_id() maps it back to 'exit_id'.
+*/
+extern NJXLInsRef NJX_addxovi(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs, int32_t exit_id);
+extern NJXLInsRef NJX_subxovi(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs, int32_t exit_id);
+extern NJXLInsRef NJX_mulxovi(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs, int32_t exit_id);
+#ifdef NANOJIT_64BIT
+extern NJXLInsRef NJX_mulxovq(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs, int32_t exit_id);
+#endif
+
+/**
+* Returns the exit_id of the overflow guard whose exit returned 'result',
+* or -1 if 'result' is an ordinary return value.
+*/
+extern int32_t NJX_get_exit_id(NJXContextRef jit, int64_t result);
+
 /**
 * Assigns a value based on the condition - similar to C's ?: operator.
 * If use_cmov is true, then emit CMOV assembly instruction
@@ -406,7 +724,8 @@ extern NJXLInsRef NJX_choose(NJXFunctionBuilderRef fn, NJXLInsRef cond,
 * are taken based on the value of an integer index.
 * size says how many possible values index can take
 * Note that each of the caller must set the
-* jump targets for each value using NJX_set_switch_target().
+* jump targets for each value using NJX_set_switch_target(), and that
+* each target label must be followed by NJX_regfence().
 * ISSUE: There is no way to specify a default case
 * ISSUE: Switch values must start at 0 and be consecutive
 */
@@ -427,6 +746,54 @@ extern void NJX_set_switch_target(NJXLInsRef switchins, uint32_t index,
 */
 extern void NJX_set_jmp_target(NJXLInsRef jmp, NJXLInsRef target);
 
+/**
+* Structured control flow, an alternative to labels and branches. A
+* variable holds a value that changes, such as a loop counter. It lives in
+* a stack slot, but is loaded at most once per block and stored only at
+* the end of a block that changed it, and within a block it is an ordinary
+* value. NJX_var() declares one, of the kind of 'initial', and returns its
+* id, or -1 if 'initial' has no value.
+*/
+extern int32_t NJX_var(NJXFunctionBuilderRef fn, NJXLInsRef initial);
+extern NJXLInsRef NJX_get_var(NJXFunctionBuilderRef fn, int32_t var);
+
+/**
+* Sets a variable. Inside a loop only the variables the loop carries, or
+* that were declared in it, can be set; returns false for any other.
+*/
+extern bool NJX_set_var(NJXFunctionBuilderRef fn, int32_t var,
+                        NJXLInsRef value);
+
+/**
+* Begins a loop, which runs until NJX_break_if() leaves it; NJX_loop_end()
+* branches back to the beginning. 'carried' lists the variables that the
+* loop changes. The others keep the values the loop uses in registers
+* through it, and should hold any value from before the loop that it uses.
+* Returns false if a carried variable can't be set here.
+*/
+extern bool NJX_loop_begin(NJXFunctionBuilderRef fn, const int32_t *carried,
+                           int ncarried);
+extern bool NJX_break_if(NJXFunctionBuilderRef fn, NJXLInsRef cond);
+extern bool NJX_loop_end(NJXFunctionBuilderRef fn);
+
+/**
+* Begins code that runs only if 'cond' is true, optionally followed by
+* NJX_else() and code that runs otherwise, and ended by NJX_endif().
+* Loops and ifs nest; the functions return false if they don't, and
+* NJX_if() and NJX_break_if() return false if 'cond' is null.
+*/
+extern bool NJX_if(NJXFunctionBuilderRef fn, NJXLInsRef cond);
+extern bool NJX_else(NJXFunctionBuilderRef fn);
+extern bool NJX_endif(NJXFunctionBuilderRef fn);
+
+/**
+* Sets the memory region of subsequent loads and stores (0 initially).
+* Memory in different regions must not overlap: a store to one region
+* doesn't invalidate values loaded from another. Returns false if region
+* is not in the range 0 to NJXMaxRegions-1.
+*/
+extern bool NJX_set_region(NJXFunctionBuilderRef fn, int region);
+
 /* Loads, here c means character, u means unsigned, s means short */
 extern NJXLInsRef NJX_load_c2i(NJXFunctionBuilderRef fn, NJXLInsRef ptr,
                                int32_t offset);
@@ -461,6 +828,33 @@ extern NJXLInsRef NJX_store_d(NJXFunctionBuilderRef fn, NJXLInsRef value,
 extern NJXLInsRef NJX_store_f(NJXFunctionBuilderRef fn, NJXLInsRef value,
                               NJXLInsRef ptr, int32_t offset);
 
+/**
+* Block memory operations on 'len' bytes, where len is a quad. They use
+* the current memory region for both blocks. NJX_copy_bytes requires that
+* the blocks don't overlap; NJX_fill_bytes stores the low byte of the int
+* 'byte'; NJX_compare_bytes returns an int that is negative, zero or
+* positive, as memcmp() does. Small constant lengths are expanded inline.
+*/
+extern NJXLInsRef NJX_copy_bytes(NJXFunctionBuilderRef fn, NJXLInsRef dest,
+                                 NJXLInsRef src, NJXLInsRef len);
+extern NJXLInsRef NJX_fill_bytes(NJXFunctionBuilderRef fn, NJXLInsRef dest,
+                                 NJXLInsRef byte, NJXLInsRef len);
+extern NJXLInsRef NJX_compare_bytes(NJXFunctionBuilderRef fn, NJXLInsRef a,
+                                    NJXLInsRef b, NJXLInsRef len);
+
+/**
+* Byte scans of 'len' bytes at 'a', in the current memory region. Both
+* return a quad: the offset of the first byte that matches, or 'len' if
+* none does. NJX_find_byte looks for the low byte of the int 'byte', as
+* memchr() does; NJX_find_any_byte looks for any of the four bytes of the
+* int 'bytes' (repeat a byte to look for fewer than four). On x64 these
+* scan 16 bytes at a time.
+*/
+extern NJXLInsRef NJX_find_byte(NJXFunctionBuilderRef fn, NJXLInsRef a,
+                                NJXLInsRef byte, NJXLInsRef len);
+extern NJXLInsRef NJX_find_any_byte(NJXFunctionBuilderRef fn, NJXLInsRef a,
+                                    NJXLInsRef bytes, NJXLInsRef len);
+
 /**
 * Tests the type of an instruction
 */
@@ -518,6 +912,107 @@ extern NJXLInsRef NJX_calld(NJXFunctionBuilderRef fn, const char *funcname,
                             enum NJXCallAbiKind abi, int nargs,
                             NJXLInsRef args[]);
 
+/**
+* Insert calls to a registered C function by handle, see
+* NJX_register_C_function(). Returns nullptr if the handle is invalid.
+*/
+extern NJXLInsRef NJX_callv_handle(NJXFunctionBuilderRef fn,
+                                   NJXFunctionHandle function, int nargs,
+                                   NJXLInsRef args[]);
+extern NJXLInsRef NJX_calli_handle(NJXFunctionBuilderRef fn,
+                                   NJXFunctionHandle function, int nargs,
+                                   NJXLInsRef args[]);
+extern NJXLInsRef NJX_callq_handle(NJXFunctionBuilderRef fn,
+                                   NJXFunctionHandle function, int nargs,
+                                   NJXLInsRef args[]);
+extern NJXLInsRef NJX_callf_handle(NJXFunctionBuilderRef fn,
+                                   NJXFunctionHandle function, int nargs,
+                                   NJXLInsRef args[]);
+extern NJXLInsRef NJX_calld_handle(NJXFunctionBuilderRef fn,
+                                   NJXFunctionHandle function, int nargs,
+                                   NJXLInsRef args[]);
+
+/**
+* Float4 (SIMD) operations. A float4 holds four floats, lanes x, y, z
+* and w, and is loaded and stored as 16 bytes. Unless noted otherwise
+* the operations work on each lane independently.
+*/
+extern NJXLInsRef NJX_immf4(NJXFunctionBuilderRef fn, float x, float y,
+                            float z, float w);
+extern NJXLInsRef NJX_retf4(NJXFunctionBuilderRef fn, NJXLInsRef result);
+extern NJXLInsRef NJX_load_f4(NJXFunctionBuilderRef fn, NJXLInsRef ptr,
+                              int32_t offset);
+extern NJXLInsRef NJX_store_f4(NJXFunctionBuilderRef fn, NJXLInsRef value,
+                               NJXLInsRef ptr, int32_t offset);
+extern NJXLInsRef NJX_addf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                            NJXLInsRef rhs);
+extern NJXLInsRef NJX_subf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                            NJXLInsRef rhs);
+extern NJXLInsRef NJX_mulf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                            NJXLInsRef rhs);
+extern NJXLInsRef NJX_divf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                            NJXLInsRef rhs);
+extern NJXLInsRef NJX_minf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                            NJXLInsRef rhs);
+extern NJXLInsRef NJX_maxf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                            NJXLInsRef rhs);
+extern NJXLInsRef NJX_negf4(NJXFunctionBuilderRef fn, NJXLInsRef f4);
+extern NJXLInsRef NJX_absf4(NJXFunctionBuilderRef fn, NJXLInsRef f4);
+extern NJXLInsRef NJX_sqrtf4(NJXFunctionBuilderRef fn, NJXLInsRef f4);
+/* Approximate 1/x and 1/sqrt(x), about 12 bits of precision */
+extern NJXLInsRef NJX_recipf4(NJXFunctionBuilderRef fn, NJXLInsRef f4);
+extern NJXLInsRef NJX_rsqrtf4(NJXFunctionBuilderRef fn, NJXLInsRef f4);
+/* The sum of the products of the lanes (all four, xyz or xy), a float */
+extern NJXLInsRef NJX_dotf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                            NJXLInsRef rhs);
+extern NJXLInsRef NJX_dotf3(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                            NJXLInsRef rhs);
+extern NJXLInsRef NJX_dotf2(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                            NJXLInsRef rhs);
+/* Comparisons giving a float4, each lane 1.0 if true and 0.0 if false */
+extern NJXLInsRef NJX_cmpeqf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs);
+extern NJXLInsRef NJX_cmpnef4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs);
+extern NJXLInsRef NJX_cmpltf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs);
+extern NJXLInsRef NJX_cmplef4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs);
+extern NJXLInsRef NJX_cmpgtf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs);
+extern NJXLInsRef NJX_cmpgef4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                              NJXLInsRef rhs);
+/* Whole-value equality, an int: 1 if all four lanes are equal */
+extern NJXLInsRef NJX_eqf4(NJXFunctionBuilderRef fn, NJXLInsRef lhs,
+                           NJXLInsRef rhs);
+/* A float copied to all four lanes, and four floats combined */
+extern NJXLInsRef NJX_f2f4(NJXFunctionBuilderRef fn, NJXLInsRef f);
+extern NJXLInsRef NJX_ffff2f4(NJXFunctionBuilderRef fn, NJXLInsRef x,
+                              NJXLInsRef y, NJXLInsRef z, NJXLInsRef w);
+/* Lane extraction, each a float */
+extern NJXLInsRef NJX_f4x(NJXFunctionBuilderRef fn, NJXLInsRef f4);
+extern NJXLInsRef NJX_f4y(NJXFunctionBuilderRef fn, NJXLInsRef f4);
+extern NJXLInsRef NJX_f4z(NJXFunctionBuilderRef fn, NJXLInsRef f4);
+extern NJXLInsRef NJX_f4w(NJXFunctionBuilderRef fn, NJXLInsRef f4);
+/**
+* Shuffles the lanes: result lane i is f4's lane (mask >> 2*i) & 3, so
+* 0x1B reverses the lanes and 0x00 broadcasts x.
+*/
+extern NJXLInsRef NJX_swzf4(NJXFunctionBuilderRef fn, NJXLInsRef f4,
+                            uint8_t mask);
+extern NJXLInsRef NJX_livef4(NJXFunctionBuilderRef fn, NJXLInsRef f4);
+extern bool NJX_is_f4(NJXLInsRef ins);
+/*
+* Calls returning a float4; float4 arguments are passed whole. A
+* conditional float4 is built with NJX_choose.
+*/
+extern NJXLInsRef NJX_callf4(NJXFunctionBuilderRef fn, const char *funcname,
+                             enum NJXCallAbiKind abi, int nargs,
+                             NJXLInsRef args[]);
+extern NJXLInsRef NJX_callf4_handle(NJXFunctionBuilderRef fn,
+                                    NJXFunctionHandle function, int nargs,
+                                    NJXLInsRef args[]);
+
 /* 
 * Inserts a comment, the supplied string must be valid as long as the 
 * function builder is live, as otherwise there will memory fault when 
@@ -525,6 +1020,90 @@ extern NJXLInsRef NJX_calld(NJXFunctionBuilderRef fn, const char *funcname,
 */
 extern NJXLInsRef NJX_comment(NJXFunctionBuilderRef fn, const char *s);
 
+/**
+* Opcodes of the batch API, NJX_build(). Each one builds what the NJX_
+* function of the same name builds, e.g. NJX_OP_ADDI is NJX_addi().
+*/
+enum NJXOpcode {
+  /* constants: imm.i, imm.d or imm.f */
+  NJX_OP_IMMI, NJX_OP_IMMQ, NJX_OP_IMMD, NJX_OP_IMMF,
+  /* imm.i is the parameter number, or the size in bytes */
+  NJX_OP_PARAM, NJX_OP_ALLOCA,
+  /* unary, operand 0 */
+  NJX_OP_NEGI, NJX_OP_NEGQ, NJX_OP_NEGD, NJX_OP_NEGF,
+  NJX_OP_NOTI, NJX_OP_NOTQ,
+  NJX_OP_I2Q, NJX_OP_UI2UQ, NJX_OP_Q2I, NJX_OP_Q2D, NJX_OP_I2D, NJX_OP_I2F,
+  NJX_OP_UI2D, NJX_OP_UI2F, NJX_OP_F2D, NJX_OP_D2F, NJX_OP_D2I, NJX_OP_F2I,
+  NJX_OP_D2Q,
+  /* binary, operands 0 and 1 */
+  NJX_OP_ADDI, NJX_OP_ADDQ, NJX_OP_ADDD, NJX_OP_ADDF,
+  NJX_OP_SUBI, NJX_OP_SUBQ, NJX_OP_SUBD, NJX_OP_SUBF,
+  NJX_OP_MULI, NJX_OP_MULQ, NJX_OP_MULD, NJX_OP_MULF,
+  NJX_OP_DIVI, NJX_OP_DIVQ, NJX_OP_DIVD, NJX_OP_DIVF,
+  NJX_OP_MODI, NJX_OP_MODQ,
+  NJX_OP_ANDI, NJX_OP_ANDQ, NJX_OP_ORI, NJX_OP_ORQ, NJX_OP_XORI, NJX_OP_XORQ,
+  NJX_OP_LSHI, NJX_OP_LSHQ, NJX_OP_RSHI, NJX_OP_RSHQ, NJX_OP_RSHUI,
+  NJX_OP_RSHUQ,
+  NJX_OP_EQI, NJX_OP_EQQ, NJX_OP_EQD, NJX_OP_EQF,
+  NJX_OP_LTI, NJX_OP_LTQ, NJX_OP_LTD, NJX_OP_LTF,
+  NJX_OP_LEI, NJX_OP_LEQ, NJX_OP_LED, NJX_OP_LEF,
+  NJX_OP_GTI, NJX_OP_GTQ, NJX_OP_GTD, NJX_OP_GTF,
+  NJX_OP_GEI, NJX_OP_GEQ, NJX_OP_GED, NJX_OP_GEF,
+  NJX_OP_LTUI, NJX_OP_LTUQ, NJX_OP_LEUI, NJX_OP_LEUQ,
+  NJX_OP_GTUI, NJX_OP_GTUQ, NJX_OP_GEUI, NJX_OP_GEUQ,
+  /* loads from operand 0, stores of operand 0 to operand 1; imm.i is
+     the offset */
+  NJX_OP_LOAD_C2I, NJX_OP_LOAD_UC2UI, NJX_OP_LOAD_S2I, NJX_OP_LOAD_US2UI,
+  NJX_OP_LOAD_I, NJX_OP_LOAD_Q, NJX_OP_LOAD_F, NJX_OP_LOAD_D,
+  NJX_OP_STORE_I2C, NJX_OP_STORE_I2S, NJX_OP_STORE_I, NJX_OP_STORE_Q,
+  NJX_OP_STORE_F, NJX_OP_STORE_D,
+  /* control flow: the branch target is an operand, the index of a label
+     record that may come later in the same batch, or -1 to set it later
+     with NJX_set_jmp_target() */
+  NJX_OP_LABEL,
+  NJX_OP_BR,        /* target is operand 0 */
+  NJX_OP_CBR_TRUE,  /* condition is operand 0, target operand 1 */
+  NJX_OP_CBR_FALSE,
+  NJX_OP_ADDJOVI,   /* operands 0 and 1, target operand 2 */
+  NJX_OP_SUBJOVI, NJX_OP_MULJOVI, NJX_OP_ADDJOVQ, NJX_OP_SUBJOVQ,
+  NJX_OP_ADDXOVI,   /* operands 0 and 1; imm.i is the exit id */
+  NJX_OP_SUBXOVI, NJX_OP_MULXOVI,
+  NJX_OP_CHOOSE,    /* condition, iftrue, iffalse; imm.i != 0 for cmov */
+  NJX_OP_RETI, NJX_OP_RETQ, NJX_OP_RETD, NJX_OP_RETF,
+  /* calls by handle, imm.i; up to three arguments, unused operands -1 */
+  NJX_OP_CALLV, NJX_OP_CALLI, NJX_OP_CALLQ, NJX_OP_CALLD, NJX_OP_CALLF,
+  NJX_OP_COUNT
+};
+
+/**
+* One instruction for NJX_build(). Operands are indices into the values
+* array passed to NJX_build(); unused ones should be -1.
+*/
+typedef struct NJXInsRecord {
+  uint32_t opcode; /* an NJXOpcode */
+  int32_t operands[3];
+  union {
+    int64_t i;
+    double d;
+    float f;
+  } imm;
+} NJXInsRecord;
+
+/**
+* Builds 'count' instructions in one call, for front-ends to which each
+* call is expensive (e.g. across an FFI boundary). The instruction built
+* for records[k] is stored in values[first + k]; operands refer to
+* values[0 .. first + k - 1], which may also hold instructions built by
+* earlier calls or by the other NJX_ functions. Branch targets may also
+* refer to labels later in the batch; a branch whose later target is not
+* an NJX_OP_LABEL record is invalid. Returns the number of records
+* built: if that is less than 'count', the record at that index was
+* invalid, and an error has been written to stderr. Forward branches
+* whose label was not built are left without a target.
+*/
+extern int NJX_build(NJXFunctionBuilderRef fn, const NJXInsRecord *records,
+                     int count, NJXLInsRef *values, int first);
+
 /**
 * Completes the function, and assembles the code.
 * If assembly is successful then the generated code is saved in the parent
@@ -534,6 +1113,41 @@ extern NJXLInsRef NJX_comment(NJXFunctionBuilderRef fn, const char *s);
 */
 extern void *NJX_finalize(NJXFunctionBuilderRef fn);
 
+/**
+* Creates a module. Functions added to a module can call each other - and
+* themselves - before any of them is compiled, so forward references and
+* mutual recursion work. NJX_compile_module() compiles them all, callees
+* before callers, and binds every call between them to a direct call.
+*/
+extern NJXModuleRef NJX_create_module(NJXContextRef context);
+
+/**
+* Adds a function to the module and returns its builder; the arguments are
+* as for NJX_create_function_builder(). From now on the other functions of
+* the module can call it by name. The builder belongs to the module: do not
+* finalize or destroy it. Returns nullptr if the module already has a
+* function of that name, or NJX_compile_module() has been called.
+*/
+extern NJXFunctionBuilderRef
+NJX_module_add_function(NJXModuleRef module, const char *name,
+                        enum NJXValueKind return_type,
+                        const enum NJXValueKind *args, int argc, int optimize);
+
+/**
+* Compiles all the functions of the module, which can then be looked up
+* with NJX_get_function_by_name() like finalized functions. Returns false
+* if any of them fails to compile; then none of them can be looked up,
+* not even those that did compile. A module is compiled only once: later
+* calls return false, whether or not the first one succeeded.
+*/
+extern bool NJX_compile_module(NJXModuleRef module);
+
+/**
+* Destroys the module and the builders of its functions. The compiled
+* functions live on in the owning Jit Context.
+*/
+extern void NJX_destroy_module(NJXModuleRef module);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,13 +1,14 @@
 #include <iostream>
 
 #include "nanojit/nanojit.h"
+#include "nanojitextra.h"
 
 using namespace nanojit;
 using namespace std;
 
-// We lump everything into a single access region for lirasm.
+// Each NJX memory region is an access region;  region 0 is the default.
 static const AccSet ACCSET_OTHER = (1 << 0);
-static const uint8_t LIRASM_NUM_USED_ACCS = 1;
+static const uint8_t LIRASM_NUM_USED_ACCS = NJXMaxRegions;
 
 
 #ifdef AVMPLUS_ARM
@@ -115,7 +116,8 @@ nanojit::LInsPrinter::formatGuardXov(InsBuf *buf, LIns *ins)
 const char*
 nanojit::LInsPrinter::accNames[] = {
     "o",    // (1 << 0) == ACCSET_OTHER
-    "?", "?", "?", "?", "?", "?", "?", "?", "?", "?",   //  1..10 (unused)
+    "r1", "r2", "r3", "r4", "r5", "r6", "r7",           //  1..7  (NJX regions)
+    "?", "?", "?",                                      //  8..10 (unused)
     "?", "?", "?", "?", "?", "?", "?", "?", "?", "?",   // 11..20 (unused)
     "?", "?", "?", "?", "?", "?", "?", "?", "?", "?",   // 21..30 (unused)
     "?"                                                 //     31 (unused)
@@ -128,6 +130,8 @@ void ValidateWriter::checkAccSet(LOpcode op, LIns* base, int32_t disp, AccSet ac
     (void)op;
     (void)base;
     (void)disp;
-    NanoAssert(accSet == ACCSET_OTHER);
+    // Exactly one region.
+    NanoAssert(accSet != 0 && (accSet & (accSet - 1)) == 0 &&
+               accSet < (AccSet(1) << LIRASM_NUM_USED_ACCS));
 }
 #endif
@@ -0,0 +1,123 @@
+/**
+* Reference versions of the kernels in njxbench.cpp, compiled by the
+* system C compiler at -O2 (see CMakeLists.txt). Each one computes
+* exactly what the corresponding NJX kernel computes, so the results
+* can be compared as well as the timings.
+*/
+#include "benchkernels.h"
+
+double c_dot(const double *a, const double *b, int64_t n) {
+  double sum = 0.0;
+  for (int64_t i = 0; i < n; i++)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+int64_t c_matmul(const double *a, const double *b, double *c, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    for (int64_t j = 0; j < n; j++) {
+      double sum = 0.0;
+      for (int64_t k = 0; k < n; k++)
+        sum += a[i * n + k] * b[k * n + j];
+      c[i * n + j] = sum;
+    }
+  }
+  return 0;
+}
+
+int64_t c_parse(const uint8_t *s, int64_t len) {
+  int64_t total = 0, value = 0;
+  for (int64_t i = 0; i < len; i++) {
+    uint32_t digit = (uint32_t)s[i] - '0';
+    if (digit < 10) {
+      value = value * 10 + digit;
+    } else {
+      total += value;
+      value = 0;
+    }
+  }
+  return total + value;
+}
+
+int64_t c_probe(const uint64_t *table, int64_t mask, const uint64_t *keys,
+                int64_t nkeys) {
+  int64_t hits = 0;
+  for (int64_t i = 0; i < nkeys; i++) {
+    uint64_t key = keys[i];
+    uint64_t h = (key * BENCH_HASH_MULTIPLIER) >> 32;
+    for (;;) {
+      uint64_t k = table[h & mask];
+      if (k == key) {
+        hits++;
+        break;
+      }
+      if (k == 0)
+        break;
+      h++;
+    }
+  }
+  return hits;
+}
+
+int64_t c_interp(const int32_t *code, int64_t count) {
+  uint64_t acc = 0; /* unsigned, so that overflow wraps as it does in LIR */
+  int64_t pc = 0;
+  for (;;) {
+    switch (code[pc]) {
+    case OP_HALT:
+      return (int64_t)acc;
+    case OP_ADDI:
+      acc += (uint64_t)(int64_t)code[pc + 1];
+      pc += 2;
+      break;
+    case OP_MULI:
+      acc *= (uint64_t)(int64_t)code[pc + 1];
+      pc += 2;
+      break;
+    case OP_XORI:
+      acc ^= (uint64_t)(int64_t)code[pc + 1];
+      pc += 2;
+      break;
+    case OP_DECJNZ:
+      count--;
+      pc = count != 0 ? code[pc + 1] : pc + 2;
+      break;
+    }
+  }
+}
+
+int64_t c_particles(float *pos, float *vel, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    float *p = pos + 4 * i;
+    float *v = vel + 4 * i;
+    for (int lane = 0; lane < 4; lane++) {
+      float g = lane == 1 ? BENCH_GRAVITY : 0.0f;
+      p[lane] = p[lane] + v[lane] * BENCH_DT;
+      v[lane] = v[lane] + g * BENCH_DT;
+    }
+  }
+  return 0;
+}
+
+int64_t c_prefix(int64_t *a, int64_t n) {
+  uint64_t sum = 0; /* unsigned, so that overflow wraps as it does in LIR */
+  for (int64_t i = 0; i < n; i++) {
+    sum += (uint64_t)a[i];
+    a[i] = (int64_t)sum;
+  }
+  return (int64_t)sum;
+}
+
+uint64_t bench_mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDULL;
+  x ^= x >> 33;
+  return x;
+}
+
+int64_t c_calls(const uint64_t *keys, int64_t n) {
+  uint64_t sum = 0;
+  for (int64_t i = 0; i < n; i++)
+    sum += bench_mix(keys[i]) ^ (bench_mix(keys[i]) >> 1);
+  return (int64_t)sum;
+}
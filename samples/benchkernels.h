@@ -0,0 +1,50 @@
+/**
+* Kernels shared by njxbench.cpp and their C reference versions in
+* benchkernels.c.
+*/
+#ifndef BENCHKERNELS_H
+#define BENCHKERNELS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Multiplier of the Fibonacci hash used by the probe kernel */
+#define BENCH_HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+/** Time step and vertical acceleration of the particle kernel */
+#define BENCH_DT 0.01f
+#define BENCH_GRAVITY -9.81f
+
+/** Opcodes of the interpreter kernel; ADDI, MULI, XORI and DECJNZ take
+* one operand, DECJNZ's being the pc to jump to */
+enum {
+  OP_HALT = 0,
+  OP_ADDI = 1,
+  OP_MULI = 2,
+  OP_XORI = 3,
+  OP_DECJNZ = 4,
+  OP_COUNT = 5
+};
+
+/** The helper called by the calls kernel, a 64-bit finalizer */
+extern uint64_t bench_mix(uint64_t x);
+
+extern double c_dot(const double *a, const double *b, int64_t n);
+extern int64_t c_matmul(const double *a, const double *b, double *c,
+                        int64_t n);
+extern int64_t c_parse(const uint8_t *s, int64_t len);
+extern int64_t c_probe(const uint64_t *table, int64_t mask,
+                       const uint64_t *keys, int64_t nkeys);
+extern int64_t c_interp(const int32_t *code, int64_t count);
+extern int64_t c_particles(float *pos, float *vel, int64_t n);
+extern int64_t c_prefix(int64_t *a, int64_t n);
+extern int64_t c_calls(const uint64_t *keys, int64_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -223,6 +223,236 @@ static int callextf1(NJXContextRef jit) {
   return 1;
 }
 
+/**
+* Compiles an addition that saturates instead of overflowing:
+* int satadd(int x, int y) { return overflows ? INT32_MAX : x+y; }
+*/
+static int satadd(NJXContextRef jit) {
+  const char *name = "satadd";
+  typedef int (*functype)(int, int);
+
+  NJXValueKind args[2] = {NJXValueKind_I, NJXValueKind_I};
+  NJXFunctionBuilderRef builder =
+      NJX_create_function_builder(jit, name, NJXValueKind_I, args, 2, true);
+  auto x = NJX_get_parameter(builder, 0);
+  auto y = NJX_get_parameter(builder, 1);
+  auto sum = NJX_addjovi(builder, x, y, nullptr); /* branch on overflow */
+  NJX_reti(builder, sum);
+  auto overflow = NJX_add_label(builder);
+  NJX_set_jmp_target(sum, overflow);
+  NJX_reti(builder, NJX_immi(builder, INT32_MAX));
+
+  functype f = (functype)NJX_finalize(builder);
+
+  NJX_destroy_function_builder(builder);
+
+  if (f != nullptr)
+    return f(2, 3) == 5 && f(INT32_MAX, 1) == INT32_MAX ? 0 : 1;
+  return 1;
+}
+
+/**
+* Compiles an addition that leaves the function through the exit tagged
+* 42 if it overflows:
+* intptr_t checkedadd(int x, int y) { return x+y; }
+*/
+static int checkedadd(NJXContextRef jit) {
+  const char *name = "checkedadd";
+  typedef int64_t (*functype)(int, int);
+
+  NJXValueKind args[2] = {NJXValueKind_I, NJXValueKind_I};
+  NJXFunctionBuilderRef builder =
+      NJX_create_function_builder(jit, name, NJXValueKind_P, args, 2, true);
+  auto x = NJX_get_parameter(builder, 0);
+  auto y = NJX_get_parameter(builder, 1);
+  auto sum = NJX_addxovi(builder, x, y, 42); /* exit on overflow */
+  NJX_retq(builder, NJX_i2q(builder, sum));
+
+  functype f = (functype)NJX_finalize(builder);
+
+  NJX_destroy_function_builder(builder);
+
+  if (f == nullptr)
+    return 1;
+  int64_t ok = f(2, 3), exited = f(INT32_MAX, 1);
+  return ok == 5 && NJX_get_exit_id(jit, ok) == -1 &&
+                 NJX_get_exit_id(jit, exited) == 42
+             ? 0
+             : 1;
+}
+
+/**
+* Compiles the add2 function above from a batch of instruction records:
+* int add2batch(int x) { return x+2; }
+*/
+static int add2batch(NJXContextRef jit) {
+  const char *name = "add2batch";
+  typedef int (*functype)(int);
+
+  NJXValueKind args[1] = {NJXValueKind_I};
+  NJXFunctionBuilderRef builder =
+      NJX_create_function_builder(jit, name, NJXValueKind_I, args, 1, true);
+
+  NJXInsRecord records[4] = {
+      {NJX_OP_PARAM, {-1, -1, -1}, {0}}, /* 0: arg1 */
+      {NJX_OP_IMMI, {-1, -1, -1}, {2}},  /* 1: 2 */
+      {NJX_OP_ADDI, {0, 1, -1}, {0}},    /* 2: add */
+      {NJX_OP_RETI, {2, -1, -1}, {0}},   /* 3: return result */
+  };
+  NJXLInsRef values[4];
+  int built = NJX_build(builder, records, 4, values, 0);
+
+  functype f = (functype)NJX_finalize(builder);
+
+  NJX_destroy_function_builder(builder);
+
+  if (built == 4 && f != nullptr)
+    return f(5) == 7 ? 0 : 1;
+  return 1;
+}
+
+/**
+* Checks that a batch whose forward branch targets a record that is not a
+* label stops at the branch: NJX_build returns the branch's index.
+*/
+static int badbatch(NJXContextRef jit) {
+  NJXValueKind args[1] = {NJXValueKind_I};
+  NJXFunctionBuilderRef builder =
+      NJX_create_function_builder(jit, "badbatch", NJXValueKind_I, args, 1,
+                                  true);
+
+  NJXInsRecord records[4] = {
+      {NJX_OP_PARAM, {-1, -1, -1}, {0}}, /* 0: arg1 */
+      {NJX_OP_BR, {3, -1, -1}, {0}},     /* 1: jump to 3, not a label */
+      {NJX_OP_IMMI, {-1, -1, -1}, {2}},  /* 2: 2 */
+      {NJX_OP_RETI, {0, -1, -1}, {0}},   /* 3: return arg1 */
+  };
+  NJXLInsRef values[4];
+  int built = NJX_build(builder, records, 4, values, 0);
+
+  NJX_destroy_function_builder(builder);
+
+  return built == 1 ? 0 : 1;
+}
+
+/**
+* Compiles a module of two mutually recursive functions:
+* int is_even(int n) { return n == 0 ? 1 : is_odd(n-1); }
+* int is_odd(int n) { return n == 0 ? 0 : is_even(n-1); }
+*/
+static int evenodd(NJXContextRef jit) {
+  typedef int (*functype)(int);
+  const char *names[2] = {"is_even", "is_odd"};
+
+  NJXValueKind args[1] = {NJXValueKind_I};
+  NJXModuleRef module = NJX_create_module(jit);
+  NJXFunctionBuilderRef builders[2];
+  for (int i = 0; i < 2; i++)
+    builders[i] = NJX_module_add_function(module, names[i], NJXValueKind_I,
+                                          args, 1, true);
+  for (int i = 0; i < 2; i++) {
+    NJXFunctionBuilderRef builder = builders[i];
+    auto n = NJX_get_parameter(builder, 0);
+    auto zero = NJX_cbr_true(
+        builder, NJX_eqi(builder, n, NJX_immi(builder, 0)), nullptr);
+    NJXLInsRef callargs[1] = {NJX_subi(builder, n, NJX_immi(builder, 1))};
+    NJX_reti(builder, NJX_calli(builder, names[1 - i],
+                                NJXCallAbiKind::NJX_CALLABI_FASTCALL, 1,
+                                callargs));
+    NJX_set_jmp_target(zero, NJX_add_label(builder));
+    NJX_reti(builder, NJX_immi(builder, i == 0 ? 1 : 0));
+  }
+  bool compiled = NJX_compile_module(module);
+  NJX_destroy_module(module);
+
+  functype even = (functype)NJX_get_function_by_name(jit, "is_even");
+  functype odd = (functype)NJX_get_function_by_name(jit, "is_odd");
+  if (compiled && even != nullptr && odd != nullptr)
+    return even(10) == 1 && even(7) == 0 && odd(7) == 1 ? 0 : 1;
+  return 1;
+}
+
+/**
+* Checks that a module with a function that fails to compile publishes
+* none of its functions, not even the two that compile, and cannot be
+* compiled again: broken() leaves an if unterminated.
+*/
+static int badmodule(NJXContextRef jit) {
+  const char *names[3] = {"bad_even", "bad_odd", "broken"};
+
+  NJXValueKind args[1] = {NJXValueKind_I};
+  NJXModuleRef module = NJX_create_module(jit);
+  NJXFunctionBuilderRef builders[3];
+  for (int i = 0; i < 3; i++)
+    builders[i] = NJX_module_add_function(module, names[i], NJXValueKind_I,
+                                          args, 1, true);
+  for (int i = 0; i < 2; i++) {
+    NJXFunctionBuilderRef builder = builders[i];
+    NJXLInsRef callargs[1] = {NJX_get_parameter(builder, 0)};
+    NJX_reti(builder, NJX_calli(builder, names[1 - i],
+                                NJXCallAbiKind::NJX_CALLABI_FASTCALL, 1,
+                                callargs));
+  }
+  auto n = NJX_get_parameter(builders[2], 0);
+  NJX_if(builders[2], NJX_eqi(builders[2], n, NJX_immi(builders[2], 0)));
+  NJX_reti(builders[2], n);
+  bool compiled = NJX_compile_module(module);
+  bool again = NJX_compile_module(module);
+  NJX_destroy_module(module);
+
+  for (int i = 0; i < 3; i++) {
+    if (NJX_get_function_by_name(jit, names[i]) != nullptr)
+      return 1;
+  }
+  return !compiled && !again ? 0 : 1;
+}
+
+/**
+* Compiles a loop with the structured builders:
+* int sumodd(int n) {
+*   int sum = 0;
+*   for (int i = 0; i < n; i++) { if (i & 1) sum += i; else sum -= 1; }
+*   return sum;
+* }
+*/
+static int sumodd(NJXContextRef jit) {
+  const char *name = "sumodd";
+  typedef int (*functype)(int);
+
+  NJXValueKind args[1] = {NJXValueKind_I};
+  NJXFunctionBuilderRef builder =
+      NJX_create_function_builder(jit, name, NJXValueKind_I, args, 1, true);
+  auto n = NJX_var(builder, NJX_get_parameter(builder, 0));
+  auto sum = NJX_var(builder, NJX_immi(builder, 0));
+  auto i = NJX_var(builder, NJX_immi(builder, 0));
+  int32_t carried[2] = {sum, i};
+  NJX_loop_begin(builder, carried, 2);
+  // A missing condition is refused, and builds nothing.
+  bool nocond = NJX_break_if(builder, nullptr) || NJX_if(builder, nullptr);
+  NJX_break_if(builder, NJX_gei(builder, NJX_get_var(builder, i),
+                                NJX_get_var(builder, n)));
+  auto odd = NJX_andi(builder, NJX_get_var(builder, i), NJX_immi(builder, 1));
+  NJX_if(builder, NJX_eqi(builder, odd, NJX_immi(builder, 1)));
+  NJX_set_var(builder, sum, NJX_addi(builder, NJX_get_var(builder, sum),
+                                     NJX_get_var(builder, i)));
+  NJX_else(builder);
+  NJX_set_var(builder, sum, NJX_subi(builder, NJX_get_var(builder, sum),
+                                     NJX_immi(builder, 1)));
+  NJX_endif(builder);
+  NJX_set_var(builder, i,
+              NJX_addi(builder, NJX_get_var(builder, i), NJX_immi(builder, 1)));
+  NJX_loop_end(builder);
+  NJX_reti(builder, NJX_get_var(builder, sum));
+
+  functype f = (functype)NJX_finalize(builder);
+
+  NJX_destroy_function_builder(builder);
+
+  if (f != nullptr && !nocond)
+    return f(0) == 0 && f(5) == 1 && f(10) == 20 ? 0 : 1;
+  return 1;
+}
+
 int main(int argc, const char *argv[]) {
 
   NJXContextRef jit = NJX_create_context(true);
@@ -235,6 +465,13 @@ int main(int argc, const char *argv[]) {
   rc += div(jit);
   rc += calladd(jit);
   rc += callextf1(jit);
+  rc += satadd(jit);
+  rc += checkedadd(jit);
+  rc += add2batch(jit);
+  rc += badbatch(jit);
+  rc += evenodd(jit);
+  rc += badmodule(jit);
+  rc += sumodd(jit);
 
   NJX_destroy_context(jit);
 
@@ -0,0 +1,607 @@
+/**
+* Measures the speed of code generated through the NanoJITExtra C API.
+* Each kernel is built with NJX and run against the same algorithm
+* compiled by the system C compiler at -O2 (benchkernels.c), and the
+* time per operation of both is reported. The results of the two
+* versions are compared too, so the benchmark doubles as a test.
+*
+* usage: njxbench [--csv] [--runs N]
+*/
+#include <nanojitextra.h>
+
+#include "benchkernels.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+typedef double (*DotFunc)(const double *, const double *, int64_t);
+typedef int64_t (*MatmulFunc)(const double *, const double *, double *,
+                              int64_t);
+typedef int64_t (*ParseFunc)(const uint8_t *, int64_t);
+typedef int64_t (*ProbeFunc)(const uint64_t *, int64_t, const uint64_t *,
+                             int64_t);
+typedef int64_t (*InterpFunc)(const int32_t *, int64_t);
+typedef int64_t (*ParticlesFunc)(float *, float *, int64_t);
+typedef int64_t (*PrefixFunc)(int64_t *, int64_t);
+typedef int64_t (*CallsFunc)(const uint64_t *, int64_t);
+
+/**
+* LIR has no phi nodes, so values carried around a loop live in stack
+* slots (NJX_alloca) that are loaded and stored on every iteration.
+* A counted loop looks like:
+*
+*   Loop loop = begin_loop(b, islot, n, &i);   // for (i = *islot; i < n;)
+*   ...body...
+*   end_loop(b, loop, islot, i);               // *islot = i + 1
+*/
+struct Loop {
+  NJXLInsRef top;  /* label at the loop head */
+  NJXLInsRef exit; /* the branch out of the loop */
+};
+
+static NJXLInsRef new_slot(NJXFunctionBuilderRef b, NJXLInsRef init) {
+  auto slot = NJX_alloca(b, 8);
+  if (NJX_is_d(init))
+    NJX_store_d(b, init, slot, 0);
+  else
+    NJX_store_q(b, init, slot, 0);
+  return slot;
+}
+
+static Loop begin_loop(NJXFunctionBuilderRef b, NJXLInsRef islot,
+                       NJXLInsRef n, NJXLInsRef *i) {
+  Loop loop;
+  loop.top = NJX_add_label(b);
+  *i = NJX_load_q(b, islot, 0);
+  loop.exit = NJX_cbr_true(b, NJX_geq(b, *i, n), nullptr);
+  return loop;
+}
+
+static void end_loop(NJXFunctionBuilderRef b, const Loop &loop,
+                     NJXLInsRef islot, NJXLInsRef i) {
+  NJX_store_q(b, NJX_addq(b, i, NJX_immq(b, 1)), islot, 0);
+  NJX_br(b, loop.top);
+  NJX_set_jmp_target(loop.exit, NJX_add_label(b));
+}
+
+/** Returns base + (index << shift) */
+static NJXLInsRef elem(NJXFunctionBuilderRef b, NJXLInsRef base,
+                       NJXLInsRef index, int shift) {
+  return NJX_addq(b, base, NJX_lshq(b, index, NJX_immi(b, shift)));
+}
+
+static void *finish(NJXFunctionBuilderRef b) {
+  void *f = NJX_finalize(b);
+  NJX_destroy_function_builder(b);
+  return f;
+}
+
+/**
+* double dot(const double *a, const double *b, int64_t n)
+*/
+static DotFunc build_dot(NJXContextRef jit) {
+  NJXValueKind args[3] = {NJXValueKind_P, NJXValueKind_P, NJXValueKind_Q};
+  auto b = NJX_create_function_builder(jit, "dot", NJXValueKind_D, args, 3,
+                                       true);
+  auto pa = NJX_get_parameter(b, 0);
+  auto pb = NJX_get_parameter(b, 1);
+  auto n = NJX_get_parameter(b, 2);
+  auto sum = new_slot(b, NJX_immd(b, 0.0));
+  auto islot = new_slot(b, NJX_immq(b, 0));
+
+  NJXLInsRef i;
+  Loop loop = begin_loop(b, islot, n, &i);
+  auto x = NJX_load_d(b, elem(b, pa, i, 3), 0);
+  auto y = NJX_load_d(b, elem(b, pb, i, 3), 0);
+  NJX_store_d(b, NJX_addd(b, NJX_load_d(b, sum, 0), NJX_muld(b, x, y)), sum,
+              0);
+  end_loop(b, loop, islot, i);
+
+  NJX_retd(b, NJX_load_d(b, sum, 0));
+  return (DotFunc)finish(b);
+}
+
+/**
+* int64_t matmul(const double *a, const double *b, double *c, int64_t n)
+* computes c = a * b for n x n matrices.
+*/
+static MatmulFunc build_matmul(NJXContextRef jit) {
+  NJXValueKind args[4] = {NJXValueKind_P, NJXValueKind_P, NJXValueKind_P,
+                          NJXValueKind_Q};
+  auto b = NJX_create_function_builder(jit, "matmul", NJXValueKind_Q, args, 4,
+                                       true);
+  auto pa = NJX_get_parameter(b, 0);
+  auto pb = NJX_get_parameter(b, 1);
+  auto pc = NJX_get_parameter(b, 2);
+  auto n = NJX_get_parameter(b, 3);
+  auto zero = NJX_immq(b, 0);
+  auto islot = new_slot(b, zero);
+  auto jslot = NJX_alloca(b, 8);
+  auto kslot = NJX_alloca(b, 8);
+  auto sum = NJX_alloca(b, 8);
+
+  NJXLInsRef i, j, k;
+  Loop iloop = begin_loop(b, islot, n, &i);
+  NJX_store_q(b, zero, jslot, 0);
+  Loop jloop = begin_loop(b, jslot, n, &j);
+  NJX_store_q(b, zero, kslot, 0);
+  NJX_store_d(b, NJX_immd(b, 0.0), sum, 0);
+  Loop kloop = begin_loop(b, kslot, n, &k);
+  // Reload i and j: they are defined outside this loop.
+  auto ii = NJX_load_q(b, islot, 0);
+  auto jj = NJX_load_q(b, jslot, 0);
+  auto x = NJX_load_d(b, elem(b, pa, NJX_addq(b, NJX_mulq(b, ii, n), k), 3), 0);
+  auto y = NJX_load_d(b, elem(b, pb, NJX_addq(b, NJX_mulq(b, k, n), jj), 3), 0);
+  NJX_store_d(b, NJX_addd(b, NJX_load_d(b, sum, 0), NJX_muld(b, x, y)), sum,
+              0);
+  end_loop(b, kloop, kslot, k);
+  ii = NJX_load_q(b, islot, 0);
+  jj = NJX_load_q(b, jslot, 0);
+  NJX_store_d(b, NJX_load_d(b, sum, 0),
+              elem(b, pc, NJX_addq(b, NJX_mulq(b, ii, n), jj), 3), 0);
+  end_loop(b, jloop, jslot, jj);
+  end_loop(b, iloop, islot, NJX_load_q(b, islot, 0));
+
+  NJX_retq(b, NJX_immq(b, 0));
+  return (MatmulFunc)finish(b);
+}
+
+/**
+* int64_t parse(const uint8_t *s, int64_t len)
+* sums the decimal numbers in s.
+*/
+static ParseFunc build_parse(NJXContextRef jit) {
+  NJXValueKind args[2] = {NJXValueKind_P, NJXValueKind_Q};
+  auto b = NJX_create_function_builder(jit, "parse", NJXValueKind_Q, args, 2,
+                                       true);
+  auto s = NJX_get_parameter(b, 0);
+  auto len = NJX_get_parameter(b, 1);
+  auto zero = NJX_immq(b, 0);
+  auto total = new_slot(b, zero);
+  auto value = new_slot(b, zero);
+  auto islot = new_slot(b, zero);
+
+  NJXLInsRef i;
+  Loop loop = begin_loop(b, islot, len, &i);
+  auto digit = NJX_subi(b, NJX_load_uc2ui(b, NJX_addq(b, s, i), 0),
+                        NJX_immi(b, '0'));
+  auto v = NJX_load_q(b, value, 0);
+  auto notdigit = NJX_cbr_false(b, NJX_ltui(b, digit, NJX_immi(b, 10)),
+                                nullptr);
+  NJX_store_q(b, NJX_addq(b, NJX_mulq(b, v, NJX_immq(b, 10)),
+                          NJX_ui2uq(b, digit)),
+              value, 0);
+  auto next = NJX_br(b, nullptr);
+  NJX_set_jmp_target(notdigit, NJX_add_label(b));
+  NJX_store_q(b, NJX_addq(b, NJX_load_q(b, total, 0), v), total, 0);
+  NJX_store_q(b, zero, value, 0);
+  NJX_set_jmp_target(next, NJX_add_label(b));
+  end_loop(b, loop, islot, i);
+
+  NJX_retq(b, NJX_addq(b, NJX_load_q(b, total, 0), NJX_load_q(b, value, 0)));
+  return (ParseFunc)finish(b);
+}
+
+/**
+* int64_t probe(const uint64_t *table, int64_t mask, const uint64_t *keys,
+*               int64_t nkeys)
+* counts the keys present in an open-addressed table (0 is empty).
+*/
+static ProbeFunc build_probe(NJXContextRef jit) {
+  NJXValueKind args[4] = {NJXValueKind_P, NJXValueKind_Q, NJXValueKind_P,
+                          NJXValueKind_Q};
+  auto b = NJX_create_function_builder(jit, "probe", NJXValueKind_Q, args, 4,
+                                       true);
+  auto table = NJX_get_parameter(b, 0);
+  auto mask = NJX_get_parameter(b, 1);
+  auto keys = NJX_get_parameter(b, 2);
+  auto nkeys = NJX_get_parameter(b, 3);
+  auto hits = new_slot(b, NJX_immq(b, 0));
+  auto hslot = NJX_alloca(b, 8);
+  auto islot = new_slot(b, NJX_immq(b, 0));
+
+  NJXLInsRef i;
+  Loop loop = begin_loop(b, islot, nkeys, &i);
+  auto key = NJX_load_q(b, elem(b, keys, i, 3), 0);
+  auto hash = NJX_rshuq(
+      b, NJX_mulq(b, key, NJX_immq(b, (int64_t)BENCH_HASH_MULTIPLIER)),
+      NJX_immi(b, 32));
+  NJX_store_q(b, hash, hslot, 0);
+  auto probe = NJX_add_label(b);
+  auto h = NJX_load_q(b, hslot, 0);
+  auto k = NJX_load_q(b, elem(b, table, NJX_andq(b, h, mask), 3), 0);
+  auto hit = NJX_cbr_true(b, NJX_eqq(b, k, key), nullptr);
+  auto miss = NJX_cbr_true(b, NJX_eqq(b, k, NJX_immq(b, 0)), nullptr);
+  NJX_store_q(b, NJX_addq(b, h, NJX_immq(b, 1)), hslot, 0);
+  // 'key' is used around the back edge, so extend its live range.
+  NJX_liveq(b, key);
+  NJX_br(b, probe);
+  NJX_set_jmp_target(hit, NJX_add_label(b));
+  NJX_store_q(b, NJX_addq(b, NJX_load_q(b, hits, 0), NJX_immq(b, 1)), hits,
+              0);
+  NJX_set_jmp_target(miss, NJX_add_label(b));
+  end_loop(b, loop, islot, NJX_load_q(b, islot, 0));
+
+  NJX_retq(b, NJX_load_q(b, hits, 0));
+  return (ProbeFunc)finish(b);
+}
+
+/**
+* int64_t interp(const int32_t *code, int64_t count)
+* runs a bytecode program, dispatching through a jump table.
+*/
+static InterpFunc build_interp(NJXContextRef jit) {
+  NJXValueKind args[2] = {NJXValueKind_P, NJXValueKind_Q};
+  auto b = NJX_create_function_builder(jit, "interp", NJXValueKind_Q, args, 2,
+                                       true);
+  auto code = NJX_get_parameter(b, 0);
+  auto acc = new_slot(b, NJX_immq(b, 0));
+  auto pcslot = new_slot(b, NJX_immq(b, 0));
+  auto count = new_slot(b, NJX_get_parameter(b, 1));
+
+  auto dispatch = NJX_add_label(b);
+  auto pc = NJX_load_q(b, pcslot, 0);
+  auto insn = elem(b, code, pc, 2);
+  auto sw = NJX_switch(b, NJX_load_i(b, insn, 0), OP_COUNT);
+
+  // Every switch target needs a register fence, see NJX_switch().
+  NJX_set_switch_target(sw, OP_HALT, NJX_add_label(b));
+  NJX_regfence(b);
+  NJX_retq(b, NJX_load_q(b, acc, 0));
+
+  NJXLInsRef (*arith[3])(NJXFunctionBuilderRef, NJXLInsRef, NJXLInsRef) = {
+      NJX_addq, NJX_mulq, NJX_xorq};
+  int ops[3] = {OP_ADDI, OP_MULI, OP_XORI};
+  for (int op = 0; op < 3; op++) {
+    NJX_set_switch_target(sw, ops[op], NJX_add_label(b));
+    NJX_regfence(b);
+    auto operand = NJX_i2q(b, NJX_load_i(b, insn, 4));
+    NJX_store_q(b, arith[op](b, NJX_load_q(b, acc, 0), operand), acc, 0);
+    NJX_store_q(b, NJX_addq(b, pc, NJX_immq(b, 2)), pcslot, 0);
+    NJX_br(b, dispatch);
+  }
+
+  NJX_set_switch_target(sw, OP_DECJNZ, NJX_add_label(b));
+  NJX_regfence(b);
+  auto c = NJX_subq(b, NJX_load_q(b, count, 0), NJX_immq(b, 1));
+  NJX_store_q(b, c, count, 0);
+  auto target = NJX_i2q(b, NJX_load_i(b, insn, 4));
+  NJX_store_q(b,
+              NJX_choose(b, NJX_eqq(b, c, NJX_immq(b, 0)),
+                         NJX_addq(b, pc, NJX_immq(b, 2)), target, true),
+              pcslot, 0);
+  NJX_br(b, dispatch);
+
+  return (InterpFunc)finish(b);
+}
+
+/**
+* int64_t particles(float *pos, float *vel, int64_t n)
+* advances n particles, stored as x,y,z,w float quadruples, by one step,
+* one float4 operation per quadruple.
+*/
+static ParticlesFunc build_particles(NJXContextRef jit) {
+  NJXValueKind args[3] = {NJXValueKind_P, NJXValueKind_P, NJXValueKind_Q};
+  auto b = NJX_create_function_builder(jit, "particles", NJXValueKind_Q, args,
+                                       3, true);
+  auto pos = NJX_get_parameter(b, 0);
+  auto vel = NJX_get_parameter(b, 1);
+  auto n = NJX_get_parameter(b, 2);
+  auto islot = new_slot(b, NJX_immq(b, 0));
+
+  NJXLInsRef i;
+  Loop loop = begin_loop(b, islot, n, &i);
+  auto p = elem(b, pos, i, 4);
+  auto v = elem(b, vel, i, 4);
+  auto dt = NJX_f2f4(b, NJX_immf(b, BENCH_DT));
+  auto g = NJX_immf4(b, 0.0f, BENCH_GRAVITY, 0.0f, 0.0f);
+  auto px = NJX_load_f4(b, p, 0);
+  auto vx = NJX_load_f4(b, v, 0);
+  NJX_store_f4(b, NJX_addf4(b, px, NJX_mulf4(b, vx, dt)), p, 0);
+  NJX_store_f4(b, NJX_addf4(b, vx, NJX_mulf4(b, g, dt)), v, 0);
+  end_loop(b, loop, islot, i);
+
+  NJX_retq(b, NJX_immq(b, 0));
+  return (ParticlesFunc)finish(b);
+}
+
+/**
+* int64_t prefix(int64_t *a, int64_t n)
+* replaces a[] by its running sums and returns the total.
+*/
+static PrefixFunc build_prefix(NJXContextRef jit) {
+  NJXValueKind args[2] = {NJXValueKind_P, NJXValueKind_Q};
+  auto b = NJX_create_function_builder(jit, "prefix", NJXValueKind_Q, args, 2,
+                                       true);
+  auto a = NJX_get_parameter(b, 0);
+  auto n = NJX_get_parameter(b, 1);
+  auto sum = new_slot(b, NJX_immq(b, 0));
+  auto islot = new_slot(b, NJX_immq(b, 0));
+
+  NJXLInsRef i;
+  Loop loop = begin_loop(b, islot, n, &i);
+  auto p = elem(b, a, i, 3);
+  auto s = NJX_addq(b, NJX_load_q(b, sum, 0), NJX_load_q(b, p, 0));
+  NJX_store_q(b, s, p, 0);
+  NJX_store_q(b, s, sum, 0);
+  end_loop(b, loop, islot, i);
+
+  NJX_retq(b, NJX_load_q(b, sum, 0));
+  return (PrefixFunc)finish(b);
+}
+
+/**
+* int64_t calls(const uint64_t *keys, int64_t n)
+* sums mix(keys[i]) ^ (mix(keys[i]) >> 1), reloading the key and calling
+* the helper twice as naively generated code would. Built once with mix
+* registered as NJX_EFFECTS_ANY and once as NJX_EFFECTS_PURE, in which
+* case the second load and call are merged with the first.
+*/
+static CallsFunc build_calls(NJXContextRef jit, const char *name,
+                             NJXFunctionHandle mix) {
+  NJXValueKind args[2] = {NJXValueKind_P, NJXValueKind_Q};
+  auto b = NJX_create_function_builder(jit, name, NJXValueKind_Q, args, 2,
+                                       true);
+  auto keys = NJX_get_parameter(b, 0);
+  auto n = NJX_get_parameter(b, 1);
+  auto sum = new_slot(b, NJX_immq(b, 0));
+  auto islot = new_slot(b, NJX_immq(b, 0));
+
+  NJXLInsRef i;
+  Loop loop = begin_loop(b, islot, n, &i);
+  NJXLInsRef key = NJX_load_q(b, elem(b, keys, i, 3), 0);
+  auto h1 = NJX_callq_handle(b, mix, 1, &key);
+  key = NJX_load_q(b, elem(b, keys, i, 3), 0);
+  auto h2 = NJX_callq_handle(b, mix, 1, &key);
+  auto h = NJX_xorq(b, h1, NJX_rshuq(b, h2, NJX_immi(b, 1)));
+  NJX_store_q(b, NJX_addq(b, NJX_load_q(b, sum, 0), h), sum, 0);
+  end_loop(b, loop, islot, i);
+
+  NJX_retq(b, NJX_load_q(b, sum, 0));
+  return (CallsFunc)finish(b);
+}
+
+/**
+* Runs f() until at least 20ms have passed, 'runs' times over, and
+* returns the best time per operation in ns.
+*/
+template <typename F> static double time_op(F f, double ops, int runs) {
+  typedef std::chrono::steady_clock clock;
+  double best = 0;
+  for (int r = 0; r < runs; r++) {
+    int64_t iters = 0;
+    auto start = clock::now();
+    std::chrono::duration<double, std::nano> elapsed;
+    do {
+      f();
+      iters++;
+      elapsed = clock::now() - start;
+    } while (elapsed.count() < 20e6);
+    double ns = elapsed.count() / (double(iters) * ops);
+    if (r == 0 || ns < best)
+      best = ns;
+  }
+  return best;
+}
+
+struct Result {
+  const char *name;
+  double ops;
+  double njx;
+  double c;
+  bool ok;
+};
+
+/** Deterministic pseudo-random numbers, so that runs are comparable */
+static uint64_t next_random(uint64_t *state) {
+  *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return *state >> 17;
+}
+
+int main(int argc, const char *argv[]) {
+  bool csv = false;
+  int runs = 5;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+      if (runs <= 0)
+        runs = 1;
+    } else {
+      fprintf(stderr, "usage: %s [--csv] [--runs N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  NJXContextRef jit = NJX_create_context(false);
+  NJXValueKind mixArgs[1] = {NJXValueKind_Q};
+  NJXFunctionHandle mix = NJX_register_C_function_ex(
+      jit, "mix", (void *)bench_mix, NJXValueKind_Q, mixArgs, 1,
+      NJX_EFFECTS_ANY, 0);
+  NJXFunctionHandle mixPure = NJX_register_C_function_ex(
+      jit, "mix_pure", (void *)bench_mix, NJXValueKind_Q, mixArgs, 1,
+      NJX_EFFECTS_PURE, 0);
+  DotFunc njx_dot = build_dot(jit);
+  MatmulFunc njx_matmul = build_matmul(jit);
+  ParseFunc njx_parse = build_parse(jit);
+  ProbeFunc njx_probe = build_probe(jit);
+  InterpFunc njx_interp = build_interp(jit);
+  ParticlesFunc njx_particles = build_particles(jit);
+  PrefixFunc njx_prefix = build_prefix(jit);
+  CallsFunc njx_calls = build_calls(jit, "calls", mix);
+  CallsFunc njx_calls_pure = build_calls(jit, "calls_pure", mixPure);
+  if (!njx_dot || !njx_matmul || !njx_parse || !njx_probe || !njx_interp ||
+      !njx_particles || !njx_prefix || !njx_calls || !njx_calls_pure) {
+    fprintf(stderr, "failed to compile the kernels\n");
+    return 1;
+  }
+
+  uint64_t seed = 42;
+  std::vector<Result> results;
+
+  {
+    const int64_t n = 100000;
+    std::vector<double> a(n), b(n);
+    for (int64_t i = 0; i < n; i++) {
+      a[i] = double(next_random(&seed) % 1000) / 7;
+      b[i] = double(next_random(&seed) % 1000) / 13;
+    }
+    volatile double sink;
+    Result r = {"dot", double(n), 0, 0,
+                njx_dot(&a[0], &b[0], n) == c_dot(&a[0], &b[0], n)};
+    r.njx = time_op([&] { sink = njx_dot(&a[0], &b[0], n); }, r.ops, runs);
+    r.c = time_op([&] { sink = c_dot(&a[0], &b[0], n); }, r.ops, runs);
+    (void)sink;
+    results.push_back(r);
+  }
+
+  {
+    const int64_t n = 64;
+    std::vector<double> a(n * n), b(n * n), c1(n * n), c2(n * n);
+    for (int64_t i = 0; i < n * n; i++) {
+      a[i] = double(next_random(&seed) % 100) / 3;
+      b[i] = double(next_random(&seed) % 100) / 5;
+    }
+    njx_matmul(&a[0], &b[0], &c1[0], n);
+    c_matmul(&a[0], &b[0], &c2[0], n);
+    Result r = {"matmul", double(n * n * n), 0, 0, c1 == c2};
+    r.njx = time_op([&] { njx_matmul(&a[0], &b[0], &c1[0], n); }, r.ops, runs);
+    r.c = time_op([&] { c_matmul(&a[0], &b[0], &c2[0], n); }, r.ops, runs);
+    results.push_back(r);
+  }
+
+  {
+    std::string text;
+    while (text.size() < 1000000) {
+      text += std::to_string(next_random(&seed) % 100000);
+      text += next_random(&seed) % 4 ? "," : "\n";
+    }
+    const uint8_t *s = (const uint8_t *)text.data();
+    int64_t len = int64_t(text.size());
+    volatile int64_t sink;
+    Result r = {"parse", double(len), 0, 0,
+                njx_parse(s, len) == c_parse(s, len)};
+    r.njx = time_op([&] { sink = njx_parse(s, len); }, r.ops, runs);
+    r.c = time_op([&] { sink = c_parse(s, len); }, r.ops, runs);
+    (void)sink;
+    results.push_back(r);
+  }
+
+  {
+    const int64_t size = 1 << 16;
+    const int64_t nkeys = 100000;
+    std::vector<uint64_t> table(size), keys(nkeys);
+    for (int64_t i = 0; i < size / 2; i++) {
+      uint64_t key = next_random(&seed) | 1;
+      uint64_t h = (key * BENCH_HASH_MULTIPLIER) >> 32;
+      while (table[h & (size - 1)] != 0)
+        h++;
+      table[h & (size - 1)] = key;
+    }
+    for (int64_t i = 0; i < nkeys; i++) {
+      // Half of the keys are present.
+      keys[i] = i % 2 ? table[next_random(&seed) % size] | 1
+                      : next_random(&seed) | 1;
+    }
+    volatile int64_t sink;
+    Result r = {"probe", double(nkeys), 0, 0,
+                njx_probe(&table[0], size - 1, &keys[0], nkeys) ==
+                    c_probe(&table[0], size - 1, &keys[0], nkeys)};
+    r.njx = time_op([&] { sink = njx_probe(&table[0], size - 1, &keys[0], nkeys); },
+                    r.ops, runs);
+    r.c = time_op([&] { sink = c_probe(&table[0], size - 1, &keys[0], nkeys); },
+                  r.ops, runs);
+    (void)sink;
+    results.push_back(r);
+  }
+
+  {
+    const int64_t count = 100000;
+    const int32_t code[] = {OP_ADDI,   3,  OP_MULI,   5,      OP_XORI,
+                            0x55,      OP_DECJNZ, 0,  OP_HALT};
+    volatile int64_t sink;
+    Result r = {"interp", double(4 * count), 0, 0,
+                njx_interp(code, count) == c_interp(code, count)};
+    r.njx = time_op([&] { sink = njx_interp(code, count); }, r.ops, runs);
+    r.c = time_op([&] { sink = c_interp(code, count); }, r.ops, runs);
+    (void)sink;
+    results.push_back(r);
+  }
+
+  {
+    const int64_t n = 10000;
+    std::vector<float> pos1(4 * n), vel1(4 * n);
+    for (int64_t i = 0; i < 4 * n; i++) {
+      pos1[i] = float(next_random(&seed) % 1000) / 10;
+      vel1[i] = float(next_random(&seed) % 1000) / 100;
+    }
+    std::vector<float> pos2(pos1), vel2(vel1);
+    njx_particles(&pos1[0], &vel1[0], n);
+    c_particles(&pos2[0], &vel2[0], n);
+    Result r = {"particles", double(n), 0, 0, pos1 == pos2 && vel1 == vel2};
+    r.njx = time_op([&] { njx_particles(&pos1[0], &vel1[0], n); }, r.ops, runs);
+    r.c = time_op([&] { c_particles(&pos2[0], &vel2[0], n); }, r.ops, runs);
+    results.push_back(r);
+  }
+
+  {
+    const int64_t n = 100000;
+    std::vector<int64_t> a1(n);
+    for (int64_t i = 0; i < n; i++)
+      a1[i] = int64_t(next_random(&seed) % 1000) - 500;
+    std::vector<int64_t> a2(a1);
+    bool same = njx_prefix(&a1[0], n) == c_prefix(&a2[0], n) && a1 == a2;
+    Result r = {"prefix", double(n), 0, 0, same};
+    // The sums grow on every call;  both versions wrap on overflow.
+    r.njx = time_op([&] { njx_prefix(&a1[0], n); }, r.ops, runs);
+    r.c = time_op([&] { c_prefix(&a2[0], n); }, r.ops, runs);
+    results.push_back(r);
+  }
+
+  {
+    const int64_t n = 100000;
+    std::vector<uint64_t> keys(n);
+    for (int64_t i = 0; i < n; i++)
+      keys[i] = next_random(&seed);
+    const int64_t expected = c_calls(&keys[0], n);
+    CallsFunc variants[2] = {njx_calls, njx_calls_pure};
+    const char *names[2] = {"calls", "calls-pure"};
+    for (int v = 0; v < 2; v++) {
+      volatile int64_t sink;
+      CallsFunc f = variants[v];
+      Result r = {names[v], double(n), 0, 0, f(&keys[0], n) == expected};
+      r.njx = time_op([&] { sink = f(&keys[0], n); }, r.ops, runs);
+      r.c = time_op([&] { sink = c_calls(&keys[0], n); }, r.ops, runs);
+      (void)sink;
+      results.push_back(r);
+    }
+  }
+
+  NJX_destroy_context(jit);
+
+  int rc = 0;
+  if (csv)
+    printf("kernel,ops,njx_ns_per_op,c_ns_per_op,ratio,ok\n");
+  else
+    printf("%-10s %10s %12s %12s %7s\n", "kernel", "ops", "njx ns/op",
+           "C -O2 ns/op", "ratio");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    if (csv)
+      printf("%s,%.0f,%.4f,%.4f,%.3f,%d\n", r.name, r.ops, r.njx, r.c,
+             r.njx / r.c, r.ok);
+    else
+      printf("%-10s %10.0f %12.3f %12.3f %7.2f%s\n", r.name, r.ops, r.njx, r.c,
+             r.njx / r.c, r.ok ? "" : "  RESULT MISMATCH");
+    if (!r.ok)
+      rc = 1;
+  }
+  return rc;
+}
@@ -12,6 +12,7 @@
 #include <sstream>
 #include <fstream>
 #include <utility>
+#include <chrono>
 
 #ifdef AVMPLUS_UNIX
 #include <sys/types.h>
@@ -25,6 +26,7 @@
 #include <assert.h>
 
 #include "nanojit/nanojit.h"
+#include "vprof/vprof.h"
 
 using namespace nanojit;
 using namespace std;
@@ -162,6 +164,30 @@ typedef float (FASTCALL *RetFloat)();
 typedef float4_t (FASTCALL *RetFloat4)();
 typedef GuardRecord* (FASTCALL *RetGuard)();
 
+// The most arguments --arg can pass to 'main'.
+static const size_t MaxArgs = 6;
+
+// Calls the code at 'code' with 'args' as its word-sized arguments.
+template<typename R> R
+callWithArgs(uintptr_t code, const vector<intptr_t>& args)
+{
+    const intptr_t* a = args.empty() ? NULL : &args[0];
+    switch (args.size()) {
+      case 0:  return ((R (FASTCALL *)())code)();
+      case 1:  return ((R (FASTCALL *)(intptr_t))code)(a[0]);
+      case 2:  return ((R (FASTCALL *)(intptr_t, intptr_t))code)(a[0], a[1]);
+      case 3:  return ((R (FASTCALL *)(intptr_t, intptr_t, intptr_t))code)(a[0], a[1], a[2]);
+      case 4:  return ((R (FASTCALL *)(intptr_t, intptr_t, intptr_t, intptr_t))code)
+                   (a[0], a[1], a[2], a[3]);
+      case 5:  return ((R (FASTCALL *)(intptr_t, intptr_t, intptr_t, intptr_t, intptr_t))code)
+                   (a[0], a[1], a[2], a[3], a[4]);
+      default: NanoAssert(args.size() == MaxArgs);
+               return ((R (FASTCALL *)(intptr_t, intptr_t, intptr_t, intptr_t, intptr_t,
+                                       intptr_t))code)
+                   (a[0], a[1], a[2], a[3], a[4], a[5]);
+    }
+}
+
 struct Function {
     const char *name;
     struct nanojit::CallInfo callInfo;
@@ -286,19 +312,52 @@ public:
         RetGuard rguard;
     };
     ReturnType mReturnType;
+    int mNumParams;             // ordinary params, ie. 'paramp N 0'
     Fragment *fragptr;
     map<string, LIns*> mLabels;
 };
 
 typedef map<string, LirasmFragment> Fragments;
 
+// The optional passes of the LIR pipeline, see -O and --passes.
+enum Pass {
+    PASS_EXPR   = 1 << 0,       // ExprFilter: folding and simplification
+    PASS_CSE    = 1 << 1,       // CseFilter
+    PASS_STACK  = 1 << 2,       // StackFilter, and Assembler::compile's own optimizations
+    PASS_SLOTS  = 1 << 3,       // SlotFilter and SlotStoreFilter
+    PASS_VECTORIZE = 1 << 4,    // LoopFilter
+    PASS_UNROLL = 1 << 5,       // LoopFilter, by Config::unroll_factor
+    PASS_CHECKS = 1 << 6        // LoopFilter, bounds checks made once per loop
+};
+
+// The names of the passes for --passes, in the order of their bits.
+static const char* const passNames[] = { "expr", "cse", "stack", "slots", "vectorize", "unroll",
+                                         "checks" };
+static const int numPasses = sizeof(passNames) / sizeof(passNames[0]);
+
+// The passes run at each optimization level.  -O2 is the place for
+// passes that cost more compile time than -O1 users would want.
+static const uint32_t O0_PASSES = 0;
+static const uint32_t O1_PASSES = PASS_EXPR | PASS_CSE | PASS_STACK;
+static const uint32_t O2_PASSES = O1_PASSES | PASS_SLOTS | PASS_VECTORIZE | PASS_UNROLL |
+                                  PASS_CHECKS;
+
+// The mix of instructions generated by --random, see --shape.
+enum RandomShape {
+    SHAPE_MIXED,        // every class, weighted as in LInsClasses.tbl
+    SHAPE_ARITH,        // straight-line integer arithmetic, loads and stores
+    SHAPE_BRANCHY,      // integer code with many short forward branches
+    SHAPE_CALLS,        // mixed code dominated by calls
+    SHAPE_FLOAT         // double and float arithmetic
+};
+
 class Lirasm {
 public:
     Lirasm(bool verbose, Config& config);
     ~Lirasm();
 
-    void assemble(istream &in, bool optimize);
-    void assembleRandom(int nIns, bool optimize);
+    void assemble(istream &in, uint32_t passes);
+    void assembleRandom(int nIns, uint32_t passes, RandomShape shape);
     bool lookupFunction(const string &name, CallInfo *&ci);
 
     LirBuffer *mLirbuf;
@@ -310,6 +369,12 @@ public:
     Fragments mFragments;
     Assembler mAssm;
     map<string, LOpcode> mOpMap;
+#ifdef NANOJIT_64BIT
+    vector<LOpcode> mProfileOps;        // opcodes to probe, see --vprof
+    vector<int64_t> mProfileBounds;     // histogram bounds, see --vprof-hist
+#endif
+    PerfSampler *mPerf;                 // non-NULL with --perf
+    uint64_t mCompileNs;                // time spent in Assembler::compile, see --compile-bench
 
     void bad(const string &msg) {
         cerr << "error: " << msg << endl;
@@ -322,14 +387,14 @@ private:
 
 class FragmentAssembler {
 public:
-    FragmentAssembler(Lirasm &parent, const string &fragmentName, bool optimize);
+    FragmentAssembler(Lirasm &parent, const string &fragmentName, uint32_t passes);
     ~FragmentAssembler();
 
     void assembleFragment(LirTokenStream &in,
                           bool implicitBegin,
                           const LirToken *firstToken);
 
-    void assembleRandomFragment(int nIns);
+    void assembleRandomFragment(int nIns, RandomShape shape);
 
 private:
     static uint32_t sProfId;
@@ -342,14 +407,17 @@ private:
     Lirasm &mParent;
     const string mFragName;
     Fragment *mFragment;
-    bool optimize;
+    uint32_t mPasses;
     vector<CallInfo*> mCallInfos;
     map<string, LIns*> mLabels;
     LirWriter *mLir;
     LirBufWriter *mBufWriter;
     LirWriter *mCseFilter;
     LirWriter *mExprFilter;
+    LirWriter *mSlotFilter;
+    LirWriter *mLoopFilter;
     LirWriter *mSoftFloatFilter;
+    LirWriter *mProfileWriter;
     LirWriter *mVerboseWriter;
     LirWriter *mValidateWriter1;
     LirWriter *mValidateWriter2;
@@ -361,6 +429,7 @@ private:
     size_t mOpcount;
 
     char mReturnTypeBits;
+    int mNumParams;
     vector<string> mTokens;
 
     void tokenizeLine(LirTokenStream &in, LirToken &token);
@@ -397,6 +466,13 @@ float callf1(float x, float i, float y, float l, float x1, float i1, float y1, f
     return x + i * y - l + x1 / i1 - y1 * l1; 
 }
 
+// Monotonic time, for the --compile-bench timings.
+static uint64_t nowNs()
+{
+    return uint64_t(chrono::duration_cast<chrono::nanoseconds>(
+                        chrono::steady_clock::now().time_since_epoch()).count());
+}
+
 // The calling tests with mixed argument types are sensible for all platforms, but they highlight
 // the differences between the supported ABIs on ARM.
 
@@ -644,10 +720,10 @@ dump_srecords(ostream &, Fragment *)
 uint32_t
 FragmentAssembler::sProfId = 0;
 
-FragmentAssembler::FragmentAssembler(Lirasm &parent, const string &fragmentName, bool optimize)
-    : mParent(parent), mFragName(fragmentName), optimize(optimize),
-      mBufWriter(NULL), mCseFilter(NULL), mExprFilter(NULL), mSoftFloatFilter(NULL), mVerboseWriter(NULL),
-      mValidateWriter1(NULL), mValidateWriter2(NULL)
+FragmentAssembler::FragmentAssembler(Lirasm &parent, const string &fragmentName, uint32_t passes)
+    : mParent(parent), mFragName(fragmentName), mPasses(passes),
+      mBufWriter(NULL), mCseFilter(NULL), mExprFilter(NULL), mSlotFilter(NULL), mLoopFilter(NULL), mSoftFloatFilter(NULL), mProfileWriter(NULL),
+      mVerboseWriter(NULL), mValidateWriter1(NULL), mValidateWriter2(NULL)
 {
     mFragment = new Fragment(NULL verbose_only(, (mParent.mLogc.lcbits &
                                                   nanojit::LC_FragProfile) ?
@@ -657,7 +733,7 @@ FragmentAssembler::FragmentAssembler(Lirasm &parent, const string &fragmentName,
 
     mLir = mBufWriter  = new LirBufWriter(mParent.mLirbuf, mParent.mConfig);
 #ifdef DEBUG
-    if (optimize) {     // don't re-validate if no optimization has taken place
+    if (passes & (PASS_EXPR | PASS_CSE)) {  // don't re-validate if no filter has run
         mLir = mValidateWriter2 =
             new ValidateWriter(mLir, mFragment->lirbuf->printer, "end of writer pipeline");
     }
@@ -669,7 +745,18 @@ FragmentAssembler::FragmentAssembler(Lirasm &parent, const string &fragmentName,
                                                   &mParent.mLogc);
     }
 #endif
-    if (optimize) {
+#ifdef NANOJIT_64BIT
+    // Probes go below CSE so that their loads and stores are left alone.
+    if (!mParent.mProfileOps.empty()) {
+        ProfileWriter *pw = new ProfileWriter(mLir, mParent.mAlloc, mFragName.c_str(), ACCSET_OTHER);
+        for (size_t i = 0; i < mParent.mProfileOps.size(); i++)
+            pw->addProbe(mParent.mProfileOps[i]);
+        if (!mParent.mProfileBounds.empty())
+            pw->setHistogram(int(mParent.mProfileBounds.size()), &mParent.mProfileBounds[0]);
+        mLir = mProfileWriter = pw;
+    }
+#endif
+    if (passes & PASS_CSE) {
         mLir = mCseFilter = new CseFilter(mLir, LIRASM_NUM_USED_ACCS, mParent.mAlloc, mParent.mConfig);
     }
 #if NJ_SOFTFLOAT_SUPPORTED
@@ -677,15 +764,24 @@ FragmentAssembler::FragmentAssembler(Lirasm &parent, const string &fragmentName,
         mLir = new SoftFloatFilter(mLir);
     }
 #endif
-    if (optimize) {
+    if (passes & PASS_EXPR) {
         mLir = mExprFilter = new ExprFilter(mLir);
     }
+    if (passes & PASS_SLOTS) {  // ahead of the others, so that they see the forwarded values
+        mLir = mSlotFilter = new SlotFilter(mLir);
+    }
+    if (passes & (PASS_VECTORIZE | PASS_UNROLL | PASS_CHECKS)) {  // ahead of the others too, so that they see the new loops
+        mLir = mLoopFilter = new LoopFilter(mLir, mParent.mAlloc, (passes & PASS_VECTORIZE) != 0,
+                                            (passes & PASS_UNROLL) ? mParent.mConfig.unroll_factor : 0,
+                                            (passes & PASS_CHECKS) != 0);
+    }
 #ifdef DEBUG
     mLir = mValidateWriter1 =
             new ValidateWriter(mLir, mFragment->lirbuf->printer, "start of writer pipeline");
 #endif
 
     mReturnTypeBits = 0;
+    mNumParams = 0;
     mLir->ins0(LIR_start);
     for (int i = 0; i < nanojit::NumSavedRegs; ++i)
         mLir->insParam(i, 1);
@@ -699,7 +795,10 @@ FragmentAssembler::~FragmentAssembler()
     delete mValidateWriter2;
     delete mVerboseWriter;
     delete mExprFilter;
+    delete mSlotFilter;
+    delete mLoopFilter;
     delete mSoftFloatFilter;
+    delete mProfileWriter;
     delete mCseFilter;
     delete mBufWriter;
 }
@@ -750,6 +849,11 @@ FragmentAssembler::assemble_jump(bool isCond)
         condition = NULL;
     }
     string name = pop_front(mTokens);
+    // A jump back to a label we have seen gets its target now, so that
+    // the writer pipeline sees the loop it closes.
+    map<string, LIns*>::const_iterator target = mJumpLabels.find(name);
+    if (target != mJumpLabels.end())
+        return mLir->insBranch(mOpcode, condition, target->second);
     LIns *ins = mLir->insBranch(mOpcode, condition, NULL);
     //mJumps.push_back(make_pair<string, LIns*>(name, ins));
     mJumps.push_back(make_pair(name, ins));
@@ -932,8 +1036,10 @@ FragmentAssembler::assemble_jump_jov()
     string name = mTokens[2];
 
     LIns *ins = mLir->insBranchJov(mOpcode, a, b, NULL);
-    //mJumps.push_back(make_pair<string, LIns*>(name, ins));
-    mJumps.push_back(make_pair(name, ins));
+    // With constant operands that cannot overflow the ExprFilter folds the
+    // branch away and returns the result, which has no target to resolve.
+    if (ins->isJov())
+        mJumps.push_back(make_pair(name, ins));
     return ins;
 }
 
@@ -963,8 +1069,11 @@ FragmentAssembler::endFragment()
     mFragment->lastIns =
         mLir->insGuard(LIR_x, NULL, createGuardRecord(createSideExit()));
 
-    mParent.mAssm.compile(mFragment, mParent.mAlloc, optimize
+    uint64_t start = nowNs();
+    mParent.mAssm.setRemoveDeadSlotStores((mPasses & PASS_SLOTS) != 0);
+    mParent.mAssm.compile(mFragment, mParent.mAlloc, (mPasses & PASS_STACK) != 0
               verbose_only(, mParent.mLirbuf->printer));
+    mParent.mCompileNs += nowNs() - start;
 
     if (mParent.mAssm.error() != nanojit::None) {
         cerr << "error during assembly: ";
@@ -979,6 +1088,9 @@ FragmentAssembler::endFragment()
         std::exit(1);
     }
 
+    if (mParent.mPerf)
+        mParent.mPerf->addCode(mFragName.c_str(), mParent.mAssm.codeList);
+
     LirasmFragment *f;
     f = &mParent.mFragments[mFragName];
 
@@ -1014,6 +1126,7 @@ FragmentAssembler::endFragment()
         break;
     }
 
+    f->mNumParams = mNumParams;
     mParent.mFragments[mFragName].mLabels = mLabels;
 }
 
@@ -1138,6 +1251,15 @@ FragmentAssembler::assembleFragment(LirTokenStream &in, bool implicitBegin, cons
           case LIR_negd:
           case LIR_negf:
           case LIR_negf4:
+          case LIR_absd:
+          case LIR_absf:
+          case LIR_absf4:
+          case LIR_sqrtf:
+          case LIR_sqrtf4:
+          case LIR_recipf:
+          case LIR_recipf4:
+          case LIR_rsqrtf:
+          case LIR_rsqrtf4:
           case LIR_noti:
           CASE86(LIR_notq:)
           CASESF(LIR_dlo2i:)
@@ -1178,18 +1300,35 @@ FragmentAssembler::assembleFragment(LirTokenStream &in, bool implicitBegin, cons
 #endif
           CASE86(LIR_mulq:)
           CASE86(LIR_divq:)
+          CASE86(LIR_mulhuq:)
+          CASE86(LIR_mulhq:)
           case LIR_addd:
           case LIR_subd:
           case LIR_muld:
           case LIR_divd:
+          case LIR_mind:
+          case LIR_maxd:
           case LIR_addf:
           case LIR_subf:
           case LIR_mulf:
           case LIR_divf:
+          case LIR_minf:
+          case LIR_maxf:
           case LIR_addf4:
           case LIR_subf4:
           case LIR_mulf4:
           case LIR_divf4:
+          case LIR_minf4:
+          case LIR_maxf4:
+          case LIR_dotf4:
+          case LIR_dotf3:
+          case LIR_dotf2:
+          case LIR_cmpgtf4:
+          case LIR_cmpltf4:
+          case LIR_cmpgef4:
+          case LIR_cmplef4:
+          case LIR_cmpeqf4:
+          case LIR_cmpnef4:
           CASE64(LIR_addq:)
           CASE64(LIR_subq:)
           case LIR_andi:
@@ -1204,6 +1343,8 @@ FragmentAssembler::assembleFragment(LirTokenStream &in, bool implicitBegin, cons
           CASE64(LIR_lshq:)
           CASE64(LIR_rshq:)
           CASE64(LIR_rshuq:)
+          case LIR_crc32ci:
+          CASE64(LIR_crc32cq:)
           case LIR_eqi:
           case LIR_lti:
           case LIR_gti:
@@ -1305,6 +1446,17 @@ FragmentAssembler::assembleFragment(LirTokenStream &in, bool implicitBegin, cons
                                   immI(mTokens[2]), ACCSET_OTHER);
             break;
 
+          case LIR_copyb:
+          case LIR_fillb:
+          case LIR_cmpb:
+          case LIR_findb:
+          case LIR_findanyb:
+            need(3);
+            ins = mLir->insMem(mOpcode, ref(mTokens[0]),
+                               ref(mTokens[1]),
+                               ref(mTokens[2]), ACCSET_OTHER);
+            break;
+
 #if NJ_EXPANDED_LOADSTORE_SUPPORTED 
           case LIR_ldc2i:
           case LIR_lds2i:
@@ -1327,6 +1479,8 @@ FragmentAssembler::assembleFragment(LirTokenStream &in, bool implicitBegin, cons
             need(2);
             ins = mLir->insParam(immI(mTokens[0]),
                                  immI(mTokens[1]));
+            if (immI(mTokens[1]) == 0)
+                mNumParams = max(mNumParams, immI(mTokens[0]) + 1);
             break;
 
           // XXX: similar to iparam/qparam above.
@@ -1352,6 +1506,7 @@ FragmentAssembler::assembleFragment(LirTokenStream &in, bool implicitBegin, cons
           case LIR_addxovi:
           case LIR_subxovi:
           case LIR_mulxovi:
+          CASE64(LIR_mulxovq:)
             ins = assemble_guard_xov();
             break;
 
@@ -1360,6 +1515,7 @@ FragmentAssembler::assembleFragment(LirTokenStream &in, bool implicitBegin, cons
           case LIR_muljovi:
           CASE64(LIR_addjovq:)
           CASE64(LIR_subjovq:)
+          CASE64(LIR_muljovq:)
             ins = assemble_jump_jov();
             break;
 
@@ -1591,7 +1747,7 @@ const CallInfo ci_V_IQF = CI(f_V_IQF, CallInfo::typeSig3(ARGTYPE_V, ARGTYPE_I, A
 //   test without having multiple fragments;  when we only have one fragment
 //   we don't really want to leave it early)
 // - LIR_reti/LIR_retq/LIR_retd/LIR_retf (hard to test without having multiple fragments)
-// - LIR_j/LIR_jt/LIR_jf/LIR_jtbl/LIR_label
+// - LIR_j/LIR_jtbl, and LIR_jt/LIR_jf other than with --shape branchy
 // - LIR_file/LIR_line (#ifdef VTUNE only)
 // - LIR_modd (not implemented in NJ backends)
 //
@@ -1599,8 +1755,11 @@ const CallInfo ci_V_IQF = CI(f_V_IQF, CallInfo::typeSig3(ARGTYPE_V, ARGTYPE_I, A
 // - Loads always use accSet==ACCSET_OTHER
 // - Stores always use accSet==ACCSET_OTHER
 //
+// 'shape' reweights the classes to produce code of a particular kind;  it
+// is mostly useful for benchmarking the compiler (see --compile-bench).
+//
 void
-FragmentAssembler::assembleRandomFragment(int nIns)
+FragmentAssembler::assembleRandomFragment(int nIns, RandomShape shape)
 {
     vector<LIns*> Bs;       // boolean values, ie. 32-bit int values produced by tests
     vector<LIns*> Is;       // 32-bit int values
@@ -1659,12 +1818,16 @@ FragmentAssembler::assembleRandomFragment(int nIns)
     D_DD_ops.push_back(LIR_subd);
     D_DD_ops.push_back(LIR_muld);
     D_DD_ops.push_back(LIR_divd);
+    D_DD_ops.push_back(LIR_mind);
+    D_DD_ops.push_back(LIR_maxd);
 
     vector<LOpcode> F_FF_ops;
     F_FF_ops.push_back(LIR_addf);
     F_FF_ops.push_back(LIR_subf);
     F_FF_ops.push_back(LIR_mulf);
     F_FF_ops.push_back(LIR_divf);
+    F_FF_ops.push_back(LIR_minf);
+    F_FF_ops.push_back(LIR_maxf);
 
     vector<LOpcode> F4_F4F4_ops;
     F4_F4F4_ops.push_back(LIR_addf4);
@@ -1844,6 +2007,45 @@ FragmentAssembler::assembleRandomFragment(int nIns)
 #include "LInsClasses.tbl"
 #undef CL___
 
+    // Reweight the classes according to the shape.  Labels are always kept
+    // because they bound CSE live ranges (see LLABEL below).
+    if (shape == SHAPE_ARITH || shape == SHAPE_BRANCHY || shape == SHAPE_FLOAT) {
+        static const LInsClass intClasses[] = {
+            LALLOC, LLABEL, LIMM_I, LOP_I_I, LOP_I_II, LOP_I_BII, LOP_B_II,
+#ifdef NANOJIT_64BIT
+            LIMM_Q, LOP_Q_QQ, LOP_Q_QI, LOP_Q_BQQ, LOP_B_QQ, LOP_Q_I, LOP_I_Q, LLD_Q, LST_Q,
+#endif
+            LLD_I, LST_I, LLAST
+        };
+        static const LInsClass floatClasses[] = {
+            LALLOC, LLABEL, LIMM_I, LIMM_D, LOP_D_D, LOP_D_DD, LOP_D_BDD, LOP_B_DD,
+            LOP_D_I, LOP_I_D, LLD_D, LST_D, LCALL_D_D3, LCALL_D_D8,
+            LIMM_F, LOP_F_F, LOP_F_FF, LOP_F_BFF, LOP_B_FF, LOP_F_I, LOP_I_F,
+            LOP_D_F, LOP_F_D, LLD_F, LST_F, LLAST
+        };
+        const LInsClass* keep = shape == SHAPE_FLOAT ? floatClasses : intClasses;
+        int kept[LLAST];
+        memset(kept, 0, sizeof(kept));
+        for (int i = 0; keep[i] != LLAST; i++)
+            kept[keep[i]] = relFreqs[keep[i]];
+        memcpy(relFreqs, kept, sizeof(relFreqs));
+    }
+    if (shape == SHAPE_BRANCHY) {
+        relFreqs[LJUMP] = 8;
+        relFreqs[LOP_B_II] *= 2;
+    }
+    if (shape == SHAPE_CALLS) {
+        relFreqs[LCALL_I_I1] *= 10;
+        relFreqs[LCALL_I_I6] *= 10;
+        relFreqs[LCALL_D_D3] *= 10;
+        relFreqs[LCALL_D_D8] *= 10;
+#ifdef NANOJIT_64BIT
+        relFreqs[LCALL_Q_Q2] *= 10;
+        relFreqs[LCALL_Q_Q7] *= 10;
+        relFreqs[LCALL_V_IQD] *= 10;
+#endif
+    }
+
     int relFreqsSum = 0;    // the sum of the individual relative frequencies
     for (int c = 0; c < LLAST; c++) {
         relFreqsSum += relFreqs[c];
@@ -1871,11 +2073,30 @@ FragmentAssembler::assembleRandomFragment(int nIns)
     // can be done immediately.
     addOrReplace(M8ps, mLir->insAlloc(16));
 
+    // The pending forward branch, if any (see LJUMP), and the operand
+    // buffers as they were when it was generated.
+    vector<LIns*>* operandBufs[] = { &Bs, &Is, &Qs, &Ds, &Fs, &F4s, &M4s, &M8ps };
+    const size_t nOperandBufs = sizeof(operandBufs) / sizeof(operandBufs[0]);
+    vector<LIns*> savedOperandBufs[nOperandBufs];
+    LIns* pendingJump = NULL;
+    int pendingJumpEnd = 0;
+
     int n = 0;
-    while (n < nIns) {
+    while (n < nIns || pendingJump) {
 
         LIns *ins;
 
+        if (pendingJump && (n >= pendingJumpEnd || n >= nIns)) {
+            // Values computed in the skipped region don't reach the label,
+            // so they must not be used after it.
+            pendingJump->setTarget(mLir->ins0(LIR_label));
+            for (size_t i = 0; i < nOperandBufs; i++)
+                *operandBufs[i] = savedOperandBufs[i];
+            pendingJump = NULL;
+            n++;
+            continue;
+        }
+
         switch (classGenerator[rnd(relFreqsSum)]) {
 
         case LFENCE:
@@ -2312,7 +2533,7 @@ FragmentAssembler::assembleRandomFragment(int nIns)
 #endif
 
         case LOP_I_F:
-            if (!Ds.empty()) {
+            if (!Fs.empty()) {
                 ins = mLir->ins1(rndPick(I_F_ops), rndPick(Fs));
                 addOrReplace(Is, ins);
                 n++;
@@ -2535,6 +2756,21 @@ FragmentAssembler::assembleRandomFragment(int nIns)
             n++;
             break;
 
+        case LJUMP:
+            // A forward branch over the next few instructions;  the label
+            // is placed at the top of the loop.  ExprFilter drops a branch
+            // on a constant condition that is never taken.
+            if (!pendingJump && !Bs.empty()) {
+                pendingJump = mLir->insBranch(rnd(2) ? LIR_jt : LIR_jf, rndPick(Bs), NULL);
+                if (pendingJump) {
+                    pendingJumpEnd = n + 2 + int(rnd(16));
+                    for (size_t i = 0; i < nOperandBufs; i++)
+                        savedOperandBufs[i] = *operandBufs[i];
+                }
+                n++;
+            }
+            break;
+
         default:
             NanoAssert(0);
             break;
@@ -2557,6 +2793,8 @@ Lirasm::Lirasm(bool verbose, Config& config) :
 {
     mVerbose = verbose;
     mLogc.lcbits = 0;
+    mPerf = NULL;
+    mCompileNs = 0;
 
     mLirbuf = new (mAlloc) LirBuffer(mAlloc);
 #ifdef DEBUG
@@ -2583,6 +2821,7 @@ Lirasm::~Lirasm()
     for (i = mFragments.begin(); i != mFragments.end(); ++i) {
         delete i->second.fragptr;
     }
+    delete mPerf;
 }
 
 
@@ -2635,7 +2874,7 @@ Lirasm::lookupFunction(const string &name, CallInfo *&ci)
 }
 
 void
-Lirasm::assemble(istream &in, bool optimize)
+Lirasm::assemble(istream &in, uint32_t passes)
 {
     LirTokenStream ts(in);
     bool first = true;
@@ -2658,13 +2897,13 @@ Lirasm::assemble(istream &in, bool optimize)
             if (!ts.eat(NEWLINE))
                 bad("extra junk after .begin " + name);
 
-            FragmentAssembler assembler(*this, name, optimize);
+            FragmentAssembler assembler(*this, name, passes);
             assembler.assembleFragment(ts, false, NULL);
             first = false;
         } else if (op == ".end") {
             bad(".end without .begin");
         } else if (first) {
-            FragmentAssembler assembler(*this, "main", optimize);
+            FragmentAssembler assembler(*this, "main", passes);
             assembler.assembleFragment(ts, true, &token);
             break;
         } else {
@@ -2674,11 +2913,11 @@ Lirasm::assemble(istream &in, bool optimize)
 }
 
 void
-Lirasm::assembleRandom(int nIns, bool optimize)
+Lirasm::assembleRandom(int nIns, uint32_t passes, RandomShape shape)
 {
     string name = "main";
-    FragmentAssembler assembler(*this, name, optimize);
-    assembler.assembleRandomFragment(nIns);
+    FragmentAssembler assembler(*this, name, passes);
+    assembler.assembleRandomFragment(nIns, shape);
 }
 
 void
@@ -2710,6 +2949,28 @@ Lirasm::handlePatch(LirTokenStream &in)
     mAssm.patch(ins->record()->exit);
 }
 
+// The --passes names as "'expr', 'cse', ... or 'none'", wrapped to 80 columns
+// for text that starts at 'column' and continues at 'indent'.
+static string
+passList(size_t column, size_t indent)
+{
+    string list;
+    for (int p = 0; p <= numPasses; p++) {
+        string name = string("'") + (p < numPasses ? passNames[p] : "none") + "'";
+        string sep = p == 0 ? "" : p < numPasses ? ", " : " or ";
+        if (p > 0 && column + sep.size() + name.size() > 79) {
+            while (sep.size() && sep[sep.size() - 1] == ' ')
+                sep.erase(sep.size() - 1);
+            list += sep + "\n" + string(indent, ' ');
+            column = indent;
+            sep = "";
+        }
+        list += sep + name;
+        column += sep.size() + name.size();
+    }
+    return list;
+}
+
 void
 usageAndQuit(const string& progname)
 {
@@ -2719,9 +2980,41 @@ usageAndQuit(const string& progname)
         "  -h --help         print this message\n"
         "  -v --verbose      print LIR and assembly code\n"
         "  --execute         execute LIR\n"
-        "  --[no-]optimize   enable or disable optimization of the LIR (default=off)\n"
+        "  --[no-]optimize   enable or disable optimization of the LIR (default=off);\n"
+        "                    the same as -O1 and -O0\n"
+        "  -O0, -O1, -O2     optimization level: no passes, expr,cse,stack, or those\n"
+        "                    plus the more expensive passes: slots,vectorize,unroll,\n"
+        "                    checks\n"
+        "  --passes P[,P]    run just the given passes: " << passList(47, 20) << "\n"
+        "  --unroll-factor N copies of a loop body the unroll pass makes (default=4)\n"
         "  --random [N]      generate a random LIR block of size N (default=100)\n"
+        "  --shape S         the kind of code --random generates: 'mixed' (default),\n"
+        "                    'arith', 'branchy', 'calls' or 'float'\n"
+        "  --compile-bench [N]  time the compilation of random blocks of size N\n"
+        "                    (default=1000) of every shape, or just of --shape,\n"
+        "                    with and without optimization, and print the throughput\n"
+        "  --bench-reps N    number of blocks compiled per --compile-bench row (default=10)\n"
+        "  --format F        --compile-bench output format: 'csv' (default) or 'json'\n"
         "  --stkskip [N]     push approximately N Kbytes of stack before execution (default=100)\n"
+        "  --bench [N]       compile once, then execute 'main' N times (default=1000) after\n"
+        "                    a warm-up, and print the compile time per stage and the\n"
+        "                    min/median/p99 cycles per run\n"
+        "  --warmup N        number of untimed runs before --bench (default=10)\n"
+        "  --arg A           pass an argument to 'main', which reads it with 'paramp N 0';\n"
+        "                    repeat it for each one, in order.  A is 'i:N' or 'q:N' (an\n"
+        "                    int or quad), 'd:X' or 'f:X' (the bits of a double or\n"
+        "                    float), 'file:PATH' (a buffer holding the file),\n"
+        "                    'bytes:N[:SEED]' (a buffer of N pseudo-random bytes),\n"
+        "                    'zeros:N' (a buffer of N zero bytes) or 'len:K' (the size\n"
+        "                    of the buffer that argument K is).  --bench also reports\n"
+        "                    the bytes of buffer processed per cycle\n"
+        "  --compare         with --bench, benchmark both at -O0 and at the -O level or\n"
+        "                    --passes given (default -O1)\n"
+        "  --perf            sample cycles, instructions, branch-misses and cache-misses\n"
+        "                    while executing (Linux only), and print them per fragment\n"
+        "  --vprof OP[,OP]   insert inline vprof probes after every OP instruction (64-bit only);\n"
+        "                    the profile is printed when lirasm exits\n"
+        "  --vprof-hist LB[,LB]  also bucket probed values by the given sorted lower bounds\n"
         "\n"
         "Build query options (these print a value for this build of lirasm and exit)\n"
         "  --show-arch       show the architecture ('i386', 'X64', 'arm', 'ppc',\n"
@@ -2732,6 +3025,10 @@ usageAndQuit(const string& progname)
         "i386-specific options:\n"
         "  --[no]sse         use SSE2 instructions (default=on)\n"
         "\n"
+        "X64-specific options:\n"
+        "  --nosse41         don't use SSE4.1 instructions, even if the CPU has them\n"
+        "  --nosse42         don't use SSE4.2 instructions, even if the CPU has them\n"
+        "\n"
         "ARM-specific options:\n"
         "  --arch N          use ARM architecture version N instructions (default=7)\n"
         "  --[no]vfp         use ARM VFP instructions (default=on)\n"
@@ -2753,9 +3050,21 @@ struct CmdLineOptions {
     string  progname;
     bool    verbose;
     bool    execute;
-    bool    optimize;
+    uint32_t passes;
+    bool    perf;
     int     random;
     int     stkskip;
+    int     bench;
+    int     warmup;
+    bool    compare;
+    int     compileBench;
+    int     benchReps;
+    bool    json;
+    bool    allShapes;
+    RandomShape shape;
+    string  vprofOps;
+    string  vprofHist;
+    vector<string> args;
     string  filename;
     Config  config;
 };
@@ -2782,6 +3091,74 @@ bool parseOptionalInt(int argc, char** argv, int* i, int* value, int defaultValu
     return true;
 }
 
+static const char* const shapeNames[] = { "mixed", "arith", "branchy", "calls", "float" };
+static const int numShapes = sizeof(shapeNames) / sizeof(shapeNames[0]);
+
+static bool
+parseShape(const string& name, RandomShape* shape)
+{
+    for (int s = 0; s < numShapes; s++) {
+        if (name == shapeNames[s]) {
+            *shape = RandomShape(s);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Splits a comma-separated option argument;  empty fields are dropped.
+static vector<string>
+split(const string& str, char sep)
+{
+    vector<string> fields;
+    istringstream in(str);
+    string field;
+    while (getline(in, field, sep)) {
+        if (!field.empty())
+            fields.push_back(field);
+    }
+    return fields;
+}
+
+// Parses a --passes list, e.g. "cse,expr";  "none" is the empty set.
+static bool
+parsePasses(const string& list, uint32_t* passes)
+{
+    vector<string> names = split(list, ',');
+    if (names.empty())
+        return false;
+    *passes = 0;
+    for (size_t j = 0; j < names.size(); j++) {
+        if (names[j] == "none")
+            continue;
+        int p = 0;
+        while (p < numPasses && names[j] != passNames[p])
+            p++;
+        if (p == numPasses)
+            return false;
+        *passes |= 1 << p;
+    }
+    return true;
+}
+
+// The name of a set of passes:  its -O level if it matches one, else the list.
+static string
+passesName(uint32_t passes)
+{
+    if (passes == O0_PASSES)
+        return "O0";
+    if (passes == O1_PASSES)
+        return "O1";
+    if (passes == O2_PASSES)
+        return "O2";
+    string name;
+    for (int p = 0; p < numPasses; p++) {
+        if (passes & (1 << p))
+            name += (name.empty() ? "" : ",") + string(passNames[p]);
+    }
+    return name;
+}
+
 static void
 processCmdLine(int argc, char **argv, CmdLineOptions& opts)
 {
@@ -2789,8 +3166,17 @@ processCmdLine(int argc, char **argv, CmdLineOptions& opts)
     opts.verbose  = false;
     opts.execute  = false;
     opts.random   = 0;
-    opts.optimize = false;
+    opts.passes   = O0_PASSES;
+    opts.perf     = false;
     opts.stkskip  = 0;
+    opts.bench    = 0;
+    opts.warmup   = 10;
+    opts.compare  = false;
+    opts.compileBench = 0;
+    opts.benchReps = 10;
+    opts.json     = false;
+    opts.allShapes = true;
+    opts.shape    = SHAPE_MIXED;
 
     // Architecture-specific options.
 #if defined NANOJIT_IA32
@@ -2798,6 +3184,9 @@ processCmdLine(int argc, char **argv, CmdLineOptions& opts)
 #elif defined NANOJIT_ARM
     unsigned int    arm_arch = 7;
     bool            arm_vfp = true;
+#elif defined NANOJIT_X64
+    bool            x64_sse41 = true;
+    bool            x64_sse42 = true;
 #endif
 
     for (int i = 1; i < argc; i++) {
@@ -2810,10 +3199,23 @@ processCmdLine(int argc, char **argv, CmdLineOptions& opts)
             opts.verbose = true;
         else if (arg == "--execute")
             opts.execute = true;
-        else if (arg == "--optimize")
-            opts.optimize = true;
-        else if (arg == "--no-optimize")
-            opts.optimize = false;
+        else if (arg == "--optimize" || arg == "-O1")
+            opts.passes = O1_PASSES;
+        else if (arg == "--no-optimize" || arg == "-O0")
+            opts.passes = O0_PASSES;
+        else if (arg == "-O2")
+            opts.passes = O2_PASSES;
+        else if (arg == "--passes") {
+            if (i == argc - 1 || !parsePasses(argv[++i], &opts.passes))
+                errMsgAndQuit(opts.progname, "--passes needs a list of " + passList(0, 0));
+        }
+        else if (arg == "--unroll-factor" && i < argc-1) {
+            char* endptr;
+            long factor = strtol(argv[++i], &endptr, 10);
+            if (*endptr != '\0' || factor < 1 || factor > 16)
+                errMsgAndQuit(opts.progname, "--unroll-factor argument must be from 1 to 16");
+            opts.config.unroll_factor = uint8_t(factor);
+        }
         else if (arg == "--random") {
             if (!parseOptionalInt(argc, argv, &i, &opts.random, 100))
                 errMsgAndQuit(opts.progname, "--random argument must be greater than zero");
@@ -2822,6 +3224,50 @@ processCmdLine(int argc, char **argv, CmdLineOptions& opts)
             if (!parseOptionalInt(argc, argv, &i, &opts.stkskip, 100))
                 errMsgAndQuit(opts.progname, "--stkskip argument must be greater than zero");
         }
+        else if (arg == "--shape" && i < argc-1) {
+            if (!parseShape(argv[++i], &opts.shape))
+                errMsgAndQuit(opts.progname, "unknown --shape '" + string(argv[i]) + "'");
+            opts.allShapes = false;
+        }
+        else if (arg == "--bench") {
+            if (!parseOptionalInt(argc, argv, &i, &opts.bench, 1000))
+                errMsgAndQuit(opts.progname, "--bench argument must be greater than zero");
+        }
+        else if (arg == "--warmup" && i < argc-1) {
+            char* endptr;
+            opts.warmup = strtol(argv[++i], &endptr, 10);
+            if (*endptr != '\0' || opts.warmup < 0)
+                errMsgAndQuit(opts.progname, "--warmup argument must be a non-negative integer");
+        }
+        else if (arg == "--arg" && i < argc-1) {
+            opts.args.push_back(argv[++i]);
+            if (opts.args.size() > MaxArgs)
+                errMsgAndQuit(opts.progname, "--arg can be given at most 6 times");
+        }
+        else if (arg == "--compare")
+            opts.compare = true;
+        else if (arg == "--compile-bench") {
+            if (!parseOptionalInt(argc, argv, &i, &opts.compileBench, 1000))
+                errMsgAndQuit(opts.progname, "--compile-bench argument must be greater than zero");
+        }
+        else if (arg == "--bench-reps") {
+            if (!parseOptionalInt(argc, argv, &i, &opts.benchReps, 10))
+                errMsgAndQuit(opts.progname, "--bench-reps argument must be greater than zero");
+        }
+        else if (arg == "--format" && i < argc-1) {
+            string format = argv[++i];
+            if (format != "csv" && format != "json")
+                errMsgAndQuit(opts.progname, "--format must be 'csv' or 'json'");
+            opts.json = format == "json";
+        }
+        else if (arg == "--perf")
+            opts.perf = true;
+        else if (arg == "--vprof" && i < argc-1) {
+            opts.vprofOps = argv[++i];
+        }
+        else if (arg == "--vprof-hist" && i < argc-1) {
+            opts.vprofHist = argv[++i];
+        }
         else if (arg == "--show-arch") {
             const char* str = 
 #if defined NANOJIT_IA32
@@ -2866,6 +3312,13 @@ processCmdLine(int argc, char **argv, CmdLineOptions& opts)
         else if (arg == "--nosse") {
             i386_sse = false;
         }
+#elif defined NANOJIT_X64
+        else if (arg == "--nosse41") {
+            x64_sse41 = false;
+        }
+        else if (arg == "--nosse42") {
+            x64_sse42 = false;
+        }
 #elif defined NANOJIT_ARM
         else if ((arg == "--arch") && (i < argc-1)) {
             char* endptr;
@@ -2906,9 +3359,23 @@ processCmdLine(int argc, char **argv, CmdLineOptions& opts)
             errMsgAndQuit(opts.progname, "bad option: " + arg);
     }
 
-    if ((!opts.random && opts.filename.empty()) || (opts.random && !opts.filename.empty()))
+    if (opts.compileBench) {
+        if (opts.random || !opts.filename.empty() || opts.execute)
+            errMsgAndQuit(opts.progname,
+                          "--compile-bench can't be combined with a filename, --random or --execute");
+    } else if ((!opts.random && opts.filename.empty()) || (opts.random && !opts.filename.empty())) {
         errMsgAndQuit(opts.progname,
                       "you must specify either a filename or --random (but not both)");
+    }
+    if (opts.bench) {
+        if (opts.execute || opts.perf || !opts.vprofOps.empty() || opts.verbose)
+            errMsgAndQuit(opts.progname,
+                          "--bench can't be combined with --execute, --perf, --vprof or --verbose");
+    } else if (opts.compare) {
+        errMsgAndQuit(opts.progname, "--compare requires --bench");
+    }
+    if (!opts.args.empty() && (opts.random || opts.compileBench))
+        errMsgAndQuit(opts.progname, "--arg can't be combined with --random or --compile-bench");
 
     // Handle the architecture-specific options.
 #if defined NANOJIT_IA32
@@ -2925,48 +3392,162 @@ processCmdLine(int argc, char **argv, CmdLineOptions& opts)
     opts.config.arm_arch = arm_arch;
     opts.config.arm_vfp = arm_vfp;
     opts.config.soft_float = !arm_vfp;
+#elif defined NANOJIT_X64
+    if (!x64_sse41)
+        opts.config.i386_sse41 = false;
+    if (!x64_sse42)
+        opts.config.i386_sse42 = false;
 #endif
 }
 
+// The arguments --arg passes to 'main', and the buffers they point to.
+struct Args {
+    vector<intptr_t> words;
+    vector< vector<uint8_t> > buffers;
+    size_t bufferBytes;
+};
+
+static intptr_t
+parseArgInt(const CmdLineOptions& opts, const string& arg, const string& num)
+{
+    char* endptr;
+    long long v = strtoll(num.c_str(), &endptr, 0);
+    if (num.empty() || *endptr != '\0')
+        errMsgAndQuit(opts.progname, "--arg: bad number in '" + arg + "'");
+    return intptr_t(v);
+}
+
+// Builds the arguments for 'main' from opts.args.  Buffers are filled
+// here, once, so a --bench run times just the fragment;  generated bytes
+// come from a fixed xorshift sequence, so runs are repeatable.
+static void
+makeArgs(const CmdLineOptions& opts, Args& args)
+{
+    args.bufferBytes = 0;
+    args.buffers.reserve(opts.args.size());     // the words point into these
+    vector<int> bufferOf(opts.args.size(), -1);
+    for (size_t j = 0; j < opts.args.size(); j++) {
+        const string& arg = opts.args[j];
+        size_t colon = arg.find(':');
+        if (colon == string::npos)
+            errMsgAndQuit(opts.progname, "--arg: expected TYPE:VALUE, not '" + arg + "'");
+        string type = arg.substr(0, colon);
+        string value = arg.substr(colon + 1);
+
+        if (type == "i") {
+            args.words.push_back(intptr_t(int32_t(parseArgInt(opts, arg, value))));
+        } else if (type == "q") {
+            args.words.push_back(parseArgInt(opts, arg, value));
+        } else if (type == "d" || type == "f") {
+            char* endptr;
+            double d = strtod(value.c_str(), &endptr);
+            if (value.empty() || *endptr != '\0')
+                errMsgAndQuit(opts.progname, "--arg: bad number in '" + arg + "'");
+            union { double d; float f; intptr_t w; } u;
+            u.w = 0;
+            if (type == "d")
+                u.d = d;
+            else
+                u.f = float(d);
+            args.words.push_back(u.w);
+        } else if (type == "len") {
+            intptr_t k = parseArgInt(opts, arg, value);
+            if (k < 0 || size_t(k) >= j || bufferOf[k] < 0)
+                errMsgAndQuit(opts.progname, "--arg: '" + arg + "' must name an earlier buffer");
+            args.words.push_back(intptr_t(args.buffers[bufferOf[k]].size()));
+        } else {
+            vector<uint8_t> buf;
+            if (type == "file") {
+                ifstream in(value.c_str(), ios::binary);
+                if (!in)
+                    errMsgAndQuit(opts.progname, "--arg: unable to open file " + value);
+                buf.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+            } else if (type == "bytes" || type == "zeros") {
+                size_t seedAt = value.find(':');
+                intptr_t n = parseArgInt(opts, arg, value.substr(0, seedAt));
+                if (n < 0)
+                    errMsgAndQuit(opts.progname, "--arg: bad size in '" + arg + "'");
+                buf.resize(size_t(n));
+                if (type == "bytes") {
+                    uint64_t x = seedAt == string::npos ? 1
+                               : uint64_t(parseArgInt(opts, arg, value.substr(seedAt + 1)));
+                    x = x ? x : 1;
+                    for (size_t b = 0; b < buf.size(); b++) {
+                        x ^= x << 13;
+                        x ^= x >> 7;
+                        x ^= x << 17;
+                        buf[b] = uint8_t(x);
+                    }
+                } else if (seedAt != string::npos) {
+                    errMsgAndQuit(opts.progname, "--arg: 'zeros' takes just a size");
+                }
+            } else {
+                errMsgAndQuit(opts.progname, "--arg: unknown type '" + type + "'");
+            }
+            bufferOf[j] = int(args.buffers.size());
+            args.bufferBytes += buf.size();
+            args.buffers.push_back(vector<uint8_t>());
+            args.buffers.back().swap(buf);
+            // Pass a valid pointer even for an empty buffer.
+            vector<uint8_t>& b = args.buffers.back();
+            b.reserve(1);
+            args.words.push_back(intptr_t(b.data()));
+        }
+    }
+}
+
+// Quits unless 'main' takes as many params as there are arguments.
+static void
+checkArgs(const CmdLineOptions& opts, const LirasmFragment& fragment, const Args& args)
+{
+    if (size_t(fragment.mNumParams) != args.words.size()) {
+        ostringstream msg;
+        msg << "'main' takes " << fragment.mNumParams << " argument(s) but "
+            << args.words.size() << " were given with --arg";
+        errMsgAndQuit(opts.progname, msg.str());
+    }
+}
+
 int32_t* dummy;
 
 void
-executeFragment(const LirasmFragment& fragment, int skip)
+executeFragment(const LirasmFragment& fragment, int skip, const vector<intptr_t>& args)
 {
     // Allocate a large frame, and make sure we don't optimize it away.
     int32_t space[512];
     dummy = space;
 
+    uintptr_t code = (uintptr_t)fragment.rint;
     if (skip > 0) {
-        executeFragment(fragment, skip-1);
+        executeFragment(fragment, skip-1, args);
     } else {
         switch (fragment.mReturnType) {
           case RT_INT: {
-            int res = fragment.rint();
+            int res = callWithArgs<int32_t>(code, args);
             cout << "Output is: " << res << endl;
             break;
           }
 #ifdef NANOJIT_64BIT
           case RT_QUAD: {
-            int64_t res = fragment.rquad();
+            int64_t res = callWithArgs<int64_t>(code, args);
             cout << "Output is: " << res << endl;
             break;
           }
 #endif
           case RT_DOUBLE: {
-            double res = fragment.rdouble();
+            double res = callWithArgs<double>(code, args);
             cout << "Output is: ";
             print_double(res) << endl;
             break;
           }
           case RT_FLOAT: {
-            float res = fragment.rfloat();
+            float res = callWithArgs<float>(code, args);
             cout << "Output is: ";
             print(res) << endl;
             break;
           }
           case RT_FLOAT4: {
-            float4_t res = fragment.rfloat4();
+            float4_t res = callWithArgs<float4_t>(code, args);
             cout << "Output is: ";
             print(f4_x(res)) << ",";
             print(f4_y(res)) << ",";
@@ -2975,7 +3556,7 @@ executeFragment(const LirasmFragment& fragment, int skip)
             break;
           }
           case RT_GUARD: {
-            LasmSideExit *ls = (LasmSideExit*) fragment.rguard()->exit;
+            LasmSideExit *ls = (LasmSideExit*) callWithArgs<GuardRecord*>(code, args)->exit;
             cout << "Exited block on line: " << ls->line << endl;
             break;
           }
@@ -2983,20 +3564,211 @@ executeFragment(const LirasmFragment& fragment, int skip)
     }
 }
 
+// Chunks are malloc'd by the VMPI layer;  their nominal size will do.
+static size_t
+chunkSize(void*)
+{
+    return 0;
+}
+
+// Compiles opts.benchReps random blocks of opts.compileBench instructions
+// for each shape and optimization setting, each with a fresh Lirasm, and
+// prints one row per setting.  The LIR stage covers generating the LIR and
+// running it through the writer pipeline;  the asm stage is
+// Assembler::compile.  Throughputs are relative to the sum of both stages.
+// The random seed depends only on the rep, so runs are repeatable.
+static void
+compileBench(CmdLineOptions& opts)
+{
+    if (opts.json)
+        cout << "[" << endl;
+    else
+        cout << "shape,optimize,size,reps,lir_ins,code_bytes,lir_ms,asm_ms,"
+                "lir_per_sec,bytes_per_sec,peak_arena_bytes" << endl;
+
+    bool first = true;
+    for (int s = 0; s < numShapes; s++) {
+        RandomShape shape = RandomShape(s);
+        if (!opts.allShapes && shape != opts.shape)
+            continue;
+        for (int optimize = 0; optimize < 2; optimize++) {
+            uint64_t lirNs = 0, asmNs = 0, lirIns = 0, codeBytes = 0;
+            size_t peakArena = 0;
+            for (int rep = 0; rep < opts.benchReps; rep++) {
+                srand(rep + 1);
+                Lirasm lasm(false, opts.config);
+                uint64_t start = nowNs();
+                lasm.assembleRandom(opts.compileBench, optimize ? O1_PASSES : O0_PASSES, shape);
+                uint64_t total = nowNs() - start;
+                asmNs += lasm.mCompileNs;
+                lirNs += total - lasm.mCompileNs;
+
+                LirReader r(lasm.mFragments["main"].fragptr->lastIns);
+                while (!r.read()->isop(LIR_start))
+                    lirIns++;
+                for (CodeRange cr(lasm.mAssm.codeList); !cr.empty(); cr.popFront())
+                    codeBytes += uintptr_t(cr.frontEnd()) - uintptr_t(cr.frontStart());
+                peakArena = max(peakArena, lasm.mAlloc.getBytesAllocated(chunkSize));
+            }
+
+            double secs = double(lirNs + asmNs) / 1e9;
+            double lirPerSec = secs > 0 ? double(lirIns) / secs : 0;
+            double bytesPerSec = secs > 0 ? double(codeBytes) / secs : 0;
+            if (opts.json) {
+                cout << (first ? "" : ",\n")
+                     << "  {\"shape\": \"" << shapeNames[s] << "\""
+                     << ", \"optimize\": " << (optimize ? "true" : "false")
+                     << ", \"size\": " << opts.compileBench
+                     << ", \"reps\": " << opts.benchReps
+                     << ", \"lir_ins\": " << lirIns
+                     << ", \"code_bytes\": " << codeBytes
+                     << ", \"lir_ms\": " << double(lirNs) / 1e6
+                     << ", \"asm_ms\": " << double(asmNs) / 1e6
+                     << ", \"lir_per_sec\": " << uint64_t(lirPerSec)
+                     << ", \"bytes_per_sec\": " << uint64_t(bytesPerSec)
+                     << ", \"peak_arena_bytes\": " << peakArena << "}";
+            } else {
+                cout << shapeNames[s] << "," << optimize << "," << opts.compileBench << ","
+                     << opts.benchReps << "," << lirIns << "," << codeBytes << ","
+                     << double(lirNs) / 1e6 << "," << double(asmNs) / 1e6 << ","
+                     << uint64_t(lirPerSec) << "," << uint64_t(bytesPerSec) << ","
+                     << peakArena << endl;
+            }
+            first = false;
+        }
+    }
+    if (opts.json)
+        cout << "\n]" << endl;
+}
+
+// Calls the fragment, discarding the result.
+static void
+runFragment(const LirasmFragment& fragment, const vector<intptr_t>& args)
+{
+    uintptr_t code = (uintptr_t)fragment.rint;
+    switch (fragment.mReturnType) {
+      case RT_INT:      { volatile int res = callWithArgs<int32_t>(code, args);          (void)res; break; }
+#ifdef NANOJIT_64BIT
+      case RT_QUAD:     { volatile int64_t res = callWithArgs<int64_t>(code, args);      (void)res; break; }
+#endif
+      case RT_DOUBLE:   { volatile double res = callWithArgs<double>(code, args);        (void)res; break; }
+      case RT_FLOAT:    { volatile float res = callWithArgs<float>(code, args);          (void)res; break; }
+      case RT_FLOAT4:   { volatile float res = f4_x(callWithArgs<float4_t>(code, args)); (void)res; break; }
+      case RT_GUARD:    { GuardRecord* volatile res = callWithArgs<GuardRecord*>(code, args); (void)res; break; }
+    }
+}
+
+// Assembles the input once, with or without optimization, then runs
+// 'main' opts.warmup times untimed and opts.bench times timed with the
+// cycle counter, each time with the same arguments.  Compile time is split
+// into the LIR stage (parsing or generating the LIR and running it through
+// the writer pipeline) and Assembler::compile.
+static void
+benchFragment(CmdLineOptions& opts, uint32_t passes, const Args& args)
+{
+    Lirasm lasm(false, opts.config);
+    uint64_t start = nowNs();
+    if (opts.random) {
+        srand(1);       // the same LIR for each --compare setting
+        lasm.assembleRandom(opts.random, passes, opts.shape);
+    } else {
+        ifstream in(opts.filename.c_str());
+        if (!in)
+            errMsgAndQuit(opts.progname, "unable to open file " + opts.filename);
+        lasm.assemble(in, passes);
+    }
+    uint64_t total = nowNs() - start;
+
+    Fragments::const_iterator i = lasm.mFragments.find("main");
+    if (i == lasm.mFragments.end())
+        errMsgAndQuit(opts.progname, "error: at least one fragment must be named 'main'");
+
+    checkArgs(opts, i->second, args);
+
+    for (int w = 0; w < opts.warmup; w++)
+        runFragment(i->second, args.words);
+    vector<uint64_t> cycles(opts.bench);
+    for (int r = 0; r < opts.bench; r++) {
+        uint64_t t0 = readTimestampCounter();
+        runFragment(i->second, args.words);
+        cycles[r] = readTimestampCounter() - t0;
+    }
+    sort(cycles.begin(), cycles.end());
+
+    printf("%s: compile lir %.3f ms, asm %.3f ms;  %d runs (%d warm-up): "
+           "min %llu, median %llu, p99 %llu cycles",
+           passesName(passes).c_str(),
+           double(total - lasm.mCompileNs) / 1e6, double(lasm.mCompileNs) / 1e6,
+           opts.bench, opts.warmup,
+           (unsigned long long) cycles[0],
+           (unsigned long long) cycles[cycles.size() / 2],
+           (unsigned long long) cycles[min(cycles.size() - 1, cycles.size() * 99 / 100)]);
+    if (args.bufferBytes > 0) {
+        uint64_t median = max(cycles[cycles.size() / 2], uint64_t(1));
+        printf(";  %.3f bytes/cycle (median)", double(args.bufferBytes) / double(median));
+    }
+    printf("\n");
+}
+
 int
 main(int argc, char **argv)
 {
     CmdLineOptions opts;
     processCmdLine(argc, argv, opts);
 
+    if (opts.compileBench) {
+        compileBench(opts);
+        return 0;
+    }
+    Args args;
+    makeArgs(opts, args);
+
+    if (opts.bench) {
+        if (opts.compare) {
+            benchFragment(opts, O0_PASSES, args);
+            benchFragment(opts, opts.passes != O0_PASSES ? opts.passes : O1_PASSES, args);
+        } else {
+            benchFragment(opts, opts.passes, args);
+        }
+        return 0;
+    }
+
     Lirasm lasm(opts.verbose, opts.config);
+    if (!opts.vprofOps.empty() || !opts.vprofHist.empty()) {
+#ifdef NANOJIT_64BIT
+        vector<string> ops = split(opts.vprofOps, ',');
+        for (size_t j = 0; j < ops.size(); j++) {
+            map<string, LOpcode>::const_iterator op = lasm.mOpMap.find(ops[j]);
+            if (op == lasm.mOpMap.end())
+                errMsgAndQuit(opts.progname, "--vprof: unknown opcode '" + ops[j] + "'");
+            lasm.mProfileOps.push_back(op->second);
+        }
+        vector<string> bounds = split(opts.vprofHist, ',');
+        for (size_t j = 0; j < bounds.size(); j++) {
+            char* endptr;
+            int64_t lb = strtoll(bounds[j].c_str(), &endptr, 0);
+            if (*endptr != '\0' || (j > 0 && lb <= lasm.mProfileBounds.back()))
+                errMsgAndQuit(opts.progname, "--vprof-hist bounds must be sorted integers");
+            lasm.mProfileBounds.push_back(lb);
+        }
+        if (lasm.mProfileOps.empty())
+            errMsgAndQuit(opts.progname, "--vprof-hist requires --vprof");
+#else
+        errMsgAndQuit(opts.progname, "--vprof is only supported on 64-bit targets");
+#endif
+    }
+    if (opts.perf) {
+        if (!opts.execute)
+            errMsgAndQuit(opts.progname, "--perf requires --execute");
+        lasm.mPerf = new PerfSampler(lasm.mAlloc);
+    }
     if (opts.random) {
-        lasm.assembleRandom(opts.random, opts.optimize);
+        lasm.assembleRandom(opts.random, opts.passes, opts.shape);
     } else {
         ifstream in(opts.filename.c_str());
         if (!in)
             errMsgAndQuit(opts.progname, "unable to open file " + opts.filename);
-        lasm.assemble(in, opts.optimize);
+        lasm.assemble(in, opts.passes);
     }
 
     Fragments::const_iterator i;
@@ -3004,7 +3776,14 @@ main(int argc, char **argv)
         i = lasm.mFragments.find("main");
         if (i == lasm.mFragments.end())
             errMsgAndQuit(opts.progname, "error: at least one fragment must be named 'main'");
-        executeFragment(i->second, opts.stkskip);
+        checkArgs(opts, i->second, args);
+        if (lasm.mPerf && !lasm.mPerf->start())
+            cerr << "warning: --perf: unable to open any performance counter" << endl;
+        executeFragment(i->second, opts.stkskip, args.words);
+        if (lasm.mPerf) {
+            lasm.mPerf->stop();
+            lasm.mPerf->dump(stdout);
+        }
     } else {
         for (i = lasm.mFragments.begin(); i != lasm.mFragments.end(); i++)
             dump_srecords(cout, i->second.fragptr);
@@ -114,6 +114,26 @@ elif [[ $($LIRASM --show-arch 2>/dev/null) == "X64" ]] ; then
     runtests "."
     runtests "hardfloat"
     runtests "64-bit"
+    runtest "$TESTS_DIR/64-bit/slots.in" "-O2"
+    runtest "$TESTS_DIR/64-bit/blockmem.in" "-O2"
+    runtest "$TESTS_DIR/64-bit/findb.in" "-O2"
+    runtest "$TESTS_DIR/64-bit/crc32c.in" "-O2"
+    runtest "$TESTS_DIR/64-bit/crc32c.in" "--nosse42"
+    runtest "$TESTS_DIR/64-bit/mulhq.in" "-O2"
+    runtest "$TESTS_DIR/64-bit/condarith.in" "-O2"
+    runtest "$TESTS_DIR/64-bit/minmax.in" "-O1"
+    runtest "$TESTS_DIR/64-bit/minmax.in" "-O2"
+    runtest "$TESTS_DIR/64-bit/minmax.in" "--nosse41"
+    runtest "$TESTS_DIR/64-bit/vectorize.in" "-O2"
+    runtest "$TESTS_DIR/64-bit/unroll.in" "-O2"
+    runtest "$TESTS_DIR/64-bit/unroll.in" "-O2 --unroll-factor 3"
+    runtest "$TESTS_DIR/64-bit/bounds.in" "-O2"
+    runtest "$TESTS_DIR/64-bit/bounds.in" "--passes expr,cse,checks"
+    runtest "$TESTS_DIR/64-bit/boundsx.in" "-O2"
+    runtest "$TESTS_DIR/64-bit/boundsx.in" "--passes expr,cse,checks"
+    runtest "$TESTS_DIR/args/findfile.in" "--arg file:$TESTS_DIR/args/hello.txt --arg len:0 --arg i:44"
+    runtest "$TESTS_DIR/args/findfile.in" "-O2 --arg file:$TESTS_DIR/args/hello.txt --arg len:0 --arg i:44"
+    runtest "$TESTS_DIR/args/typed.in" "--arg zeros:64 --arg len:0 --arg q:0x100000000 --arg d:1.25 --arg i:-7"
     runtests "littleendian"
     runtest "--random 1000000"
     runtest "--random 1000000 --optimize"
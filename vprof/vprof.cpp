@@ -237,8 +237,9 @@ int profileValue(void* id, int64_t value)
 
 // Initialize the location pointed to by 'id' to a new histogram profile entry
 // associated with 'file' and 'line', or do nothing if already initialized.
+// The 'nbins' bucket lower bounds are taken from the array 'bounds'.
 
-int initHistProfile(void** id, char* file, int line, int nbins, ...)
+int initHistProfileBounds(void** id, char* file, int line, int nbins, const int64_t* bounds)
 {
     DO_LOCK (&glock);
         entry_t e = (entry_t) *id;
@@ -255,7 +256,6 @@ int initHistProfile(void** id, char* file, int line, int nbins, ...)
         } 
 
         if (e == NULL) {
-            va_list va;
             hist_t h;
             int b, n, s;
             int64_t* lb;
@@ -280,13 +280,10 @@ int initHistProfile(void** id, char* file, int line, int nbins, ...)
             h->count = (int64_t*) malloc (s);
             VMPI_memset (h->count, 0, s);
 
-            va_start (va, nbins);
             for (b = 0; b < nbins; b++) {
-                //lb[b] = va_arg (va, int64_t);
-                lb[b] = va_arg (va, int);
+                lb[b] = bounds[b];
             }
             lb[b] = MAXINT64;
-            va_end (va);
 
             e->genptr = NULL;
             VMPI_memset (&e->ivar,   0, sizeof(e->ivar));
@@ -301,6 +298,30 @@ int initHistProfile(void** id, char* file, int line, int nbins, ...)
     return 0;
 }
 
+// Initialize the location pointed to by 'id' to a new histogram profile entry
+// associated with 'file' and 'line', or do nothing if already initialized.
+
+int initHistProfile(void** id, char* file, int line, int nbins, ...)
+{
+    va_list va;
+    int b, n;
+    int64_t* lb;
+    int res;
+
+    n = MAX(nbins,0);
+    lb = (int64_t*) malloc (1+n*sizeof(int64_t));
+    va_start (va, nbins);
+    for (b = 0; b < n; b++) {
+        //lb[b] = va_arg (va, int64_t);
+        lb[b] = va_arg (va, int);
+    }
+    va_end (va);
+
+    res = initHistProfileBounds (id, file, line, nbins, lb);
+    free (lb);
+    return res;
+}
+
 // Record a histogram profile event.
 
 int histValue(void* id, int64_t value)
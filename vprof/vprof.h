@@ -75,6 +75,7 @@ extern "C" {
 int initValueProfile(void** id, char* file, int line, ...);
 int profileValue(void* id, int64_t value);
 int initHistProfile(void** id, char* file, int line, int nbins, ...);
+int initHistProfileBounds(void** id, char* file, int line, int nbins, const int64_t* bounds);
 int histValue(void* id, int64_t value);
 uint64_t readTimestampCounter();
 